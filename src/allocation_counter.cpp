@@ -0,0 +1,218 @@
+#include "allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <iomanip>
+
+namespace {
+
+thread_local std::uint64_t allocations = 0;
+thread_local std::uint64_t allocated_bytes = 0;
+thread_local allocation_counter::SubsystemCounts subsystem_counts = {};
+
+#if A_PLUS_Q_ALLOCATION_ACCOUNTING
+void count_allocation(std::size_t size)
+{
+    ++allocations;
+    allocated_bytes += size;
+    auto & counts = subsystem_counts[std::size_t(allocation_counter::current_subsystem)];
+    ++counts.allocations;
+    counts.bytes += size;
+}
+
+void * counted_allocate(std::size_t size)
+{
+    count_allocation(size);
+    // malloc(0) may return null, new must not
+    if (void * pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void * counted_allocate(std::size_t size, std::align_val_t alignment)
+{
+    count_allocation(size);
+    // aligned_alloc takes whole multiples of the alignment, and free releases them
+    const auto bytes = std::size_t(alignment);
+    if (void * pointer = std::aligned_alloc(bytes, size ? (size + bytes - 1) / bytes * bytes : bytes)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+#endif
+
+} // anonymous
+
+namespace allocation_counter {
+
+std::string to_string(Subsystem subsystem)
+{
+    switch (subsystem) {
+    case Subsystem::OTHER:
+        return "OTHER";
+    case Subsystem::TIMER:
+        return "TIMER";
+    case Subsystem::QUEUE:
+        return "QUEUE";
+    case Subsystem::SERVER:
+        return "SERVER";
+    case Subsystem::SPY:
+        return "SPY";
+    case Subsystem::PRNG:
+        return "PRNG";
+    case Subsystem::INCOMING:
+        return "INCOMING";
+    case Subsystem::BALANCER:
+        return "BALANCER";
+    case Subsystem::COUNT:
+        break;
+    }
+    throw std::invalid_argument("Unknown Subsystem");
+}
+
+std::uint64_t thread_allocations()
+{
+    return allocations;
+}
+
+std::uint64_t thread_allocated_bytes()
+{
+    return allocated_bytes;
+}
+
+const SubsystemCounts & thread_subsystem_counts()
+{
+    return subsystem_counts;
+}
+
+std::string AllocationReport::to_string(std::uint64_t customers) const
+{
+    // take the difference before formatting allocates anything
+    SubsystemCounts counts = thread_subsystem_counts();
+    for (std::size_t i = 0; i < kSubsystemCount; ++i) {
+        counts[i].allocations -= start_[i].allocations;
+        counts[i].bytes -= start_[i].bytes;
+    }
+
+    const double per_customer = customers ? 1.0 / customers : 0;
+    Counts total;
+    std::stringstream ss;
+    ss << "Allocations per customer (" << customers << " customers):" << std::endl;
+    ss << std::left << std::setw(12) << "subsystem"
+       << std::right << std::setw(14) << "allocations"
+       << std::setw(14) << "bytes" << std::endl;
+    ss << std::fixed << std::setprecision(2);
+    for (std::size_t i = 0; i < kSubsystemCount; ++i) {
+        total.allocations += counts[i].allocations;
+        total.bytes += counts[i].bytes;
+        ss << std::left << std::setw(12) << allocation_counter::to_string(Subsystem(i))
+           << std::right << std::setw(14) << counts[i].allocations * per_customer
+           << std::setw(14) << counts[i].bytes * per_customer << std::endl;
+    }
+    ss << std::left << std::setw(12) << "TOTAL"
+       << std::right << std::setw(14) << total.allocations * per_customer
+       << std::setw(14) << total.bytes * per_customer << std::endl;
+    return ss.str();
+}
+
+} // allocation_counter
+
+#if A_PLUS_Q_ALLOCATION_ACCOUNTING
+void * operator new(std::size_t size)
+{
+    return counted_allocate(size);
+}
+
+void * operator new[](std::size_t size)
+{
+    return counted_allocate(size);
+}
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    try {
+        return counted_allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    try {
+        return counted_allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void * operator new(std::size_t size, std::align_val_t alignment)
+{
+    return counted_allocate(size, alignment);
+}
+
+void * operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return counted_allocate(size, alignment);
+}
+
+void * operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    try {
+        return counted_allocate(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void * operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    try {
+        return counted_allocate(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void * pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void * pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void * pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void * pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void * pointer, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void * pointer, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void * pointer, std::size_t, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void * pointer, std::size_t, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+#endif
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "constants.h"
+
+// With constants::ALLOCATION_ACCOUNTING on, the global operator new is replaced
+// (allocation_counter.cpp) to count heap allocations per thread and charge
+// them to the subsystem whose AllocationScope is innermost on the calling
+// thread, and every run prints what each subsystem cost per customer. With it
+// off, the standard operator new is left alone, the counts stay at zero and
+// AllocationScope compiles to nothing.
+
+namespace allocation_counter {
+
+enum class Subsystem : std::uint8_t {
+    OTHER, // outside every scope (setup, stats, std::function built by callers)
+    TIMER,
+    QUEUE,
+    SERVER,
+    SPY,
+    PRNG,
+    INCOMING,
+    BALANCER,
+    COUNT
+};
+
+constexpr std::size_t kSubsystemCount = std::size_t(Subsystem::COUNT);
+
+std::string to_string(Subsystem subsystem);
+
+// Frees aren't counted: they'd be charged to the scope freeing the memory,
+// which often isn't the one that allocated it
+struct Counts {
+    std::uint64_t allocations = 0;
+    std::uint64_t bytes = 0;
+};
+
+using SubsystemCounts = std::array<Counts, kSubsystemCount>;
+
+// operator new calls made by the calling thread so far (0 unless ALLOCATION_ACCOUNTING)
+std::uint64_t thread_allocations();
+
+// bytes requested by those calls
+std::uint64_t thread_allocated_bytes();
+
+// the calling thread's counts by subsystem (all zero unless ALLOCATION_ACCOUNTING)
+const SubsystemCounts & thread_subsystem_counts();
+
+// the innermost AllocationScope's subsystem; inline so a scope costs two
+// thread local stores instead of two calls
+inline thread_local Subsystem current_subsystem = Subsystem::OTHER;
+
+inline Subsystem & thread_current_subsystem()
+{
+    return current_subsystem;
+}
+
+// Charges allocations on this thread to subsystem until it goes out of scope
+class AllocationScope {
+public:
+    explicit AllocationScope(Subsystem subsystem)
+    {
+        if constexpr (constants::ALLOCATION_ACCOUNTING) {
+            auto & current = thread_current_subsystem();
+            previous_ = current;
+            current = subsystem;
+        }
+    }
+
+    ~AllocationScope()
+    {
+        if constexpr (constants::ALLOCATION_ACCOUNTING) {
+            thread_current_subsystem() = previous_;
+        }
+    }
+
+    AllocationScope(const AllocationScope &) = delete;
+    AllocationScope & operator=(const AllocationScope &) = delete;
+
+private:
+    Subsystem previous_ = Subsystem::OTHER;
+};
+
+// Snapshot of this thread's subsystem counts, so a run can report only its own allocations
+class AllocationReport {
+public:
+    AllocationReport()
+    : start_(thread_subsystem_counts())
+    {}
+
+    // per subsystem allocations and bytes per customer since construction
+    std::string to_string(std::uint64_t customers) const;
+
+private:
+    SubsystemCounts start_;
+};
+
+} // allocation_counter
@@ -0,0 +1,325 @@
+#include "analytic.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace analytic {
+
+namespace {
+
+void require_rates(double lambda, double mu)
+{
+    if (!(lambda >= 0 && mu > 0)) {
+        throw std::invalid_argument("analytic models need a positive service rate and a non negative arrival rate");
+    }
+}
+
+// waiting time set, the rest follows by Little's law
+void add_service(Metrics & metrics, double lambda, double mean_service_time)
+{
+    metrics.system_time = metrics.waiting_time + mean_service_time;
+    metrics.customers = lambda * metrics.system_time;
+}
+
+// The traffic equations lambda = gamma + lambda P, with gamma the given
+// arrival rate into station 0, solved exactly as (I - P^T) lambda = gamma by
+// Gauss-Jordan elimination with partial pivoting
+std::vector<double> traffic_rates(const splitting::Network & network, double arrival_rate)
+{
+    const auto & stations = network.stations;
+    const auto size = stations.size();
+
+    // rows of I - P^T, then gamma
+    std::vector<std::vector<double>> rows(size, std::vector<double>(size + 1, 0));
+    for (std::size_t j = 0; j < size; ++j) {
+        rows[j][j] = 1;
+    }
+    rows[0][size] = arrival_rate;
+    for (std::size_t i = 0; i < size; ++i) {
+        for (std::size_t j = 0; j < stations[i].routing.size(); ++j) {
+            rows.at(j)[i] -= stations[i].routing[j];
+        }
+    }
+
+    constexpr double kSingular = 1e-12;
+    for (std::size_t column = 0; column < size; ++column) {
+        auto pivot = column;
+        for (auto row = column + 1; row < size; ++row) {
+            if (std::abs(rows[row][column]) > std::abs(rows[pivot][column])) {
+                pivot = row;
+            }
+        }
+        if (std::abs(rows[pivot][column]) < kSingular) {
+            throw std::invalid_argument("the traffic equations need every customer to be able to leave");
+        }
+        std::swap(rows[column], rows[pivot]);
+
+        for (std::size_t row = 0; row < size; ++row) {
+            const double factor = rows[row][column] / rows[column][column];
+            if (row == column || factor == 0) {
+                continue;
+            }
+            for (auto k = column; k <= size; ++k) {
+                rows[row][k] -= factor * rows[column][k];
+            }
+        }
+    }
+
+    std::vector<double> rates(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        rates[i] = rows[i][size] / rows[i][i];
+    }
+    return rates;
+}
+
+} // anonymous
+
+std::string Metrics::to_string(const std::string & indent) const
+{
+    std::stringstream ss;
+    ss << indent << "CLR: " << loss_probability << std::endl
+       << indent << "Waiting Time: " << waiting_time << std::endl
+       << indent << "System Time: " << system_time << std::endl
+       << indent << "Customers in System: " << customers << std::endl
+       << indent << "Utilization: " << utilization << std::endl;
+    return ss.str();
+}
+
+Metrics mm1k(double lambda, double mu, std::size_t capacity)
+{
+    require_rates(lambda, mu);
+    if (capacity == 0) {
+        throw std::invalid_argument("mm1k needs room for the customer in service");
+    }
+
+    // p_n is proportional to rho^n. Summing from the likely end (n = 0 while
+    // rho <= 1, n = capacity after) keeps the terms at most 1 and lets the sum
+    // stop once they no longer matter, so huge capacities cost nothing.
+    const double rho = lambda / mu;
+    const bool filling = rho > 1;
+    const double ratio = filling ? 1 / rho : rho;
+    double term = 1;
+    double total = 0;
+    double weighted_total = 0;
+    double empty = 0; // unnormalized p_0, 0 if the terms vanished before it
+    double full = 0; // unnormalized p_capacity, likewise
+    for (std::size_t step = 0; step <= capacity; ++step) {
+        const auto n = filling ? capacity - step : step;
+        total += term;
+        weighted_total += double(n) * term;
+        if (n == 0) {
+            empty = term;
+        }
+        if (n == capacity) {
+            full = term;
+        }
+        if (ratio < 1 && term < 1e-18 * total) {
+            break;
+        }
+        term *= ratio;
+    }
+
+    Metrics metrics;
+    metrics.loss_probability = full / total;
+    metrics.customers = weighted_total / total;
+    metrics.utilization = 1 - empty / total;
+    const double throughput = lambda * (1 - metrics.loss_probability);
+    metrics.system_time = throughput > 0 ? metrics.customers / throughput : 1 / mu;
+    metrics.waiting_time = metrics.system_time - 1 / mu;
+    return metrics;
+}
+
+double erlang_c(double offered_load, std::size_t servers)
+{
+    if (servers == 0 || !(offered_load >= 0 && offered_load < double(servers))) {
+        throw std::invalid_argument("erlang_c needs an offered load below the number of servers");
+    }
+
+    // Erlang B by its recursion over servers, which never overflows, then C from B
+    double blocking = 1;
+    for (std::size_t k = 1; k <= servers; ++k) {
+        blocking = offered_load * blocking / (double(k) + offered_load * blocking);
+    }
+    const double rho = offered_load / double(servers);
+    return blocking / (1 - rho * (1 - blocking));
+}
+
+Metrics mmc(double lambda, double mu, std::size_t servers)
+{
+    require_rates(lambda, mu);
+    Metrics metrics;
+    metrics.waiting_time = erlang_c(lambda / mu, servers) / (double(servers) * mu - lambda);
+    metrics.utilization = lambda / mu / double(servers);
+    add_service(metrics, lambda, 1 / mu);
+    return metrics;
+}
+
+Metrics mg1(double lambda, double mean_service_time, double service_time_second_moment)
+{
+    require_rates(lambda, 1 / mean_service_time);
+    const double rho = lambda * mean_service_time;
+    if (!(rho < 1)) {
+        throw std::invalid_argument("mg1 needs rho < 1");
+    }
+
+    Metrics metrics;
+    metrics.waiting_time = lambda * service_time_second_moment / (2 * (1 - rho));
+    metrics.utilization = rho;
+    add_service(metrics, lambda, mean_service_time);
+    return metrics;
+}
+
+Metrics mgc(double lambda, double mean_service_time, double service_time_second_moment, std::size_t servers)
+{
+    auto metrics = mmc(lambda, 1 / mean_service_time, servers);
+
+    // (1 + Cs^2) / 2, which is 1 for exponential service
+    const double scale = service_time_second_moment / (2 * mean_service_time * mean_service_time);
+    metrics.waiting_time *= scale;
+    metrics.exact = servers == 1 || std::abs(scale - 1) < 1e-12;
+    add_service(metrics, lambda, mean_service_time);
+    return metrics;
+}
+
+Metrics mg1_sjf(double lambda, const std::function<double(double)> & percentile_to_service_time)
+{
+    // Percentiles at p = 1 - e^-t for evenly spaced t put most of the points
+    // in the tail, where heavy tailed service times keep most of their second
+    // moment. t stops where 1 - p is still far above the spacing of doubles near 1.
+    constexpr std::size_t kSteps = 100000;
+    constexpr double kLastT = 34;
+    const double step = kLastT / kSteps;
+
+    std::vector<double> service_times(kSteps);
+    std::vector<double> weights(kSteps);
+    double total_weight = 0;
+    for (std::size_t i = 0; i < kSteps; ++i) {
+        const double t = (double(i) + .5) * step;
+        service_times[i] = percentile_to_service_time(-std::expm1(-t));
+        weights[i] = std::exp(-t) * step;
+        total_weight += weights[i];
+    }
+
+    double mean = 0;
+    double second_moment = 0;
+    for (std::size_t i = 0; i < kSteps; ++i) {
+        weights[i] /= total_weight;
+        mean += weights[i] * service_times[i];
+        second_moment += weights[i] * service_times[i] * service_times[i];
+    }
+
+    const double rho = lambda * mean;
+    require_rates(lambda, 1 / mean);
+    if (!(rho < 1)) {
+        throw std::invalid_argument("mg1_sjf needs rho < 1");
+    }
+
+    // A job of size x waits for the residual service in progress, then for
+    // everything shorter that arrives before it starts:
+    // W(x) = W0 / ((1 - rho(<x)) (1 - rho(<=x))) with rho(x) the load of jobs up to size x
+    const double residual = lambda * second_moment / 2;
+    double shorter_load = 0;
+    Metrics metrics;
+    for (std::size_t i = 0; i < kSteps; ++i) {
+        const double load_up_to = shorter_load + lambda * service_times[i] * weights[i];
+        metrics.waiting_time += weights[i] * residual / ((1 - shorter_load) * (1 - load_up_to));
+        shorter_load = load_up_to;
+    }
+    metrics.utilization = rho;
+    add_service(metrics, lambda, mean);
+    return metrics;
+}
+
+NetworkMetrics jackson(const splitting::Network & network)
+{
+    const auto & stations = network.stations;
+    const auto size = stations.size();
+    if (size == 0) {
+        throw std::invalid_argument("jackson needs a station");
+    }
+    require_rates(network.arrival_rate, 1);
+
+    // visits to each station per customer, and the rates they make
+    const auto visits = traffic_rates(network, 1);
+
+    NetworkMetrics metrics;
+    metrics.throughput = network.arrival_rate; // nothing is lost
+    auto & overall = metrics.overall;
+    for (std::size_t i = 0; i < size; ++i) {
+        const double rate = network.arrival_rate * visits[i];
+        if (!(rate < stations[i].service_rate)) {
+            throw std::invalid_argument("jackson needs rho < 1 at every station");
+        }
+        metrics.arrival_rates.push_back(rate);
+        metrics.stations.push_back(mmc(rate, stations[i].service_rate, 1));
+
+        const auto & station = metrics.stations.back();
+        overall.waiting_time += visits[i] * station.waiting_time;
+        overall.system_time += visits[i] * station.system_time;
+        overall.customers += station.customers;
+        overall.utilization = std::max(overall.utilization, station.utilization);
+    }
+    return metrics;
+}
+
+NetworkMetrics mva(const splitting::Network & network, std::size_t population)
+{
+    const auto & stations = network.stations;
+    const auto size = stations.size();
+    if (size == 0 || population == 0 || !(network.arrival_rate > 0)) {
+        throw std::invalid_argument("mva needs a station, a population and a positive think rate");
+    }
+
+    const auto visits = traffic_rates(network, 1);
+    std::vector<double> demands(size); // service time per request
+    for (std::size_t i = 0; i < size; ++i) {
+        require_rates(0, stations[i].service_rate);
+        demands[i] = visits[i] / stations[i].service_rate;
+    }
+
+    // An arriving request sees the network as it is with one customer fewer
+    // (the arrival theorem), so each population's residence times follow from
+    // the previous one's queue lengths
+    const double think_time = 1 / network.arrival_rate;
+    std::vector<double> queue_lengths(size, 0);
+    std::vector<double> residence_times(size, 0); // per request, over all its visits
+    double throughput = 0;
+    for (std::size_t customers = 1; customers <= population; ++customers) {
+        double response_time = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            residence_times[i] = demands[i] * (1 + queue_lengths[i]);
+            response_time += residence_times[i];
+        }
+        throughput = double(customers) / (think_time + response_time);
+        for (std::size_t i = 0; i < size; ++i) {
+            queue_lengths[i] = throughput * residence_times[i];
+        }
+    }
+
+    NetworkMetrics metrics;
+    metrics.throughput = throughput;
+    auto & overall = metrics.overall;
+    for (const auto & station : stations) {
+        overall.exact = overall.exact && std::size_t(station.capacity) + 1 >= population;
+    }
+    for (std::size_t i = 0; i < size; ++i) {
+        metrics.arrival_rates.push_back(throughput * visits[i]);
+        Metrics station;
+        station.exact = overall.exact;
+        station.customers = queue_lengths[i];
+        station.utilization = throughput * demands[i];
+        station.system_time = visits[i] > 0 ? residence_times[i] / visits[i] : 1 / stations[i].service_rate;
+        station.waiting_time = station.system_time - 1 / stations[i].service_rate;
+        metrics.stations.push_back(station);
+
+        overall.system_time += residence_times[i];
+        overall.waiting_time += residence_times[i] - demands[i];
+        overall.customers += queue_lengths[i];
+        overall.utilization = std::max(overall.utilization, station.utilization);
+    }
+    return metrics;
+}
+
+} // analytic
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "splitting.h"
+
+// Closed form and product form answers for the models the projects simulate.
+//
+// M/M/1/K, M/M/c (Erlang C) and M/G/1 (Pollaczek-Khinchine, and Conway's
+// formula for non preemptive shortest job first) are exact in steady state.
+// M/G/c has no closed form, so it scales Erlang C by (1 + Cs^2) / 2, which is
+// exact for one server or exponential service and close otherwise.
+//
+// Open networks are solved as Jackson networks: the traffic equations
+// lambda = gamma + lambda P give each station's arrival rate, and by the
+// product form every station is then an M/M/1 on its own, exactly. Jackson
+// networks have unlimited buffers, so the network's capacities are ignored;
+// they only matter once they fill, which is what the simulation is for.
+//
+// Closed networks, a fixed population alternating between thinking and one
+// request through the stations, are solved exactly by mean value analysis
+// while every buffer holds the whole population.
+//
+// Used to answer --analytic without simulating and as the oracle the
+// simulation engines are tested against.
+
+namespace analytic {
+
+struct Metrics {
+    double loss_probability = 0; // of an arriving customer
+    double waiting_time = 0; // mean time in queue of the customers served
+    double system_time = 0; // mean waiting plus service time of the customers served
+    double customers = 0; // mean number in the system, in service included
+    double utilization = 0; // fraction of time a server is busy (the busiest one for a network)
+    bool exact = true; // false for approximations
+
+    std::string to_string(const std::string & indent = "    ") const;
+};
+
+// capacity counts the customer in service. Any rho is fine, the buffer keeps it stable.
+Metrics mm1k(double lambda, double mu, std::size_t capacity);
+
+// probability an arrival waits in an M/M/c with offered load lambda / mu < servers
+double erlang_c(double offered_load, std::size_t servers);
+
+// the queues below have unlimited buffers and throw std::invalid_argument unless rho < 1
+Metrics mmc(double lambda, double mu, std::size_t servers);
+Metrics mg1(double lambda, double mean_service_time, double service_time_second_moment);
+Metrics mgc(double lambda, double mean_service_time, double service_time_second_moment, std::size_t servers);
+
+// M/G/1 serving the shortest job first without preemption. Service times are
+// given by percentile (0 <= p < 1) like BoundedParetoGenerator::percentile_to_value,
+// and their moments are integrated from it.
+Metrics mg1_sjf(double lambda, const std::function<double(double)> & percentile_to_service_time);
+
+struct NetworkMetrics {
+    std::vector<double> arrival_rates; // offered to each station by the traffic equations
+    std::vector<Metrics> stations; // per visit
+    Metrics overall; // per customer: lost anywhere, total waiting and system time over its visits
+    double throughput = 0; // customers leaving served per unit time
+};
+
+// The network the splitting module steps, Poisson arrivals into station 0,
+// with unlimited buffers. Throws std::invalid_argument unless every station's
+// rho < 1 and every customer can leave.
+NetworkMetrics jackson(const splitting::Network & network);
+
+// The same stations closed: population customers each think for an
+// exponential time of rate network.arrival_rate (1 / mean think time), then
+// send a request into station 0. Exact MVA over populations 1..population,
+// with each station's visits per request from the traffic equations. Exact
+// unless a buffer is smaller than the population, then nothing is lost here
+// while the real network would block.
+NetworkMetrics mva(const splitting::Network & network, std::size_t population);
+
+} // analytic
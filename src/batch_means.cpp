@@ -0,0 +1,146 @@
+#include "batch_means.h"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+#include "stats.h"
+
+namespace statistics {
+
+namespace {
+
+constexpr auto kZ975 = 1.959963984540054;
+
+std::vector<double> merge_neighbours(const std::vector<double> & means)
+{
+    std::vector<double> merged;
+    for (std::size_t i = 0; i + 1 < means.size(); i += 2) {
+        merged.push_back((means[i] + means[i + 1]) / 2);
+    }
+    return merged;
+}
+
+} // anonymous
+
+std::string BatchMeansEstimate::to_string() const
+{
+    std::stringstream ss;
+    ss << mean << " ± " << half_width
+       << " (" << batches << " batches of " << batch_size
+       << ", lag-1 r = " << lag1_autocorrelation << ")";
+    if (!independent) {
+        ss << " WARNING: batches still correlated, use a longer run";
+    }
+    return ss.str();
+}
+
+double lag1_autocorrelation(const std::vector<double> & items)
+{
+    if (items.size() < 2) {
+        return 0;
+    }
+
+    auto mean = sample_mean<std::vector<double>, double>(items);
+    double numerator = 0;
+    double denominator = 0;
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        const auto difference = items[i] - mean;
+        denominator += difference * difference;
+        if (i + 1 < items.size()) {
+            numerator += difference * (items[i + 1] - mean);
+        }
+    }
+    return denominator > 0 ? numerator / denominator : 0;
+}
+
+double student_t_975(std::size_t degrees_of_freedom)
+{
+    static constexpr std::array<double, 30> kTable = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+
+    if (degrees_of_freedom == 0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    if (degrees_of_freedom <= kTable.size()) {
+        return kTable[degrees_of_freedom - 1];
+    }
+
+    // Cornish-Fisher expansion around the normal quantile, good to 3 decimals past 30
+    const double n = degrees_of_freedom;
+    const double z = kZ975;
+    const double z3 = z * z * z;
+    const double z5 = z3 * z * z;
+    return z + (z3 + z) / (4 * n) + (5 * z5 + 16 * z3 + 3 * z) / (96 * n * n);
+}
+
+BatchMeansEstimate estimate_batch_means(const BatchMeans & batch_means, std::size_t minimum_batches)
+{
+    auto means = batch_means.means();
+    auto batch_size = batch_means.batch_size();
+
+    auto significant = [] (double r, std::size_t batches) {
+        return std::abs(r) > kZ975 / std::sqrt(double(batches));
+    };
+
+    auto r = lag1_autocorrelation(means);
+    while (significant(r, means.size()) && means.size() >= 2 * minimum_batches) {
+        means = merge_neighbours(means);
+        batch_size *= 2;
+        r = lag1_autocorrelation(means);
+    }
+
+    BatchMeansEstimate estimate;
+    estimate.batches = means.size();
+    estimate.batch_size = batch_size;
+    estimate.lag1_autocorrelation = r;
+    estimate.independent = !significant(r, means.size());
+    estimate.mean = sample_mean<std::vector<double>, double>(means);
+    estimate.half_width = means.size() > 1
+        ? student_t_975(means.size() - 1) * std::sqrt(sample_variance(means, estimate.mean) / means.size())
+        : std::numeric_limits<double>::quiet_NaN();
+    return estimate;
+}
+
+std::string batch_means_report(const TimeBatchMeans & batch_means)
+{
+    std::stringstream ss;
+    ss << "Waiting Time: " << estimate_batch_means(batch_means.waiting_times).to_string() << std::endl;
+    ss << "System Time: " << estimate_batch_means(batch_means.system_times).to_string() << std::endl;
+    return ss.str();
+}
+
+std::size_t mser_truncation(const std::vector<double> & batch_means)
+{
+    const auto k = batch_means.size();
+    if (k < 2) {
+        return 0;
+    }
+
+    // suffix sums, so every candidate d costs O(1)
+    std::vector<double> sums(k + 1, 0);
+    std::vector<double> sums_of_squares(k + 1, 0);
+    for (std::size_t j = k; j-- > 0;) {
+        sums[j] = sums[j + 1] + batch_means[j];
+        sums_of_squares[j] = sums_of_squares[j + 1] + batch_means[j] * batch_means[j];
+    }
+
+    std::size_t best_d = 0;
+    double best_statistic = std::numeric_limits<double>::infinity();
+    for (std::size_t d = 0; d <= k / 2; ++d) {
+        const double remaining = k - d;
+        const double squared_deviations = sums_of_squares[d] - sums[d] * sums[d] / remaining;
+        const double statistic = squared_deviations / (remaining * remaining);
+        if (statistic < best_statistic) {
+            best_statistic = statistic;
+            best_d = d;
+        }
+    }
+    return best_d;
+}
+
+} // statistics
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Batch means: one long run instead of independent replications.
+//
+// After the warm up, consecutive observations are grouped into batches of
+// batch_size and only each batch's mean is kept. If the batches are long
+// enough to be nearly independent, the batch means can stand in for
+// replications in a t interval, and the run only warms up once. The lag-1
+// autocorrelation of the batch means checks that; while it is significant,
+// neighbouring batches are merged into longer ones.
+
+namespace statistics {
+
+class BatchMeans {
+public:
+    explicit BatchMeans(std::size_t batch_size = 0)
+    : batch_size_(batch_size)
+    {}
+
+    void add(double value)
+    {
+        if (batch_size_ == 0) {
+            return;
+        }
+
+        sum_ += value;
+        if (++in_batch_ == batch_size_) {
+            means_.push_back(sum_ / batch_size_);
+            sum_ = 0;
+            in_batch_ = 0;
+        }
+    }
+
+    // means of the completed batches, a partial last batch is left out
+    const std::vector<double> & means() const
+    {
+        return means_;
+    }
+
+    std::size_t batch_size() const
+    {
+        return batch_size_;
+    }
+
+    void clear()
+    {
+        means_.clear();
+        sum_ = 0;
+        in_batch_ = 0;
+    }
+
+private:
+    std::size_t batch_size_;
+    std::vector<double> means_;
+    double sum_ = 0;
+    std::size_t in_batch_ = 0;
+};
+
+// What a spy batched in one run (empty unless enabled)
+struct TimeBatchMeans {
+    BatchMeans waiting_times;
+    BatchMeans system_times;
+};
+
+struct BatchMeansEstimate {
+    double mean;
+    double half_width; // of the 95% t interval
+    double lag1_autocorrelation;
+    std::size_t batches;
+    std::size_t batch_size;
+    bool independent; // lag-1 autocorrelation not significant at 5%
+
+    std::string to_string() const;
+};
+
+double lag1_autocorrelation(const std::vector<double> & items);
+
+// two sided 95% critical value of Student's t
+double student_t_975(std::size_t degrees_of_freedom);
+
+// Merges neighbouring batches while their lag-1 autocorrelation is significant
+// and at least 2 * minimum_batches remain, then builds the interval
+BatchMeansEstimate estimate_batch_means(const BatchMeans & batch_means, std::size_t minimum_batches = 10);
+
+std::string batch_means_report(const TimeBatchMeans & batch_means);
+
+// MSER truncation point: the number of leading batch means d (at most half of
+// them) whose removal minimizes the squared standard error of the rest,
+// sum_{j > d} (Z_j - mean_d)^2 / (k - d)^2
+std::size_t mser_truncation(const std::vector<double> & batch_means);
+
+} // statistics
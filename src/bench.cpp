@@ -0,0 +1,323 @@
+#include "bench.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "allocation_counter.h"
+#include "simulation_options.h"
+#include "proj_1.h"
+#include "proj_2.h"
+#include "proj_3.h"
+
+namespace bench {
+
+namespace {
+
+struct Configuration {
+    std::string name;
+    std::function<void(const SimulationOptions &)> run;
+};
+
+constexpr long kSeedOffset = 0;
+constexpr std::size_t kRepetitions = 3; // throughput is the fastest repetition, to filter out noise
+
+std::string to_string(project2::Discipline discipline)
+{
+    switch (discipline) {
+    case project2::Discipline::FCFS:
+        return "FCFS";
+    case project2::Discipline::LCFS_NP:
+        return "LCFS_NP";
+    case project2::Discipline::SJF_NP:
+        return "SJF_NP";
+    case project2::Discipline::PRIO_NP:
+        return "PRIO_NP";
+    case project2::Discipline::PRIO_P:
+        return "PRIO_P";
+    }
+    throw std::invalid_argument("Unknown Discipline");
+}
+
+std::vector<Configuration> configurations()
+{
+    std::vector<Configuration> configurations;
+
+    configurations.push_back({"proj1", [] (const SimulationOptions & options) {
+        run_project_1(.9, 20, 200000, 50000, options);
+    }});
+
+    for (auto discipline : {project2::Discipline::FCFS,
+                            project2::Discipline::LCFS_NP,
+                            project2::Discipline::SJF_NP,
+                            project2::Discipline::PRIO_NP,
+                            project2::Discipline::PRIO_P}) {
+        configurations.push_back({"proj2/MM1/" + to_string(discipline), [discipline] (const SimulationOptions & options) {
+            project2::do_m_m_1_k(.9, 40, 50000, discipline, kSeedOffset, options);
+        }});
+    }
+
+    // the CPU model has no discipline parameter, so it only needs one configuration
+    configurations.push_back({"proj2/CPU", [] (const SimulationOptions & options) {
+        project2::do_web_server(.3, 40, 5, 50000, kSeedOffset, options);
+    }});
+
+    const std::vector<std::pair<project3::Mode, std::string>> modes = {
+        {project3::Mode::MM3, "MM3"},
+        {project3::Mode::MG3, "MG3"},
+        {project3::Mode::MG1, "MG1"}
+    };
+    const std::vector<std::pair<project3::Discipline, std::string>> disciplines = {
+        {project3::Discipline::FCFS, "FCFS"},
+        {project3::Discipline::SJF_NP, "SJF_NP"}
+    };
+    for (const auto & mode : modes) {
+        // about 90% utilization for either server count
+        const float lambda = mode.first == project3::Mode::MG1 ? .0003 : .0009;
+        for (const auto & discipline : disciplines) {
+            configurations.push_back({"proj3/" + mode.second + "/" + discipline.second,
+                                      [mode, discipline, lambda] (const SimulationOptions & options) {
+                project3::do_one_run(lambda, 50000, discipline.first, mode.first, kSeedOffset, options);
+            }});
+        }
+    }
+
+    return configurations;
+}
+
+// Runs one configuration in the calling process, with its output silenced
+Metrics measure(const Configuration & configuration)
+{
+    Metrics metrics;
+
+    std::stringstream discarded;
+    auto * cout_buffer = std::cout.rdbuf(discarded.rdbuf());
+    try {
+        for (std::size_t repetition = 0; repetition < kRepetitions; ++repetition) {
+            RunCounters counters;
+            SimulationOptions options;
+            options.counters = &counters;
+
+            auto allocations_before = allocation_counter::thread_allocations();
+            auto start = std::chrono::steady_clock::now();
+            configuration.run(options);
+            auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            auto allocations = allocation_counter::thread_allocations() - allocations_before;
+
+            metrics.events_per_second = std::max(metrics.events_per_second, counters.timer_dispatches / seconds);
+            metrics.customers_per_second = std::max(metrics.customers_per_second, counters.customers / seconds);
+            metrics.allocations_per_customer = counters.customers ? double(allocations) / counters.customers : 0;
+        }
+    } catch (...) {
+        std::cout.rdbuf(cout_buffer);
+        throw;
+    }
+    std::cout.rdbuf(cout_buffer);
+
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    metrics.peak_rss_kb = usage.ru_maxrss; // kilobytes on linux
+    return metrics;
+}
+
+// A fresh child per configuration so peak RSS and the heap start from the same place every time
+Metrics measure_in_child(const Configuration & configuration)
+{
+    int pipe_ends[2];
+    if (pipe(pipe_ends) != 0) {
+        throw std::runtime_error("pipe failed");
+    }
+
+    std::cout.flush();
+    auto child = fork();
+    if (child < 0) {
+        throw std::runtime_error("fork failed");
+    }
+
+    if (child == 0) {
+        close(pipe_ends[0]);
+        int status = 0;
+        try {
+            auto metrics = measure(configuration);
+            if (write(pipe_ends[1], &metrics, sizeof(metrics)) != sizeof(metrics)) {
+                status = 1;
+            }
+        } catch (const std::exception & e) {
+            std::cerr << configuration.name << " failed: " << e.what() << std::endl;
+            status = 1;
+        }
+        close(pipe_ends[1]);
+        _exit(status);
+    }
+
+    close(pipe_ends[1]);
+    Metrics metrics;
+    auto bytes = read(pipe_ends[0], &metrics, sizeof(metrics));
+    close(pipe_ends[0]);
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (bytes != sizeof(metrics) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw std::runtime_error("benchmark " + configuration.name + " failed");
+    }
+    return metrics;
+}
+
+// how much worse value is than baseline, as a fraction of baseline (negative = better)
+double relative_loss(double value, double baseline, bool higher_is_better)
+{
+    if (baseline == 0) {
+        return 0;
+    }
+    return higher_is_better ? (baseline - value) / baseline : (value - baseline) / baseline;
+}
+
+} // anonymous
+
+Baseline read_baseline(const std::string & path)
+{
+    Baseline baseline;
+    std::ifstream file(path);
+    if (!file) {
+        return baseline;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::stringstream ss(line);
+        std::string name;
+        Metrics metrics;
+        if (!(ss >> name
+                 >> metrics.events_per_second
+                 >> metrics.customers_per_second
+                 >> metrics.peak_rss_kb
+                 >> metrics.allocations_per_customer)) {
+            throw std::runtime_error("bad line in " + path + ": " + line);
+        }
+        baseline[name] = metrics;
+    }
+    return baseline;
+}
+
+void write_baseline(const std::vector<Result> & results, const std::string & path)
+{
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("could not open " + path);
+    }
+    file << "# configuration events_per_second customers_per_second peak_rss_kb allocations_per_customer" << std::endl;
+    for (const auto & result : results) {
+        file << result.name
+             << " " << std::fixed << std::setprecision(0) << result.metrics.events_per_second
+             << " " << result.metrics.customers_per_second
+             << " " << result.metrics.peak_rss_kb
+             << " " << std::setprecision(2) << result.metrics.allocations_per_customer
+             << std::endl;
+    }
+}
+
+std::vector<std::string> find_regressions(const std::vector<Result> & results,
+                                          const Baseline & baseline,
+                                          double threshold)
+{
+    std::vector<std::string> regressions;
+    for (const auto & result : results) {
+        auto iterator = baseline.find(result.name);
+        if (iterator == baseline.end()) {
+            continue;
+        }
+        const auto & expected = iterator->second;
+
+        auto check = [&] (const std::string & metric, double value, double baseline_value, bool higher_is_better) {
+            auto loss = relative_loss(value, baseline_value, higher_is_better);
+            if (loss > threshold) {
+                std::stringstream ss;
+                ss << std::fixed << std::setprecision(2)
+                   << result.name << " " << metric << ": " << value
+                   << " vs baseline " << baseline_value
+                   << " (" << std::setprecision(1) << loss * 100 << "% worse)";
+                regressions.push_back(ss.str());
+            }
+        };
+
+        check("events_per_second", result.metrics.events_per_second, expected.events_per_second, true);
+        check("customers_per_second", result.metrics.customers_per_second, expected.customers_per_second, true);
+        check("peak_rss_kb", result.metrics.peak_rss_kb, expected.peak_rss_kb, false);
+        check("allocations_per_customer",
+              result.metrics.allocations_per_customer,
+              expected.allocations_per_customer,
+              false);
+    }
+    return regressions;
+}
+
+int run_benchmarks(const Settings & settings)
+{
+    auto baseline = read_baseline(settings.baseline_path);
+
+    std::cout << std::left << std::setw(22) << "configuration"
+              << std::right << std::setw(14) << "events/s"
+              << std::setw(14) << "customers/s"
+              << std::setw(12) << "peak KB"
+              << std::setw(14) << "allocs/cust"
+              << std::setw(12) << "vs base" << std::endl;
+
+    std::vector<Result> results;
+    for (const auto & configuration : configurations()) {
+        Result result{configuration.name, measure_in_child(configuration)};
+        results.push_back(result);
+
+        std::string versus_baseline = "-";
+        auto iterator = baseline.find(result.name);
+        if (iterator != baseline.end() && iterator->second.events_per_second > 0) {
+            std::stringstream ss;
+            ss << std::showpos << std::fixed << std::setprecision(1)
+               << (result.metrics.events_per_second / iterator->second.events_per_second - 1) * 100 << "%";
+            versus_baseline = ss.str();
+        }
+
+        std::cout << std::left << std::setw(22) << result.name
+                  << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << result.metrics.events_per_second
+                  << std::setw(14) << result.metrics.customers_per_second
+                  << std::setw(12) << result.metrics.peak_rss_kb
+                  << std::setprecision(2) << std::setw(14) << result.metrics.allocations_per_customer
+                  << std::setw(12) << versus_baseline << std::endl;
+    }
+    std::cout.unsetf(std::ios::fixed);
+
+    if (!settings.write_baseline_path.empty()) {
+        write_baseline(results, settings.write_baseline_path);
+        std::cout << "Wrote baseline to " << settings.write_baseline_path << std::endl;
+    }
+
+    if (baseline.empty()) {
+        std::cout << "No baseline at " << settings.baseline_path << ", nothing to compare" << std::endl;
+        return 0;
+    }
+
+    auto regressions = find_regressions(results, baseline, settings.threshold);
+    if (regressions.empty()) {
+        std::cout << "No regressions beyond " << settings.threshold * 100 << "% of " << settings.baseline_path << std::endl;
+        return 0;
+    }
+
+    std::cout << regressions.size() << " regressions beyond " << settings.threshold * 100 << "%:" << std::endl;
+    for (const auto & regression : regressions) {
+        std::cout << "  " << regression << std::endl;
+    }
+    return 1;
+}
+
+} // bench
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// End to end benchmark: fixed, seeded configurations of every project, each
+// run in a forked child so peak RSS and allocation counts belong to that
+// configuration alone. Results are compared against a baseline file and any
+// metric that is worse by more than the threshold is reported as a regression.
+
+namespace bench {
+
+struct Metrics {
+    double events_per_second = 0;     // timer dispatches
+    double customers_per_second = 0;  // arrivals into the system
+    double peak_rss_kb = 0;
+    double allocations_per_customer = 0;
+};
+
+struct Result {
+    std::string name;
+    Metrics metrics;
+};
+
+struct Settings {
+    std::string baseline_path = "bench_baseline.txt"; // compare against this (skipped if missing)
+    std::string write_baseline_path = "";             // write the results here as a new baseline
+    double threshold = 0.20;                          // allowed relative loss before it's a regression
+};
+
+using Baseline = std::map<std::string, Metrics>;
+
+// Throws if the file exists but can't be parsed; returns empty if it doesn't exist
+Baseline read_baseline(const std::string & path);
+void write_baseline(const std::vector<Result> & results, const std::string & path);
+
+// One line per metric that is more than threshold worse than its baseline
+std::vector<std::string> find_regressions(const std::vector<Result> & results,
+                                          const Baseline & baseline,
+                                          double threshold);
+
+// Runs every configuration and prints the results. Returns the process exit
+// code: non zero when something regressed.
+int run_benchmarks(const Settings & settings);
+
+} // bench
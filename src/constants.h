@@ -1,8 +1,27 @@
 #pragma once
 
+// make bench sets this to build with ALLOCATION_ACCOUNTING on
+#ifndef A_PLUS_Q_ALLOCATION_ACCOUNTING
+#define A_PLUS_Q_ALLOCATION_ACCOUNTING 0
+#endif
+
 namespace constants {
     constexpr auto DEBUG_ENABLED = false;
     constexpr auto STRICT_TEST_TYPES = true;
     constexpr auto PRINT_STATS = true;
     constexpr auto SEED_OFFSET = 12345678;
+
+    // log.h: messages below LOG_LEVEL (0 TRACE, 1 DEBUG, 2 INFO, 3 WARNING, 4 OFF)
+    // or from components not in the LOG_COMPONENTS mask are compiled out
+    constexpr auto LOG_LEVEL = 4;
+    constexpr auto LOG_COMPONENTS = 0xFFFFFFFFu;
+
+    // allocation_counter.h: replace operator new to count heap allocations,
+    // charge them to the subsystem making them and print a per customer
+    // breakdown at the end of every run
+    constexpr auto ALLOCATION_ACCOUNTING = A_PLUS_Q_ALLOCATION_ACCOUNTING != 0;
+
+    // probe.h: count cycles spent in the hot paths and print a per customer
+    // breakdown at the end of every run
+    constexpr auto PROBES_ENABLED = false;
 }
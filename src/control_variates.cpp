@@ -0,0 +1,188 @@
+#include "control_variates.h"
+
+#include <cmath>
+#include <sstream>
+#include <utility>
+
+#include "batch_means.h"
+
+namespace statistics {
+
+namespace {
+
+// Gaussian elimination with partial pivoting on a small dense system, false if singular
+bool solve(std::vector<std::vector<double>> matrix, std::vector<double> & rhs)
+{
+    const auto size = rhs.size();
+    for (std::size_t column = 0; column < size; ++column) {
+        auto pivot = column;
+        for (std::size_t row = column + 1; row < size; ++row) {
+            if (std::abs(matrix[row][column]) > std::abs(matrix[pivot][column])) {
+                pivot = row;
+            }
+        }
+        if (!(std::abs(matrix[pivot][column]) > 1e-300)) {
+            return false;
+        }
+        std::swap(matrix[column], matrix[pivot]);
+        std::swap(rhs[column], rhs[pivot]);
+
+        for (std::size_t row = column + 1; row < size; ++row) {
+            const auto factor = matrix[row][column] / matrix[column][column];
+            for (std::size_t k = column; k < size; ++k) {
+                matrix[row][k] -= factor * matrix[column][k];
+            }
+            rhs[row] -= factor * rhs[column];
+        }
+    }
+
+    for (std::size_t row = size; row-- > 0;) {
+        for (std::size_t k = row + 1; k < size; ++k) {
+            rhs[row] -= matrix[row][k] * rhs[k];
+        }
+        rhs[row] /= matrix[row][row];
+    }
+    return true;
+}
+
+} // anonymous
+
+std::string ControlVariateEstimate::to_string() const
+{
+    std::stringstream ss;
+    ss << mean << " ± " << half_width;
+    if (controls > 0) {
+        ss << " (plain: " << plain_mean << " ± " << plain_half_width
+           << ", variance reduced " << 100 * variance_reduction() << "%)";
+    }
+    return ss.str();
+}
+
+ControlVariateEstimate control_variate_estimate(const std::vector<float> & outputs,
+                                                const std::vector<RunControls> & controls)
+{
+    const auto n = outputs.size();
+
+    double output_mean = 0;
+    for (auto output : outputs) {
+        output_mean += output;
+    }
+    output_mean /= n;
+
+    double output_squares = 0;
+    for (auto output : outputs) {
+        output_squares += (output - output_mean) * (output - output_mean);
+    }
+
+    ControlVariateEstimate estimate;
+    estimate.plain_mean = output_mean;
+    estimate.plain_variance = n > 1 ? output_squares / (n - 1) / n : std::numeric_limits<double>::quiet_NaN();
+    estimate.plain_half_width = n > 1
+        ? student_t_975(n - 1) * std::sqrt(estimate.plain_variance)
+        : std::numeric_limits<double>::quiet_NaN();
+    estimate.mean = estimate.plain_mean;
+    estimate.variance = estimate.plain_variance;
+    estimate.half_width = estimate.plain_half_width;
+    estimate.controls = 0;
+
+    const auto q = controls.empty() ? 0 : controls.front().observed.size();
+    if (q == 0 || controls.size() != n || n < q + 3) {
+        return estimate;
+    }
+
+    // centred cross products of the controls with each other and with the output
+    std::vector<double> control_means(q, 0);
+    for (const auto & run : controls) {
+        for (std::size_t j = 0; j < q; ++j) {
+            control_means[j] += run.observed[j] / n;
+        }
+    }
+
+    std::vector<std::vector<double>> control_squares(q, std::vector<double>(q, 0));
+    std::vector<double> control_output(q, 0);
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < q; ++j) {
+            const auto dj = controls[i].observed[j] - control_means[j];
+            control_output[j] += dj * (outputs[i] - output_mean);
+            for (std::size_t k = 0; k < q; ++k) {
+                control_squares[j][k] += dj * (controls[i].observed[k] - control_means[k]);
+            }
+        }
+    }
+
+    auto coefficients = control_output;
+    if (!solve(control_squares, coefficients)) {
+        return estimate;
+    }
+
+    double residual_squares = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        double fitted = 0;
+        for (std::size_t j = 0; j < q; ++j) {
+            fitted += coefficients[j] * (controls[i].observed[j] - control_means[j]);
+        }
+        const auto residual = outputs[i] - output_mean - fitted;
+        residual_squares += residual * residual;
+    }
+
+    std::vector<double> offsets(q);
+    double correction = 0;
+    for (std::size_t j = 0; j < q; ++j) {
+        offsets[j] = control_means[j] - controls.front().expected[j];
+        correction += coefficients[j] * offsets[j];
+    }
+
+    // var = s^2 (1/n + d' S^-1 d) with d the controls' distance from their expected values
+    auto solved_offsets = offsets;
+    if (!solve(control_squares, solved_offsets)) {
+        return estimate;
+    }
+    double offset_term = 0;
+    for (std::size_t j = 0; j < q; ++j) {
+        offset_term += offsets[j] * solved_offsets[j];
+    }
+
+    const auto degrees_of_freedom = n - q - 1;
+    const auto residual_variance = residual_squares / degrees_of_freedom;
+    estimate.mean = output_mean - correction;
+    estimate.variance = residual_variance * (1.0 / n + offset_term);
+    estimate.half_width = student_t_975(degrees_of_freedom) * std::sqrt(estimate.variance);
+    estimate.controls = q;
+    return estimate;
+}
+
+std::string control_variate_report(const std::vector<std::pair<std::string, std::vector<float>>> & outputs,
+                                   const std::vector<RunControls> & controls,
+                                   const std::string & indent)
+{
+    std::stringstream ss;
+    ss << "Control Variates (";
+    if (!controls.empty()) {
+        const auto & names = controls.front().names;
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            ss << (i ? ", " : "") << names[i];
+        }
+    }
+    ss << "):" << std::endl;
+
+    for (const auto & name_and_outputs : outputs) {
+        ss << indent << name_and_outputs.first << ": "
+           << control_variate_estimate(name_and_outputs.second, controls).to_string() << std::endl;
+    }
+    return ss.str();
+}
+
+std::vector<RunControls> control_pair_averages(const std::vector<RunControls> & controls)
+{
+    std::vector<RunControls> averages;
+    for (std::size_t i = 0; i + 1 < controls.size(); i += 2) {
+        auto average = controls[i];
+        for (std::size_t j = 0; j < average.observed.size(); ++j) {
+            average.observed[j] = (controls[i].observed[j] + controls[i + 1].observed[j]) / 2;
+        }
+        averages.push_back(average);
+    }
+    return averages;
+}
+
+} // statistics
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Control variates: every run also reports the sample means of its random
+// inputs (inter-arrival and service draws), whose true means are known. Runs
+// that drew short services tend to see short waits, so regressing the per run
+// outputs on how far those sample means landed from the truth and subtracting
+// the fitted part leaves a tighter interval for the same runs.
+
+namespace statistics {
+
+class RunningMean {
+public:
+    double add(double value)
+    {
+        sum_ += value;
+        ++count_;
+        return value;
+    }
+
+    double mean() const
+    {
+        return count_ ? sum_ / count_ : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    std::size_t count() const
+    {
+        return count_;
+    }
+
+    // adds in the values other has seen
+    void merge(const RunningMean & other)
+    {
+        sum_ += other.sum_;
+        count_ += other.count_;
+    }
+
+private:
+    double sum_ = 0;
+    std::size_t count_ = 0;
+};
+
+// Hands out a generator's draws unchanged while adding them to a RunningMean
+template <class Generator>
+class MeasuredGenerator {
+public:
+    MeasuredGenerator(const Generator & generator, RunningMean & draws)
+    : generator_(generator)
+    , draws_(&draws)
+    {}
+
+    auto generate() const
+    {
+        auto value = generator_.generate();
+        draws_->add(value);
+        return value;
+    }
+
+    // the generator's state and the draws so far, see time_warp::SavedGenerator
+    auto state() const
+    {
+        return std::make_pair(generator_.state(), *draws_);
+    }
+
+    template <class State>
+    void restore(const State & state) const
+    {
+        generator_.restore(state.first);
+        *draws_ = state.second;
+    }
+
+private:
+    Generator generator_;
+    RunningMean * draws_;
+};
+
+// The sample means of one run's random inputs, next to the means they were drawn with
+struct RunControls {
+    std::vector<std::string> names;
+    std::vector<double> observed;
+    std::vector<double> expected;
+
+    void add(const std::string & name, double observed_mean, double expected_mean)
+    {
+        names.push_back(name);
+        observed.push_back(observed_mean);
+        expected.push_back(expected_mean);
+    }
+};
+
+struct ControlVariateEstimate {
+    double mean;
+    double half_width; // of the 95% t interval
+    double variance;
+    double plain_mean; // the usual mean over runs, for comparison
+    double plain_half_width;
+    double plain_variance;
+    std::size_t controls; // 0 if there were too few runs to fit them
+
+    // fraction of the plain estimator's variance the controls removed
+    double variance_reduction() const
+    {
+        return 1 - variance / plain_variance;
+    }
+
+    std::string to_string() const;
+};
+
+// Regresses outputs[i] on controls[i].observed (multiple controls are fit
+// together) and corrects the mean by the fitted effect of the controls'
+// distance from their expected values
+ControlVariateEstimate control_variate_estimate(const std::vector<float> & outputs,
+                                                const std::vector<RunControls> & controls);
+
+// A heading naming the controls, then "name: estimate" for each (name, per run outputs)
+std::string control_variate_report(const std::vector<std::pair<std::string, std::vector<float>>> & outputs,
+                                   const std::vector<RunControls> & controls,
+                                   const std::string & indent = "    ");
+
+// the two runs of each antithetic pair as one, like statistics::pair_averages
+std::vector<RunControls> control_pair_averages(const std::vector<RunControls> & controls);
+
+} // statistics
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdexcept>
 #include <memory>
 #include <string>
 #include <sstream>
@@ -56,6 +57,7 @@ std::string to_string(CustomerEventType type)
     case CustomerEventType::PREEMPTED_FROM:
         return "PREEMPTED_FROM";
     }
+    throw std::invalid_argument("Unknown CustomerEventType");
 }
 
 std::string to_string(PlaceType type)
@@ -66,6 +68,7 @@ std::string to_string(PlaceType type)
     case PlaceType::SERVER:
         return "SERVER";
     }
+    throw std::invalid_argument("Unknown PlaceType");
 }
 
 std::string to_string(const CustomerEvent & event) {
@@ -206,6 +209,23 @@ public:
         return waiting_time;
     }
 
+    // from entering place_name until a server is next done with the customer,
+    // summed over the visits: the waiting there plus the service after it
+    float sojourn_time(const std::string & place_name) const
+    {
+        float sojourn_time = 0.0;
+        const CustomerEvent * visit = nullptr;
+        for (const auto & event : events_) {
+            if (!visit && event.event_type_ == CustomerEventType::ENTERED && event.place_name_ == place_name) {
+                visit = &event;
+            } else if (visit && event.event_type_ == CustomerEventType::EXITED && event.place_type_ == PlaceType::SERVER) {
+                sojourn_time += event.time_ - visit->time_;
+                visit = nullptr;
+            }
+        }
+        return sojourn_time;
+    }
+
     bool entered(const std::string & place_name)
     {
         for (const auto & event : events_) {
@@ -261,6 +281,22 @@ public:
         departure_time_ = departure_time;
     }
 
+    // of the path up to this customer's arrival, under importance sampling
+    double likelihood_ratio() const
+    {
+        return likelihood_ratio_;
+    }
+
+    void set_likelihood_ratio(double likelihood_ratio)
+    {
+        likelihood_ratio_ = likelihood_ratio;
+    }
+
+    const std::vector<CustomerEvent> & events() const
+    {
+        return events_;
+    }
+
     void add_event(const CustomerEvent & event) {
         events_.push_back(event);
     }
@@ -277,6 +313,7 @@ private:
     float service_time_; // time their next job will take
     bool serviced_; // was request fulfilled
     float departure_time_;
+    double likelihood_ratio_ = 1;
     std::vector<CustomerEvent> events_;
     // could refactor this to just save explicitly what I need rather than save every event and calculate but
     // this is a useful debugging tool.
@@ -0,0 +1,100 @@
+#include "importance_sampling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+namespace statistics {
+
+namespace {
+
+constexpr double kZ975 = 1.96;
+
+} // anonymous
+
+double ImportanceSampledCycles::Sums::mean() const
+{
+    return count ? sum / count : std::numeric_limits<double>::quiet_NaN();
+}
+
+double ImportanceSampledCycles::Sums::relative_error() const
+{
+    if (count < 2) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    const auto average = mean();
+    const auto variance = std::max(0.0, (squares - count * average * average) / (count - 1));
+    return std::sqrt(variance / count) / average;
+}
+
+void ImportanceSampledCycles::on_regeneration()
+{
+    if (in_cycle_) {
+        if (tilted_cycle_) {
+            weighted_losses_.add(cycle_losses_);
+            overflows_.add(cycle_overflow_);
+        } else {
+            arrivals_.add(cycle_arrivals_);
+        }
+    }
+
+    tilted_cycle_ = in_cycle_ && !tilted_cycle_;
+    in_cycle_ = true;
+    cycle_losses_ = 0;
+    cycle_overflow_ = 0;
+    cycle_arrivals_ = 0;
+    likelihood_ratio_.tilted = tilted_cycle_;
+    likelihood_ratio_.value = 1;
+}
+
+void ImportanceSampledCycles::on_lost(double weight)
+{
+    if (!in_cycle_ || !tilted_cycle_) {
+        return;
+    }
+    cycle_losses_ += weight;
+    if (likelihood_ratio_.tilted) {
+        // the rare part is over, the rest of the cycle runs at the real rates
+        cycle_overflow_ = weight;
+        likelihood_ratio_.tilted = false;
+    }
+}
+
+void ImportanceSampledCycles::clear()
+{
+    weighted_losses_ = {};
+    overflows_ = {};
+    arrivals_ = {};
+    in_cycle_ = false;
+    tilted_cycle_ = false;
+    likelihood_ratio_.tilted = false;
+    likelihood_ratio_.value = 1;
+}
+
+ImportanceSamplingEstimate ImportanceSampledCycles::estimate() const
+{
+    ImportanceSamplingEstimate estimate;
+    estimate.loss_probability = weighted_losses_.mean() / arrivals_.mean();
+    // the two means come from different cycles, so their errors add in quadrature
+    estimate.loss_relative_error = std::hypot(weighted_losses_.relative_error(), arrivals_.relative_error());
+    estimate.overflow_probability = overflows_.mean();
+    estimate.overflow_relative_error = overflows_.relative_error();
+    estimate.tilted_cycles = weighted_losses_.count;
+    estimate.plain_cycles = arrivals_.count;
+    return estimate;
+}
+
+std::string ImportanceSamplingEstimate::to_string() const
+{
+    std::stringstream ss;
+    ss << "CLR: " << loss_probability << " ± " << kZ975 * loss_relative_error * loss_probability
+       << " (relative error " << 100 * loss_relative_error << "%)" << std::endl;
+    ss << "Overflow probability per cycle: " << overflow_probability
+       << " ± " << kZ975 * overflow_relative_error * overflow_probability
+       << " (relative error " << 100 * overflow_relative_error << "%)" << std::endl;
+    ss << "Cycles: " << tilted_cycles << " tilted, " << plain_cycles << " plain" << std::endl;
+    return ss.str();
+}
+
+} // statistics
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "prng.h"
+
+// Importance sampling of rare losses over regenerative cycles.
+//
+// Every arrival that finds the system empty starts a new cycle (see
+// regenerative.h), so cycles are independent whatever rates they ran at.
+// Cycles alternate: plain ones run at the model's own rates and count the
+// customers arriving per cycle, tilted ones draw from rates that push the
+// queue toward full until their first loss and at the real rates after it.
+// A loss in a tilted cycle counts the likelihood ratio of the path up to it,
+// so the weighted losses per tilted cycle are an unbiased estimate of the
+// real losses per cycle even when those are around 1e-9, and divided by the
+// arrivals per plain cycle they give the CLR.
+
+namespace statistics {
+
+struct ImportanceSamplingEstimate {
+    double loss_probability; // CLR
+    double loss_relative_error; // standard error over the estimate
+    double overflow_probability; // of a cycle filling the buffer
+    double overflow_relative_error;
+    std::size_t tilted_cycles;
+    std::size_t plain_cycles;
+
+    std::string to_string() const;
+};
+
+class ImportanceSampledCycles {
+public:
+    // turns likelihood_ratio's tilt on and off as cycles start and overflow
+    explicit ImportanceSampledCycles(LikelihoodRatio & likelihood_ratio)
+    : likelihood_ratio_(likelihood_ratio)
+    {}
+
+    // an arrival found the system empty
+    void on_regeneration();
+
+    // returns the weight of the customer that just arrived
+    double on_entered()
+    {
+        cycle_arrivals_ += in_cycle_;
+        return likelihood_ratio_.value;
+    }
+
+    // weight is the lost customer's on_entered value
+    void on_lost(double weight);
+
+    // also drops the open cycle, counting resumes at the next regeneration point
+    void clear();
+
+    // over the cycles that have ended
+    ImportanceSamplingEstimate estimate() const;
+
+private:
+    struct Sums {
+        double sum = 0;
+        double squares = 0;
+        std::size_t count = 0;
+
+        void add(double value)
+        {
+            sum += value;
+            squares += value * value;
+            ++count;
+        }
+
+        double mean() const;
+        double relative_error() const;
+    };
+
+    LikelihoodRatio & likelihood_ratio_;
+    Sums weighted_losses_; // per tilted cycle
+    Sums overflows_; // per tilted cycle, weighted
+    Sums arrivals_; // per plain cycle
+    double cycle_losses_ = 0;
+    double cycle_overflow_ = 0;
+    std::uint32_t cycle_arrivals_ = 0;
+    bool in_cycle_ = false;
+    bool tilted_cycle_ = false;
+};
+
+} // statistics
@@ -4,7 +4,10 @@
 #include "prng.h"
 #include "customer.h"
 #include "priority_generator.h"
+#include "state_log.h"
 #include "constants.h"
+#include "log.h"
+#include "allocation_counter.h"
 
 namespace {
 
@@ -33,38 +36,49 @@ public:
         generate_customer();
     }
 
+    // the customer count and the last arrival are saved while a log is set, so
+    // the Time Warp engine can roll arrivals back (null turns saving off). The
+    // arrival generator's draws need saving on their own.
+    void set_state_log(StateLog * state_log)
+    {
+        state_log_ = state_log;
+    }
+
 private:
     void generate_customer()
     {
+        allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::INCOMING);
         auto arrival_time = last_arrival_time_ + arrival_time_generator_.generate();
         auto customer = make_customer(id_, arrival_time, generate_priority_());
 
+        if (state_log_) {
+            state_log_->save([this, id = id_, last_arrival_time = last_arrival_time_] {
+                id_ = id;
+                last_arrival_time_ = last_arrival_time;
+            });
+        }
         last_arrival_time_ = arrival_time;
         ++id_;
 
-        if (constants::DEBUG_ENABLED) {
-            std::cout << "IncomingCustomers::" << __func__
-                      << " called at time: " << simulation_timer_.time()
-                      << " scheduling delivery of: " << customer->to_string()
-                      << " for time: " << arrival_time << std::endl;
-        }
+        logging::log<logging::Level::DEBUG, logging::Component::INCOMING>(
+            "IncomingCustomers::generate_customer called at time: {} scheduling delivery of customer: {} priority: {} for time: {}",
+            simulation_timer_.time(), customer->id(), customer->priority(), arrival_time);
 
         simulation_timer_.register_job(
             arrival_time,
             [this, customer] {
 
-                if (constants::DEBUG_ENABLED) {
-                    std::cout << "IncomingCustomers::" << __func__
-                              <<  " delivering customer: " << customer->to_string()
-                              << " at time: " << simulation_timer_.time() << std::endl;
-                }
+                logging::log<logging::Level::DEBUG, logging::Component::INCOMING>(
+                    "IncomingCustomers::generate_customer delivering customer: {} at time: {}",
+                    customer->id(), simulation_timer_.time());
 
                 for (const auto & callback : customer_destinations_) {
                     callback(customer);
                 }
 
                 generate_customer();
-            }
+            },
+            JobTag{TraceKind::ARRIVAL, customer->id(), nullptr}
         );
     }
 
@@ -74,4 +88,5 @@ private:
     const std::function<std::uint32_t()> generate_priority_;
     std::uint32_t id_ = 0;
     float last_arrival_time_ = 0;
+    StateLog * state_log_ = nullptr;
 };
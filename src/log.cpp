@@ -0,0 +1,218 @@
+#include "log.h"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+namespace logging {
+
+std::string to_string(Level level)
+{
+    switch (level) {
+    case Level::TRACE:
+        return "TRACE";
+    case Level::DEBUG:
+        return "DEBUG";
+    case Level::INFO:
+        return "INFO";
+    case Level::WARNING:
+        return "WARNING";
+    case Level::OFF:
+        return "OFF";
+    }
+    return "UNKNOWN";
+}
+
+std::string to_string(Component component)
+{
+    switch (component) {
+    case Component::TIMER:
+        return "TIMER";
+    case Component::QUEUE:
+        return "QUEUE";
+    case Component::SERVER:
+        return "SERVER";
+    case Component::SPY:
+        return "SPY";
+    case Component::INCOMING:
+        return "INCOMING";
+    case Component::BALANCER:
+        return "BALANCER";
+    case Component::PROJECT:
+        return "PROJECT";
+    }
+    return "UNKNOWN";
+}
+
+std::string LogArgument::to_string() const
+{
+    std::stringstream ss;
+    switch (type) {
+    case Type::SIGNED:
+        ss << signed_value;
+        break;
+    case Type::UNSIGNED:
+        ss << unsigned_value;
+        break;
+    case Type::REAL:
+        ss << real_value;
+        break;
+    case Type::TEXT:
+        ss << text;
+        break;
+    }
+    return ss.str();
+}
+
+std::string format(const LogRecord & record)
+{
+    std::stringstream ss;
+    ss << "[" << to_string(record.level) << "][" << to_string(record.component) << "] ";
+
+    std::size_t argument = 0;
+    for (const char * c = record.message; *c != '\0'; ++c) {
+        if (c[0] == '{' && c[1] == '}' && argument < record.argument_count) {
+            ss << record.arguments[argument++].to_string();
+            ++c;
+        } else {
+            ss << *c;
+        }
+    }
+
+    // anything without a placeholder still gets printed
+    for (; argument < record.argument_count; ++argument) {
+        ss << " " << record.arguments[argument].to_string();
+    }
+
+    return ss.str();
+}
+
+LogRing::LogRing(std::size_t capacity)
+: cells_(capacity)
+, mask_(capacity - 1)
+, tail_(0)
+, head_(0)
+{
+    if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+        throw std::invalid_argument("LogRing capacity must be a power of two");
+    }
+    for (std::size_t i = 0; i < capacity; ++i) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool LogRing::try_push(const LogRecord & record)
+{
+    auto position = tail_.load(std::memory_order_relaxed);
+    while (true) {
+        auto & cell = cells_[position & mask_];
+        auto sequence = cell.sequence.load(std::memory_order_acquire);
+        auto difference = std::intptr_t(sequence) - std::intptr_t(position);
+        if (difference == 0) {
+            if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.record = record;
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false; // full
+        } else {
+            position = tail_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool LogRing::try_pop(LogRecord & record)
+{
+    auto position = head_.load(std::memory_order_relaxed);
+    while (true) {
+        auto & cell = cells_[position & mask_];
+        auto sequence = cell.sequence.load(std::memory_order_acquire);
+        auto difference = std::intptr_t(sequence) - std::intptr_t(position + 1);
+        if (difference == 0) {
+            if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                record = cell.record;
+                cell.sequence.store(position + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false; // empty
+        } else {
+            position = head_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+Logger::Logger(std::size_t capacity, const Sink & sink)
+: ring_(capacity)
+, sink_(sink)
+, dropped_(0)
+, running_(false)
+{}
+
+Logger::~Logger()
+{
+    stop();
+}
+
+Logger & Logger::instance()
+{
+    static Logger logger;
+    static std::once_flag started;
+    std::call_once(started, [] { logger.start(); });
+    return logger;
+}
+
+void Logger::start()
+{
+    if (running_.exchange(true)) {
+        return;
+    }
+
+    drain_thread_ = std::thread([this] {
+        constexpr auto kIdleSleep = std::chrono::milliseconds(1);
+        while (running_.load(std::memory_order_acquire)) {
+            if (drain() == 0) {
+                std::this_thread::sleep_for(kIdleSleep);
+            }
+        }
+    });
+}
+
+void Logger::stop()
+{
+    if (running_.exchange(false)) {
+        drain_thread_.join();
+    }
+    drain();
+
+    auto dropped_records = dropped();
+    if (dropped_records > 0) {
+        write("[WARNING][LOG] dropped " + std::to_string(dropped_records) + " records (ring buffer full)");
+        dropped_ = 0;
+    }
+}
+
+std::size_t Logger::drain()
+{
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+
+    std::size_t drained = 0;
+    LogRecord record;
+    while (ring_.try_pop(record)) {
+        write(format(record));
+        ++drained;
+    }
+    return drained;
+}
+
+void Logger::write(const std::string & line)
+{
+    if (sink_) {
+        sink_(line);
+    } else {
+        std::cout << line << '\n';
+    }
+}
+
+} // logging
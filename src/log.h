@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "constants.h"
+
+// Structured logging for the hot paths.
+//
+// logging::log<Level, Component>("{} got customer {} at time {}", name_, id, time)
+// compiles to nothing unless the level is at least constants::LOG_LEVEL and the
+// component is in constants::LOG_COMPONENTS. Enabled messages only copy their
+// arguments into a lock free ring buffer; the "{}" formatting and the write to
+// stdout happen later on a background drain thread. If the ring is full the
+// message is dropped (and counted) rather than stalling the simulation.
+
+namespace logging {
+
+enum class Level : std::uint8_t {
+    TRACE,
+    DEBUG,
+    INFO,
+    WARNING,
+    OFF
+};
+
+enum class Component : std::uint32_t {
+    TIMER = 1 << 0,
+    QUEUE = 1 << 1,
+    SERVER = 1 << 2,
+    SPY = 1 << 3,
+    INCOMING = 1 << 4,
+    BALANCER = 1 << 5,
+    PROJECT = 1 << 6
+};
+
+constexpr bool enabled(Level level, Component component)
+{
+    return std::uint8_t(level) >= constants::LOG_LEVEL
+           && level != Level::OFF
+           && (std::uint32_t(component) & constants::LOG_COMPONENTS) != 0;
+}
+
+std::string to_string(Level level);
+std::string to_string(Component component);
+
+struct LogArgument {
+    enum class Type : std::uint8_t {
+        SIGNED,
+        UNSIGNED,
+        REAL,
+        TEXT
+    };
+
+    static constexpr std::size_t kMaxTextSize = 23;
+
+    Type type = Type::SIGNED;
+    union {
+        long long signed_value;
+        unsigned long long unsigned_value;
+        double real_value;
+    };
+    char text[kMaxTextSize + 1] = {}; // strings are copied (and truncated) so they can't dangle
+
+    LogArgument()
+    : signed_value(0)
+    {}
+
+    template <class T>
+    static LogArgument from(const T & value)
+    {
+        LogArgument argument;
+        if constexpr (std::is_floating_point_v<T>) {
+            argument.type = Type::REAL;
+            argument.real_value = value;
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            argument.type = Type::SIGNED;
+            argument.signed_value = value;
+        } else if constexpr (std::is_integral_v<T>) {
+            argument.type = Type::UNSIGNED;
+            argument.unsigned_value = value;
+        } else if constexpr (std::is_enum_v<T>) {
+            argument.type = Type::SIGNED;
+            argument.signed_value = static_cast<long long>(value);
+        } else {
+            argument.type = Type::TEXT;
+            argument.set_text(value);
+        }
+        return argument;
+    }
+
+    std::string to_string() const;
+
+private:
+    void set_text(const std::string & value)
+    {
+        auto size = std::min(value.size(), kMaxTextSize);
+        std::memcpy(text, value.data(), size);
+        text[size] = '\0';
+    }
+
+    void set_text(const char * value)
+    {
+        set_text(std::string(value));
+    }
+};
+
+struct LogRecord {
+    static constexpr std::size_t kMaxArguments = 6;
+
+    const char * message = ""; // must be a string literal
+    Level level = Level::OFF;
+    Component component = Component::PROJECT;
+    std::uint8_t argument_count = 0;
+    LogArgument arguments[kMaxArguments];
+};
+
+// Replaces each "{}" in the message with the next argument
+std::string format(const LogRecord & record);
+
+// Bounded multi producer / multi consumer queue (Vyukov). Each cell carries a
+// sequence number so producers only contend on the tail index.
+class LogRing {
+public:
+    explicit LogRing(std::size_t capacity);
+
+    bool try_push(const LogRecord & record);
+    bool try_pop(LogRecord & record);
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        LogRecord record;
+    };
+
+    std::vector<Cell> cells_;
+    const std::size_t mask_;
+    alignas(64) std::atomic<std::size_t> tail_;
+    alignas(64) std::atomic<std::size_t> head_;
+};
+
+class Logger {
+public:
+    using Sink = std::function<void(const std::string &)>;
+
+    static constexpr std::size_t kDefaultCapacity = 1 << 16;
+
+    explicit Logger(std::size_t capacity = kDefaultCapacity, const Sink & sink = nullptr);
+    ~Logger();
+
+    Logger(const Logger &) = delete;
+    Logger & operator=(const Logger &) = delete;
+
+    static Logger & instance();
+
+    template <class... Args>
+    void push(Level level, Component component, const char * message, const Args &... args)
+    {
+        static_assert(sizeof...(Args) <= LogRecord::kMaxArguments, "too many log arguments");
+
+        LogRecord record;
+        record.message = message;
+        record.level = level;
+        record.component = component;
+        record.argument_count = sizeof...(Args);
+        std::size_t index = 0;
+        ((record.arguments[index++] = LogArgument::from(args)), ...);
+
+        if (!ring_.try_push(record)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Starts the background thread that formats and writes queued records
+    void start();
+
+    // Stops the background thread after writing everything queued so far
+    void stop();
+
+    // Formats and writes every queued record on the calling thread
+    std::size_t drain();
+
+    std::uint64_t dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void write(const std::string & line);
+
+    LogRing ring_;
+    Sink sink_;
+    std::atomic<std::uint64_t> dropped_;
+    std::atomic<bool> running_;
+    std::thread drain_thread_;
+    std::mutex drain_mutex_;
+};
+
+template <Level level, Component component, class... Args>
+inline void log(const char * message, const Args &... args)
+{
+    if constexpr (enabled(level, component)) {
+        Logger::instance().push(level, component, message, args...);
+    }
+}
+
+} // logging
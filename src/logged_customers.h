@@ -0,0 +1,106 @@
+#pragma once
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+#include "simulation_timer.h"
+#include "customer.h"
+#include "request_log.h"
+#include "log.h"
+#include "allocation_counter.h"
+
+// Replays a RequestLog in place of IncomingCustomers. Like IncomingCustomers
+// only the next arrival is scheduled at a time, it's read from the log once
+// the one before it is delivered.
+//
+// Customers arrive with their service time set, the logged one or else one
+// from generate_service_time, so the queue they join must not draw its own.
+// With a single priority every customer gets it and the logged ones are
+// ignored, otherwise a logged priority outside the range throws
+// std::runtime_error, as do timestamps that go backwards.
+class LoggedCustomers {
+public:
+    LoggedCustomers(const SimulationTimer & simulation_timer,
+                    RequestLog & request_log,
+                    const std::function<float()> & generate_service_time,
+                    std::uint32_t minimum_priority = default_customer_priority(),
+                    std::uint32_t maximum_priority = default_customer_priority())
+    : simulation_timer_(simulation_timer)
+    , request_log_(request_log)
+    , generate_service_time_(generate_service_time)
+    , minimum_priority_(minimum_priority)
+    , maximum_priority_(maximum_priority)
+    {}
+
+    void register_for_customers(const CustomerRequest & callback)
+    {
+        customer_destinations_.push_back(callback);
+    }
+
+    void start()
+    {
+        generate_customer();
+    }
+
+private:
+    void generate_customer()
+    {
+        allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::INCOMING);
+        LoggedRequest request;
+        if (!request_log_.next(request)) {
+            return;
+        }
+
+        if (id_ == 0) {
+            first_timestamp_ = request.timestamp;
+        }
+        auto arrival_time = float(request.timestamp - first_timestamp_);
+        if (arrival_time < last_arrival_time_) {
+            throw std::runtime_error("request log timestamps go backwards at request " + std::to_string(id_));
+        }
+
+        auto priority = minimum_priority_;
+        if (minimum_priority_ != maximum_priority_) {
+            priority = request.priority;
+            if (priority < minimum_priority_ || priority > maximum_priority_) {
+                throw std::runtime_error("request log priority " + std::to_string(priority)
+                                         + " at request " + std::to_string(id_) + " is out of range");
+            }
+        }
+
+        auto customer = make_customer(id_, arrival_time, priority);
+        customer->set_service_time(request.service_time == no_logged_service_time()
+                                   ? generate_service_time_()
+                                   : request.service_time);
+
+        last_arrival_time_ = arrival_time;
+        ++id_;
+
+        logging::log<logging::Level::DEBUG, logging::Component::INCOMING>(
+            "LoggedCustomers::generate_customer called at time: {} scheduling delivery of customer: {} priority: {} for time: {}",
+            simulation_timer_.time(), customer->id(), customer->priority(), arrival_time);
+
+        simulation_timer_.register_job(
+            arrival_time,
+            [this, customer] {
+                for (const auto & callback : customer_destinations_) {
+                    callback(customer);
+                }
+
+                generate_customer();
+            },
+            JobTag{TraceKind::ARRIVAL, customer->id(), nullptr}
+        );
+    }
+
+    std::vector<CustomerRequest> customer_destinations_;
+    const SimulationTimer & simulation_timer_;
+    RequestLog & request_log_;
+    const std::function<float()> generate_service_time_;
+    const std::uint32_t minimum_priority_;
+    const std::uint32_t maximum_priority_;
+    std::uint32_t id_ = 0;
+    double first_timestamp_ = 0;
+    float last_arrival_time_ = 0;
+};
@@ -0,0 +1,257 @@
+#include "microbench.h"
+
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+
+#include "simulation_timer.h"
+#include "simulation_spy.h"
+#include "queue.h"
+#include "prng.h"
+#include "random_load_balancer.h"
+#include "customer.h"
+
+namespace microbench {
+
+namespace {
+
+// results are written here so the compiler can't throw the work away
+volatile double sink = 0;
+
+const std::vector<std::size_t> kEventListSizes = {16, 256, 4096, 65536};
+const std::vector<std::size_t> kQueueSizes = {16, 256, 4096};
+const std::vector<std::size_t> kEventsPerCustomer = {2, 8, 32};
+const std::vector<std::size_t> kLoadBalancerTargets = {2, 4, 8};
+constexpr std::uint32_t kPriorities = 4;
+constexpr long kSeed = 12345;
+
+std::string to_string(queueing::Discipline discipline)
+{
+    switch (discipline) {
+    case queueing::Discipline::FCFS:
+        return "FCFS";
+    case queueing::Discipline::LCFS_NP:
+        return "LCFS_NP";
+    case queueing::Discipline::SJF_NP:
+        return "SJF_NP";
+    case queueing::Discipline::PRIO_NP:
+        return "PRIO_NP";
+    case queueing::Discipline::PRIO_P:
+        return "PRIO_P";
+    }
+    throw std::invalid_argument("Unknown Discipline");
+}
+
+void timer_benchmarks(const Settings & settings, std::vector<Result> & results)
+{
+    for (auto size : kEventListSizes) {
+        ExponentialGenerator exponential(1, kSeed);
+        SimulationTimer timer;
+        for (std::size_t i = 0; i < size; ++i) {
+            timer.register_job(exponential.generate(), [] {});
+        }
+
+        // classic hold model: schedule one event, dispatch the soonest one
+        results.push_back(measure("timer/hold", "timer", size, [&] {
+            timer.register_job(timer.time() + exponential.generate(), [] {});
+            timer.advance_time();
+        }, settings));
+
+        results.push_back(measure("timer/register_remove", "timer", size, [&] {
+            auto id = timer.register_job(timer.time() + exponential.generate(), [] {});
+            sink = timer.remove_job(id);
+        }, settings));
+    }
+}
+
+void queue_benchmarks(const Settings & settings, std::vector<Result> & results)
+{
+    const std::vector<queueing::Discipline> disciplines = {
+        queueing::Discipline::FCFS,
+        queueing::Discipline::LCFS_NP,
+        queueing::Discipline::SJF_NP,
+        queueing::Discipline::PRIO_NP,
+        queueing::Discipline::PRIO_P
+    };
+
+    for (auto discipline : disciplines) {
+        const bool prioritized = discipline == queueing::Discipline::PRIO_NP
+                                 || discipline == queueing::Discipline::PRIO_P;
+        const std::uint32_t maximum_priority = prioritized ? kPriorities - 1 : default_customer_priority();
+        const std::uint32_t priority_count = maximum_priority - default_customer_priority() + 1;
+
+        for (auto size : kQueueSizes) {
+            ExponentialGenerator service_times(1, kSeed);
+            UniformGenerator priorities(kSeed);
+            std::uint32_t next_id = 0;
+            float time = 0;
+
+            // big enough that nothing is ever rejected, so every accept is matched by a dispatch
+            Queue queue((size + 1) * priority_count,
+                        [] (const std::shared_ptr<Customer> &) {},
+                        [&service_times] { return service_times.generate(); },
+                        [&time] { return time; },
+                        discipline,
+                        "Queue",
+                        default_customer_priority(),
+                        maximum_priority);
+            queue.register_for_preempts([] (const std::shared_ptr<Customer> & customer) {
+                return customer;
+            });
+
+            auto next_customer = [&] {
+                std::uint32_t priority = prioritized ? std::uint32_t(priorities.generate() * priority_count)
+                                                     : default_customer_priority();
+                return make_customer(next_id++, time, priority);
+            };
+
+            for (std::size_t i = 0; i < size; ++i) {
+                queue.accept_customer(next_customer());
+            }
+
+            CustomerRequest request = [] (const std::shared_ptr<Customer> & customer) {
+                sink = customer->service_time();
+            };
+
+            results.push_back(measure("queue/accept_dispatch/" + to_string(discipline), "queue", size, [&] {
+                time += 1;
+                queue.accept_customer(next_customer());
+                queue.request_one_customer(request);
+            }, settings));
+        }
+    }
+}
+
+void spy_benchmarks(const Settings & settings, std::vector<Result> & results)
+{
+    const std::vector<std::string> queue_names = {"CPU", "IO 1", "IO 2", "IO 3"};
+    constexpr std::size_t kCustomers = 1024;
+    constexpr std::size_t kL = UINT32_MAX; // never matches an id, so no additional stats
+
+    for (auto events : kEventsPerCustomer) {
+        SimulationSpy spy(kL, kCustomers, queue_names);
+
+        // reuse the same customers: each one is entered and exited once per operation
+        std::vector<std::shared_ptr<Customer>> customers;
+        for (std::uint32_t id = 0; id < kCustomers; ++id) {
+            auto customer = make_customer(id, 0);
+            float time = 0;
+            for (std::size_t i = 0; i < events / 2; ++i) {
+                const auto & name = queue_names[i % queue_names.size()];
+                customer->add_event(CustomerEvent(CustomerEventType::ENTERED, PlaceType::QUEUE, name, time));
+                time += 1;
+                customer->add_event(CustomerEvent(CustomerEventType::EXITED, PlaceType::QUEUE, name, time));
+                time += 1;
+            }
+            customer->set_service_time(1);
+            customer->set_departure_time(time);
+            customer->set_serviced(true);
+            customers.push_back(customer);
+        }
+
+        std::size_t next = 0;
+        results.push_back(measure("spy/enter_exit", "spy", events, [&] {
+            const auto & customer = customers[next];
+            next = (next + 1) % kCustomers;
+            spy.on_customer_entering(customer);
+            spy.on_customer_exiting(customer);
+        }, settings));
+    }
+}
+
+void prng_benchmarks(const Settings & settings, std::vector<Result> & results)
+{
+    ExponentialGenerator exponential(1, kSeed);
+    results.push_back(measure("prng/exponential", "prng", 0, [&] {
+        sink = exponential.generate();
+    }, settings));
+
+    UniformGenerator uniform(kSeed);
+    results.push_back(measure("prng/uniform", "prng", 0, [&] {
+        sink = uniform.generate();
+    }, settings));
+
+    BoundedParetoGenerator bounded_pareto(332, 1e10, 1.1, kSeed);
+    results.push_back(measure("prng/bounded_pareto", "prng", 0, [&] {
+        sink = bounded_pareto.generate();
+    }, settings));
+}
+
+void load_balancer_benchmarks(const Settings & settings, std::vector<Result> & results)
+{
+    for (auto target_count : kLoadBalancerTargets) {
+        std::vector<RandomLoadBalancerTarget> targets;
+        for (std::size_t i = 1; i <= target_count; ++i) {
+            targets.push_back({[] (const std::shared_ptr<Customer> & customer) {
+                                   sink = customer->id();
+                               },
+                               i == target_count ? 1.0f : float(i) / target_count});
+        }
+        RandomLoadBalancer load_balancer(targets, UniformGenerator(kSeed));
+        auto customer = make_customer(0, 0);
+
+        results.push_back(measure("load_balancer/route_customer", "load_balancer", target_count, [&] {
+            load_balancer.route_customer(customer);
+        }, settings));
+    }
+}
+
+} // anonymous
+
+std::vector<Result> run_all(const Settings & settings)
+{
+    std::vector<Result> results;
+    timer_benchmarks(settings, results);
+    queue_benchmarks(settings, results);
+    spy_benchmarks(settings, results);
+    prng_benchmarks(settings, results);
+    load_balancer_benchmarks(settings, results);
+    return results;
+}
+
+void write_json(const std::vector<Result> & results, std::ostream & out)
+{
+#ifdef __OPTIMIZE__
+    constexpr bool kOptimized = true;
+#else
+    constexpr bool kOptimized = false;
+#endif
+
+    out << "{" << std::endl;
+    out << "  \"compiler\": \"" << __VERSION__ << "\"," << std::endl;
+    out << "  \"optimized\": " << (kOptimized ? "true" : "false") << "," << std::endl;
+    out << "  \"results\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto & result = results[i];
+        out << (i ? "," : "") << std::endl
+            << "    {\"name\": \"" << result.name << "\""
+            << ", \"component\": \"" << result.component << "\""
+            << ", \"size\": " << result.size
+            << ", \"operations\": " << result.operations
+            << ", \"median_ns\": " << result.median_nanoseconds
+            << ", \"min_ns\": " << result.min_nanoseconds
+            << "}";
+    }
+    out << std::endl << "  ]" << std::endl;
+    out << "}" << std::endl;
+}
+
+void run_microbenchmarks(const std::string & output_path)
+{
+    auto results = run_all();
+
+    if (output_path.empty()) {
+        write_json(results, std::cout);
+        return;
+    }
+
+    std::ofstream file(output_path);
+    if (!file) {
+        throw std::runtime_error("could not open " + output_path);
+    }
+    write_json(results, file);
+    std::cout << "Wrote " << results.size() << " results to " << output_path << std::endl;
+}
+
+} // microbench
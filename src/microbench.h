@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+
+// Microbenchmarks for the simulation's hot paths (timer, queues, spy, PRNGs,
+// load balancer). Each benchmark repeats one operation until a repetition has
+// run for at least min_seconds, takes several repetitions, and reports the
+// median and fastest time per operation. Results are written as JSON so runs
+// from different versions can be diffed.
+
+namespace microbench {
+
+struct Result {
+    std::string name;       // e.g. "timer/hold"
+    std::string component;  // timer, queue, spy, prng, load_balancer
+    std::size_t size;       // event list / queue length / events per customer / targets (0 = n/a)
+    std::uint64_t operations; // per repetition
+    double median_nanoseconds;
+    double min_nanoseconds;
+};
+
+struct Settings {
+    double min_seconds = 0.02;   // per repetition
+    std::size_t repetitions = 5;
+};
+
+// Calls operation() until one repetition takes min_seconds, then times
+// settings.repetitions repetitions of that many calls.
+template <class Operation>
+Result measure(const std::string & name,
+               const std::string & component,
+               std::size_t size,
+               Operation && operation,
+               const Settings & settings = Settings())
+{
+    using clock = std::chrono::steady_clock;
+
+    auto time_operations = [&operation] (std::uint64_t count) {
+        auto start = clock::now();
+        for (std::uint64_t i = 0; i < count; ++i) {
+            operation();
+        }
+        return std::chrono::duration<double>(clock::now() - start).count();
+    };
+
+    std::uint64_t operations = 1;
+    while (time_operations(operations) < settings.min_seconds && operations < (1ull << 40)) {
+        operations *= 2;
+    }
+
+    std::vector<double> nanoseconds;
+    for (std::size_t i = 0; i < std::max<std::size_t>(1, settings.repetitions); ++i) {
+        nanoseconds.push_back(time_operations(operations) * 1e9 / operations);
+    }
+    std::sort(nanoseconds.begin(), nanoseconds.end());
+
+    return Result{name,
+                  component,
+                  size,
+                  operations,
+                  nanoseconds[nanoseconds.size() / 2],
+                  nanoseconds.front()};
+}
+
+std::vector<Result> run_all(const Settings & settings = Settings());
+
+void write_json(const std::vector<Result> & results, std::ostream & out);
+
+// Runs every benchmark and writes the JSON to output_path (stdout when empty)
+void run_microbenchmarks(const std::string & output_path = "");
+
+} // microbench
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <optional>
+#include <exception>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <iterator>
+#include <cmath>
+#include <type_traits>
+
+#include "stats.h"
+#include "simulation_options.h"
+
+// Replications share nothing (each one owns its timer, queues, servers and spy)
+// so instead of synchronizing one model across threads we hand whole runs to
+// worker threads. Run i always uses seed offset i so results match the
+// sequential loop regardless of thread count or scheduling.
+
+struct ParallelRunReport {
+    std::size_t runs = 0;
+    std::size_t threads = 0;
+    double wall_seconds = 0;
+    double busy_seconds = 0; // sum of time each thread spent inside a run
+
+    // how much faster than running the same runs back to back on one thread
+    double speedup() const
+    {
+        return wall_seconds > 0 ? busy_seconds / wall_seconds : 0;
+    }
+
+    // fraction of the available thread time spent doing useful runs
+    double efficiency() const
+    {
+        return threads > 0 ? speedup() / threads : 0;
+    }
+
+    std::string to_string() const
+    {
+        std::stringstream ss;
+        ss << runs << " runs on " << threads << " threads"
+           << ", speedup: " << speedup()
+           << ", efficiency: " << efficiency();
+        return ss.str();
+    }
+};
+
+inline std::size_t default_thread_count()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// do_run(i) is called exactly once for every i in [0, runs) and must only touch
+// state it creates itself. Results come back in run order.
+template <class RunFunction, class Result = std::invoke_result_t<RunFunction, std::size_t>>
+std::vector<Result> run_in_parallel(std::size_t runs,
+                                                const RunFunction & do_run,
+                                                std::size_t threads = default_thread_count(),
+                                                ParallelRunReport * report = nullptr)
+{
+    threads = std::max<std::size_t>(1, std::min(threads, runs));
+
+    std::vector<std::optional<Result>> results(runs);
+    std::atomic<std::size_t> next_run(0);
+    std::atomic<long long> busy_nanoseconds(0);
+    std::exception_ptr first_exception = nullptr;
+    std::mutex exception_mutex;
+
+    auto worker = [&] {
+        while (true) {
+            auto run = next_run++;
+            if (run >= runs) {
+                return;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            try {
+                results[run].emplace(do_run(run));
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(exception_mutex);
+                if (!first_exception) {
+                    first_exception = std::current_exception();
+                }
+                next_run = runs; // stop handing out work
+            }
+            auto stop = std::chrono::steady_clock::now();
+            busy_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    if (threads == 1) {
+        worker(); // don't pay for a thread when there is nothing to overlap
+    } else {
+        std::vector<std::thread> workers;
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers.emplace_back(worker);
+        }
+        for (auto & thread : workers) {
+            thread.join();
+        }
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    if (first_exception) {
+        std::rethrow_exception(first_exception);
+    }
+
+    if (report) {
+        report->runs = runs;
+        report->threads = threads;
+        report->wall_seconds = std::chrono::duration<double>(stop - start).count();
+        report->busy_seconds = busy_nanoseconds / 1e9;
+    }
+
+    std::vector<Result> stats;
+    stats.reserve(runs);
+    for (auto & result : results) {
+        stats.push_back(std::move(*result));
+    }
+    return stats;
+}
+
+// The overall waiting time, CLR and system time (those in the PrecisionMetric
+// mask) of the runs so far all have a 95% half width within relative_precision
+// of their mean
+inline bool meets_relative_precision(std::vector<SimulationRunStats> & stats,
+                                     double relative_precision,
+                                     unsigned metrics = PRECISION_ALL)
+{
+    if (stats.size() < 2) {
+        return false;
+    }
+
+    std::vector<float> waiting_times;
+    std::vector<float> loss_rates;
+    std::vector<float> system_times;
+    for (auto & stat : stats) {
+        waiting_times.push_back(stat.average_waiting_times()
+                                [SimulationRunStats::all_queues()][SimulationRunStats::all_priorities()]);
+        loss_rates.push_back(stat.customer_loss_rates()
+                             [SimulationRunStats::all_queues()][SimulationRunStats::all_priorities()]);
+        system_times.push_back(stat.average_system_time());
+    }
+
+    auto precise = [relative_precision, metrics] (PrecisionMetric metric, const std::vector<float> & items) {
+        return !(metrics & metric)
+            || statistics::confidence_half_width(items) <= relative_precision * std::abs(statistics::sample_mean(items));
+    };
+    return precise(PRECISION_WAITING_TIME, waiting_times)
+        && precise(PRECISION_CLR, loss_rates)
+        && precise(PRECISION_SYSTEM_TIME, system_times);
+}
+
+// Runs waves of replications (run i still uses seed offset i) until
+// meets_relative_precision or max_runs have been done. Each wave adds half the
+// runs so far, since the half width only shrinks with the square root of the runs.
+template <class RunFunction>
+std::vector<SimulationRunStats> run_until_precise(const SimulationOptions & options,
+                                                  const RunFunction & do_run,
+                                                  std::size_t threads = default_thread_count(),
+                                                  ParallelRunReport * report = nullptr,
+                                                  std::size_t min_runs = 10)
+{
+    std::vector<SimulationRunStats> stats;
+    ParallelRunReport total;
+
+    auto wave = std::min(std::max(min_runs, threads), options.max_runs);
+    while (wave > 0) {
+        const auto first_run = stats.size();
+        ParallelRunReport wave_report;
+        auto wave_stats = run_in_parallel(
+            wave,
+            [&do_run, first_run] (std::size_t i) { return do_run(first_run + i); },
+            threads,
+            &wave_report);
+
+        total.runs += wave_report.runs;
+        total.threads = std::max(total.threads, wave_report.threads);
+        total.wall_seconds += wave_report.wall_seconds;
+        total.busy_seconds += wave_report.busy_seconds;
+        std::move(wave_stats.begin(), wave_stats.end(), std::back_inserter(stats));
+
+        if (meets_relative_precision(stats, options.precision, options.precision_metrics)) {
+            break;
+        }
+        wave = std::min(std::max(stats.size() / 2, threads), options.max_runs - stats.size());
+    }
+
+    if (report) {
+        *report = total;
+    }
+    return stats;
+}
+
+// one line saying whether a --precision target was met
+inline std::string precision_string(std::vector<SimulationRunStats> & stats, const SimulationOptions & options)
+{
+    std::stringstream ss;
+    ss << "Precision: ±" << options.precision * 100 << "% on";
+    std::string separator = " ";
+    for (auto [metric, name] : {std::make_pair(PRECISION_WAITING_TIME, "waiting time"),
+                                std::make_pair(PRECISION_CLR, "CLR"),
+                                std::make_pair(PRECISION_SYSTEM_TIME, "system time")}) {
+        if (options.precision_metrics & metric) {
+            ss << separator << name;
+            separator = ", ";
+        }
+    }
+    if (meets_relative_precision(stats, options.precision, options.precision_metrics)) {
+        ss << " reached after " << stats.size() << " runs";
+    } else {
+        ss << " NOT reached, stopped at the " << stats.size() << " run budget";
+    }
+    return ss.str();
+}
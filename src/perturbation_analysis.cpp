@@ -0,0 +1,51 @@
+#include "perturbation_analysis.h"
+
+#include <sstream>
+
+namespace statistics {
+
+std::string Sensitivities::to_string(const std::string & indent) const
+{
+    std::stringstream ss;
+    ss << indent << "d Waiting Time / d lambda: " << waiting_time_by_arrival_rate << std::endl
+       << indent << "d Waiting Time / d mu: " << waiting_time_by_service_rate << std::endl
+       << indent << "d System Time / d lambda: " << system_time_by_arrival_rate << std::endl
+       << indent << "d System Time / d mu: " << system_time_by_service_rate << std::endl;
+    return ss.str();
+}
+
+void PerturbationAnalysis::on_serviced(double arrival_time, double waiting_time, double service_time)
+{
+    // this arrival moves -gap / λ further than the last one
+    const double gap = arrival_time - last_arrival_time_;
+    last_arrival_time_ = arrival_time;
+    const double service_by_service_rate = -service_time / service_rate_;
+
+    // the start moves with the arrival, or with the previous departure if the customer waited
+    const bool waited = waiting_time > 0;
+    const double start_lead_by_arrival_rate = waited ? departure_lead_by_arrival_rate_ + gap / arrival_rate_ : 0;
+    const double start_by_service_rate = waited ? departure_by_service_rate_ : 0;
+
+    departure_lead_by_arrival_rate_ = start_lead_by_arrival_rate;
+    departure_by_service_rate_ = start_by_service_rate + service_by_service_rate;
+
+    sums_.waiting_time_by_arrival_rate += start_lead_by_arrival_rate;
+    sums_.waiting_time_by_service_rate += start_by_service_rate;
+    sums_.system_time_by_arrival_rate += departure_lead_by_arrival_rate_;
+    sums_.system_time_by_service_rate += departure_by_service_rate_;
+    ++sums_.customers;
+}
+
+Sensitivities PerturbationAnalysis::sensitivities() const
+{
+    auto averages = sums_;
+    if (averages.customers > 0) {
+        averages.waiting_time_by_arrival_rate /= averages.customers;
+        averages.waiting_time_by_service_rate /= averages.customers;
+        averages.system_time_by_arrival_rate /= averages.customers;
+        averages.system_time_by_service_rate /= averages.customers;
+    }
+    return averages;
+}
+
+} // statistics
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Infinitesimal perturbation analysis (IPA) for a FCFS single server queue.
+//
+// Inter-arrival and service times are drawn by inversion, A = -ln(u) / λ and
+// S = -ln(u) / μ, so nudging a rate scales every draw: an arrival epoch t
+// moves by -t / λ per unit of λ and a service time by -S / μ per unit of μ.
+// A customer who found the server idle starts when it arrives, anyone else
+// when the customer before them departs, so those nudges flow along each busy
+// period and stop at its end. Averaging the moved waiting and system times
+// over one run gives the derivatives of their means without a second run.
+//
+// Only differences of arrival moves matter, so they are kept relative to the
+// latest arrival and built in double from the gaps between arrivals, rather
+// than from -t / λ of the float arrival times, which loses precision as the
+// clock grows.
+//
+// Losses are ignored: a small change of rate only moves them, it doesn't add
+// or remove them (which is true with probability one), so the estimate is
+// good while losses are rare.
+
+namespace statistics {
+
+struct Sensitivities {
+    double waiting_time_by_arrival_rate = 0; // d mean waiting time / d λ
+    double waiting_time_by_service_rate = 0; // d mean waiting time / d μ
+    double system_time_by_arrival_rate = 0;
+    double system_time_by_service_rate = 0;
+    std::size_t customers = 0;
+
+    std::string to_string(const std::string & indent = "    ") const;
+};
+
+class PerturbationAnalysis {
+public:
+    PerturbationAnalysis(double arrival_rate, double service_rate)
+    : arrival_rate_(arrival_rate)
+    , service_rate_(service_rate)
+    {}
+
+    // serviced customers in the order they departed
+    void on_serviced(double arrival_time, double waiting_time, double service_time);
+
+    // restarts the averages (e.g. after the transient period), the busy period carries on
+    void clear()
+    {
+        sums_ = {};
+    }
+
+    Sensitivities sensitivities() const;
+
+private:
+    double arrival_rate_;
+    double service_rate_;
+
+    double last_arrival_time_ = 0;
+
+    // d(last departure time) / d λ less d(last arrival time) / d λ, and d(last departure time) / d μ
+    double departure_lead_by_arrival_rate_ = 0;
+    double departure_by_service_rate_ = 0;
+
+    Sensitivities sums_;
+};
+
+} // statistics
@@ -8,10 +8,11 @@ class UniformPriorityGenerator {
 public:
     UniformPriorityGenerator(std::uint32_t min,
                              std::uint32_t max,
-                             long seed)
+                             long seed,
+                             bool antithetic = false)
     : min_(min)
     , max_(max)
-    , generator_(UniformGenerator(seed))
+    , generator_(UniformGenerator(seed, antithetic))
     {
     }
 
@@ -1,5 +1,7 @@
 #include <math.h>
 #include "prng.h"
+#include "allocation_counter.h"
+#include "probe.h"
 
 // ------------------- CODE FROM LECTURE MATERIAL -----------
 #define IA 16807
@@ -34,17 +36,85 @@ while (dummy == 0.0);
 // TODO: these don't have to be classes, they could just be functions that return lambdas
 float ExponentialGenerator::generate() const
 {
+   probe::ScopedProbe scoped_probe(probe::Probe::GENERATOR);
+   allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::PRNG);
+   if (rate_profile_) {
+      return modulated_gap();
+   }
+   if (antithetic_) {
+      // skip the same zero draws expdev does so both runs stay in step
+      float uniform;
+      do
+         uniform = ran0(&seed_);
+      while (uniform == 0.0);
+      return -one_over_lambda_*log(1 - uniform);
+   }
+   if (likelihood_ratio_ && likelihood_ratio_->tilted) {
+      const float draw = tilted_one_over_lambda_*expdev(&seed_);
+      likelihood_ratio_->value *= double(tilted_one_over_lambda_)/one_over_lambda_
+                                  * exp((1.0/tilted_one_over_lambda_ - 1.0/one_over_lambda_)*draw);
+      return draw;
+   }
    // will modify seed
    return one_over_lambda_*expdev(&seed_);
 }
 
+// an Exp(1) draw
+float ExponentialGenerator::unit_draw() const
+{
+   if (!antithetic_) {
+      return expdev(&seed_);
+   }
+   float uniform;
+   do
+      uniform = ran0(&seed_);
+   while (uniform == 0.0);
+   return -log(1 - uniform);
+}
+
+// Lewis-Shedler thinning, one piece of the profile at a time. A candidate
+// past the end of its piece is dropped and drawing restarts at the end under
+// the next piece's bound, which memorylessness makes the same process.
+float ExponentialGenerator::modulated_gap() const
+{
+   const auto & profile = *rate_profile_;
+   auto time = modulated_time_;
+   auto piece = profile.piece(time);
+   while (true) {
+      if (piece.bound > 0) {
+         time += one_over_lambda_*unit_draw()/piece.bound;
+         if (time < piece.end) {
+            if (profile.exact_bounds()) {
+               break;
+            }
+            auto uniform = ran0(&seed_);
+            if ((antithetic_ ? 1 - uniform : uniform)*piece.bound <= profile.rate(time)) {
+               break;
+            }
+            continue;
+         }
+      }
+      time = piece.end;
+      piece = profile.next(piece);
+   }
+
+   const auto gap = float(time - modulated_time_);
+   modulated_time_ = time;
+   return gap;
+}
+
 float UniformGenerator::generate() const
 {
-   return ran0(&seed_);
+   probe::ScopedProbe scoped_probe(probe::Probe::GENERATOR);
+   allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::PRNG);
+   auto uniform = ran0(&seed_);
+   return antithetic_ ? 1 - uniform : uniform;
 }
 
 double BoundedParetoGenerator::generate() const
 {
+   probe::ScopedProbe scoped_probe(probe::Probe::GENERATOR);
+   allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::PRNG);
    // compute using inverse of CDF and uniform var
    double uniform;
 
@@ -59,8 +129,38 @@ double BoundedParetoGenerator::generate() const
 
 double BoundedParetoGenerator::percentile_to_value(double percentile) const
 {
-   double base = (h_to_the_alpha_ - l_to_the_alpha_plus_h_to_the_alpha_*percentile)
+   double base = (h_to_the_alpha_ - h_to_the_alpha_minus_l_to_the_alpha_*percentile)
                  / l_to_the_alpha_times_h_to_the_alpha_;
 
    return pow(base, negative_one_over_alpha_);
 }
+
+double BoundedParetoGenerator::mean() const
+{
+   const double alpha = -1.0/negative_one_over_alpha_;
+   const double lower_bound = pow(l_to_the_alpha_, 1/alpha);
+   const double upper_bound = pow(h_to_the_alpha_, 1/alpha);
+   if (alpha == 1) {
+      return lower_bound*upper_bound/(upper_bound - lower_bound)*log(upper_bound/lower_bound);
+   }
+
+   return l_to_the_alpha_/(1 - l_to_the_alpha_/h_to_the_alpha_)
+          * alpha/(alpha - 1)
+          * (pow(lower_bound, 1 - alpha) - pow(upper_bound, 1 - alpha));
+}
+
+double BoundedParetoGenerator::second_moment() const
+{
+   const double alpha = -1.0/negative_one_over_alpha_;
+   const double lower_bound = pow(l_to_the_alpha_, 1/alpha);
+   const double upper_bound = pow(h_to_the_alpha_, 1/alpha);
+   if (alpha == 2) {
+      return l_to_the_alpha_/(1 - l_to_the_alpha_/h_to_the_alpha_)
+             * alpha
+             * log(upper_bound/lower_bound);
+   }
+
+   return l_to_the_alpha_/(1 - l_to_the_alpha_/h_to_the_alpha_)
+          * alpha/(alpha - 2)
+          * (pow(lower_bound, 2 - alpha) - pow(upper_bound, 2 - alpha));
+}
@@ -1,33 +1,87 @@
 #include <math.h>
 #pragma once
 
+#include "rate_profile.h"
+
+// An antithetic generator turns every uniform u it draws into 1 - u, so a run
+// using it is negatively correlated with the run using the same seed without it
 template <class T>
 class RandomNumberGenerator {
 public:
-    RandomNumberGenerator(long seed = 0)
+    RandomNumberGenerator(long seed = 0, bool antithetic = false)
     : seed_(seed)
+    , antithetic_(antithetic)
     {}
     virtual T generate() const = 0;
+
+    // where the stream is, to put the generator back and redraw the same
+    // numbers after a Time Warp rollback (modulate's clock isn't included)
+    long state() const
+    {
+        return seed_;
+    }
+
+    void restore(long state) const
+    {
+        seed_ = state;
+    }
 protected:
     mutable long seed_;
+    bool antithetic_;
+};
+
+// Importance sampling state shared by the generators of one run. While tilted
+// is set, tilted generators draw from their tilted rate and multiply value by
+// the draw's density ratio f(x; rate) / f(x; tilted rate), so an outcome
+// weighted by value estimates its probability under the real rates.
+struct LikelihoodRatio {
+    bool tilted = false;
+    double value = 1;
 };
 
 class ExponentialGenerator : public RandomNumberGenerator<float> {
 public:
-    ExponentialGenerator(float lambda, long seed = 0)
-    : RandomNumberGenerator(seed)
+    ExponentialGenerator(float lambda, long seed = 0, bool antithetic = false)
+    : RandomNumberGenerator(seed, antithetic)
     , one_over_lambda_(1/lambda)
     {}
 
     float generate() const override;
+
+    float mean() const
+    {
+        return one_over_lambda_;
+    }
+
+    // draw at tilted_lambda whenever likelihood_ratio.tilted is set (copies share likelihood_ratio)
+    void tilt(float tilted_lambda, LikelihoodRatio & likelihood_ratio)
+    {
+        tilted_one_over_lambda_ = 1/tilted_lambda;
+        likelihood_ratio_ = &likelihood_ratio;
+    }
+
+    // Draw the gaps between arrivals of a Poisson process whose rate is λ
+    // times rate_profile's, by thinning, counting time from 0 at the first
+    // draw (copies share rate_profile, it must outlive them). Not with tilt.
+    void modulate(const RateProfile & rate_profile)
+    {
+        rate_profile_ = &rate_profile;
+    }
 private:
+    float unit_draw() const;
+    float modulated_gap() const;
+
     float one_over_lambda_;
+    float tilted_one_over_lambda_ = 0;
+    LikelihoodRatio * likelihood_ratio_ = nullptr;
+    const RateProfile * rate_profile_ = nullptr;
+    mutable double modulated_time_ = 0; // of the last arrival drawn
 };
 
 class UniformGenerator : public RandomNumberGenerator<float> {
 public:
-    UniformGenerator(long seed = 0)
-    : RandomNumberGenerator(seed)
+    UniformGenerator(long seed = 0, bool antithetic = false)
+    : RandomNumberGenerator(seed, antithetic)
     {}
 
     float generate() const override;
@@ -43,16 +97,18 @@ public:
     , h_to_the_alpha_(pow(upper_bound, alpha))
     , l_to_the_alpha_(pow(lower_bound, alpha))
     , l_to_the_alpha_times_h_to_the_alpha_(h_to_the_alpha_*l_to_the_alpha_)
-    , l_to_the_alpha_plus_h_to_the_alpha_(h_to_the_alpha_+l_to_the_alpha_)
+    , h_to_the_alpha_minus_l_to_the_alpha_(h_to_the_alpha_-l_to_the_alpha_)
     , negative_one_over_alpha_(-1.0/alpha)
     {}
 
     double generate() const override;
     double percentile_to_value(double percentile) const;
+    double mean() const;
+    double second_moment() const;
 private:
     double h_to_the_alpha_;
     double l_to_the_alpha_;
     double l_to_the_alpha_times_h_to_the_alpha_;
-    double l_to_the_alpha_plus_h_to_the_alpha_;
+    double h_to_the_alpha_minus_l_to_the_alpha_;
     double negative_one_over_alpha_;
 };
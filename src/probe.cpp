@@ -0,0 +1,105 @@
+#include "probe.h"
+
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace probe {
+
+namespace {
+
+thread_local Histograms histograms = {};
+thread_local std::uint64_t child_cycles = 0;
+
+} // anonymous
+
+std::string to_string(Probe probe)
+{
+    switch (probe) {
+    case Probe::ADVANCE_TIME:
+        return "advance_time";
+    case Probe::QUEUE_ACCEPT:
+        return "accept_customer";
+    case Probe::QUEUE_HANDLE_REQUESTS:
+        return "handle_requests";
+    case Probe::SERVER_ENTERED:
+        return "server_entered";
+    case Probe::SPY_EXITING:
+        return "spy_exiting";
+    case Probe::GENERATOR:
+        return "generators";
+    case Probe::COUNT:
+        break;
+    }
+    throw std::invalid_argument("Unknown Probe");
+}
+
+std::uint64_t Histogram::percentile(double fraction) const
+{
+    std::uint64_t in_buckets = 0;
+    for (auto count : buckets) {
+        in_buckets += count;
+    }
+
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+        seen += buckets[i];
+        if (seen > 0 && seen >= fraction * in_buckets) {
+            return i ? (std::uint64_t(1) << i) - 1 : 0;
+        }
+    }
+    return 0;
+}
+
+Histograms & thread_histograms()
+{
+    return histograms;
+}
+
+std::uint64_t & thread_child_cycles()
+{
+    return child_cycles;
+}
+
+std::string ProbeReport::to_string(std::uint64_t customers) const
+{
+    Histograms run = thread_histograms();
+    std::uint64_t total_self_cycles = 0;
+    for (std::size_t i = 0; i < kProbeCount; ++i) {
+        run[i].calls -= start_[i].calls;
+        run[i].self_cycles -= start_[i].self_cycles;
+        run[i].inclusive_cycles -= start_[i].inclusive_cycles;
+        for (std::size_t bucket = 0; bucket < kBuckets; ++bucket) {
+            run[i].buckets[bucket] -= start_[i].buckets[bucket];
+        }
+        total_self_cycles += run[i].self_cycles;
+    }
+
+    const double per_customer = customers ? 1.0 / customers : 0;
+    std::stringstream ss;
+    ss << "Cycles per customer (" << customers << " customers):" << std::endl;
+    ss << std::left << std::setw(18) << "probe"
+       << std::right << std::setw(12) << "calls"
+       << std::setw(12) << "self"
+       << std::setw(12) << "inclusive"
+       << std::setw(8) << "share"
+       << std::setw(12) << "p50 call"
+       << std::setw(12) << "p99 call" << std::endl;
+    ss << std::fixed << std::setprecision(1);
+    for (std::size_t i = 0; i < kProbeCount; ++i) {
+        const auto & histogram = run[i];
+        ss << std::left << std::setw(18) << probe::to_string(Probe(i))
+           << std::right << std::setw(12) << histogram.calls * per_customer
+           << std::setw(12) << histogram.self_cycles * per_customer
+           << std::setw(12) << histogram.inclusive_cycles * per_customer
+           << std::setw(7) << (total_self_cycles ? 100.0 * histogram.self_cycles / total_self_cycles : 0) << "%"
+           << std::setw(12) << histogram.percentile(.5)
+           << std::setw(12) << histogram.percentile(.99) << std::endl;
+    }
+    ss << std::left << std::setw(18) << "TOTAL"
+       << std::right << std::setw(12) << ""
+       << std::setw(12) << total_self_cycles * per_customer << std::endl;
+    return ss.str();
+}
+
+} // probe
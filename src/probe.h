@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+#include "constants.h"
+
+// Scoped cycle counters for the hot paths.
+//
+// With constants::PROBES_ENABLED on, a ScopedProbe reads the time stamp counter
+// on entry and exit and adds the cycles to a per thread histogram for its
+// probe. Nested probes are subtracted from their parent, so each probe's "self"
+// cycles are only the work done in that function, and the self columns add up
+// to the time spent under the outermost probe (advance_time). Every run prints
+// the breakdown per simulated customer next to its results. With the flag off,
+// ScopedProbe compiles to nothing.
+
+namespace probe {
+
+enum class Probe : std::uint8_t {
+    ADVANCE_TIME,
+    QUEUE_ACCEPT,
+    QUEUE_HANDLE_REQUESTS,
+    SERVER_ENTERED,
+    SPY_EXITING,
+    GENERATOR,
+    COUNT
+};
+
+constexpr std::size_t kProbeCount = std::size_t(Probe::COUNT);
+constexpr std::size_t kBuckets = 64; // bucket i holds self cycle counts in [2^(i-1), 2^i)
+
+std::string to_string(Probe probe);
+
+struct Histogram {
+    std::uint64_t calls = 0;
+    std::uint64_t self_cycles = 0;
+    std::uint64_t inclusive_cycles = 0;
+    std::array<std::uint64_t, kBuckets> buckets = {};
+
+    void add(std::uint64_t self, std::uint64_t inclusive)
+    {
+        ++calls;
+        self_cycles += self;
+        inclusive_cycles += inclusive;
+        std::size_t bucket = self ? 64 - __builtin_clzll(self) : 0;
+        ++buckets[bucket < kBuckets ? bucket : kBuckets - 1];
+    }
+
+    // upper bound of the bucket holding the given fraction of calls
+    std::uint64_t percentile(double fraction) const;
+};
+
+using Histograms = std::array<Histogram, kProbeCount>;
+
+inline std::uint64_t cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// the calling thread's histograms (all zero unless PROBES_ENABLED)
+Histograms & thread_histograms();
+
+// cycles spent in probes nested inside the innermost open probe on this thread
+std::uint64_t & thread_child_cycles();
+
+class ScopedProbe {
+public:
+    explicit ScopedProbe(Probe probe)
+    {
+        if constexpr (constants::PROBES_ENABLED) {
+            probe_ = probe;
+            auto & child_cycles = thread_child_cycles();
+            parent_child_cycles_ = child_cycles;
+            child_cycles = 0;
+            start_ = cycles();
+        }
+    }
+
+    ~ScopedProbe()
+    {
+        if constexpr (constants::PROBES_ENABLED) {
+            auto inclusive = cycles() - start_;
+            auto & child_cycles = thread_child_cycles();
+            auto self = inclusive > child_cycles ? inclusive - child_cycles : 0;
+            thread_histograms()[std::size_t(probe_)].add(self, inclusive);
+            child_cycles = parent_child_cycles_ + inclusive;
+        }
+    }
+
+    ScopedProbe(const ScopedProbe &) = delete;
+    ScopedProbe & operator=(const ScopedProbe &) = delete;
+
+private:
+    Probe probe_ = Probe::ADVANCE_TIME;
+    std::uint64_t start_ = 0;
+    std::uint64_t parent_child_cycles_ = 0;
+};
+
+// Snapshot of this thread's histograms, so a run can report only its own cycles
+class ProbeReport {
+public:
+    ProbeReport()
+    : start_(thread_histograms())
+    {}
+
+    // per probe calls and cycles per customer, plus self cycle percentiles, since construction
+    std::string to_string(std::uint64_t customers) const;
+
+private:
+    Histograms start_;
+};
+
+} // probe
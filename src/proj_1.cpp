@@ -8,43 +8,81 @@
 #include "incoming_customers.h"
 #include "queue.h"
 #include "server.h"
+#include "trace.h"
+#include "allocation_counter.h"
+#include "probe.h"
+#include "log.h"
+#include "analytic.h"
 
 void run_project_1(const float lambda,
                    const std::size_t max_queue_customers,
                    const std::size_t customers_to_serve,
-                   const std::size_t L)
+                   const std::size_t L,
+                   const SimulationOptions & options)
 {
-    if (constants::DEBUG_ENABLED) {
-        std::cout << __func__
-                  << " lambda: " << lambda
-                  << ", max queue customers: " << max_queue_customers
-                  << ", customers_to_serve: " << customers_to_serve
-                  << ", L" << L << std::endl;
-    }
+    logging::log<logging::Level::INFO, logging::Component::PROJECT>(
+        "run_project_1 lambda: {}, max queue customers: {}, customers_to_serve: {}, L: {}",
+        lambda, max_queue_customers, customers_to_serve, L);
 
     // set up simulation
     constexpr float kMu = 1.0;
     constexpr long kServiceSeed = 1234 + constants::SEED_OFFSET;
     constexpr long kArrivalSeed = 4321 + constants::SEED_OFFSET;
 
+    if (options.analytic != Analytic::OFF) {
+        if (constants::PRINT_STATS) {
+            std::cout << "Analytic M/M/1/" << max_queue_customers + 1 << " (exact):" << std::endl
+                      << analytic::mm1k(lambda, kMu, max_queue_customers + 1).to_string();
+        }
+        if (options.analytic == Analytic::ONLY) {
+            return;
+        }
+    }
+
     SimulationTimer timer;
 
     const std::string kQueueName = "Queue";
     auto spy = SimulationSpy(L, max_queue_customers + 1, {kQueueName});
 
+    auto trace_writer = attach_trace_writer(options.trace_path, timer, spy);
+
+    if (options.regenerative) {
+        spy.enable_regenerative_cycles();
+    }
+
+    if (options.perturbation_analysis) {
+        spy.enable_perturbation_analysis(lambda, kMu);
+    }
+
     auto exit_customer = [&spy] (const std::shared_ptr<Customer> & customer) {
         spy.on_customer_exiting(customer);
     };
 
-    auto incoming_customers = IncomingCustomers(timer,
-                                                ExponentialGenerator(lambda, kArrivalSeed));
+    auto arrival_generator = ExponentialGenerator(lambda, kArrivalSeed);
+    auto service_generator = ExponentialGenerator(kMu, kServiceSeed);
+    LikelihoodRatio likelihood_ratio;
+    if (options.importance_sampling > 0) {
+        const auto tilt = options.importance_sampling;
+        arrival_generator.tilt(lambda + tilt * (kMu - lambda), likelihood_ratio);
+        service_generator.tilt(kMu + tilt * (lambda - kMu), likelihood_ratio);
+        spy.enable_importance_sampling(likelihood_ratio);
+    }
 
+    auto incoming_customers = IncomingCustomers(timer, arrival_generator);
+
+
+    // Importance sampling draws each service time when the service starts, so
+    // a tilted cycle leaves no tilted draws waiting in the queue once it overflows
+    std::function<float()> generate_service_time = nullptr;
+    if (options.importance_sampling == 0) {
+        generate_service_time = [gen = service_generator] {
+            return gen.generate();
+        };
+    }
 
     auto queue = Queue(max_queue_customers,
                        exit_customer,
-                       [gen = ExponentialGenerator(kMu, kServiceSeed)] {
-                            return gen.generate();
-                       },
+                       generate_service_time,
                        [&timer]{ return timer.time(); },
                        queueing::Discipline::FCFS,
                        kQueueName);
@@ -61,9 +99,17 @@ void run_project_1(const float lambda,
     incoming_customers.register_for_customers(insert_into_spy); // MUST REGISTER FIRST
     incoming_customers.register_for_customers(insert_into_queue);
 
-    auto request_from_queue = [&queue] (const CustomerRequest & request) {
+    CustomerRequestHandler request_from_queue = [&queue] (const CustomerRequest & request) {
         queue.request_one_customer(request);
     };
+    if (options.importance_sampling > 0) {
+        request_from_queue = [&queue, &service_generator] (const CustomerRequest & request) {
+            queue.request_one_customer([&service_generator, request] (const std::shared_ptr<Customer> & customer) {
+                customer->set_service_time(service_generator.generate());
+                request(customer);
+            });
+        };
+    }
 
     auto server = Server(timer, request_from_queue, exit_customer);
 
@@ -71,15 +117,47 @@ void run_project_1(const float lambda,
     server.start();
     incoming_customers.start();
 
+    allocation_counter::AllocationReport allocation_report;
+    probe::ProbeReport probe_report;
     while (spy.total_serviced_customers() < customers_to_serve) {
         timer.advance_time();
     }
 
+    // finished here rather than by its destructor, which can't report a failure
+    if (trace_writer) {
+        trace_writer->close();
+    }
+
+    if (options.counters) {
+        options.counters->add_run(timer.dispatched_jobs(), timer.dispatched_arrivals());
+    }
+
+    if constexpr (constants::ALLOCATION_ACCOUNTING) {
+        std::cout << allocation_report.to_string(timer.dispatched_arrivals());
+    }
+
+    if constexpr (constants::PROBES_ENABLED) {
+        std::cout << probe_report.to_string(timer.dispatched_arrivals());
+    }
+
     if (constants::PRINT_STATS) {
         std::cout << "Lambda: " << lambda << std::endl;
         std::cout << "K: " << max_queue_customers << std::endl;
         std::cout << "C: " << customers_to_serve << std::endl;
         std::cout << "Master Clock Value: " << timer.time() << std::endl;
-        spy.print_proj1_stats();
+        if (options.importance_sampling > 0) {
+            // the plain statistics would mix in the tilted cycles
+            std::cout << "Importance sampling, tilt " << options.importance_sampling << ":" << std::endl
+                      << spy.importance_sampling_estimate().to_string();
+        } else {
+            spy.print_proj1_stats();
+        }
+        if (options.perturbation_analysis) {
+            std::cout << "IPA Sensitivities:" << std::endl << spy.sensitivities().to_string();
+        }
+        if (options.regenerative) {
+            std::cout << "Regenerative cycles:" << std::endl
+                      << statistics::regenerative_report(spy.regenerative_cycles());
+        }
     }
 }
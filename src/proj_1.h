@@ -3,7 +3,10 @@
 #include <cstdint>
 #include <cstddef>
 
+#include "simulation_options.h"
+
 void run_project_1(float lambda,
                    std::size_t max_queue_customers,
                    std::size_t customers_to_serve,
-                   std::size_t L);
+                   std::size_t L,
+                   const SimulationOptions & options = {});
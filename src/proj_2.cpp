@@ -1,5 +1,8 @@
 #include "proj_2.h"
 
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
 #include <iostream>
 #include <map>
 
@@ -7,12 +10,30 @@
 #include "simulation_spy.h"
 #include "prng.h"
 #include "incoming_customers.h"
+#include "thinking_customers.h"
+#include "logged_customers.h"
 #include "queue.h"
 #include "server.h"
+#include "trace.h"
+#include "allocation_counter.h"
+#include "probe.h"
 #include "random_load_balancer.h"
+#include "parallel_runs.h"
+#include "splitting.h"
+#include "analytic.h"
+#include "time_warp.h"
 
 namespace {
 
+// service rates, shared by the event driven models and their Markov chains for splitting
+constexpr float kMm1Mu = 1.0;
+constexpr float kCpuMu = 1.0;
+constexpr float kIoMu = .5;
+constexpr double kIoQueueProbability = .1; // each IO queue's share of CPU departures
+
+// how far past GVT the Time Warp processes may run, in mean inter-arrival times
+constexpr float kTimeWarpWindowArrivals = 8;
+
 queueing::Discipline to_discipline(project2::Discipline discipline)
 {
     switch (discipline) {
@@ -27,6 +48,125 @@ queueing::Discipline to_discipline(project2::Discipline discipline)
     case project2::Discipline::PRIO_P:
         return queueing::Discipline::PRIO_P;
     }
+    throw std::invalid_argument("Unknown Discipline");
+}
+
+std::string to_string(project2::Discipline discipline)
+{
+    switch (discipline) {
+    case project2::Discipline::FCFS:
+        return "FCFS";
+    case project2::Discipline::LCFS_NP:
+        return "LCFS_NP";
+    case project2::Discipline::SJF_NP:
+        return "SJF_NP";
+    case project2::Discipline::PRIO_NP:
+        return "PRIO_NP";
+    case project2::Discipline::PRIO_P:
+        return "PRIO_P";
+    }
+    throw std::invalid_argument("Unknown Discipline");
+}
+
+// The same network as do_m_m_1_k (FCFS, LCFS_NP and SJF_NP lose the same
+// customers) or do_web_server, as a Markov chain splitting can copy
+splitting::Network markov_network(float lambda,
+                                  std::size_t max_cpu_queue_customers,
+                                  std::size_t max_io_queue_customers,
+                                  project2::Mode mode)
+{
+    switch (mode) {
+    case project2::Mode::MM1:
+        return {lambda, {{kMm1Mu, std::uint32_t(max_cpu_queue_customers), {}}}};
+    case project2::Mode::CPU:
+    {
+        const splitting::Station io_station{kIoMu, std::uint32_t(max_io_queue_customers), {1}};
+        return {lambda,
+                {{kCpuMu, std::uint32_t(max_cpu_queue_customers), {0, kIoQueueProbability, kIoQueueProbability, kIoQueueProbability}},
+                 io_station,
+                 io_station,
+                 io_station}};
+    }
+    }
+    throw std::invalid_argument("Unknown Mode");
+}
+
+std::vector<std::string> markov_station_names(project2::Mode mode)
+{
+    switch (mode) {
+    case project2::Mode::MM1:
+        return {"Queue"};
+    case project2::Mode::CPU:
+        return {"CPU_QUEUE", "IO_QUEUE1", "IO_QUEUE2", "IO_QUEUE3"};
+    }
+    throw std::invalid_argument("Unknown Mode");
+}
+
+// The MM1 model's closed form (FCFS and LCFS_NP share it), the CPU model's
+// open Jackson network or, with a population, its closed network by MVA,
+// per station and overall
+void print_analytic(float lambda,
+                    std::size_t max_cpu_queue_customers,
+                    std::size_t max_io_queue_customers,
+                    project2::Mode mode,
+                    std::size_t population)
+{
+    const auto network = markov_network(lambda, max_cpu_queue_customers, max_io_queue_customers, mode);
+    if (mode == project2::Mode::MM1) {
+        const auto metrics = analytic::mm1k(lambda, kMm1Mu, max_cpu_queue_customers + 1);
+        std::cout << "Analytic (exact):" << std::endl
+                  << metrics.to_string()
+                  << "    Throughput: " << lambda * (1 - metrics.loss_probability) << std::endl;
+        return;
+    }
+
+    analytic::NetworkMetrics solution;
+    try {
+        solution = population ? analytic::mva(network, population) : analytic::jackson(network);
+    } catch (std::invalid_argument &) {
+        std::cout << "Analytic: none, without its buffers a station has rho >= 1" << std::endl;
+        return;
+    }
+    const auto names = markov_station_names(mode);
+    std::cout << "Analytic (" << (solution.overall.exact ? "exact" : "approximate")
+              << (population ? "" : ", unlimited buffers") << "):" << std::endl;
+    for (std::size_t station = 0; station < names.size(); ++station) {
+        std::cout << names[station] << ", offered " << solution.arrival_rates[station] << " per unit time:" << std::endl
+                  << solution.stations[station].to_string();
+    }
+    std::cout << "Overall:" << std::endl;
+    std::cout << solution.overall.to_string();
+    std::cout << "    Throughput: " << solution.throughput << std::endl;
+}
+
+// One buffer configuration's replications, added until its targets are decided
+struct Candidate {
+    std::size_t max_cpu_queue_customers;
+    std::size_t max_io_queue_customers;
+    std::vector<float> loss_rates; // overall, per run
+    std::vector<float> waiting_times; // overall, per run
+    bool meets_targets = false;
+};
+
+// -1 if the interval is entirely below target, 1 if entirely above, 0 if it straddles it
+int side_of_target(const std::vector<float> & per_run, double target)
+{
+    const auto mean = statistics::sample_mean(per_run);
+    const auto half_width = statistics::confidence_half_width(per_run);
+    if (mean + half_width < target) {
+        return -1;
+    }
+    return mean - half_width > target ? 1 : 0;
+}
+
+// Poisson arrivals at lambda, or at lambda times options.rate_profile's rate when there is one
+ExponentialGenerator make_arrival_generator(float lambda, long seed, const SimulationOptions & options)
+{
+    auto generator = ExponentialGenerator(lambda, seed, options.antithetic_draws);
+    if (options.rate_profile) {
+        generator.modulate(*options.rate_profile);
+    }
+    return generator;
 }
 
 } // annonymous
@@ -34,30 +174,180 @@ queueing::Discipline to_discipline(project2::Discipline discipline)
 
 namespace project2 {
 
-void run_project_2(float lambda,
+std::size_t run_project_2(float lambda,
                    std::size_t max_cpu_queue_customers,
                    std::size_t max_io_queue_customers,
                    std::size_t customers_to_serve,
                    Mode mode,
                    Discipline discipline,
-                   const int runs)
+                   const int runs,
+                   std::size_t threads,
+                   const SimulationOptions & options)
 {
-    std::map<std::string, std::map<std::uint32_t, std::vector<float>>> customer_loss_rates;
-    std::map<std::string, std::map<std::uint32_t, std::vector<float>>> average_waiting_times;
-    std::vector<float> system_times;
-    for (auto i = 0; i < runs; ++i) {
+    if (options.analytic != Analytic::OFF) {
         if (constants::PRINT_STATS) {
-            std::cout << std::endl << "STARTING RUN: " << i << std::endl;
+            print_analytic(lambda, max_cpu_queue_customers, max_io_queue_customers, mode, options.population);
         }
+        if (options.analytic == Analytic::ONLY) {
+            return 0;
+        }
+    }
 
+    if (options.batch_means) {
+        // one long run warms up once, the batches stand in for replications
         auto stat = do_one_run(lambda,
                                max_cpu_queue_customers,
                                max_io_queue_customers,
                                customers_to_serve,
                                mode,
                                discipline,
-                               i*constants::SEED_OFFSET);
+                               0,
+                               options);
+        if (constants::PRINT_STATS) {
+            std::cout << "Batch Means of one run of " << customers_to_serve << " customers:" << std::endl
+                      << statistics::batch_means_report(stat.batch_means());
+            if (options.mser_warm_up) {
+                std::cout << "Warm-up (MSER-5): " << stat.warm_up_customers() << " customers dropped" << std::endl;
+            }
+        }
+        return 1;
+    }
+
+    if (options.regenerative) {
+        // every run starts empty, so the cycles of all of them are independent and pool together
+        const auto run_customers = std::max<std::size_t>(1, customers_to_serve / options.regenerative);
+        ParallelRunReport report;
+        auto stats = run_in_parallel(options.regenerative,
+                                     [=] (std::size_t i) {
+                                         return do_one_run(lambda,
+                                                           max_cpu_queue_customers,
+                                                           max_io_queue_customers,
+                                                           run_customers,
+                                                           mode,
+                                                           discipline,
+                                                           long(i)*constants::SEED_OFFSET,
+                                                           run_options(options, i));
+                                     },
+                                     threads,
+                                     &report);
+
+        std::vector<statistics::RegenerativeCycle> cycles;
+        for (auto & stat : stats) {
+            cycles.insert(cycles.end(), stat.regenerative_cycles().begin(), stat.regenerative_cycles().end());
+        }
+
+        if (constants::PRINT_STATS) {
+            std::cout << "Regenerative cycles of " << stats.size() << " runs of " << run_customers << " customers:" << std::endl
+                      << statistics::regenerative_report(cycles);
+            std::cout << "Parallel Runs: " << report.to_string() << std::endl;
+        }
+        return stats.size();
+    }
+
+    if (options.restart) {
+        // CLR only, from the Markov chain of the model split at every CPU queue occupancy
+        const auto network = markov_network(lambda, max_cpu_queue_customers, max_io_queue_customers, mode);
+        const auto settings = splitting::every_level(network, 0, options.restart, customers_to_serve);
+        ParallelRunReport report;
+        auto estimates = run_in_parallel(runs,
+                                         [&network, &settings, &options] (std::size_t i) {
+                                             return splitting::restart(network, settings, 1111 + run_seed_offset(options, i));
+                                         },
+                                         threads,
+                                         &report);
+
+        const auto names = markov_station_names(mode);
+        std::vector<std::vector<double>> loss_rates(names.size());
+        std::vector<double> total_loss_rates;
+        std::vector<double> events;
+        for (const auto & estimate : estimates) {
+            for (std::size_t station = 0; station < names.size(); ++station) {
+                loss_rates[station].push_back(estimate.loss_rate(station));
+            }
+            total_loss_rates.push_back(estimate.total_loss_rate());
+            events.push_back(estimate.events);
+        }
 
+        if (constants::PRINT_STATS) {
+            std::cout << "RESTART splitting " << options.restart << " ways at every " << names.front()
+                      << " occupancy, " << runs << " runs of " << customers_to_serve << " arrivals:" << std::endl;
+            for (std::size_t station = 0; station < names.size(); ++station) {
+                std::cout << names[station] << " CLR: "
+                          << statistics::confidence_interval_string<std::vector<double>>(loss_rates[station]) << std::endl;
+            }
+            std::cout << "Overall CLR: "
+                      << statistics::confidence_interval_string<std::vector<double>>(total_loss_rates) << std::endl;
+            std::cout << "Events per run: " << statistics::sample_mean<std::vector<double>, double>(events) << std::endl;
+            std::cout << "Parallel Runs: " << report.to_string() << std::endl;
+        }
+        return estimates.size();
+    }
+
+    std::map<std::string, std::map<std::uint32_t, std::vector<float>>> customer_loss_rates;
+    std::map<std::string, std::map<std::uint32_t, std::vector<float>>> average_waiting_times;
+    std::vector<float> system_times;
+    std::map<std::string, std::vector<quantiles::Sketch>> waiting_time_sketches;
+    std::map<std::string, std::vector<quantiles::Sketch>> sojourn_time_sketches;
+    std::vector<quantiles::Sketch> system_time_sketches;
+    std::vector<float> warm_up_customers;
+    std::vector<statistics::RunControls> controls;
+    std::vector<statistics::Sensitivities> sensitivities;
+    std::vector<statistics::TimeBuckets> time_buckets;
+    ParallelRunReport report;
+    time_warp::Report time_warp_report;
+    auto do_run = [=, &time_warp_report] (std::size_t i) {
+        if (options.time_warp) {
+            // the first replication also runs on the sequential engine, to tell
+            // whether Time Warp paid off without doubling every run
+            const bool timed = i == 0;
+            if (timed) {
+                const auto start = std::chrono::steady_clock::now();
+                do_web_server(lambda,
+                              max_cpu_queue_customers,
+                              max_io_queue_customers,
+                              customers_to_serve,
+                              run_seed_offset(options, i),
+                              run_options(options, i));
+                time_warp_report.sequential_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            const auto wall_seconds = time_warp_report.wall_seconds;
+            auto stats = do_web_server_time_warp(lambda,
+                                                 max_cpu_queue_customers,
+                                                 max_io_queue_customers,
+                                                 customers_to_serve,
+                                                 run_seed_offset(options, i),
+                                                 options.time_warp,
+                                                 run_options(options, i),
+                                                 time_warp_report);
+            if (timed) {
+                time_warp_report.timed_wall_seconds += time_warp_report.wall_seconds - wall_seconds;
+            }
+            return stats;
+        }
+        return do_one_run(lambda,
+                          max_cpu_queue_customers,
+                          max_io_queue_customers,
+                          customers_to_serve,
+                          mode,
+                          discipline,
+                          run_seed_offset(options, i),
+                          run_options(options, i));
+    };
+    // a Time Warp run spreads over the threads itself, so the runs go one at a time
+    const auto run_threads = options.time_warp ? 1 : threads;
+    auto stats = options.precision > 0
+        ? run_until_precise(options, do_run, run_threads, &report)
+        : run_in_parallel(runs, do_run, run_threads, &report);
+
+    // the runs come back in order, so their results are printed in order even
+    // though each run's own output may come from any thread
+    for (std::size_t i = 0; i < stats.size(); ++i) {
+        if (constants::PRINT_STATS) {
+            std::cout << std::endl << "STARTING RUN: " << i << std::endl;
+        }
+
+        auto & stat = stats[i];
         for (const auto & name_and_clr_map : stat.customer_loss_rates()) {
             auto & name = name_and_clr_map.first;
             for (const auto & priority_and_clr : name_and_clr_map.second) {
@@ -78,6 +368,18 @@ void run_project_2(float lambda,
 
         system_times.push_back(stat.average_system_time());
 
+        for (const auto & name_and_sketch : stat.time_sketches().waiting_times) {
+            waiting_time_sketches[name_and_sketch.first].push_back(name_and_sketch.second);
+        }
+        for (const auto & name_and_sketch : stat.time_sketches().sojourn_times) {
+            sojourn_time_sketches[name_and_sketch.first].push_back(name_and_sketch.second);
+        }
+        system_time_sketches.push_back(stat.time_sketches().system_times);
+        warm_up_customers.push_back(stat.warm_up_customers());
+        controls.push_back(stat.controls());
+        sensitivities.push_back(stat.sensitivities());
+        time_buckets.push_back(stat.time_buckets());
+
         if (constants::PRINT_STATS) {
             std::cout << std::endl << "ENDING RUN: " << i << std::endl;
         }
@@ -91,6 +393,11 @@ void run_project_2(float lambda,
         }
     };
 
+    // the two runs of an antithetic pair are one sample
+    auto interval = [&options] (const std::vector<float> & per_run) {
+        return statistics::confidence_interval_string(options.antithetic ? statistics::pair_averages(per_run) : per_run);
+    };
+
     if (constants::PRINT_STATS) {
         std::cout << std::endl << "Customer Loss Rates:" << std::endl;
         for (const auto & name_and_clr_vector_map : customer_loss_rates) {
@@ -98,7 +405,7 @@ void run_project_2(float lambda,
 
             for (const auto & priority_and_clr : name_and_clr_vector_map.second) {
                 std::cout << "    Priority_" << to_string(priority_and_clr.first) << ":"
-                          << " CLR: " << statistics::confidence_interval_string(priority_and_clr.second)
+                          << " CLR: " << interval(priority_and_clr.second)
                           << std::endl;
             }
         }
@@ -111,16 +418,313 @@ void run_project_2(float lambda,
 
             for (const auto & priority_and_time : name_and_time_vector_map.second) {
                 std::cout << "    Priority_" << to_string(priority_and_time.first) << ":"
-                          << " Waiting Time: " << statistics::confidence_interval_string(priority_and_time .second)
+                          << " Waiting Time: " << interval(priority_and_time.second)
                           << std::endl;
             }
         }
         std::cout << std::endl;
 
         std::cout << "System Time "
-                  << statistics::confidence_interval_string(system_times)
+                  << interval(system_times)
                   << std::endl;
+
+        const auto & overall_waiting_times = average_waiting_times
+                                             .at(SimulationRunStats::all_queues())
+                                             .at(SimulationRunStats::all_priorities());
+        std::cout << statistics::control_variate_report(
+            {{"Waiting Time", options.antithetic ? statistics::pair_averages(overall_waiting_times) : overall_waiting_times},
+             {"System Time", options.antithetic ? statistics::pair_averages(system_times) : system_times}},
+            options.antithetic ? statistics::control_pair_averages(controls) : controls);
+
+        if (options.time_bucket_width > 0) {
+            std::cout << statistics::time_bucket_report(time_buckets);
+        }
+
+        if (options.perturbation_analysis) {
+            std::vector<float> waiting_by_arrival_rate;
+            std::vector<float> waiting_by_service_rate;
+            std::vector<float> system_by_arrival_rate;
+            std::vector<float> system_by_service_rate;
+            for (const auto & run : sensitivities) {
+                waiting_by_arrival_rate.push_back(run.waiting_time_by_arrival_rate);
+                waiting_by_service_rate.push_back(run.waiting_time_by_service_rate);
+                system_by_arrival_rate.push_back(run.system_time_by_arrival_rate);
+                system_by_service_rate.push_back(run.system_time_by_service_rate);
+            }
+            std::cout << "IPA Sensitivities:" << std::endl
+                      << "    d Waiting Time / d lambda: " << interval(waiting_by_arrival_rate) << std::endl
+                      << "    d Waiting Time / d mu: " << interval(waiting_by_service_rate) << std::endl
+                      << "    d System Time / d lambda: " << interval(system_by_arrival_rate) << std::endl
+                      << "    d System Time / d mu: " << interval(system_by_service_rate) << std::endl;
+        }
+
+        if (options.quantiles) {
+            std::cout << std::endl << "Waiting Time Quantiles:" << std::endl;
+            for (const auto & name_and_sketches : waiting_time_sketches) {
+                std::cout << name_and_sketches.first << ":" << std::endl
+                          << quantiles::quantile_report(name_and_sketches.second);
+            }
+            std::cout << "Sojourn Time Quantiles:" << std::endl;
+            for (const auto & name_and_sketches : sojourn_time_sketches) {
+                std::cout << name_and_sketches.first << ":" << std::endl
+                          << quantiles::quantile_report(name_and_sketches.second);
+            }
+            std::cout << "System Time Quantiles:" << std::endl
+                      << quantiles::quantile_report(system_time_sketches) << std::endl;
+        }
+
+        if (options.mser_warm_up) {
+            std::cout << "Warm-up (MSER-5): "
+                      << interval(warm_up_customers)
+                      << " customers dropped" << std::endl;
+        }
+
+        std::cout << "Parallel Runs: " << report.to_string() << std::endl;
+        if (options.time_warp) {
+            std::cout << "Time Warp: " << time_warp_report.to_string() << std::endl;
+        }
+        if (options.precision > 0) {
+            std::cout << precision_string(stats, options) << std::endl;
+        }
+    }
+
+    return stats.size();
+}
+
+std::size_t compare_disciplines(float lambda,
+                                std::size_t max_cpu_queue_customers,
+                                std::size_t customers_to_serve,
+                                const std::vector<Discipline> & disciplines,
+                                const int runs,
+                                std::size_t threads,
+                                const SimulationOptions & options)
+{
+    auto common_options = options;
+    common_options.common_random_numbers = true;
+
+    // per run (or per antithetic pair) overall results, one entry per discipline
+    std::vector<std::vector<float>> waiting_times;
+    std::vector<std::vector<float>> system_times;
+    std::vector<std::vector<float>> loss_rates;
+    for (auto discipline : disciplines) {
+        auto stats = run_in_parallel(runs,
+                                     [=] (std::size_t i) {
+                                         return do_m_m_1_k(lambda,
+                                                           max_cpu_queue_customers,
+                                                           customers_to_serve,
+                                                           discipline,
+                                                           run_seed_offset(common_options, i),
+                                                           run_options(common_options, i));
+                                     },
+                                     threads);
+
+        std::vector<float> discipline_waiting_times;
+        std::vector<float> discipline_system_times;
+        std::vector<float> discipline_loss_rates;
+        for (auto & stat : stats) {
+            discipline_waiting_times.push_back(stat.average_waiting_times()
+                                               .at(SimulationRunStats::all_queues())
+                                               .at(SimulationRunStats::all_priorities()));
+            discipline_system_times.push_back(stat.average_system_time());
+            discipline_loss_rates.push_back(stat.customer_loss_rates()
+                                            .at(SimulationRunStats::all_queues())
+                                            .at(SimulationRunStats::all_priorities()));
+        }
+
+        if (options.antithetic) {
+            discipline_waiting_times = statistics::pair_averages(discipline_waiting_times);
+            discipline_system_times = statistics::pair_averages(discipline_system_times);
+            discipline_loss_rates = statistics::pair_averages(discipline_loss_rates);
+        }
+        waiting_times.push_back(discipline_waiting_times);
+        system_times.push_back(discipline_system_times);
+        loss_rates.push_back(discipline_loss_rates);
+    }
+
+    if (constants::PRINT_STATS) {
+        std::cout << "Common random numbers over " << runs << " runs"
+                  << (options.antithetic ? " (antithetic pairs)" : "") << ":" << std::endl;
+        for (std::size_t i = 0; i < disciplines.size(); ++i) {
+            std::cout << to_string(disciplines[i]) << ":" << std::endl
+                      << "    Waiting Time: " << statistics::confidence_interval_string(waiting_times[i]) << std::endl
+                      << "    System Time: " << statistics::confidence_interval_string(system_times[i]) << std::endl
+                      << "    CLR: " << statistics::confidence_interval_string(loss_rates[i]) << std::endl;
+        }
+
+        auto difference_string = [] (const std::vector<float> & lhs, const std::vector<float> & rhs) {
+            std::stringstream ss;
+            ss << statistics::paired_difference_string(lhs, rhs)
+               << " (independent runs: ± " << statistics::unpaired_difference_half_width(lhs, rhs) << ")";
+            return ss.str();
+        };
+
+        std::cout << std::endl << "Paired Differences:" << std::endl;
+        for (std::size_t i = 0; i < disciplines.size(); ++i) {
+            for (std::size_t j = i + 1; j < disciplines.size(); ++j) {
+                std::cout << to_string(disciplines[j]) << " - " << to_string(disciplines[i]) << ":" << std::endl
+                          << "    Waiting Time: " << difference_string(waiting_times[j], waiting_times[i]) << std::endl
+                          << "    System Time: " << difference_string(system_times[j], system_times[i]) << std::endl
+                          << "    CLR: " << difference_string(loss_rates[j], loss_rates[i]) << std::endl;
+            }
+        }
+    }
+
+    return runs * disciplines.size();
+}
+
+std::optional<std::pair<std::size_t, std::size_t>> search_smallest_buffers(
+    std::size_t max_cpu_queue_customers,
+    std::size_t first_io_queue_customers,
+    std::size_t max_io_queue_customers,
+    const std::function<bool(std::size_t, std::size_t)> & meets_targets)
+{
+    std::optional<std::pair<std::size_t, std::size_t>> best;
+    for (auto kio = first_io_queue_customers; kio <= max_io_queue_customers; ++kio) {
+        // only a Kcpu one smaller in total than the best so far is worth trying
+        auto high = max_cpu_queue_customers;
+        if (best) {
+            const auto best_total = best->first + best->second;
+            if (best_total <= kio + 1) {
+                break;
+            }
+            high = std::min(high, best_total - kio - 1);
+        }
+        if (!meets_targets(high, kio)) {
+            continue;
+        }
+
+        std::size_t low = 1;
+        while (low < high) {
+            const auto middle = low + (high - low) / 2;
+            if (meets_targets(middle, kio)) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+        best = std::make_pair(high, kio);
+    }
+    return best;
+}
+
+std::size_t optimize_buffers(float lambda,
+                             std::size_t max_cpu_queue_customers,
+                             std::size_t max_io_queue_customers,
+                             std::size_t customers_to_serve,
+                             Mode mode,
+                             Discipline discipline,
+                             std::size_t threads,
+                             const SimulationOptions & options)
+{
+    // run i of every candidate uses the same seeds, so differences between candidates are the buffers'
+    auto common_options = options;
+    common_options.common_random_numbers = mode == Mode::MM1;
+    constexpr std::size_t kMinRuns = 10;
+
+    std::map<std::pair<std::size_t, std::size_t>, Candidate> candidates;
+    std::size_t total_runs = 0;
+
+    auto evaluate = [&] (std::size_t kcpu, std::size_t kio) -> const Candidate & {
+        auto found = candidates.find({kcpu, kio});
+        if (found != candidates.end()) {
+            return found->second;
+        }
+
+        Candidate candidate{kcpu, kio, {}, {}};
+        auto wave = std::min(std::max(kMinRuns, threads), options.max_runs);
+        while (wave > 0) {
+            const auto first_run = candidate.loss_rates.size();
+            auto stats = run_in_parallel(wave,
+                                         [=] (std::size_t i) {
+                                             return do_one_run(lambda,
+                                                               kcpu,
+                                                               kio,
+                                                               customers_to_serve,
+                                                               mode,
+                                                               discipline,
+                                                               run_seed_offset(common_options, first_run + i),
+                                                               run_options(common_options, first_run + i));
+                                         },
+                                         threads);
+            for (auto & stat : stats) {
+                candidate.loss_rates.push_back(stat.customer_loss_rates()
+                                               .at(SimulationRunStats::all_queues())
+                                               .at(SimulationRunStats::all_priorities()));
+                candidate.waiting_times.push_back(stat.average_waiting_times()
+                                                  .at(SimulationRunStats::all_queues())
+                                                  .at(SimulationRunStats::all_priorities()));
+            }
+            total_runs += stats.size();
+
+            // decided once the CLR interval is on one side of the target
+            const auto side = side_of_target(candidate.loss_rates, options.target_clr);
+            if (side != 0) {
+                candidate.meets_targets = side < 0;
+                break;
+            }
+
+            const auto runs = candidate.loss_rates.size();
+            wave = std::min(std::max(runs / 2, threads), options.max_runs - runs);
+            if (wave == 0) {
+                // out of budget, the mean decides
+                candidate.meets_targets = statistics::sample_mean(candidate.loss_rates) <= options.target_clr;
+            }
+        }
+
+        if (constants::PRINT_STATS) {
+            std::cout << "Kcpu " << kcpu;
+            if (mode == Mode::CPU) {
+                std::cout << " Kio " << kio;
+            }
+            std::cout << ": CLR " << statistics::confidence_interval_string(candidate.loss_rates)
+                      << ", Waiting Time " << statistics::confidence_interval_string(candidate.waiting_times)
+                      << " over " << candidate.loss_rates.size() << " runs, "
+                      << (candidate.meets_targets ? "meets" : "misses") << " the CLR target" << std::endl;
+        }
+        return candidates.emplace(std::make_pair(kcpu, kio), std::move(candidate)).first->second;
+    };
+
+    const std::size_t first_kio = mode == Mode::CPU ? 1 : max_io_queue_customers; // MM1 has no IO queues
+    const auto smallest = search_smallest_buffers(max_cpu_queue_customers,
+                                                  first_kio,
+                                                  max_io_queue_customers,
+                                                  [&evaluate] (std::size_t kcpu, std::size_t kio) {
+                                                      return evaluate(kcpu, kio).meets_targets;
+                                                  });
+    const Candidate * best = smallest ? &candidates.at(*smallest) : nullptr;
+
+    if (constants::PRINT_STATS) {
+        std::cout << std::endl << "Targets:";
+        if (options.target_clr > 0) {
+            std::cout << " CLR <= " << options.target_clr;
+        }
+        if (options.target_waiting_time > 0) {
+            std::cout << " Waiting Time <= " << options.target_waiting_time;
+        }
+        std::cout << std::endl;
+        if (best) {
+            std::cout << "Smallest buffers: Kcpu " << best->max_cpu_queue_customers;
+            if (mode == Mode::CPU) {
+                std::cout << " Kio " << best->max_io_queue_customers;
+            }
+            std::cout << " (CLR " << statistics::confidence_interval_string(best->loss_rates)
+                      << ", Waiting Time " << statistics::confidence_interval_string(best->waiting_times) << ")" << std::endl;
+            // waiting only grows with the buffers, and any smaller ones miss the CLR target
+            if (options.target_waiting_time > 0
+                && side_of_target(best->waiting_times, options.target_waiting_time) > 0) {
+                std::cout << "Their waiting time is above its target, so no buffers meet both" << std::endl;
+            }
+        } else {
+            std::cout << "No buffers up to Kcpu " << max_cpu_queue_customers;
+            if (mode == Mode::CPU) {
+                std::cout << " Kio " << max_io_queue_customers;
+            }
+            std::cout << " meet the CLR target" << std::endl;
+        }
+        std::cout << candidates.size() << " candidates evaluated" << std::endl;
     }
+
+    return total_runs;
 }
 
 SimulationRunStats do_one_run(float lambda,
@@ -129,7 +733,8 @@ SimulationRunStats do_one_run(float lambda,
                               std::size_t customers_to_serve,
                               Mode mode,
                               Discipline discipline,
-                              long seed_offset)
+                              long seed_offset,
+                              const SimulationOptions & options)
 {
     switch (mode) {
     case Mode::MM1:
@@ -137,23 +742,26 @@ SimulationRunStats do_one_run(float lambda,
                           max_cpu_queue_customers,
                           customers_to_serve,
                           discipline,
-                          seed_offset);
+                          seed_offset,
+                          options);
     case Mode::CPU:
         return do_web_server(lambda,
                              max_cpu_queue_customers,
                              max_io_queue_customers,
                              customers_to_serve,
-                             seed_offset);
+                             seed_offset,
+                             options);
     }
+    throw std::invalid_argument("Unknown Mode");
 }
 
 SimulationRunStats do_m_m_1_k(float lambda,
                               std::size_t max_cpu_queue_customers,
                               std::size_t customers_to_serve,
                               Discipline discipline,
-                              long seed_offset)
+                              long seed_offset,
+                              const SimulationOptions & options)
 {
-    constexpr float kMu = 1.0;
     long service_seed = 1111 + seed_offset;
     long arrival_seed = 2222 + seed_offset;
     long priority_seed = 3333 + seed_offset;
@@ -163,11 +771,44 @@ SimulationRunStats do_m_m_1_k(float lambda,
     constexpr std::size_t stats_index = 0; // used for project 1
     constexpr auto kTransientPeriod = 1000;
 
+    constexpr auto kMinPriority = 1;
+    constexpr auto kMaxPriority = 4;
+
     const std::string kQueueName = "Queue";
     auto spy = SimulationSpy(stats_index,
                              max_cpu_queue_customers + 1,
                              {kQueueName},
-                             kTransientPeriod);
+                             options.mser_warm_up || options.regenerative ? 0 : kTransientPeriod,
+                             nullptr,
+                             default_customer_priority(),
+                             kMaxPriority);
+
+    auto trace_writer = attach_trace_writer(options.trace_path, timer, spy);
+
+    if (options.batch_means) {
+        spy.enable_batch_means(std::max<std::size_t>(1, customers_to_serve / options.batch_means));
+    }
+
+    if (options.mser_warm_up) {
+        // half the run at most, so the buffer of held back customers stays bounded
+        spy.enable_mser_warm_up(customers_to_serve / 2);
+    }
+
+    if (options.regenerative) {
+        spy.enable_regenerative_cycles();
+    }
+
+    if (options.quantiles) {
+        spy.enable_quantiles(quantiles::HdrHistogram());
+    }
+
+    if (options.time_bucket_width > 0) {
+        spy.enable_time_buckets(options.time_bucket_width, options.rate_profile ? options.rate_profile->period() : 0);
+    }
+
+    if (options.perturbation_analysis) {
+        spy.enable_perturbation_analysis(lambda, kMm1Mu);
+    }
 
     auto exit_customer = [&spy] (const std::shared_ptr<Customer> & customer) {
         spy.on_customer_exiting(customer);
@@ -175,9 +816,7 @@ SimulationRunStats do_m_m_1_k(float lambda,
 
 
     std::function<std::uint32_t()> generate_priority;
-    constexpr auto kMinPriority = 1;
-    constexpr auto kMaxPriority = 4;
-    auto priority_generator = UniformPriorityGenerator(kMinPriority, kMaxPriority, priority_seed);
+    auto priority_generator = UniformPriorityGenerator(kMinPriority, kMaxPriority, priority_seed, options.antithetic_draws);
 
     std::uint32_t min_priority = 0;
     std::uint32_t max_priority = 0;
@@ -195,15 +834,38 @@ SimulationRunStats do_m_m_1_k(float lambda,
         break;
     }
 
+    // sample means of the draws, for control variates
+    statistics::RunningMean arrival_draws;
+    statistics::RunningMean service_draws;
+    const auto arrival_generator = make_arrival_generator(lambda, arrival_seed, options);
+    const auto service_generator = ExponentialGenerator(kMm1Mu, service_seed, options.antithetic_draws);
+
     IncomingCustomers incoming_customers(timer,
-                                         ExponentialGenerator(lambda, arrival_seed),
+                                         statistics::MeasuredGenerator(arrival_generator, arrival_draws),
                                          generate_priority);
 
+    std::function<float()> generate_service_time = [gen = statistics::MeasuredGenerator(service_generator, service_draws)] {
+        return gen.generate();
+    };
+
+    // A replayed log brings the arrivals, and the service times it has
+    const bool logged = !options.arrivals_path.empty();
+    std::unique_ptr<RequestLog> request_log;
+    std::unique_ptr<LoggedCustomers> logged_customers;
+    if (logged) {
+        request_log = std::make_unique<RequestLog>(options.arrivals_path);
+        logged_customers = std::make_unique<LoggedCustomers>(timer,
+                                                             *request_log,
+                                                             generate_service_time,
+                                                             min_priority,
+                                                             max_priority);
+    }
+
+    // With common random numbers customer i gets the i-th service time under every discipline.
+    // The queue only draws for customers it accepts, so instead every arrival draws one.
     auto queue = Queue(max_cpu_queue_customers,
                        exit_customer,
-                       [gen = ExponentialGenerator(kMu, service_seed)] {
-                            return gen.generate();
-                       },
+                       options.common_random_numbers || logged ? std::function<float()>() : generate_service_time,
                        [&timer]{ return timer.time(); },
                        to_discipline(discipline),
                        kQueueName,
@@ -219,8 +881,18 @@ SimulationRunStats do_m_m_1_k(float lambda,
     };
 
     // register queue to get customers
-    incoming_customers.register_for_customers(insert_into_spy); // MUST REGISTER FIRST
-    incoming_customers.register_for_customers(insert_into_queue);
+    if (logged) {
+        logged_customers->register_for_customers(insert_into_spy); // MUST REGISTER FIRST
+        logged_customers->register_for_customers(insert_into_queue);
+    } else {
+        incoming_customers.register_for_customers(insert_into_spy); // MUST REGISTER FIRST
+        if (options.common_random_numbers) {
+            incoming_customers.register_for_customers([generate_service_time] (const std::shared_ptr<Customer> & customer) {
+                customer->set_service_time(generate_service_time());
+            });
+        }
+        incoming_customers.register_for_customers(insert_into_queue);
+    }
 
     auto request_from_queue = [&queue] (const CustomerRequest & request) {
         queue.request_one_customer(request);
@@ -237,28 +909,67 @@ SimulationRunStats do_m_m_1_k(float lambda,
 
     // run simulation
     server.start();
-    incoming_customers.start();
+    if (logged) {
+        logged_customers->start();
+    } else {
+        incoming_customers.start();
+    }
 
-    while (spy.total_serviced_customers() < customers_to_serve) {
+    // a log may run out before C customers are served
+    allocation_counter::AllocationReport allocation_report;
+    probe::ProbeReport probe_report;
+    while (spy.total_serviced_customers() < customers_to_serve && timer.has_jobs()) {
         timer.advance_time();
     }
 
+    // finished here rather than by its destructor, which can't report a failure
+    if (trace_writer) {
+        trace_writer->close();
+    }
+
+    if (options.counters) {
+        options.counters->add_run(timer.dispatched_jobs(), timer.dispatched_arrivals());
+    }
+
+    if constexpr (constants::ALLOCATION_ACCOUNTING) {
+        std::cout << allocation_report.to_string(timer.dispatched_arrivals());
+    }
+
+    if constexpr (constants::PROBES_ENABLED) {
+        std::cout << probe_report.to_string(timer.dispatched_arrivals());
+    }
+
+    // logged draws have no known mean to control with, and the gaps of a varying rate only a long run one
+    statistics::RunControls controls;
+    if (!logged) {
+        if (!options.rate_profile) {
+            controls.add("arrival", arrival_draws.mean(), arrival_generator.mean());
+        }
+        controls.add("service", service_draws.mean(), service_generator.mean());
+    }
+
     return SimulationRunStats(spy.customer_loss_rates(),
                               spy.average_waiting_times(),
                               spy.average_system_time(),
                               spy.average_service_time(),
                               timer.time(),
-                              {});
+                              {},
+                              spy.time_sketches(),
+                              spy.batch_means(),
+                              spy.warm_up_customers(),
+                              spy.regenerative_cycles(),
+                              controls,
+                              spy.sensitivities(),
+                              spy.time_buckets());
 }
 
 SimulationRunStats do_web_server(float lambda,
                                  std::size_t max_cpu_queue_customers,
                                  std::size_t max_io_queue_customers,
                                  std::size_t customers_to_serve,
-                                 long seed_offset)
+                                 long seed_offset,
+                                 const SimulationOptions & options)
 {
-    constexpr float kCpuMu = 1.0;
-    constexpr float kIoMu = .5;
     long arrival_seed = 1111 + seed_offset;
     long cpu_service_seed = 2222 + seed_offset;
     long io_service_seed_1 = 3333 + seed_offset;
@@ -280,19 +991,55 @@ SimulationRunStats do_web_server(float lambda,
                              + 3*max_io_queue_customers
                              + 4,
                              {kCpuQueueName, kIoQueueName1, kIoQueueName2, kIoQueueName3},
-                             kTransientPeriod);
+                             options.mser_warm_up || options.regenerative ? 0 : kTransientPeriod);
 
-    auto exit_customer = [&spy] (const std::shared_ptr<Customer> & customer) {
-        spy.on_customer_exiting(customer);
-    };
+    auto trace_writer = attach_trace_writer(options.trace_path, timer, spy);
+
+    if (options.batch_means) {
+        spy.enable_batch_means(std::max<std::size_t>(1, customers_to_serve / options.batch_means));
+    }
+
+    if (options.mser_warm_up) {
+        // half the run at most, so the buffer of held back customers stays bounded
+        spy.enable_mser_warm_up(customers_to_serve / 2);
+    }
+
+    if (options.regenerative) {
+        spy.enable_regenerative_cycles();
+    }
+
+    if (options.quantiles) {
+        spy.enable_quantiles(quantiles::HdrHistogram());
+    }
+
+    if (options.time_bucket_width > 0) {
+        spy.enable_time_buckets(options.time_bucket_width, options.rate_profile ? options.rate_profile->period() : 0);
+    }
+
+    // sample means of the draws, for control variates (the three IO queues share one)
+    statistics::RunningMean arrival_draws;
+    statistics::RunningMean cpu_service_draws;
+    statistics::RunningMean io_service_draws;
+    const auto arrival_generator = make_arrival_generator(lambda, arrival_seed, options);
 
+    // open: Poisson arrivals, closed: options.population customers thinking for the same draws
     auto incoming_customers = IncomingCustomers(timer,
-                                                ExponentialGenerator(lambda, arrival_seed));
+                                                statistics::MeasuredGenerator(arrival_generator, arrival_draws));
+    auto thinking_customers = ThinkingCustomers(timer,
+                                                statistics::MeasuredGenerator(arrival_generator, arrival_draws),
+                                                options.population);
 
+    auto exit_customer = [&spy, &thinking_customers, closed = options.population > 0] (const std::shared_ptr<Customer> & customer) {
+        spy.on_customer_exiting(customer);
+        if (closed) {
+            thinking_customers.on_customer_left(customer);
+        }
+    };
 
     auto cpu_queue = Queue(max_cpu_queue_customers,
                            exit_customer,
-                           [gen = ExponentialGenerator(kCpuMu, cpu_service_seed)] {
+                           [gen = statistics::MeasuredGenerator(ExponentialGenerator(kCpuMu, cpu_service_seed, options.antithetic_draws),
+                                                                cpu_service_draws)] {
                                return gen.generate();
                            },
                            [&timer]{ return timer.time(); },
@@ -300,7 +1047,8 @@ SimulationRunStats do_web_server(float lambda,
                            kCpuQueueName);
     auto io_queue_1 = Queue(max_io_queue_customers,
                             exit_customer,
-                            [gen = ExponentialGenerator(kIoMu, io_service_seed_1)] {
+                            [gen = statistics::MeasuredGenerator(ExponentialGenerator(kIoMu, io_service_seed_1, options.antithetic_draws),
+                                                                 io_service_draws)] {
                                return gen.generate();
                             },
                             [&timer]{ return timer.time(); },
@@ -308,7 +1056,8 @@ SimulationRunStats do_web_server(float lambda,
                             kIoQueueName1);
     auto io_queue_2 = Queue(max_io_queue_customers,
                             exit_customer,
-                            [gen = ExponentialGenerator(kIoMu, io_service_seed_2)] {
+                            [gen = statistics::MeasuredGenerator(ExponentialGenerator(kIoMu, io_service_seed_2, options.antithetic_draws),
+                                                                 io_service_draws)] {
                                return gen.generate();
                             },
                             [&timer]{ return timer.time(); },
@@ -316,7 +1065,8 @@ SimulationRunStats do_web_server(float lambda,
                             kIoQueueName2);
     auto io_queue_3 = Queue(max_io_queue_customers,
                             exit_customer,
-                            [gen = ExponentialGenerator(kIoMu, io_service_seed_3)] {
+                            [gen = statistics::MeasuredGenerator(ExponentialGenerator(kIoMu, io_service_seed_3, options.antithetic_draws),
+                                                                 io_service_draws)] {
                                return gen.generate();
                             },
                             [&timer]{ return timer.time(); },
@@ -346,6 +1096,8 @@ SimulationRunStats do_web_server(float lambda,
     // register queue to get customers
     incoming_customers.register_for_customers(insert_into_spy); // MUST REGISTER FIRST
     incoming_customers.register_for_customers(insert_into_cpu_queue);
+    thinking_customers.register_for_customers(insert_into_spy);
+    thinking_customers.register_for_customers(insert_into_cpu_queue);
 
     auto request_from_cpu_queue = [&cpu_queue] (const CustomerRequest & request) {
         cpu_queue.request_one_customer(request);
@@ -369,7 +1121,7 @@ SimulationRunStats do_web_server(float lambda,
                                                      std::make_pair(insert_into_io_queue_3, kIoQueue3Upper),
                                                      std::make_pair(exit_customer, kExitServicedUpper)};
 
-    auto balancer = RandomLoadBalancer(targets, UniformGenerator(load_balancer_seed));
+    auto balancer = RandomLoadBalancer(targets, UniformGenerator(load_balancer_seed, options.antithetic_draws));
     CustomerRequest send_to_balancer = [&balancer] (const std::shared_ptr<Customer> & customer) {
         balancer.route_customer(customer);
     };
@@ -384,18 +1136,273 @@ SimulationRunStats do_web_server(float lambda,
     io_server_1.start();
     io_server_2.start();
     io_server_3.start();
-    incoming_customers.start();
+    if (options.population) {
+        thinking_customers.start();
+    } else {
+        incoming_customers.start();
+    }
 
+    allocation_counter::AllocationReport allocation_report;
+    probe::ProbeReport probe_report;
     while (spy.total_serviced_customers() < customers_to_serve) {
         timer.advance_time();
     }
 
+    // finished here rather than by its destructor, which can't report a failure
+    if (trace_writer) {
+        trace_writer->close();
+    }
+
+    if (options.counters) {
+        options.counters->add_run(timer.dispatched_jobs(), timer.dispatched_arrivals());
+    }
+
+    if constexpr (constants::ALLOCATION_ACCOUNTING) {
+        std::cout << allocation_report.to_string(timer.dispatched_arrivals());
+    }
+
+    if constexpr (constants::PROBES_ENABLED) {
+        std::cout << probe_report.to_string(timer.dispatched_arrivals());
+    }
+
+    // the gaps of a varying arrival rate only have a long run mean
+    statistics::RunControls controls;
+    if (!options.rate_profile) {
+        controls.add("arrival", arrival_draws.mean(), arrival_generator.mean());
+    }
+    controls.add("cpu service", cpu_service_draws.mean(), 1 / kCpuMu);
+    controls.add("io service", io_service_draws.mean(), 1 / kIoMu);
+
     return SimulationRunStats(spy.customer_loss_rates(),
                               spy.average_waiting_times(),
                               spy.average_system_time(),
                               spy.average_service_time(),
                               timer.time(),
-                              {});
+                              {},
+                              spy.time_sketches(),
+                              spy.batch_means(),
+                              spy.warm_up_customers(),
+                              spy.regenerative_cycles(),
+                              controls,
+                              spy.sensitivities(),
+                              spy.time_buckets());
+}
+
+SimulationRunStats do_web_server_time_warp(float lambda,
+                                           std::size_t max_cpu_queue_customers,
+                                           std::size_t max_io_queue_customers,
+                                           std::size_t customers_to_serve,
+                                           long seed_offset,
+                                           std::size_t threads,
+                                           const SimulationOptions & options,
+                                           time_warp::Report & report)
+{
+    long arrival_seed = 1111 + seed_offset;
+    long cpu_service_seed = 2222 + seed_offset;
+    long io_service_seed_1 = 3333 + seed_offset;
+    long io_service_seed_2 = 4444 + seed_offset;
+    long io_service_seed_3 = 5555 + seed_offset;
+    long load_balancer_seed = 6666 + seed_offset;
+
+    // declared before the components, whose saved changes and jobs it holds on to
+    time_warp::Engine engine(threads, kTimeWarpWindowArrivals / lambda);
+    auto & arrivals = engine.add_process();
+    auto & cpu = engine.add_process();
+    auto & io_1 = engine.add_process();
+    auto & io_2 = engine.add_process();
+    auto & io_3 = engine.add_process();
+
+    const std::string kCpuQueueName = "CPU_QUEUE";
+    const std::string kIoQueueName1 = "IO_QUEUE1";
+    const std::string kIoQueueName2 = "IO_QUEUE2";
+    const std::string kIoQueueName3 = "IO_QUEUE3";
+
+    constexpr std::size_t stats_index = 0; // used for project 1
+    constexpr auto kTransientPeriod = 1000;
+    auto spy = SimulationSpy(stats_index,
+                             max_cpu_queue_customers
+                             + 3*max_io_queue_customers
+                             + 4,
+                             {kCpuQueueName, kIoQueueName1, kIoQueueName2, kIoQueueName3},
+                             options.mser_warm_up ? 0 : kTransientPeriod);
+
+    if (options.mser_warm_up) {
+        // half the run at most, so the buffer of held back customers stays bounded
+        spy.enable_mser_warm_up(customers_to_serve / 2);
+    }
+
+    if (options.quantiles) {
+        spy.enable_quantiles(quantiles::HdrHistogram());
+    }
+
+    if (options.time_bucket_width > 0) {
+        spy.enable_time_buckets(options.time_bucket_width);
+    }
+
+    // each process measures its own draws, the threads can't share a mean
+    statistics::RunningMean arrival_draws;
+    statistics::RunningMean cpu_service_draws;
+    statistics::RunningMean io_service_draws_1;
+    statistics::RunningMean io_service_draws_2;
+    statistics::RunningMean io_service_draws_3;
+
+    const auto arrival_generator = make_arrival_generator(lambda, arrival_seed, options);
+    auto incoming_customers = IncomingCustomers(arrivals.timer(),
+                                                time_warp::SavedGenerator(statistics::MeasuredGenerator(arrival_generator, arrival_draws),
+                                                                          arrivals.state_log()));
+    incoming_customers.set_state_log(&arrivals.state_log());
+    incoming_customers.register_for_customers([&arrivals] (const std::shared_ptr<Customer> & customer) {
+        arrivals.record_entering(customer);
+    });
+    incoming_customers.register_for_customers([&arrivals, &cpu] (const std::shared_ptr<Customer> & customer) {
+        arrivals.send(cpu, customer);
+    });
+
+    auto exit_from = [] (time_warp::LogicalProcess & process) {
+        return CustomerRequest([&process] (const std::shared_ptr<Customer> & customer) {
+            process.record_exiting(customer);
+        });
+    };
+    auto service_times = [&options] (float mu, long seed, statistics::RunningMean & draws, time_warp::LogicalProcess & process) {
+        return [gen = time_warp::SavedGenerator(statistics::MeasuredGenerator(ExponentialGenerator(mu, seed, options.antithetic_draws),
+                                                                              draws),
+                                                process.state_log())] {
+            return gen.generate();
+        };
+    };
+    auto now_at = [] (time_warp::LogicalProcess & process) {
+        return [&process] { return process.timer().time(); };
+    };
+
+    auto cpu_queue = Queue(max_cpu_queue_customers,
+                           exit_from(cpu),
+                           service_times(kCpuMu, cpu_service_seed, cpu_service_draws, cpu),
+                           now_at(cpu),
+                           queueing::Discipline::FCFS,
+                           kCpuQueueName);
+    auto io_queue_1 = Queue(max_io_queue_customers,
+                            exit_from(io_1),
+                            service_times(kIoMu, io_service_seed_1, io_service_draws_1, io_1),
+                            now_at(io_1),
+                            queueing::Discipline::FCFS,
+                            kIoQueueName1);
+    auto io_queue_2 = Queue(max_io_queue_customers,
+                            exit_from(io_2),
+                            service_times(kIoMu, io_service_seed_2, io_service_draws_2, io_2),
+                            now_at(io_2),
+                            queueing::Discipline::FCFS,
+                            kIoQueueName2);
+    auto io_queue_3 = Queue(max_io_queue_customers,
+                            exit_from(io_3),
+                            service_times(kIoMu, io_service_seed_3, io_service_draws_3, io_3),
+                            now_at(io_3),
+                            queueing::Discipline::FCFS,
+                            kIoQueueName3);
+    cpu_queue.set_state_log(&cpu.state_log());
+    io_queue_1.set_state_log(&io_1.state_log());
+    io_queue_2.set_state_log(&io_2.state_log());
+    io_queue_3.set_state_log(&io_3.state_log());
+
+    cpu.set_inlet([&cpu_queue] (const std::shared_ptr<Customer> & customer) {
+        cpu_queue.accept_customer(customer);
+    });
+    io_1.set_inlet([&io_queue_1] (const std::shared_ptr<Customer> & customer) {
+        io_queue_1.accept_customer(customer);
+    });
+    io_2.set_inlet([&io_queue_2] (const std::shared_ptr<Customer> & customer) {
+        io_queue_2.accept_customer(customer);
+    });
+    io_3.set_inlet([&io_queue_3] (const std::shared_ptr<Customer> & customer) {
+        io_queue_3.accept_customer(customer);
+    });
+
+    auto send_from_cpu_to = [&cpu] (time_warp::LogicalProcess & receiver) {
+        return CustomerRequest([&cpu, &receiver] (const std::shared_ptr<Customer> & customer) {
+            cpu.send(receiver, customer);
+        });
+    };
+    auto send_to_cpu_from = [&cpu] (time_warp::LogicalProcess & sender) {
+        return CustomerRequest([&cpu, &sender] (const std::shared_ptr<Customer> & customer) {
+            sender.send(cpu, customer);
+        });
+    };
+
+    constexpr float kIoQueue1Upper = .1;
+    constexpr float kIoQueue2Upper = .2;
+    constexpr float kIoQueue3Upper = .3;
+    constexpr float kExitServicedUpper = 1.0;
+    std::vector<RandomLoadBalancerTarget> targets = {std::make_pair(send_from_cpu_to(io_1), kIoQueue1Upper),
+                                                     std::make_pair(send_from_cpu_to(io_2), kIoQueue2Upper),
+                                                     std::make_pair(send_from_cpu_to(io_3), kIoQueue3Upper),
+                                                     std::make_pair(exit_from(cpu), kExitServicedUpper)};
+
+    auto balancer = RandomLoadBalancer(targets, UniformGenerator(load_balancer_seed, options.antithetic_draws));
+    balancer.set_state_log(&cpu.state_log());
+    CustomerRequest send_to_balancer = [&balancer] (const std::shared_ptr<Customer> & customer) {
+        balancer.route_customer(customer);
+    };
+
+    auto cpu_server = Server(cpu.timer(),
+                             [&cpu_queue] (const CustomerRequest & request) { cpu_queue.request_one_customer(request); },
+                             send_to_balancer,
+                             "CPU_SERVER");
+    auto io_server_1 = Server(io_1.timer(),
+                              [&io_queue_1] (const CustomerRequest & request) { io_queue_1.request_one_customer(request); },
+                              send_to_cpu_from(io_1),
+                              "IO_SERVER_1");
+    auto io_server_2 = Server(io_2.timer(),
+                              [&io_queue_2] (const CustomerRequest & request) { io_queue_2.request_one_customer(request); },
+                              send_to_cpu_from(io_2),
+                              "IO_SERVER_2");
+    auto io_server_3 = Server(io_3.timer(),
+                              [&io_queue_3] (const CustomerRequest & request) { io_queue_3.request_one_customer(request); },
+                              send_to_cpu_from(io_3),
+                              "IO_SERVER_3");
+    cpu_server.set_state_log(&cpu.state_log());
+    io_server_1.set_state_log(&io_1.state_log());
+    io_server_2.set_state_log(&io_2.state_log());
+    io_server_3.set_state_log(&io_3.state_log());
+
+    // run simulation, the spy hears of customers once they are committed
+    cpu_server.start();
+    io_server_1.start();
+    io_server_2.start();
+    io_server_3.start();
+    incoming_customers.start();
+
+    const auto end_time = engine.run([&spy, customers_to_serve] (const time_warp::Record & record) {
+        if (record.entering) {
+            spy.on_customer_entering(record.customer);
+        } else {
+            spy.on_customer_exiting(record.customer);
+        }
+        return spy.total_serviced_customers() >= customers_to_serve;
+    });
+    report.add(engine.report());
+
+    // the engine put every process back to the end, so the draws are the ones the sequential run makes
+    statistics::RunningMean io_service_draws;
+    io_service_draws.merge(io_service_draws_1);
+    io_service_draws.merge(io_service_draws_2);
+    io_service_draws.merge(io_service_draws_3);
+    statistics::RunControls controls;
+    controls.add("arrival", arrival_draws.mean(), arrival_generator.mean());
+    controls.add("cpu service", cpu_service_draws.mean(), 1 / kCpuMu);
+    controls.add("io service", io_service_draws.mean(), 1 / kIoMu);
+
+    return SimulationRunStats(spy.customer_loss_rates(),
+                              spy.average_waiting_times(),
+                              spy.average_system_time(),
+                              spy.average_service_time(),
+                              end_time,
+                              {},
+                              spy.time_sketches(),
+                              spy.batch_means(),
+                              spy.warm_up_customers(),
+                              spy.regenerative_cycles(),
+                              controls,
+                              spy.sensitivities(),
+                              spy.time_buckets());
 }
 
 } // project2
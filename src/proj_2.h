@@ -2,8 +2,19 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
 
 #include "stats.h"
+#include "simulation_options.h"
+
+namespace time_warp {
+
+struct Report;
+
+} // time_warp
 
 namespace project2 {
 
@@ -20,13 +31,52 @@ enum class Discipline {
     PRIO_P
 };
 
-void run_project_2(float lambda,
+// returns how many runs were done
+std::size_t run_project_2(float lambda,
                    std::size_t max_cpu_queue_customers,
                    std::size_t max_io_queue_customers,
                    std::size_t customers_to_serve,
                    Mode mode,
                    Discipline discipline,
-                   const int runs);
+                   const int runs,
+                   std::size_t threads,
+                   const SimulationOptions & options = {});
+
+// Runs the MM1 model under every discipline on common random numbers, then
+// prints each one's results and paired difference intervals between them.
+// returns how many runs were done
+std::size_t compare_disciplines(float lambda,
+                                std::size_t max_cpu_queue_customers,
+                                std::size_t customers_to_serve,
+                                const std::vector<Discipline> & disciplines,
+                                const int runs,
+                                std::size_t threads,
+                                const SimulationOptions & options = {});
+
+// Searches Kcpu in [1, max_cpu_queue_customers] (and Kio in [1, max_io_queue_customers]
+// for the CPU model) for the smallest total buffer whose overall CLR stays
+// below options.target_clr, then checks its mean waiting time against
+// options.target_waiting_time if set. Every candidate sees the same random
+// streams and gets replications in waves only until its interval clears the target.
+// returns how many runs were done
+std::size_t optimize_buffers(float lambda,
+                             std::size_t max_cpu_queue_customers,
+                             std::size_t max_io_queue_customers,
+                             std::size_t customers_to_serve,
+                             Mode mode,
+                             Discipline discipline,
+                             std::size_t threads,
+                             const SimulationOptions & options);
+
+// The search behind optimize_buffers: for each Kio from first_kio up, bisects
+// Kcpu (assuming bigger buffers only help) for the smallest that meets_targets,
+// skipping any Kio that can't beat the smallest total found so far.
+// Returns {Kcpu, Kio}, or nothing if even the largest buffers miss.
+std::optional<std::pair<std::size_t, std::size_t>> search_smallest_buffers(
+    std::size_t max_cpu_queue_customers,
+    std::size_t first_io_queue_customers,
+    std::size_t max_io_queue_customers,
+    const std::function<bool(std::size_t, std::size_t)> & meets_targets);
 
 SimulationRunStats do_one_run(float lambda,
                               std::size_t max_cpu_queue_customers,
@@ -34,18 +84,36 @@ SimulationRunStats do_one_run(float lambda,
                               std::size_t customers_to_serve,
                               Mode mode,
                               Discipline discipline,
-                              long seed_offset);
+                              long seed_offset,
+                              const SimulationOptions & options = {});
 
 SimulationRunStats do_m_m_1_k(float lambda,
                               std::size_t max_cpu_queue_customers,
                               std::size_t customers_to_serve,
                               Discipline discipline,
-                              long seed_offset);
+                              long seed_offset,
+                              const SimulationOptions & options = {});
 
 SimulationRunStats do_web_server(float lambda,
                                  std::size_t max_cpu_queue_customers,
                                  std::size_t max_io_queue_customers,
                                  std::size_t customers_to_serve,
-                                 long seed_offset);
+                                 long seed_offset,
+                                 const SimulationOptions & options = {});
+
+// do_web_server spread over threads by the optimistic Time Warp engine (see
+// time_warp.h), with one logical process for the arrivals, one for the CPU and
+// one for each IO queue. Draws the same numbers as do_web_server, so it gets
+// the same results unless events tie. Adds the engine's counts to report.
+// Takes the options do_web_server does, except batch means, regenerative
+// cycles, traces, a rate profile and a population.
+SimulationRunStats do_web_server_time_warp(float lambda,
+                                           std::size_t max_cpu_queue_customers,
+                                           std::size_t max_io_queue_customers,
+                                           std::size_t customers_to_serve,
+                                           long seed_offset,
+                                           std::size_t threads,
+                                           const SimulationOptions & options,
+                                           time_warp::Report & report);
 
 } // project2
@@ -1,5 +1,7 @@
 #include "proj_3.h"
 
+#include <algorithm>
+#include <stdexcept>
 #include <iostream>
 #include <map>
 
@@ -9,10 +11,21 @@
 #include "incoming_customers.h"
 #include "queue.h"
 #include "server.h"
+#include "trace.h"
+#include "allocation_counter.h"
+#include "probe.h"
 #include "random_load_balancer.h"
+#include "parallel_runs.h"
+#include "analytic.h"
 
 namespace {
 
+// service times, shared by the simulation and the analytic answers
+constexpr float kMu = 1.0/3000;
+constexpr double kLowerBound = 332;
+constexpr double kUpperBound = 1e10;
+constexpr double kAlpha = 1.1;
+
 queueing::Discipline to_discipline(project3::Discipline discipline)
 {
     switch (discipline) {
@@ -21,6 +34,7 @@ queueing::Discipline to_discipline(project3::Discipline discipline)
     case project3::Discipline::SJF_NP:
         return queueing::Discipline::SJF_NP;
     }
+    throw std::invalid_argument("Unknown Discipline");
 }
 
 std::string to_string(project3::Discipline discipline)
@@ -31,6 +45,7 @@ std::string to_string(project3::Discipline discipline)
     case project3::Discipline::SJF_NP:
         return "SJF_NP";
     }
+    throw std::invalid_argument("Unknown Discipline");
 }
 
 std::string to_string(project3::Mode mode)
@@ -43,6 +58,31 @@ std::string to_string(project3::Mode mode)
     case project3::Mode::MM3:
         return "MM3";
     }
+    throw std::invalid_argument("Unknown Mode");
+}
+
+// Erlang C, Pollaczek-Khinchine or Conway's SJF formula, scaled Erlang C for MG3
+analytic::Metrics analytic_metrics(float lambda, project3::Discipline discipline, project3::Mode mode)
+{
+    const BoundedParetoGenerator bounded_pareto(kLowerBound, kUpperBound, kAlpha);
+    if (discipline == project3::Discipline::SJF_NP) {
+        if (mode != project3::Mode::MG1) {
+            throw std::invalid_argument("SJF_NP only has a closed form with one server");
+        }
+        return analytic::mg1_sjf(lambda, [&bounded_pareto] (double percentile) {
+            return bounded_pareto.percentile_to_value(percentile);
+        });
+    }
+
+    switch (mode) {
+    case project3::Mode::MM3:
+        return analytic::mmc(lambda, kMu, 3);
+    case project3::Mode::MG3:
+        return analytic::mgc(lambda, bounded_pareto.mean(), bounded_pareto.second_moment(), 3);
+    case project3::Mode::MG1:
+        return analytic::mg1(lambda, bounded_pareto.mean(), bounded_pareto.second_moment());
+    }
+    throw std::invalid_argument("Unknown Mode");
 }
 
 } // annonymous
@@ -50,29 +90,107 @@ std::string to_string(project3::Mode mode)
 
 namespace project3 {
 
-void run_project_3(float lambda,
+std::size_t run_project_3(float lambda,
                    std::size_t customers_to_serve,
                    Discipline discipline,
                    Mode mode,
-                   const int runs)
+                   const int runs,
+                   std::size_t threads,
+                   const SimulationOptions & options)
 {
+    if (options.analytic != Analytic::OFF) {
+        if (constants::PRINT_STATS) {
+            const auto metrics = analytic_metrics(lambda, discipline, mode);
+            std::cout << "Analytic (" << (metrics.exact ? "exact" : "approximate") << "):" << std::endl
+                      << metrics.to_string();
+        }
+        if (options.analytic == Analytic::ONLY) {
+            return 0;
+        }
+    }
+
+    if (options.batch_means) {
+        // one long run warms up once, the batches stand in for replications
+        auto stat = do_one_run(lambda,
+                               customers_to_serve,
+                               discipline,
+                               mode,
+                               0,
+                               options);
+        if (constants::PRINT_STATS) {
+            std::cout << "Mode: " << to_string(mode) << std::endl;
+            std::cout << "Discipline: " << to_string(discipline) << std::endl;
+            std::cout << "Batch Means of one run of " << customers_to_serve << " customers:" << std::endl
+                      << statistics::batch_means_report(stat.batch_means());
+            if (options.mser_warm_up) {
+                std::cout << "Warm-up (MSER-5): " << stat.warm_up_customers() << " customers dropped" << std::endl;
+            }
+        }
+        return 1;
+    }
+
+    if (options.regenerative) {
+        // every run starts empty, so the cycles of all of them are independent and pool together
+        const auto run_customers = std::max<std::size_t>(1, customers_to_serve / options.regenerative);
+        ParallelRunReport report;
+        auto stats = run_in_parallel(options.regenerative,
+                                     [=] (std::size_t i) {
+                                         return do_one_run(lambda,
+                                                           run_customers,
+                                                           discipline,
+                                                           mode,
+                                                           long(i)*constants::SEED_OFFSET,
+                                                           run_options(options, i));
+                                     },
+                                     threads,
+                                     &report);
+
+        std::vector<statistics::RegenerativeCycle> cycles;
+        for (auto & stat : stats) {
+            cycles.insert(cycles.end(), stat.regenerative_cycles().begin(), stat.regenerative_cycles().end());
+        }
+
+        if (constants::PRINT_STATS) {
+            std::cout << "Mode: " << to_string(mode) << std::endl;
+            std::cout << "Discipline: " << to_string(discipline) << std::endl;
+            std::cout << "Regenerative cycles of " << stats.size() << " runs of " << run_customers << " customers:" << std::endl
+                      << statistics::regenerative_report(cycles);
+            std::cout << "Parallel Runs: " << report.to_string() << std::endl;
+        }
+        return stats.size();
+    }
+
     std::map<std::string, std::map<std::uint32_t, std::vector<float>>> customer_loss_rates;
     std::map<std::string, std::map<std::uint32_t, std::vector<float>>> average_waiting_times;
     std::vector<float> system_times;
     std::vector<float> service_times;
     std::vector<float> run_times;
-    std::array<std::vector<float>, 100> slowdown_percentiles = {}; // each index holds vector of same percentile from each run
-    for (auto i = 0; i < runs; ++i) {
+    std::vector<std::vector<float>> slowdown_percentiles; // each index holds vector of same percentile from each run
+    std::vector<quantiles::Sketch> waiting_time_sketches;
+    std::vector<quantiles::Sketch> system_time_sketches;
+    std::vector<float> warm_up_customers;
+    std::vector<statistics::RunControls> controls;
+    ParallelRunReport report;
+    auto do_run = [=] (std::size_t i) {
+        return do_one_run(lambda,
+                          customers_to_serve,
+                          discipline,
+                          mode,
+                          long(i)*constants::SEED_OFFSET,
+                          run_options(options, i));
+    };
+    auto stats = options.precision > 0
+        ? run_until_precise(options, do_run, threads, &report)
+        : run_in_parallel(runs, do_run, threads, &report);
+
+    // the runs come back in order, so their results are printed in order even
+    // though each run's own output may come from any thread
+    for (std::size_t i = 0; i < stats.size(); ++i) {
         if (constants::PRINT_STATS) {
             std::cout << std::endl << "STARTING RUN: " << i << std::endl;
         }
 
-        auto stat = do_one_run(lambda,
-                               customers_to_serve,
-                               discipline,
-                               mode,
-                               i*constants::SEED_OFFSET);
-
+        auto & stat = stats[i];
         for (const auto & name_and_clr_map : stat.customer_loss_rates()) {
             auto & name = name_and_clr_map.first;
             for (const auto & priority_and_clr : name_and_clr_map.second) {
@@ -95,8 +213,14 @@ void run_project_3(float lambda,
         service_times.push_back(stat.average_service_time());
         run_times.push_back(stat.simulation_end_time());
 
+        waiting_time_sketches.push_back(stat.time_sketches().waiting_times.at(SimulationRunStats::all_queues()));
+        system_time_sketches.push_back(stat.time_sketches().system_times);
+        warm_up_customers.push_back(stat.warm_up_customers());
+        controls.push_back(stat.controls());
+
         auto & run_slowdown_percentiles = stat.average_slowdown_percentiles();
-        for (auto percentile = 0; percentile < 100; ++percentile) {
+        slowdown_percentiles.resize(run_slowdown_percentiles.size());
+        for (std::size_t percentile = 0; percentile < run_slowdown_percentiles.size(); ++percentile) {
             slowdown_percentiles[percentile].push_back(run_slowdown_percentiles[percentile]);
         }
 
@@ -130,12 +254,41 @@ void run_project_3(float lambda,
                   << statistics::confidence_interval_string(system_times)
                   << std::endl;
 
-        /*
-        for (auto percentile = 0; percentile < 100; ++percentile) {
-            std::cout << statistics::confidence_interval_string(slowdown_percentiles[percentile]) << std::endl;
+        std::cout << statistics::control_variate_report(
+            {{"Waiting Time", average_waiting_times.at(SimulationRunStats::all_queues()).at(SimulationRunStats::all_priorities())},
+             {"System Time", system_times}},
+            controls);
+
+        if (options.quantiles) {
+            std::cout << "Waiting Time Quantiles:" << std::endl
+                      << quantiles::quantile_report(waiting_time_sketches);
+
+            std::cout << "System Time Quantiles:" << std::endl
+                      << quantiles::quantile_report(system_time_sketches);
+        }
+
+        if (options.mser_warm_up) {
+            std::cout << "Warm-up (MSER-5): "
+                      << statistics::confidence_interval_string(warm_up_customers)
+                      << " customers dropped" << std::endl;
+        }
+
+        std::cout << "Parallel Runs: " << report.to_string() << std::endl;
+        if (options.precision > 0) {
+            std::cout << precision_string(stats, options) << std::endl;
+        }
+
+        // only the bounded pareto modes know their service time percentiles
+        if (options.slowdown_buckets && mode != Mode::MM3) {
+            std::cout << "Slowdown by service time percentile:" << std::endl;
+            for (std::size_t percentile = 0; percentile < slowdown_percentiles.size(); ++percentile) {
+                std::cout << float(100 * (percentile + 1)) / slowdown_percentiles.size() << "%: "
+                          << statistics::confidence_interval_string(slowdown_percentiles[percentile]) << std::endl;
+            }
         }
-        */
     }
+
+    return stats.size();
 }
 
 
@@ -143,7 +296,8 @@ SimulationRunStats do_one_run(float lambda,
                               std::size_t customers_to_serve,
                               Discipline discipline,
                               Mode mode,
-                              long seed_offset)
+                              long seed_offset,
+                              const SimulationOptions & options)
 {
     long arrival_seed = 1111 + seed_offset;
     long service_seed = 2222 + seed_offset;
@@ -151,18 +305,16 @@ SimulationRunStats do_one_run(float lambda,
 
     SimulationTimer timer;
 
-    constexpr float kMu = 1.0/3000;
-    constexpr double kLowerBound = 332;
-    constexpr double kUpperBound = 1e10;
-    constexpr double kAlpha = 1.1;
     std::function<float()> service_time_generator;
     std::function<double(double)> percentile_to_service_time;
+    double expected_service_time = 0;
     switch(mode) {
     case Mode::MM3:
         service_time_generator = [gen = ExponentialGenerator(kMu, service_seed)] {
             return gen.generate();
         };
         percentile_to_service_time = nullptr; // could make this for exponential if needed
+        expected_service_time = ExponentialGenerator(kMu).mean();
         break;
     case Mode::MG3:
     case Mode::MG1:
@@ -180,9 +332,17 @@ SimulationRunStats do_one_run(float lambda,
             return gen.percentile_to_value(percentile);
         };
 
+        expected_service_time = BoundedParetoGenerator(kLowerBound, kUpperBound, kAlpha).mean();
         break;
     }
 
+    // sample means of the draws, for control variates
+    statistics::RunningMean arrival_draws;
+    statistics::RunningMean service_draws;
+    service_time_generator = [generate = service_time_generator, &service_draws] {
+        return float(service_draws.add(generate()));
+    };
+
     const std::string kQueueName = "QUEUE";
     constexpr std::size_t stats_index = 0; // used for project 1
     constexpr auto kTransientPeriod = 1000;
@@ -190,15 +350,38 @@ SimulationRunStats do_one_run(float lambda,
     auto spy = SimulationSpy(stats_index,
                              kInitialReserve,
                              {kQueueName},
-                             kTransientPeriod,
-                             percentile_to_service_time);
+                             options.mser_warm_up || options.regenerative ? 0 : kTransientPeriod,
+                             percentile_to_service_time,
+                             default_customer_priority(),
+                             default_customer_priority(),
+                             options.slowdown_buckets ? options.slowdown_buckets : default_slowdown_buckets());
+
+    if (options.quantiles) {
+        spy.enable_quantiles(quantiles::TDigest()); // bounded pareto waits have a very long tail
+    }
+
+    auto trace_writer = attach_trace_writer(options.trace_path, timer, spy);
+
+    if (options.batch_means) {
+        spy.enable_batch_means(std::max<std::size_t>(1, customers_to_serve / options.batch_means));
+    }
+
+    if (options.mser_warm_up) {
+        // half the run at most, so the buffer of held back customers stays bounded
+        spy.enable_mser_warm_up(customers_to_serve / 2);
+    }
+
+    if (options.regenerative) {
+        spy.enable_regenerative_cycles();
+    }
 
     auto exit_customer = [&spy] (const std::shared_ptr<Customer> & customer) {
         spy.on_customer_exiting(customer);
     };
 
+    const auto arrival_generator = ExponentialGenerator(lambda, arrival_seed);
     auto incoming_customers = IncomingCustomers(timer,
-                                                ExponentialGenerator(lambda, arrival_seed));
+                                                statistics::MeasuredGenerator(arrival_generator, arrival_draws));
 
 
     Queue queue(SIZE_MAX,
@@ -246,16 +429,46 @@ SimulationRunStats do_one_run(float lambda,
 
     incoming_customers.start();
 
+    allocation_counter::AllocationReport allocation_report;
+    probe::ProbeReport probe_report;
     while (spy.total_serviced_customers() < customers_to_serve) {
         timer.advance_time();
     }
 
+    // finished here rather than by its destructor, which can't report a failure
+    if (trace_writer) {
+        trace_writer->close();
+    }
+
+    if (options.counters) {
+        options.counters->add_run(timer.dispatched_jobs(), timer.dispatched_arrivals());
+    }
+
+    if constexpr (constants::ALLOCATION_ACCOUNTING) {
+        std::cout << allocation_report.to_string(timer.dispatched_arrivals());
+    }
+
+    if constexpr (constants::PROBES_ENABLED) {
+        std::cout << probe_report.to_string(timer.dispatched_arrivals());
+    }
+
+    statistics::RunControls controls;
+    controls.add("arrival", arrival_draws.mean(), arrival_generator.mean());
+    controls.add("service", service_draws.mean(), expected_service_time);
+
     return SimulationRunStats(spy.customer_loss_rates(),
                               spy.average_waiting_times(),
                               spy.average_system_time(),
                               spy.average_service_time(),
                               timer.time(),
-                              spy.average_slowdown_percentiles());
+                              spy.average_slowdown_percentiles(),
+                              spy.time_sketches(),
+                              spy.batch_means(),
+                              spy.warm_up_customers(),
+                              spy.regenerative_cycles(),
+                              controls,
+                              spy.sensitivities(),
+                              spy.time_buckets());
 }
 
 } // project3
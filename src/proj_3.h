@@ -4,6 +4,7 @@
 #include <cstddef>
 
 #include "stats.h"
+#include "simulation_options.h"
 
 namespace project3 {
 
@@ -18,16 +19,20 @@ enum class Discipline {
     SJF_NP,
 };
 
-void run_project_3(float lambda,
+// returns how many runs were done
+std::size_t run_project_3(float lambda,
                    std::size_t customers_to_serve,
                    Discipline discipline,
                    Mode mode,
-                   const int runs);
+                   const int runs,
+                   std::size_t threads,
+                   const SimulationOptions & options = {});
 
 SimulationRunStats do_one_run(float lambda,
                               std::size_t customers_to_serve,
                               Discipline discipline,
                               Mode mode,
-                              long seed_offset);
+                              long seed_offset,
+                              const SimulationOptions & options = {});
 
 } // project3
@@ -0,0 +1,260 @@
+#include "quantile_sketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "stats.h"
+
+namespace quantiles {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+} // anonymous
+
+HdrHistogram::HdrHistogram(double lowest, double highest, int sub_bucket_bits)
+: lowest_(lowest)
+, highest_(highest)
+, sub_bucket_bits_(sub_bucket_bits)
+, sub_buckets_(std::size_t(1) << sub_bucket_bits)
+{
+    if (!(lowest > 0) || !(highest > lowest) || sub_bucket_bits < 0 || sub_bucket_bits > 16) {
+        throw std::invalid_argument("HdrHistogram needs 0 < lowest < highest and 0 <= sub_bucket_bits <= 16");
+    }
+
+    const auto octaves = std::size_t(std::ilogb(highest / lowest)) + 1;
+    counts_.resize(1 + octaves * sub_buckets_);
+}
+
+std::size_t HdrHistogram::index(double value) const
+{
+    if (!(value > lowest_)) {
+        return 0;
+    }
+
+    const double scaled = std::min(value, highest_) / lowest_;
+    const auto exponent = std::ilogb(scaled);
+    const double mantissa = std::scalbn(scaled, -exponent); // in [1, 2)
+    const auto sub_bucket = std::size_t((mantissa - 1) * sub_buckets_);
+    return std::min(1 + std::size_t(exponent) * sub_buckets_ + sub_bucket, counts_.size() - 1);
+}
+
+double HdrHistogram::bucket_midpoint(std::size_t index) const
+{
+    if (index == 0) {
+        return 0; // mostly customers that didn't wait at all
+    }
+
+    const auto exponent = int((index - 1) / sub_buckets_);
+    const auto sub_bucket = double((index - 1) % sub_buckets_);
+    const double octave_start = std::scalbn(lowest_, exponent);
+    return octave_start * (1 + (sub_bucket + .5) / sub_buckets_);
+}
+
+void HdrHistogram::merge(const HdrHistogram & other)
+{
+    if (lowest_ != other.lowest_ || highest_ != other.highest_ || sub_bucket_bits_ != other.sub_bucket_bits_) {
+        throw std::invalid_argument("HdrHistogram can only merge histograms with the same range");
+    }
+
+    for (std::size_t i = 0; i < counts_.size(); ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+}
+
+double HdrHistogram::quantile(double fraction) const
+{
+    if (count_ == 0) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    const auto rank = std::max<std::uint64_t>(1, std::uint64_t(std::ceil(fraction * count_)));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts_.size(); ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::min(bucket_midpoint(i), highest_);
+        }
+    }
+    return highest_;
+}
+
+void HdrHistogram::clear()
+{
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+}
+
+TDigest::TDigest(double compression)
+: compression_(compression)
+, buffer_capacity_(std::size_t(5 * compression))
+, min_(std::numeric_limits<double>::infinity())
+, max_(-std::numeric_limits<double>::infinity())
+{
+    if (!(compression >= 10)) {
+        throw std::invalid_argument("TDigest compression must be at least 10");
+    }
+    buffer_.reserve(buffer_capacity_);
+}
+
+// Merging t-digest: sort everything by mean, then greedily fold neighbours
+// together while the merged centroid stays within one unit of the arcsine
+// scale function, which keeps centroids small near q = 0 and q = 1.
+void TDigest::compress() const
+{
+    if (buffer_.empty()) {
+        return;
+    }
+
+    for (const auto & centroid : buffer_) {
+        count_ += std::uint64_t(centroid.weight);
+        min_ = std::min(min_, centroid.mean);
+        max_ = std::max(max_, centroid.mean);
+    }
+
+    buffer_.insert(buffer_.end(), centroids_.begin(), centroids_.end());
+    std::sort(buffer_.begin(), buffer_.end(), [] (const Centroid & lhs, const Centroid & rhs) {
+        return lhs.mean < rhs.mean;
+    });
+
+    const double total_weight = count_;
+    const double normalizer = compression_ / (2 * kPi);
+    auto k = [normalizer] (double q) { return normalizer * std::asin(2 * q - 1); };
+    auto k_inverse = [normalizer] (double scale) { return (std::sin(scale / normalizer) + 1) / 2; };
+
+    centroids_.clear();
+    auto current = buffer_.front();
+    double weight_so_far = 0;
+    double q_limit = k_inverse(k(0) + 1);
+    for (std::size_t i = 1; i < buffer_.size(); ++i) {
+        const auto & next = buffer_[i];
+        const double proposed_weight = current.weight + next.weight;
+        if ((weight_so_far + proposed_weight) / total_weight <= q_limit) {
+            current.mean += (next.mean - current.mean) * next.weight / proposed_weight;
+            current.weight = proposed_weight;
+        } else {
+            weight_so_far += current.weight;
+            centroids_.push_back(current);
+            q_limit = k_inverse(k(weight_so_far / total_weight) + 1);
+            current = next;
+        }
+    }
+    centroids_.push_back(current);
+    buffer_.clear();
+}
+
+void TDigest::merge(const TDigest & other)
+{
+    other.compress();
+    for (const auto & centroid : other.centroids_) {
+        buffer_.push_back(centroid);
+    }
+    // the other's centroids only give the means of its extremes
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    compress();
+}
+
+double TDigest::quantile(double fraction) const
+{
+    compress();
+    if (centroids_.empty()) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    if (centroids_.size() == 1) {
+        return centroids_.front().mean;
+    }
+
+    const double total_weight = count_;
+    const double index = std::clamp(fraction, 0.0, 1.0) * total_weight;
+
+    const auto & first = centroids_.front();
+    if (index < first.weight / 2) {
+        return min_ + (first.mean - min_) * index / (first.weight / 2);
+    }
+
+    const auto & last = centroids_.back();
+    if (index > total_weight - last.weight / 2) {
+        return last.mean + (max_ - last.mean) * (index - (total_weight - last.weight / 2)) / (last.weight / 2);
+    }
+
+    // interpolate between the centres of the two centroids around index
+    double centre = first.weight / 2;
+    for (std::size_t i = 0; i + 1 < centroids_.size(); ++i) {
+        const auto & left = centroids_[i];
+        const auto & right = centroids_[i + 1];
+        const double gap = (left.weight + right.weight) / 2;
+        if (index <= centre + gap) {
+            return left.mean + (right.mean - left.mean) * (index - centre) / gap;
+        }
+        centre += gap;
+    }
+    return last.mean;
+}
+
+void TDigest::clear()
+{
+    centroids_.clear();
+    buffer_.clear();
+    count_ = 0;
+    min_ = std::numeric_limits<double>::infinity();
+    max_ = -std::numeric_limits<double>::infinity();
+}
+
+double NoSketch::quantile(double) const
+{
+    return std::numeric_limits<double>::quiet_NaN();
+}
+
+void Sketch::merge(const Sketch & other)
+{
+    std::visit(
+        [] (auto & sketch, const auto & other_sketch) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(sketch)>, std::decay_t<decltype(other_sketch)>>) {
+                sketch.merge(other_sketch);
+            } else {
+                throw std::invalid_argument("Sketch can only merge sketches of the same kind");
+            }
+        },
+        sketch_,
+        other.sketch_);
+}
+
+const std::vector<double> & reported_quantiles()
+{
+    static const std::vector<double> fractions = {.5, .9, .99, .999};
+    return fractions;
+}
+
+std::string quantile_report(const std::vector<Sketch> & runs, const std::string & indent)
+{
+    std::stringstream ss;
+    if (runs.empty()) {
+        return ss.str();
+    }
+
+    auto merged = runs.front();
+    for (std::size_t i = 1; i < runs.size(); ++i) {
+        merged.merge(runs[i]);
+    }
+
+    for (auto fraction : reported_quantiles()) {
+        std::vector<float> per_run;
+        for (const auto & run : runs) {
+            per_run.push_back(run.quantile(fraction));
+        }
+
+        ss << indent << "p" << fraction * 100 << ": "
+           << statistics::confidence_interval_string(per_run)
+           << " (merged: " << merged.quantile(fraction) << ")" << std::endl;
+    }
+    return ss.str();
+}
+
+} // quantiles
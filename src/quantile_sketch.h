@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+// Constant memory streaming quantile estimators.
+//
+// HdrHistogram keeps log-linear buckets over a fixed [lowest, highest] range,
+// so every recorded value is off by at most 1 / 2^sub_bucket_bits of itself.
+// It suits the bounded waiting times of projects 1 and 2. TDigest keeps a few
+// hundred weighted centroids whose size shrinks towards the tails, which holds
+// up better for the heavy tailed bounded pareto service times of project 3.
+// Both merge, so replications can be combined into one estimate.
+
+namespace quantiles {
+
+class HdrHistogram {
+public:
+    explicit HdrHistogram(double lowest = 1e-3, double highest = 1e5, int sub_bucket_bits = 7);
+
+    void record(double value)
+    {
+        ++counts_[index(value)];
+        ++count_;
+    }
+
+    void merge(const HdrHistogram & other);
+    double quantile(double fraction) const;
+    std::uint64_t count() const
+    {
+        return count_;
+    }
+    void clear();
+
+private:
+    std::size_t index(double value) const;
+    double bucket_midpoint(std::size_t index) const;
+
+    double lowest_;
+    double highest_;
+    int sub_bucket_bits_;
+    std::size_t sub_buckets_;
+    std::vector<std::uint32_t> counts_; // [0] holds everything at or below lowest_, read back as 0
+    std::uint64_t count_ = 0;
+};
+
+class TDigest {
+public:
+    explicit TDigest(double compression = 100);
+
+    void record(double value)
+    {
+        buffer_.push_back({value, 1});
+        if (buffer_.size() >= buffer_capacity_) {
+            compress();
+        }
+    }
+
+    void merge(const TDigest & other);
+    double quantile(double fraction) const;
+    std::uint64_t count() const
+    {
+        return count_ + buffer_.size();
+    }
+    void clear();
+
+private:
+    struct Centroid {
+        double mean;
+        double weight;
+    };
+
+    // folds the buffer into the centroids (const so quantile() can flush first)
+    void compress() const;
+
+    double compression_;
+    std::size_t buffer_capacity_;
+    mutable std::vector<Centroid> centroids_; // sorted by mean
+    mutable std::vector<Centroid> buffer_;
+    mutable std::uint64_t count_ = 0; // weight already in centroids_
+    mutable double min_;
+    mutable double max_;
+};
+
+// Records nothing and allocates nothing, so runs that don't report quantiles
+// don't pay for them
+class NoSketch {
+public:
+    void record(double)
+    {}
+
+    void merge(const NoSketch &)
+    {}
+
+    double quantile(double) const;
+    std::uint64_t count() const
+    {
+        return 0;
+    }
+    void clear()
+    {}
+};
+
+// Either kind of estimator behind one interface; only sketches of the same kind
+// merge. A default constructed Sketch is off, a NoSketch.
+class Sketch {
+public:
+    Sketch()
+    : sketch_(NoSketch())
+    {}
+
+    Sketch(const HdrHistogram & histogram)
+    : sketch_(histogram)
+    {}
+
+    Sketch(const TDigest & digest)
+    : sketch_(digest)
+    {}
+
+    void record(double value)
+    {
+        std::visit([value] (auto & sketch) { sketch.record(value); }, sketch_);
+    }
+
+    void merge(const Sketch & other);
+
+    double quantile(double fraction) const
+    {
+        return std::visit([fraction] (const auto & sketch) { return sketch.quantile(fraction); }, sketch_);
+    }
+
+    std::uint64_t count() const
+    {
+        return std::visit([] (const auto & sketch) { return sketch.count(); }, sketch_);
+    }
+
+    void clear()
+    {
+        std::visit([] (auto & sketch) { sketch.clear(); }, sketch_);
+    }
+
+    bool enabled() const
+    {
+        return !std::holds_alternative<NoSketch>(sketch_);
+    }
+
+private:
+    std::variant<NoSketch, HdrHistogram, TDigest> sketch_;
+};
+
+// What a spy measured in one run
+struct TimeSketches {
+    std::unordered_map<std::string, Sketch> waiting_times; // by queue name, plus the total under all_queues()
+    std::unordered_map<std::string, Sketch> sojourn_times; // by queue name, the waiting plus the service after it
+    Sketch system_times;
+};
+
+// the quantiles every report prints: p50, p90, p99, p99.9
+const std::vector<double> & reported_quantiles();
+
+// One line per reported quantile: the mean ± 95% interval of the per run
+// estimates, followed by the estimate from all runs merged together
+std::string quantile_report(const std::vector<Sketch> & runs, const std::string & indent = "    ");
+
+} // quantiles
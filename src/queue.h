@@ -1,8 +1,10 @@
 #pragma once
 
+#include <stdexcept>
 #include <memory>
 #include <functional>
-#include <queue>
+#include <deque>
+#include <iterator>
 #include <vector>
 #include <iostream>
 #include <map>
@@ -10,6 +12,10 @@
 
 #include "constants.h"
 #include "customer.h"
+#include "state_log.h"
+#include "log.h"
+#include "allocation_counter.h"
+#include "probe.h"
 
 namespace queueing {
 
@@ -23,6 +29,7 @@ namespace queueing {
 
 } // queueing
 
+// A null service_time_generator means customers arrive with their service time already set
 class Queue {
 public:
     Queue(std::size_t max_size,
@@ -69,59 +76,60 @@ public:
 
     void incoming_preempted_customer(const std::shared_ptr<Customer> & customer)
     {
+        allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::QUEUE);
         if (!customer) {
             throw std::runtime_error("incoming_preempted_customer got null customer");
         }
-        if (constants::DEBUG_ENABLED) {
-            std::cout << "Queue::" << __func__
-                      << ": got {" << customer->to_string()
-                      << "}" << std::endl;
-        }
+        logging::log<logging::Level::DEBUG, logging::Component::QUEUE>(
+            "{}::incoming_preempted_customer got customer: {} priority: {} remaining service time: {}",
+            name_, customer->id(), customer->priority(), customer->service_time());
         auto & priority_vector = customers_.at(customer->priority());
-        priority_vector.insert(priority_vector.begin(), customer);
+        insert(priority_vector, priority_vector.begin(), customer);
 
         if (priority_vector.size() > max_vector_size_) {
-            if (constants::DEBUG_ENABLED) {
-                std::cout << "Queue::" << __func__
-                        << " vector too large after performing preempt!"
-                        << " Kicking: " << priority_vector.back()->to_string()
-                        << std::endl;
-            }
+            logging::log<logging::Level::DEBUG, logging::Component::QUEUE>(
+                "{}::incoming_preempted_customer vector too large after performing preempt! Kicking: {}",
+                name_, priority_vector.back()->id());
 
             on_customer_rejected(priority_vector.back());
-            priority_vector.pop_back();
+            pop_back(priority_vector);
         }
     }
 
     void accept_customer(const std::shared_ptr<Customer> & customer)
     {
+        probe::ScopedProbe scoped_probe(probe::Probe::QUEUE_ACCEPT);
+        allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::QUEUE);
         auto & priority_vector = customers_.at(customer->priority());
 
         if (priority_vector.size() >= max_vector_size_) {
             on_customer_rejected(customer);
         } else {
-            if (constants::DEBUG_ENABLED) {
-                std::cout << name_ << "::" << __func__
-                        << " adding customer: " << customer->to_string()
-                        << std::endl;
+            logging::log<logging::Level::DEBUG, logging::Component::QUEUE>(
+                "{}::accept_customer adding customer: {} priority: {}",
+                name_, customer->id(), customer->priority());
+            if (generate_service_time_) {
+                if (state_log_) {
+                    state_log_->save([customer, service_time = customer->service_time()] {
+                        customer->set_service_time(service_time);
+                    });
+                }
+                customer->set_service_time(generate_service_time_());
             }
-            customer->set_service_time(generate_service_time_());
 
-            customer->add_event(CustomerEvent(CustomerEventType::ENTERED,
-                                              PlaceType::QUEUE,
-                                              name_,
-                                              current_time_()));
+            add_event(customer, CustomerEventType::ENTERED);
 
             switch (discipline_) {
             case queueing::Discipline::FCFS:
-                priority_vector.push_back(customer);
+                push_back(priority_vector, customer);
                 break;
             case queueing::Discipline::LCFS_NP:
-                priority_vector.push_back(customer);
+                push_back(priority_vector, customer);
                 break;
             case queueing::Discipline::SJF_NP:
             {
-                priority_vector.insert(
+                insert(
+                    priority_vector,
                     std::upper_bound(priority_vector.begin(),
                                      priority_vector.end(),
                                      customer,
@@ -134,7 +142,7 @@ public:
                 break;
             }
             case queueing::Discipline::PRIO_NP:
-                priority_vector.push_back(customer);
+                push_back(priority_vector, customer);
                 break;
             case queueing::Discipline::PRIO_P:
                 if (attempt_preempt_ == nullptr) {
@@ -143,20 +151,22 @@ public:
 
                 if (priority_vector.empty() && requests_.empty()) {
                     // Add entrance event assuming preempt goes through (fix this?)
-                    customer->add_event(CustomerEvent(CustomerEventType::EXITED,
-                                                      PlaceType::QUEUE,
-                                                      name_,
-                                                      current_time_()));
+                    add_event(customer, CustomerEventType::EXITED);
 
                     auto swapped_customer = attempt_preempt_(customer);
                     if (swapped_customer != customer) {
                         incoming_preempted_customer(swapped_customer);
                     } else {
+                        if (state_log_) {
+                            state_log_->save([customer, event = customer->events().back()] {
+                                customer->add_event(event);
+                            });
+                        }
                         customer->delete_last_event();
-                        priority_vector.push_back(customer);
+                        push_back(priority_vector, customer);
                     }
                 } else {
-                    priority_vector.push_back(customer);
+                    push_back(priority_vector, customer);
                 }
                 break;
             }
@@ -167,7 +177,11 @@ public:
 
     void request_one_customer(const CustomerRequest & request)
     {
-        requests_.push(request);
+        allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::QUEUE);
+        requests_.push_back(request);
+        if (state_log_) {
+            state_log_->save([this] { requests_.pop_back(); });
+        }
         handle_requests();
     }
 
@@ -175,18 +189,82 @@ public:
         attempt_preempt_ = attempt_preempt;
     }
 
+    // every change to the waiting customers and requests, and to the customers
+    // themselves, is saved while a log is set, so the Time Warp engine can roll
+    // the queue back (null turns saving off)
+    void set_state_log(StateLog * state_log)
+    {
+        state_log_ = state_log;
+    }
+
 private:
     void on_customer_rejected(const std::shared_ptr<Customer> & customer) {
-        if (constants::DEBUG_ENABLED) {
-            std::cout << "Queue was full. Rejected:" << customer->to_string() << std::endl;
+        logging::log<logging::Level::DEBUG, logging::Component::QUEUE>(
+            "{} was full. Rejected: {}", name_, customer->id());
+        if (state_log_) {
+            state_log_->save([customer, departure_time = customer->departure_time(), serviced = customer->serviced()] {
+                customer->set_departure_time(departure_time);
+                customer->set_serviced(serviced);
+            });
         }
         customer->set_departure_time(current_time_());
-        customer->add_event(CustomerEvent(CustomerEventType::DROPPED_BY,
+        add_event(customer, CustomerEventType::DROPPED_BY);
+        customer->set_serviced(false);
+        exit_customer_(customer);
+    }
+
+    // The changes to the customers and their lists, saved to the state log if
+    // there is one. A list position is saved as an index, since undoing the
+    // changes after it can replace the list's nodes.
+    void add_event(const std::shared_ptr<Customer> & customer, CustomerEventType type)
+    {
+        customer->add_event(CustomerEvent(type,
                                           PlaceType::QUEUE,
                                           name_,
                                           current_time_()));
-        customer->set_serviced(false);
-        exit_customer_(customer);
+        if (state_log_) {
+            state_log_->save([customer] { customer->delete_last_event(); });
+        }
+    }
+
+    void push_back(std::list<std::shared_ptr<Customer>> & customers, const std::shared_ptr<Customer> & customer)
+    {
+        customers.push_back(customer);
+        if (state_log_) {
+            state_log_->save([&customers] { customers.pop_back(); });
+        }
+    }
+
+    void insert(std::list<std::shared_ptr<Customer>> & customers,
+                std::list<std::shared_ptr<Customer>>::iterator position,
+                const std::shared_ptr<Customer> & customer)
+    {
+        if (state_log_) {
+            state_log_->save([&customers, index = std::distance(customers.begin(), position)] {
+                customers.erase(std::next(customers.begin(), index));
+            });
+        }
+        customers.insert(position, customer);
+    }
+
+    std::shared_ptr<Customer> pop_front(std::list<std::shared_ptr<Customer>> & customers)
+    {
+        auto customer = customers.front();
+        customers.pop_front();
+        if (state_log_) {
+            state_log_->save([&customers, customer] { customers.push_front(customer); });
+        }
+        return customer;
+    }
+
+    std::shared_ptr<Customer> pop_back(std::list<std::shared_ptr<Customer>> & customers)
+    {
+        auto customer = customers.back();
+        customers.pop_back();
+        if (state_log_) {
+            state_log_->save([&customers, customer] { customers.push_back(customer); });
+        }
+        return customer;
     }
 
 
@@ -205,65 +283,57 @@ private:
         switch (discipline_) {
         case queueing::Discipline::FCFS:
         {
-            auto & customer_vector = customers_.at(default_customer_priority());
-            auto customer = customer_vector.front();
-            customer_vector.erase(customer_vector.begin()); // oof the moves
-            return customer;
+            return pop_front(customers_.at(default_customer_priority()));
         }
         case queueing::Discipline::LCFS_NP:
         case queueing::Discipline::SJF_NP:
         {
-            auto & customer_vector = customers_.at(default_customer_priority());
-            auto customer = customer_vector.back();
-            customer_vector.pop_back();
-            return customer;
+            return pop_back(customers_.at(default_customer_priority()));
         }
         case queueing::Discipline::PRIO_NP:
         case queueing::Discipline::PRIO_P:
         {
-            auto & customer_vector = lowest_non_empty_customer_vector();
-            auto customer = customer_vector.front();
-            customer_vector.erase(customer_vector.begin()); // oof the moves
-            return customer;
+            return pop_front(lowest_non_empty_customer_vector());
         }
         }
+        throw std::invalid_argument("Unknown Discipline");
     }
 
     void handle_requests()
     {
-        if (constants::DEBUG_ENABLED) {
-            std::cout << name_ << "::" << __func__ << " entered with: "
-                      << size() << " customers and "
-                      << requests_.size() << " requests" << std::endl;
+        probe::ScopedProbe scoped_probe(probe::Probe::QUEUE_HANDLE_REQUESTS);
+        if constexpr (logging::enabled(logging::Level::TRACE, logging::Component::QUEUE)) {
+            logging::log<logging::Level::TRACE, logging::Component::QUEUE>(
+                "{}::handle_requests entered with: {} customers and {} requests",
+                name_, size(), requests_.size());
         }
 
         while (!empty() && !requests_.empty()) {
             auto request = requests_.front();
             auto customer = return_and_pop_customer();
 
-            if (constants::DEBUG_ENABLED) {
-                std::cout << name_ << "::" << __func__
-                          << " delivering_customer: " << customer->to_string() << std::endl;
-            }
+            logging::log<logging::Level::DEBUG, logging::Component::QUEUE>(
+                "{}::handle_requests delivering customer: {} service time: {}",
+                name_, customer->id(), customer->service_time());
 
-            customer->add_event(CustomerEvent(CustomerEventType::EXITED,
-                                              PlaceType::QUEUE,
-                                              name_,
-                                              current_time_()));
+            add_event(customer, CustomerEventType::EXITED);
             request(customer);
 
-            requests_.pop();
+            requests_.pop_front();
+            if (state_log_) {
+                state_log_->save([this, request] { requests_.push_front(request); });
+            }
         }
 
-        if (constants::DEBUG_ENABLED) {
-            std::cout << name_ << "::" << __func__ << " exited with: "
-                    << size() << " customers and "
-                    << requests_.size() << " requests" << std::endl;
+        if constexpr (logging::enabled(logging::Level::TRACE, logging::Component::QUEUE)) {
+            logging::log<logging::Level::TRACE, logging::Component::QUEUE>(
+                "{}::handle_requests exited with: {} customers and {} requests",
+                name_, size(), requests_.size());
         }
     }
     std::size_t max_vector_size_;
     CustomerRequest exit_customer_;
-    std::queue<std::function<void(std::shared_ptr<Customer>)>> requests_;
+    std::deque<std::function<void(std::shared_ptr<Customer>)>> requests_;
     std::map<std::uint32_t , std::list<std::shared_ptr<Customer>>> customers_;
     std::function<float()> generate_service_time_;
     const std::function<float()> current_time_;
@@ -271,4 +341,5 @@ private:
     const std::string name_;
 
    CustomerSwapFunction attempt_preempt_ = nullptr;
+   StateLog * state_log_ = nullptr;
 };
@@ -6,7 +6,10 @@
 
 #include "customer.h"
 #include "prng.h"
+#include "state_log.h"
 #include "constants.h"
+#include "log.h"
+#include "allocation_counter.h"
 
 using RandomLoadBalancerTarget = std::pair<CustomerRequest, float>;
 // Each target has the associated upper probability between 0 and 1
@@ -38,16 +41,17 @@ public:
 
     void route_customer(const std::shared_ptr<Customer> & customer)
     {
+        allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::BALANCER);
+        if (state_log_) {
+            state_log_->save([this, state = uniform_generator_.state()] { uniform_generator_.restore(state); });
+        }
         auto generated_number = uniform_generator_.generate();
 
         for (const auto & target : targets_) {
             if (generated_number < target.second) {
-                if (constants::DEBUG_ENABLED) {
-                    std::cout << "RandomLoadBalancer::" << __func__
-                              << " generated: " << generated_number
-                              << " and chose target with upper value: " << target.second
-                              << std::endl;
-                }
+                logging::log<logging::Level::DEBUG, logging::Component::BALANCER>(
+                    "RandomLoadBalancer::route_customer generated: {} and chose target with upper value: {} for customer: {}",
+                    generated_number, target.second, customer->id());
 
                 target.first(customer);
                 return;
@@ -55,7 +59,15 @@ public:
         }
     }
 
+    // every draw is saved while a log is set, so a Time Warp rollback
+    // redraws the same numbers (null turns saving off)
+    void set_state_log(StateLog * state_log)
+    {
+        state_log_ = state_log;
+    }
+
 private:
     const std::vector<RandomLoadBalancerTarget> targets_;
     UniformGenerator uniform_generator_;
+    StateLog * state_log_ = nullptr;
 };
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include "rate_profile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+RateProfile::RateProfile(const std::vector<Point> & points, Shape shape, double period)
+: points_(points)
+, shape_(shape)
+, period_(period)
+{
+    if (points_.empty() || points_.front().time != 0) {
+        throw std::invalid_argument("a rate profile starts with a point at time 0");
+    }
+    for (std::size_t i = 0; i < points_.size(); ++i) {
+        if (!(points_[i].rate >= 0) || (i > 0 && !(points_[i].time > points_[i - 1].time))) {
+            throw std::invalid_argument("rate profile points need rising times and rates >= 0");
+        }
+    }
+    if (!(period_ > points_.back().time) || std::isinf(period_)) {
+        throw std::invalid_argument("a rate profile's period must come after its last point");
+    }
+    points_.push_back({period_, points_.front().rate});
+
+    for (std::size_t i = 0; i + 1 < points_.size(); ++i) {
+        const auto & start = points_[i];
+        const auto & end = points_[i + 1];
+        if (shape_ == Shape::STEP) {
+            piece_starts_.push_back(start.time);
+            piece_bounds_.push_back(start.rate);
+            continue;
+        }
+        const auto width = (end.time - start.time) / kLinearPieces;
+        for (std::size_t j = 0; j < kLinearPieces; ++j) {
+            piece_starts_.push_back(start.time + j * width);
+            piece_bounds_.push_back(std::max(rate(start.time + j * width), rate(start.time + (j + 1) * width)));
+        }
+    }
+
+    if (mean_rate() <= 0) {
+        throw std::invalid_argument("a rate profile needs a rate above 0 somewhere");
+    }
+}
+
+double RateProfile::rate(double time) const
+{
+    auto local = std::fmod(time, period_);
+    if (local < 0) {
+        local += period_;
+    }
+
+    // the last point at or before local, which never is the closing one
+    auto after = std::upper_bound(points_.begin(), points_.end() - 1, local,
+                                  [] (double value, const Point & point) { return value < point.time; });
+    const auto & start = *(after - 1);
+    if (shape_ == Shape::STEP) {
+        return start.rate;
+    }
+    const auto & end = *after;
+    return start.rate + (end.rate - start.rate) * (local - start.time) / (end.time - start.time);
+}
+
+RateProfile::Piece RateProfile::piece(double time) const
+{
+    const auto cycle_start = std::floor(time / period_) * period_;
+    const auto local = std::clamp(time - cycle_start, 0.0, period_);
+    std::size_t index = std::upper_bound(piece_starts_.begin(), piece_starts_.end(), local) - piece_starts_.begin() - 1;
+
+    const auto end = index + 1 < piece_starts_.size() ? piece_starts_[index + 1] : period_;
+    return {index, cycle_start, cycle_start + end, piece_bounds_[index]};
+}
+
+RateProfile::Piece RateProfile::next(const Piece & piece) const
+{
+    auto index = piece.index + 1;
+    auto cycle_start = piece.cycle_start;
+    if (index == piece_starts_.size()) {
+        index = 0;
+        cycle_start += period_;
+    }
+
+    const auto end = index + 1 < piece_starts_.size() ? piece_starts_[index + 1] : period_;
+    return {index, cycle_start, cycle_start + end, piece_bounds_[index]};
+}
+
+double RateProfile::mean_rate() const
+{
+    double area = 0;
+    for (std::size_t i = 0; i + 1 < points_.size(); ++i) {
+        const auto width = points_[i + 1].time - points_[i].time;
+        area += shape_ == Shape::STEP
+            ? points_[i].rate * width
+            : (points_[i].rate + points_[i + 1].rate) / 2 * width;
+    }
+    return area / period_;
+}
+
+double RateProfile::acceptance() const
+{
+    double bound_area = 0;
+    for (std::size_t i = 0; i < piece_starts_.size(); ++i) {
+        const auto end = i + 1 < piece_starts_.size() ? piece_starts_[i + 1] : period_;
+        bound_area += piece_bounds_[i] * (end - piece_starts_[i]);
+    }
+    return mean_rate() * period_ / bound_area;
+}
+
+RateProfile parse_rate_profile(const std::string & text)
+{
+    const auto colon = text.find(':');
+    const auto shape_name = text.substr(0, colon);
+    RateProfile::Shape shape;
+    if (shape_name == "step") {
+        shape = RateProfile::Shape::STEP;
+    } else if (shape_name == "linear") {
+        shape = RateProfile::Shape::LINEAR;
+    } else {
+        throw std::invalid_argument("rate profile shape must be step or linear");
+    }
+    if (colon == std::string::npos) {
+        throw std::invalid_argument("rate profile needs points after the shape");
+    }
+
+    std::vector<RateProfile::Point> points;
+    double period = 0;
+    std::stringstream entries(text.substr(colon + 1));
+    std::string entry;
+    bool period_read = false;
+    while (std::getline(entries, entry, ',')) {
+        if (period_read) {
+            throw std::invalid_argument("the period is a rate profile's last entry");
+        }
+        const auto equals = entry.find('=');
+        std::stringstream time_text(entry.substr(0, equals));
+        RateProfile::Point point{0, 0};
+        if (!(time_text >> point.time)) {
+            throw std::invalid_argument("rate profile entry is not Time=Rate: " + entry);
+        }
+        if (equals == std::string::npos) {
+            period = point.time;
+            period_read = true;
+            continue;
+        }
+        std::stringstream rate_text(entry.substr(equals + 1));
+        if (!(rate_text >> point.rate)) {
+            throw std::invalid_argument("rate profile entry is not Time=Rate: " + entry);
+        }
+        points.push_back(point);
+    }
+    if (!period_read) {
+        throw std::invalid_argument("rate profile needs a period after its points");
+    }
+
+    return RateProfile(points, shape, period);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A time varying arrival rate, as a multiple of the base rate λ, for
+// non-homogeneous Poisson arrivals (see ExponentialGenerator::modulate).
+//
+// The profile goes through points (time, multiplier), holding each one until
+// the next point (STEP) or interpolating to it (LINEAR), and repeats every
+// period, so one period can be a day with its peaks. The first point is at
+// time 0 and the last one runs to the first again at the period.
+//
+// Arrivals are drawn by Lewis-Shedler thinning: candidates come at the rate
+// bound of the piece of the profile they fall in and are kept with
+// probability rate / bound. A step piece is its own bound, so nothing is
+// rejected. Linear pieces are cut into kLinearPieces bounded by their larger
+// end, which rejects at most a few percent of the candidates on a ramp.
+
+class RateProfile {
+public:
+    enum class Shape {
+        STEP,
+        LINEAR
+    };
+
+    struct Point {
+        double time;
+        double rate; // multiplier of λ
+    };
+
+    // Where a time falls: a piece of one period, offset to the cycle it's in
+    struct Piece {
+        std::size_t index;
+        double cycle_start;
+        double end; // absolute time the piece ends
+        double bound; // of the rate over the piece
+    };
+
+    // throws std::invalid_argument unless the points start at 0, rise in
+    // time before the period, and have non negative rates that aren't all 0
+    RateProfile(const std::vector<Point> & points, Shape shape, double period);
+
+    double rate(double time) const;
+
+    Piece piece(double time) const;
+    Piece next(const Piece & piece) const;
+
+    // true if every piece's bound is its rate, so thinning keeps every candidate
+    bool exact_bounds() const
+    {
+        return shape_ == Shape::STEP;
+    }
+
+    double period() const
+    {
+        return period_;
+    }
+
+    // average rate over a period
+    double mean_rate() const;
+
+    // expected fraction of candidates thinning keeps
+    double acceptance() const;
+
+    static constexpr std::size_t kLinearPieces = 32;
+
+private:
+    std::vector<Point> points_; // the first point repeated at the period closes the list
+    Shape shape_;
+    double period_;
+    std::vector<double> piece_starts_; // ascending, within one period
+    std::vector<double> piece_bounds_;
+};
+
+// Parses "step|linear:Time=Rate,Time=Rate,...,Period" like
+// "linear:0=.5,600=1.2,1200". Throws std::invalid_argument.
+RateProfile parse_rate_profile(const std::string & text);
@@ -0,0 +1,77 @@
+#include "regenerative.h"
+
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "batch_means.h"
+
+namespace statistics {
+
+std::string RatioEstimate::to_string() const
+{
+    std::stringstream ss;
+    ss << mean << " ± " << half_width;
+    return ss.str();
+}
+
+RatioEstimate ratio_estimate(const std::vector<double> & numerators, const std::vector<double> & denominators)
+{
+    if (numerators.size() != denominators.size()) {
+        throw std::invalid_argument("ratio_estimate needs one numerator per denominator");
+    }
+
+    const auto n = numerators.size();
+    double numerator_sum = 0;
+    double denominator_sum = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        numerator_sum += numerators[i];
+        denominator_sum += denominators[i];
+    }
+
+    RatioEstimate estimate;
+    estimate.cycles = n;
+    estimate.mean = numerator_sum / denominator_sum;
+    estimate.half_width = std::numeric_limits<double>::quiet_NaN();
+    if (n < 2 || !(denominator_sum > 0)) {
+        return estimate;
+    }
+
+    double sum_of_squared_residuals = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        const auto residual = numerators[i] - estimate.mean * denominators[i];
+        sum_of_squared_residuals += residual * residual;
+    }
+    const auto residual_deviation = std::sqrt(sum_of_squared_residuals / (n - 1));
+    const auto denominator_mean = denominator_sum / n;
+    estimate.half_width = student_t_975(n - 1) * residual_deviation / (denominator_mean * std::sqrt(double(n)));
+    return estimate;
+}
+
+std::string regenerative_report(const std::vector<RegenerativeCycle> & cycles)
+{
+    std::vector<double> waiting_times;
+    std::vector<double> system_times;
+    std::vector<double> serviced;
+    std::vector<double> lost;
+    std::vector<double> entered;
+    for (const auto & cycle : cycles) {
+        waiting_times.push_back(cycle.waiting_time);
+        system_times.push_back(cycle.system_time);
+        serviced.push_back(cycle.serviced);
+        lost.push_back(cycle.lost);
+        entered.push_back(cycle.entered);
+    }
+
+    std::stringstream ss;
+    ss << "Cycles: " << cycles.size()
+       << " (" << ratio_estimate(entered, std::vector<double>(cycles.size(), 1)).to_string()
+       << " customers each)" << std::endl;
+    ss << "Waiting Time: " << ratio_estimate(waiting_times, serviced).to_string() << std::endl;
+    ss << "System Time: " << ratio_estimate(system_times, serviced).to_string() << std::endl;
+    ss << "CLR: " << ratio_estimate(lost, entered).to_string() << std::endl;
+    return ss.str();
+}
+
+} // statistics
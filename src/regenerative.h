@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Regenerative simulation: every arrival that finds the system empty starts
+// the process over, because arrivals are Poisson and no service is in
+// progress. The cycles between those points are independent and identically
+// distributed, so per cycle sums give ratio estimators (e.g. total waiting time
+// over customers serviced) with a valid interval from a single run, with no
+// warm up to delete. Runs that start empty add more independent cycles, so the
+// cycles of several shorter runs can be pooled.
+
+namespace statistics {
+
+struct RegenerativeCycle {
+    double waiting_time = 0; // summed over serviced customers
+    double system_time = 0; // summed over serviced customers
+    std::uint32_t entered = 0;
+    std::uint32_t serviced = 0;
+    std::uint32_t lost = 0;
+};
+
+// Sums the customers that arrived in each cycle. Only cycles that have ended
+// (the next one started) are kept. Whatever came before the first
+// regeneration point, or is still open, is left out.
+class RegenerativeCycles {
+public:
+    // an arrival found the system empty
+    void on_regeneration()
+    {
+        if (in_cycle_) {
+            cycles_.push_back(current_);
+        }
+        current_ = {};
+        in_cycle_ = true;
+    }
+
+    void on_entered()
+    {
+        current_.entered += in_cycle_;
+    }
+
+    void on_serviced(double waiting_time, double system_time)
+    {
+        if (in_cycle_) {
+            current_.waiting_time += waiting_time;
+            current_.system_time += system_time;
+            ++current_.serviced;
+        }
+    }
+
+    void on_lost()
+    {
+        current_.lost += in_cycle_;
+    }
+
+    const std::vector<RegenerativeCycle> & cycles() const
+    {
+        return cycles_;
+    }
+
+    // also drops the open cycle, counting resumes at the next regeneration point
+    void clear()
+    {
+        cycles_.clear();
+        current_ = {};
+        in_cycle_ = false;
+    }
+
+private:
+    std::vector<RegenerativeCycle> cycles_;
+    RegenerativeCycle current_;
+    bool in_cycle_ = false;
+};
+
+struct RatioEstimate {
+    double mean;
+    double half_width; // of the 95% t interval
+    std::size_t cycles;
+
+    std::string to_string() const;
+};
+
+// sum(numerators) / sum(denominators), with the classical interval from the
+// variance of numerator - mean * denominator across cycles
+RatioEstimate ratio_estimate(const std::vector<double> & numerators, const std::vector<double> & denominators);
+
+// waiting time, system time and CLR estimated from the pooled cycles
+std::string regenerative_report(const std::vector<RegenerativeCycle> & cycles);
+
+} // statistics
@@ -0,0 +1,176 @@
+#include "request_log.h"
+
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr char kRequestLogMagic[8] = {'A', 'P', 'Q', 'R', 'E', 'Q', 'S', '1'};
+
+struct RequestLogHeader {
+    char magic[8];
+    std::uint64_t record_count;
+};
+
+const char * skip_blanks(const char * position, const char * end)
+{
+    while (position < end && (*position == ' ' || *position == '\t')) {
+        ++position;
+    }
+    return position;
+}
+
+bool starts_number(char c)
+{
+    return (c >= '0' && c <= '9') || c == '-' || c == '.';
+}
+
+std::runtime_error malformed(std::uint64_t line)
+{
+    return std::runtime_error("request log line " + std::to_string(line)
+                              + " is not timestamp,priority[,service_time]");
+}
+
+} // anonymous
+
+RequestLog::RequestLog(const std::string & path)
+{
+    auto file_descriptor = open(path.c_str(), O_RDONLY);
+    if (file_descriptor < 0) {
+        throw std::runtime_error("could not open request log: " + path);
+    }
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) != 0) {
+        ::close(file_descriptor);
+        throw std::runtime_error("could not read request log: " + path);
+    }
+
+    // an empty file has nothing to map and no requests
+    mapping_bytes_ = file_stat.st_size;
+    if (mapping_bytes_ == 0) {
+        ::close(file_descriptor);
+        return;
+    }
+
+    mapping_ = mmap(nullptr, mapping_bytes_, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    ::close(file_descriptor);
+    if (mapping_ == MAP_FAILED) {
+        mapping_ = nullptr;
+        throw std::runtime_error("could not map request log: " + path);
+    }
+    madvise(mapping_, mapping_bytes_, MADV_SEQUENTIAL);
+
+    position_ = static_cast<const char *>(mapping_);
+    end_ = position_ + mapping_bytes_;
+
+    binary_ = mapping_bytes_ >= sizeof(RequestLogHeader)
+              && std::memcmp(position_, kRequestLogMagic, sizeof(kRequestLogMagic)) == 0;
+    if (binary_) {
+        RequestLogHeader header;
+        std::memcpy(&header, position_, sizeof(header));
+        // compared as a count, record_count * sizeof could overflow
+        const auto record_bytes = mapping_bytes_ - sizeof(header);
+        if (record_bytes % sizeof(LoggedRequest) != 0 || header.record_count != record_bytes / sizeof(LoggedRequest)) {
+            munmap(mapping_, mapping_bytes_);
+            mapping_ = nullptr;
+            throw std::runtime_error("request log is truncated: " + path);
+        }
+        position_ += sizeof(header);
+    }
+}
+
+RequestLog::~RequestLog()
+{
+    if (mapping_) {
+        munmap(mapping_, mapping_bytes_);
+    }
+}
+
+bool RequestLog::next(LoggedRequest & request)
+{
+    if (!binary_) {
+        return next_csv(request);
+    }
+
+    if (end_ - position_ < std::ptrdiff_t(sizeof(LoggedRequest))) {
+        return false;
+    }
+    std::memcpy(&request, position_, sizeof(request));
+    position_ += sizeof(request);
+    return true;
+}
+
+bool RequestLog::next_csv(LoggedRequest & request)
+{
+    while (position_ < end_) {
+        auto line_end = static_cast<const char *>(std::memchr(position_, '\n', end_ - position_));
+        if (line_end == nullptr) {
+            line_end = end_;
+        }
+        auto position = skip_blanks(position_, line_end);
+        position_ = line_end == end_ ? end_ : line_end + 1;
+        ++line_;
+
+        if (line_end > position && line_end[-1] == '\r') {
+            --line_end;
+        }
+        if (position == line_end || *position == '#') {
+            continue;
+        }
+        if (line_ == 1 && !starts_number(*position)) {
+            continue; // column names
+        }
+
+        auto timestamp = std::from_chars(position, line_end, request.timestamp);
+        position = skip_blanks(timestamp.ptr, line_end);
+        if (timestamp.ec != std::errc() || position == line_end || *position != ',') {
+            throw malformed(line_);
+        }
+
+        auto priority = std::from_chars(skip_blanks(position + 1, line_end), line_end, request.priority);
+        position = skip_blanks(priority.ptr, line_end);
+        if (priority.ec != std::errc()) {
+            throw malformed(line_);
+        }
+
+        request.service_time = no_logged_service_time();
+        if (position == line_end) {
+            return true;
+        }
+        if (*position != ',') {
+            throw malformed(line_);
+        }
+        position = skip_blanks(position + 1, line_end);
+        if (position != line_end) {
+            auto service_time = std::from_chars(position, line_end, request.service_time);
+            position = skip_blanks(service_time.ptr, line_end);
+            if (service_time.ec != std::errc() || request.service_time < 0 || position != line_end) {
+                throw malformed(line_);
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+void write_request_log(const std::string & path, const std::vector<LoggedRequest> & requests)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    RequestLogHeader header = {};
+    std::memcpy(header.magic, kRequestLogMagic, sizeof(kRequestLogMagic));
+    header.record_count = requests.size();
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(requests.data()), requests.size() * sizeof(LoggedRequest));
+    if (!file) {
+        throw std::runtime_error("could not write request log: " + path);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Recorded requests to replay in place of drawn arrivals.
+//
+// A log is either binary, a header and then fixed size LoggedRequest records,
+// or CSV text with one "timestamp,priority[,service_time]" line per request.
+// In CSV a first line that doesn't start with a number names the columns and
+// lines starting with '#' are comments. An empty or missing service time
+// means the model draws one as usual.
+//
+// The file is memory mapped and each request is parsed where it lies when
+// next() is called, so replaying a log of any length keeps one request in
+// memory and reads the file once front to back.
+
+struct LoggedRequest {
+    double timestamp; // any origin and unit of time, replays shift the first request to time 0
+    std::uint32_t priority;
+    float service_time; // no_logged_service_time() if the log has none for this request
+};
+
+static_assert(sizeof(LoggedRequest) == 16, "request logs are written raw");
+
+constexpr float no_logged_service_time() {
+    return -1;
+}
+
+class RequestLog {
+public:
+    // throws std::runtime_error if the file can't be mapped or a binary log is truncated
+    explicit RequestLog(const std::string & path);
+    ~RequestLog();
+
+    RequestLog(const RequestLog &) = delete;
+    RequestLog & operator=(const RequestLog &) = delete;
+
+    // false once the log is used up. Throws std::runtime_error naming the line
+    // of a CSV request that doesn't parse.
+    bool next(LoggedRequest & request);
+
+    bool binary() const
+    {
+        return binary_;
+    }
+
+private:
+    bool next_csv(LoggedRequest & request);
+
+    void * mapping_ = nullptr;
+    std::size_t mapping_bytes_ = 0;
+    const char * position_ = nullptr;
+    const char * end_ = nullptr;
+    bool binary_ = false;
+    std::uint64_t line_ = 0; // of the CSV request last parsed, for errors
+};
+
+// Writes requests as a binary log
+void write_request_log(const std::string & path, const std::vector<LoggedRequest> & requests);
@@ -4,11 +4,18 @@
 #include <string>
 #include <sstream>
 #include <chrono>
+#include <charconv>
+#include <cmath>
 
 #include "test.h"
 #include "proj_1.h"
 #include "proj_2.h"
 #include "proj_3.h"
+#include "parallel_runs.h"
+#include "simulation_options.h"
+#include "trace.h"
+#include "microbench.h"
+#include "bench.h"
 
 void print_help_text(std::string_view error = "")
 {
@@ -22,9 +29,256 @@ void print_help_text(std::string_view error = "")
     std::cout << "2) ./run.o --proj1 Lambda K C L)" << std::endl;
     std::cout << "3) ./run.o --proj2 Lambda Kcpu Kio C L M" << std::endl;
     std::cout << "4) ./run.o --proj3 Lambda C L M" << std::endl;
+    std::cout << "5) ./run.o --replay TraceFile" << std::endl;
+    std::cout << "6) ./run.o --microbench [OutputFile.json]" << std::endl;
+    std::cout << "7) ./run.o --bench [--baseline File] [--threshold 0.1] [--write-baseline File]" << std::endl;
+    std::cout << "options for --proj1/2/3: --trace TraceFile" << std::endl;
+    std::cout << "options for --proj2 with L 1: --time-warp Threads (each run on the optimistic parallel engine, the first also timed on the sequential one)" << std::endl;
+    std::cout << "options for --proj2/3: --warm-up mser|fixed" << std::endl;
+    std::cout << "options for --proj1/2/3: --regenerative Runs (not with --warm-up mser or --batch-means)" << std::endl;
+    std::cout << "options for --proj1: --importance-sampling swap|Tilt (0 < Tilt <= 1, not with --regenerative)" << std::endl;
+    std::cout << "options for --proj1, --proj2 with L 0 M 1: --sensitivity ipa" << std::endl;
+    std::cout << "options for --proj1/2/3: --analytic only|also (closed form answer instead of or before simulating)" << std::endl;
+    std::cout << "options for --proj2/3: --precision 0.01 [--precision-on waiting,clr,system] [--max-runs N] | --batch-means K" << std::endl;
+    std::cout << "options for --proj2: --variance-reduction crn,antithetic [--compare 1,2,3,4,5]" << std::endl;
+    std::cout << "options for --proj2: --optimize clr=0.01[,waiting=2] [--max-runs N] (Kcpu, Kio become the search limits)" << std::endl;
+    std::cout << "options for --proj2 with L 1: --population N (closed network, Lambda becomes each customer's think rate)" << std::endl;
+    std::cout << "options for --proj2 with L 0: --arrivals RequestLog (binary or CSV timestamp,priority[,service_time]; one run, --batch-means K for intervals; Lambda unused)" << std::endl;
+    std::cout << "options for --proj2: --rate-profile step|linear:Time=Rate,...,Period (Rate multiplies Lambda) [--time-buckets Width]" << std::endl;
+    std::cout << "options for --proj2: --restart SplitsPerLevel (CLR by splitting, 1 = plain Markov chain)" << std::endl;
+    std::cout << "options for --proj2/3: --quantiles on (p50 to p99.9 of waiting and system time)" << std::endl;
+    std::cout << "options for --proj3: --slowdown-buckets N" << std::endl;
 }
 
-void proj_1(const std::vector<std::string> & args)
+// a whole number option within [minimum, maximum]; stringstream would read
+// "-1" into a size_t as a huge count
+template <typename Count>
+bool parse_count(const std::string & value, long long minimum, long long maximum, Count & count)
+{
+    long long parsed = 0;
+    const auto end = value.data() + value.size();
+    const auto result = std::from_chars(value.data(), end, parsed);
+    if (result.ec != std::errc() || result.ptr != end || parsed < minimum || parsed > maximum) {
+        return false;
+    }
+    count = Count(parsed);
+    return true;
+}
+
+constexpr long long kMaxCountOption = 1000000;
+
+// a finite real option with nothing after the number; stringstream would stop
+// at "0.1x" and keep the 0.1
+template <typename Number>
+bool parse_number(std::string_view value, Number & number)
+{
+    Number parsed = 0;
+    const auto end = value.data() + value.size();
+    const auto result = std::from_chars(value.data(), end, parsed);
+    if (result.ec != std::errc() || result.ptr != end || !std::isfinite(parsed)) {
+        return false;
+    }
+    number = parsed;
+    return true;
+}
+
+// optional "--name value" pairs may follow a mode's positional arguments
+bool parse_options(const std::vector<std::string> & args,
+                   std::size_t first_option_index,
+                   SimulationOptions & options)
+{
+    for (auto i = first_option_index; i < args.size(); i += 2) {
+        if (i + 1 >= args.size()) {
+            return false;
+        }
+
+        const auto & name = args[i];
+        const auto & value = args[i + 1];
+        if (name == "--trace") {
+            options.trace_path = value;
+        } else if (name == "--time-warp") {
+            if (!parse_count(value, 1, kMaxCountOption, options.time_warp)) {
+                return false;
+            }
+        } else if (name == "--precision") {
+            if (!parse_number(value, options.precision) || !(options.precision > 0)) {
+                return false;
+            }
+        } else if (name == "--precision-on") {
+            options.precision_metrics = 0;
+            std::stringstream metrics(value);
+            std::string metric;
+            while (std::getline(metrics, metric, ',')) {
+                if (metric == "waiting") {
+                    options.precision_metrics |= PRECISION_WAITING_TIME;
+                } else if (metric == "clr") {
+                    options.precision_metrics |= PRECISION_CLR;
+                } else if (metric == "system") {
+                    options.precision_metrics |= PRECISION_SYSTEM_TIME;
+                } else {
+                    return false;
+                }
+            }
+        } else if (name == "--max-runs") {
+            if (!parse_count(value, 2, kMaxCountOption, options.max_runs)) {
+                return false;
+            }
+        } else if (name == "--warm-up") {
+            if (value == "mser") {
+                options.mser_warm_up = true;
+            } else if (value == "fixed") {
+                options.mser_warm_up = false;
+            } else {
+                return false;
+            }
+        } else if (name == "--batch-means") {
+            if (!parse_count(value, 2, kMaxCountOption, options.batch_means)) {
+                return false;
+            }
+        } else if (name == "--regenerative") {
+            if (!parse_count(value, 1, kMaxCountOption, options.regenerative)) {
+                return false;
+            }
+        } else if (name == "--variance-reduction") {
+            std::stringstream techniques(value);
+            std::string technique;
+            while (std::getline(techniques, technique, ',')) {
+                if (technique == "crn") {
+                    options.common_random_numbers = true;
+                } else if (technique == "antithetic") {
+                    options.antithetic = true;
+                } else {
+                    return false;
+                }
+            }
+        } else if (name == "--compare") {
+            options.compare = value;
+        } else if (name == "--restart") {
+            if (!parse_count(value, 1, kMaxCountOption, options.restart)) {
+                return false;
+            }
+        } else if (name == "--importance-sampling") {
+            if (value == "swap") {
+                options.importance_sampling = 1;
+            } else if (!parse_number(value, options.importance_sampling)) {
+                return false;
+            }
+            if (!(options.importance_sampling > 0 && options.importance_sampling <= 1)) {
+                return false;
+            }
+        } else if (name == "--sensitivity") {
+            if (value != "ipa") {
+                return false;
+            }
+            options.perturbation_analysis = true;
+        } else if (name == "--optimize") {
+            std::stringstream targets(value);
+            std::string target;
+            while (std::getline(targets, target, ',')) {
+                const auto equals = target.find('=');
+                const auto metric = target.substr(0, equals);
+                double bound = 0;
+                if (equals == std::string::npos || !parse_number(std::string_view(target).substr(equals + 1), bound)
+                    || bound <= 0) {
+                    return false;
+                }
+                if (metric == "clr") {
+                    options.target_clr = bound;
+                } else if (metric == "waiting") {
+                    options.target_waiting_time = bound;
+                } else {
+                    return false;
+                }
+            }
+        } else if (name == "--arrivals") {
+            options.arrivals_path = value;
+        } else if (name == "--rate-profile") {
+            try {
+                options.rate_profile = std::make_shared<const RateProfile>(parse_rate_profile(value));
+            } catch (std::invalid_argument &) {
+                return false;
+            }
+        } else if (name == "--time-buckets") {
+            if (!parse_number(value, options.time_bucket_width) || !(options.time_bucket_width > 0)) {
+                return false;
+            }
+        } else if (name == "--population") {
+            if (!parse_count(value, 1, kMaxCountOption, options.population)) {
+                return false;
+            }
+        } else if (name == "--analytic") {
+            if (value == "only") {
+                options.analytic = Analytic::ONLY;
+            } else if (value == "also") {
+                options.analytic = Analytic::ALSO;
+            } else {
+                return false;
+            }
+        } else if (name == "--quantiles") {
+            if (value == "on") {
+                options.quantiles = true;
+            } else if (value == "off") {
+                options.quantiles = false;
+            } else {
+                return false;
+            }
+        } else if (name == "--slowdown-buckets") {
+            if (!parse_count(value, 1, kMaxCountOption, options.slowdown_buckets)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    // regenerative cycles need every customer counted from the very first arrival
+    if (options.regenerative && (options.mser_warm_up || options.batch_means)) {
+        return false;
+    }
+
+    // importance sampling keeps its own cycles, half of them at tilted rates
+    if (options.importance_sampling > 0 && options.regenerative) {
+        return false;
+    }
+
+    // IPA follows the run's own customers from the first departure, at the real rates
+    if (options.perturbation_analysis
+        && (options.mser_warm_up || options.batch_means || options.regenerative || options.importance_sampling > 0)) {
+        return false;
+    }
+
+    // antithetic pairs need an even number of replications
+    const bool optimize = options.target_clr > 0 || options.target_waiting_time > 0;
+    return !(options.antithetic && (options.precision > 0 || options.batch_means || options.regenerative || optimize));
+}
+
+bool parse_bench_settings(const std::vector<std::string> & args,
+                          std::size_t first_option_index,
+                          bench::Settings & settings)
+{
+    for (auto i = first_option_index; i < args.size(); i += 2) {
+        if (i + 1 >= args.size()) {
+            return false;
+        }
+
+        const auto & name = args[i];
+        const auto & value = args[i + 1];
+        if (name == "--baseline") {
+            settings.baseline_path = value;
+        } else if (name == "--write-baseline") {
+            settings.write_baseline_path = value;
+        } else if (name == "--threshold") {
+            if (!parse_number(value, settings.threshold) || settings.threshold <= 0) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+void proj_1(const std::vector<std::string> & args, const SimulationOptions & options)
 {
     constexpr auto kLambdaIndex = 2;
     constexpr auto kQueueSizeIndex = 3;
@@ -50,14 +304,38 @@ void proj_1(const std::vector<std::string> & args)
     }
 
     auto start = std::chrono::high_resolution_clock::now();
-    run_project_1(lambda, queue_size, customers_to_serve, L);
+    run_project_1(lambda, queue_size, customers_to_serve, L, options);
     auto stop = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
     std::cout << customers_to_serve  << " customers took "
               << duration.count() << " milliseconds!" << std::endl;
 }
 
-void proj_2(const std::vector<std::string> & args)
+// M on the command line: 1 fcfs, 2 lcfs_np, 3 sjf_np, 4 prio_np, 5 prio_preempt
+bool to_project2_discipline(std::size_t M, project2::Discipline & discipline)
+{
+    switch(M) {
+    case 1:
+        discipline = project2::Discipline::FCFS;
+        return true;
+    case 2:
+        discipline = project2::Discipline::LCFS_NP;
+        return true;
+    case 3:
+        discipline = project2::Discipline::SJF_NP;
+        return true;
+    case 4:
+        discipline = project2::Discipline::PRIO_NP;
+        return true;
+    case 5:
+        discipline = project2::Discipline::PRIO_P;
+        return true;
+    default:
+        return false;
+    }
+}
+
+void proj_2(const std::vector<std::string> & args, const SimulationOptions & options)
 {
     // pname, mode, lambda, kcpu, kio, C, L, M
     constexpr auto kLambdaIndex = 2;
@@ -105,46 +383,144 @@ void proj_2(const std::vector<std::string> & args)
     }
 
     project2::Discipline discipline;
-    switch(M) {
-    case 1:
-        discipline = project2::Discipline::FCFS;
-        break;
-    case 2:
-        discipline = project2::Discipline::LCFS_NP;
-        break;
-    case 3:
-        discipline = project2::Discipline::SJF_NP;
-        break;
-    case 4:
-        discipline = project2::Discipline::PRIO_NP;
-        break;
-    case 5:
-        discipline = project2::Discipline::PRIO_P;
-        break;
-    default:
+    if (!to_project2_discipline(M, discipline)) {
         print_help_text("Invalid M for project 2 [1-5] for fcfs, lcfs_np, sjf_np, prio_np, prio_preempt");
         return;
     }
 
+    // Time Warp runs the open web server's replications, the other run modes
+    // and the arrivals and traces it can't roll back are the sequential engine's
+    if (options.time_warp
+        && (mode != project2::Mode::CPU || options.population || options.restart || options.regenerative
+            || options.batch_means || options.rate_profile || !options.trace_path.empty()
+            || options.target_clr > 0 || options.target_waiting_time > 0)) {
+        print_help_text("--time-warp needs the CPU model (L 1) without --population, --restart, --regenerative, --batch-means, --rate-profile, --trace or --optimize");
+        return;
+    }
+
+    // splitting's Markov chain has one shared waiting room, the priority disciplines split it
+    if (options.restart && mode == project2::Mode::MM1
+        && (discipline == project2::Discipline::PRIO_NP || discipline == project2::Discipline::PRIO_P)) {
+        print_help_text("--restart needs a discipline without priorities (M 1-3) for the MM1 model");
+        return;
+    }
+
+    // the IPA recursion is the one of a single FCFS server
+    if (options.perturbation_analysis && (mode != project2::Mode::MM1 || discipline != project2::Discipline::FCFS)) {
+        print_help_text("--sensitivity ipa needs the MM1 model with FCFS (L 0 M 1)");
+        return;
+    }
+
+    // the closed network's customers think in place of the web server's Poisson arrivals
+    if (options.population && (mode != project2::Mode::CPU || options.restart)) {
+        print_help_text("--population needs the CPU model (L 1) and doesn't combine with --restart");
+        return;
+    }
+
+    // a varying rate breaks what the Markov chain, IPA, regenerative cycles
+    // and the closed forms rely on, and the closed network has no arrival rate
+    if (options.rate_profile
+        && (options.restart || options.perturbation_analysis || options.regenerative || options.population
+            || options.analytic != Analytic::OFF || !options.arrivals_path.empty())) {
+        print_help_text("--rate-profile doesn't combine with --restart, --sensitivity, --regenerative, --population, --analytic or --arrivals");
+        return;
+    }
+
+    // a log is one recorded sample path of the MM1 model's arrivals, the
+    // Markov chain, IPA, regenerative cycles and antithetic pairs all need drawn ones
+    if (!options.arrivals_path.empty()
+        && (mode != project2::Mode::MM1 || options.restart || options.perturbation_analysis
+            || options.regenerative || options.antithetic || options.analytic != Analytic::OFF
+            || options.precision > 0)) {
+        print_help_text("--arrivals needs the MM1 model (L 0) without --restart, --sensitivity, --regenerative, antithetic, --analytic or --precision");
+        return;
+    }
+
+    // the closed form holds for orders that look at neither service times nor priorities
+    if (options.analytic != Analytic::OFF && mode == project2::Mode::MM1
+        && discipline != project2::Discipline::FCFS && discipline != project2::Discipline::LCFS_NP) {
+        print_help_text("--analytic needs FCFS or LCFS_NP (M 1-2) for the MM1 model");
+        return;
+    }
+
+    // --compare replaces M with the listed disciplines
+    std::vector<project2::Discipline> compared_disciplines;
+    std::stringstream compare(options.compare);
+    std::string compared_M;
+    while (std::getline(compare, compared_M, ',')) {
+        std::size_t value = 0;
+        std::stringstream(compared_M) >> value;
+        if (!to_project2_discipline(value, discipline)) {
+            print_help_text("Invalid M in --compare for project 2 [1-5]");
+            return;
+        }
+        compared_disciplines.push_back(discipline);
+    }
+
+    if (!compared_disciplines.empty() && (mode != project2::Mode::MM1 || compared_disciplines.size() < 2)) {
+        print_help_text("--compare needs the MM1 model (L = 0) and at least two disciplines");
+        return;
+    }
+
     constexpr size_t kRuns = 30; // number of runs to generate stats from
+    // batch means needs only one long run, and a log replays the same arrivals every run
+    const auto runs = options.batch_means || !options.arrivals_path.empty() ? 1 : kRuns;
     auto start = std::chrono::high_resolution_clock::now();
 
-    project2::run_project_2(lambda,
-                            cpu_queue_size,
-                            io_queue_size,
-                            customers_to_serve,
-                            mode,
-                            discipline,
-                            kRuns);
+    const bool optimize = options.target_clr > 0 || options.target_waiting_time > 0;
+    if (optimize && options.target_clr <= 0) {
+        print_help_text("--optimize needs a clr target, a waiting bound alone is met by the smallest buffers");
+        return;
+    }
+    if (optimize && (!compared_disciplines.empty() || options.restart || options.precision > 0 || options.batch_means
+                     || options.regenerative || !options.arrivals_path.empty())) {
+        print_help_text("--optimize replaces the usual runs, it doesn't combine with other run modes");
+        return;
+    }
+    if (optimize && options.population) {
+        print_help_text("--optimize sizes buffers for the open network, not --population");
+        return;
+    }
+    if (options.analytic != Analytic::OFF && (optimize || !compared_disciplines.empty())) {
+        print_help_text("--analytic answers a single configuration, not --compare or --optimize");
+        return;
+    }
+
+    auto runs_done = optimize
+        ? project2::optimize_buffers(lambda,
+                                     cpu_queue_size,
+                                     io_queue_size,
+                                     customers_to_serve,
+                                     mode,
+                                     discipline,
+                                     default_thread_count(),
+                                     options)
+        : compared_disciplines.empty()
+        ? project2::run_project_2(lambda,
+                                  cpu_queue_size,
+                                  io_queue_size,
+                                  customers_to_serve,
+                                  mode,
+                                  discipline,
+                                  runs,
+                                  default_thread_count(),
+                                  options)
+        : project2::compare_disciplines(lambda,
+                                        cpu_queue_size,
+                                        customers_to_serve,
+                                        compared_disciplines,
+                                        runs,
+                                        default_thread_count(),
+                                        options);
 
     auto stop = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
-    std::cout << kRuns << " runs of "
+    std::cout << runs_done << " runs of "
               << customers_to_serve  << " customers took "
               << duration.count() << " milliseconds!" << std::endl;
 }
 
-void proj_3(const std::vector<std::string> & args)
+void proj_3(const std::vector<std::string> & args, const SimulationOptions & options)
 {
     // pname, lambda, C, L, M
     constexpr auto kLambdaIndex = 2;
@@ -171,6 +547,11 @@ void proj_3(const std::vector<std::string> & args)
         return;
     }
 
+    if (options.perturbation_analysis) {
+        print_help_text("--sensitivity ipa is only for --proj1 and --proj2");
+        return;
+    }
+
     project3::Discipline discipline;
     switch(L) {
     case 1:
@@ -200,19 +581,28 @@ void proj_3(const std::vector<std::string> & args)
         return;
     }
 
+    // shortest job first has a closed form with one server only
+    if (options.analytic != Analytic::OFF && discipline == project3::Discipline::SJF_NP && mode != project3::Mode::MG1) {
+        print_help_text("--analytic with SJF_NP (L 2) needs the MG1 model (M 2)");
+        return;
+    }
+
 
     constexpr size_t kRuns = 30; // number of runs to generate stats from
+    const auto runs = options.batch_means ? 1 : kRuns; // batch means needs only one long run
     auto start = std::chrono::high_resolution_clock::now();
 
-    project3::run_project_3(lambda,
-                            customers_to_serve,
-                            discipline,
-                            mode,
-                            kRuns);
+    auto runs_done = project3::run_project_3(lambda,
+                                             customers_to_serve,
+                                             discipline,
+                                             mode,
+                                             runs,
+                                             default_thread_count(),
+                                             options);
 
     auto stop = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
-    std::cout << kRuns << " runs of "
+    std::cout << runs_done << " runs of "
               << customers_to_serve  << " customers took "
               << duration.count() << " milliseconds!" << std::endl;
 }
@@ -229,11 +619,17 @@ int main(int argc, char ** argv) {
     constexpr auto kProj1ArgsNumber = 6; // pname, mode, Lambda, K, C, L
     constexpr auto kProj2ArgsNumber = 8; // pname, mode, lambda, kcpu, kio, C, L, M
     constexpr auto kProj3ArgsNumber = 6; // pname, mode, lambda, C, L, M
+    constexpr auto kReplayArgsNumber = 3; // pname, mode, trace file
+    constexpr auto kReplayFileIndex = 2;
+    constexpr auto kMicrobenchMaxArgsNumber = 3; // pname, mode, optional output file
+    constexpr auto kMicrobenchFileIndex = 2;
+    constexpr auto kBenchArgsNumber = 2; // pname, mode, then optional settings
     const auto received_params = args.size();
 
     constexpr auto kModeIndex = 1;
 
     const auto & mode = args[kModeIndex];
+    SimulationOptions options;
     if (mode == "--test") {
         if (received_params != kTestArgsNumber) {
             print_help_text();
@@ -241,23 +637,47 @@ int main(int argc, char ** argv) {
         }
         testing::run_all_tests();
     } else if (mode == "--proj1") {
-        if (received_params != kProj1ArgsNumber) {
+        if (received_params < kProj1ArgsNumber
+            || !parse_options(args, kProj1ArgsNumber, options)) {
             print_help_text();
             return 0;
         }
-        proj_1(args);
+        proj_1(args, options);
     } else if (mode == "--proj2") {
-        if (received_params != kProj2ArgsNumber) {
+        if (received_params < kProj2ArgsNumber
+            || !parse_options(args, kProj2ArgsNumber, options)) {
             print_help_text();
             return 0;
         }
-        proj_2(args);
+        proj_2(args, options);
     } else if (mode == "--proj3") {
-        if (received_params != kProj3ArgsNumber) {
+        if (received_params < kProj3ArgsNumber
+            || !parse_options(args, kProj3ArgsNumber, options)) {
+            print_help_text();
+            return 0;
+        }
+        proj_3(args, options);
+    } else if (mode == "--replay") {
+        if (received_params != kReplayArgsNumber) {
+            print_help_text();
+            return 0;
+        }
+        print_trace_replay(args[kReplayFileIndex]);
+    } else if (mode == "--microbench") {
+        if (received_params > kMicrobenchMaxArgsNumber) {
+            print_help_text();
+            return 0;
+        }
+        microbench::run_microbenchmarks(received_params == kMicrobenchMaxArgsNumber
+                                        ? args[kMicrobenchFileIndex]
+                                        : "");
+    } else if (mode == "--bench") {
+        bench::Settings settings;
+        if (!parse_bench_settings(args, kBenchArgsNumber, settings)) {
             print_help_text();
             return 0;
         }
-        proj_3(args);
+        return bench::run_benchmarks(settings);
     } else {
         print_help_text();
     }
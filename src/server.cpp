@@ -1,12 +1,14 @@
 #include "server.h"
 #include "constants.h"
+#include "log.h"
+#include "allocation_counter.h"
+#include "probe.h"
 #include <iostream>
 
 void Server::start()
 {
-    if (constants::DEBUG_ENABLED) {
-        std::cout << "Server Started" << std::endl;
-    }
+    allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::SERVER);
+    logging::log<logging::Level::DEBUG, logging::Component::SERVER>("{} Started", name_);
     customer_request_handler_([this](std::shared_ptr<Customer> customer){
         on_customer_entered_server(customer);
     });
@@ -14,15 +16,13 @@ void Server::start()
 
 void Server::on_customer_entered_server(const std::shared_ptr<Customer> & customer)
 {
+    probe::ScopedProbe scoped_probe(probe::Probe::SERVER_ENTERED);
+    allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::SERVER);
     auto departure_time = simulation_timer_.time() + customer->service_time();
 
-    if (constants::DEBUG_ENABLED) {
-        std::cout << name_ << "::" << __func__
-                  << " got customer: " << customer->to_string()
-                  << " at time: " << simulation_timer_.time()
-                  << " scheduling departure at time: " << departure_time
-                  << std::endl;
-    }
+    logging::log<logging::Level::DEBUG, logging::Component::SERVER>(
+        "{}::on_customer_entered_server got customer: {} at time: {} scheduling departure at time: {}",
+        name_, customer->id(), simulation_timer_.time(), departure_time);
 
     // TODO put this back, and fix waiting time calculation with preempts
     /*
@@ -32,50 +32,56 @@ void Server::on_customer_entered_server(const std::shared_ptr<Customer> & custom
                                       simulation_timer_.time()));
     */
 
+    if (state_log_) {
+        state_log_->save([this, customer = customer_, job_id = job_id_] {
+            customer_ = customer;
+            job_id_ = job_id;
+        });
+    }
     customer_ = customer;
     job_id_ = simulation_timer_.register_job(
         departure_time,
         [this] {
             on_customer_serviced(customer_); // service this customer
 
-            customer_request_handler_([this](std::shared_ptr<Customer> customer){
-                on_customer_entered_server(customer);
+            customer_request_handler_([this](std::shared_ptr<Customer> next_customer){
+                on_customer_entered_server(next_customer);
             });
-        }
+        },
+        JobTag{TraceKind::DEPARTURE, customer->id(), &name_}
     );
 }
 
 std::shared_ptr<Customer> Server::attempt_preempt(const std::shared_ptr<Customer> & customer)
 {
+    allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::SERVER);
     if (customer->priority() >= customer_->priority()) {
-        if (constants::DEBUG_ENABLED) {
-            std::cout << "Server::" <<  __func__
-                      << ": DID NOT replace {" << customer_->to_string()
-                      << "} with {" << customer->to_string()
-                      << "}" << std::endl;
-        }
+        logging::log<logging::Level::DEBUG, logging::Component::SERVER>(
+            "{}::attempt_preempt DID NOT replace: {} with: {}",
+            name_, customer_->id(), customer->id());
 
         return customer;
     } else {
-        if (constants::DEBUG_ENABLED) {
-            std::cout << "Server::" <<  __func__
-                      << ": REPLACING {" << customer_->to_string()
-                      << "} with {" << customer->to_string()
-                      << "}" << std::endl;
-        }
+        logging::log<logging::Level::DEBUG, logging::Component::SERVER>(
+            "{}::attempt_preempt REPLACING: {} with: {}",
+            name_, customer_->id(), customer->id());
 
         auto old_departure_time = simulation_timer_.remove_job(job_id_);
         auto remaining_service_time = (old_departure_time - simulation_timer_.time());
 
-        if (constants::DEBUG_ENABLED) {
-            std::cout << "ID: " << customer_->id()
-                    << " Old Departure Time: " << old_departure_time
-                    << " Current Time: " << simulation_timer_.time()
-                    << " Old service_time: " << customer_->service_time()
-                    << " New Service Time" << remaining_service_time
-                    << std::endl;
+        logging::log<logging::Level::DEBUG, logging::Component::SERVER>(
+            "ID: {} Old Departure Time: {} Current Time: {} Old service_time: {} New Service Time: {}",
+            customer_->id(), old_departure_time, simulation_timer_.time(),
+            customer_->service_time(), remaining_service_time);
+
+        if (state_log_) {
+            state_log_->save([customer = customer_,
+                              service_time = customer_->service_time(),
+                              event = customer_->events().back()] {
+                customer->add_event(event);
+                customer->set_service_time(service_time);
+            });
         }
-
         customer_->set_service_time(remaining_service_time);
         customer_->delete_last_event();
         // customer_->delete_last_event(); // delete the queue exit and server entrance
@@ -92,11 +98,8 @@ std::shared_ptr<Customer> Server::attempt_preempt(const std::shared_ptr<Customer
         auto cached_customer = customer_;
         on_customer_entered_server(customer);
 
-        if (constants::DEBUG_ENABLED) {
-            std::cout << "Server::" << __func__
-                      << " Returning: " << cached_customer->to_string()
-                      << std::endl;
-        }
+        logging::log<logging::Level::DEBUG, logging::Component::SERVER>(
+            "{}::attempt_preempt Returning: {}", name_, cached_customer->id());
 
         return cached_customer;
     }
@@ -104,16 +107,22 @@ std::shared_ptr<Customer> Server::attempt_preempt(const std::shared_ptr<Customer
 
 void Server::on_customer_serviced(const std::shared_ptr<Customer> & customer)
 {
+    allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::SERVER);
+    if (state_log_) {
+        // undone after whatever exit_customer_ did with the customer
+        state_log_->save([customer, serviced = customer->serviced(), departure_time = customer->departure_time()] {
+            customer->delete_last_event();
+            customer->set_serviced(serviced);
+            customer->set_departure_time(departure_time);
+        });
+    }
     customer->set_serviced(true);
     customer->set_departure_time(simulation_timer_.time());
 
     // TODO put this back, and fix waiting time calculation with preempts
     /*
-    if (constants::DEBUG_ENABLED) {
-        std::cout << name_ << "::" << __func__
-                  << " serviced customer: " << customer->to_string()
-                  << std::endl;
-    }
+    logging::log<logging::Level::DEBUG, logging::Component::SERVER>(
+        "{}::on_customer_serviced serviced customer: {}", name_, customer->id());
     */
 
     customer->add_event(CustomerEvent(CustomerEventType::EXITED,
@@ -5,6 +5,7 @@
 
 #include "simulation_timer.h"
 #include "customer.h"
+#include "state_log.h"
 
 class Server {
 public:
@@ -22,6 +23,13 @@ public:
 
     std::shared_ptr<Customer> attempt_preempt(const std::shared_ptr<Customer> & customer);
 
+    // who is in service and the changes to them are saved while a log is set,
+    // so the Time Warp engine can roll the server back (null turns saving off)
+    void set_state_log(StateLog * state_log)
+    {
+        state_log_ = state_log;
+    }
+
 private:
     void on_customer_entered_server(const std::shared_ptr<Customer> & customer);
     void on_customer_serviced(const std::shared_ptr<Customer> & customer);
@@ -33,4 +41,5 @@ private:
     CustomerRequestHandler customer_request_handler_;
     CustomerRequest exit_customer_;
     const std::string name_;
+    StateLog * state_log_ = nullptr;
 };
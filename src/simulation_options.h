@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+
+#include "constants.h"
+#include "rate_profile.h"
+
+// Totals across every run that shares a RunCounters (runs may be on different threads)
+struct RunCounters {
+    std::atomic<std::uint64_t> runs{0};
+    std::atomic<std::uint64_t> timer_dispatches{0};
+    std::atomic<std::uint64_t> customers{0}; // arrivals into the system
+
+    void add_run(std::uint64_t dispatches, std::uint64_t arrivals)
+    {
+        ++runs;
+        timer_dispatches += dispatches;
+        customers += arrivals;
+    }
+};
+
+// Metrics a --precision target applies to
+enum PrecisionMetric : unsigned {
+    PRECISION_WAITING_TIME = 1u << 0,
+    PRECISION_CLR = 1u << 1,
+    PRECISION_SYSTEM_TIME = 1u << 2,
+    PRECISION_ALL = PRECISION_WAITING_TIME | PRECISION_CLR | PRECISION_SYSTEM_TIME
+};
+
+// What --analytic does with the closed form answer
+enum class Analytic {
+    OFF,
+    ONLY, // print it instead of simulating
+    ALSO // print it before simulating, to check one against the other
+};
+
+// Settings that apply to a single simulation run no matter which project builds it
+struct SimulationOptions {
+    std::string trace_path = ""; // write a binary trace of the run here (empty = no trace)
+    std::size_t time_warp = 0; // proj2 CPU: spread each run over this many threads with the Time Warp engine, see time_warp.h (0 = sequential)
+    RunCounters * counters = nullptr; // each finished run adds its counts here (null = don't count)
+    double precision = 0; // proj2/3: add replications until the 95% intervals are this relative width (0 = fixed 30 runs)
+    std::size_t max_runs = 1000; // replication budget for precision
+    unsigned precision_metrics = PRECISION_ALL; // PrecisionMetric mask
+    bool mser_warm_up = false; // proj2/3: find each run's warm up with MSER-5 instead of dropping the first 1000 customers
+    bool common_random_numbers = false; // proj2: draw customer i's service time on arrival so every discipline sees the same customers
+    bool antithetic = false; // proj2: pair run 2j (uniforms u) with run 2j + 1 (1 - u) and report the pair averages
+    bool antithetic_draws = false; // set by run_options on the second run of an antithetic pair
+    std::string compare = ""; // proj2: comma separated M values to run on common random numbers and compare in pairs
+    std::uint32_t restart = 0; // proj2: estimate CLR by RESTART splitting this many ways at every CPU queue occupancy (0 = simulate)
+    float importance_sampling = 0; // proj1: in every other cycle move λ and μ this far toward each other's value, 1 swaps them (0 = off)
+    bool perturbation_analysis = false; // proj1, proj2 MM1 FCFS: also estimate d(mean waiting/system time) / d(λ, μ) by IPA
+    double target_clr = 0; // proj2 --optimize: search for the smallest buffers keeping the overall CLR below this (0 = no target)
+    double target_waiting_time = 0; // proj2 --optimize: ... and the mean waiting time below this (0 = no target)
+    std::string arrivals_path = ""; // proj2 MM1: replay this request log in place of Poisson arrivals, see request_log.h (empty = draw them)
+    std::shared_ptr<const RateProfile> rate_profile; // proj2: Poisson arrivals at λ times this profile's rate (null = constant λ)
+    double time_bucket_width = 0; // proj2: also report customers by arrival time in buckets this wide (0 = don't)
+    std::size_t population = 0; // proj2 CPU: close the network, this many customers think for Exp(λ) between requests (0 = open)
+    Analytic analytic = Analytic::OFF; // proj1/2/3: the analytic answer for the model, see analytic.h
+    std::size_t regenerative = 0; // proj1/2/3: pool the regenerative cycles of this many runs sharing C customers (0 = replications, proj1 always 1 run)
+    std::size_t batch_means = 0; // proj2/3: one long run split into this many batches instead of replications (0 = replications)
+    bool quantiles = false; // proj2/3: also estimate waiting and system time quantiles with streaming sketches
+    std::size_t slowdown_buckets = 0; // proj3: print slowdown for this many service time percentile buckets (0 = don't print)
+};
+
+// Each replication writes its own trace, suffixed with the run number
+inline SimulationOptions run_options(const SimulationOptions & options, std::size_t run)
+{
+    auto options_for_run = options;
+    if (!options_for_run.trace_path.empty()) {
+        options_for_run.trace_path += "." + std::to_string(run);
+    }
+    options_for_run.antithetic_draws = options.antithetic && run % 2;
+    return options_for_run;
+}
+
+// Both runs of an antithetic pair use the same seeds
+inline long run_seed_offset(const SimulationOptions & options, std::size_t run)
+{
+    return long(options.antithetic ? run / 2 : run) * constants::SEED_OFFSET;
+}
@@ -2,30 +2,58 @@
 
 #include "simulation_spy.h"
 #include "constants.h"
+#include "log.h"
+#include "allocation_counter.h"
+#include "probe.h"
 
 void SimulationSpy::on_customer_entering(const std::shared_ptr<Customer> & customer)
 {
-    if (constants::DEBUG_ENABLED) {
-        std::cout << "SimulationSpy::" << __func__
-                  << " got " << customer->to_string()
-                  << " old size:" << system_customers_.size() << std::endl;
+    allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::SPY);
+    logging::log<logging::Level::DEBUG, logging::Component::SPY>(
+        "SimulationSpy::on_customer_entering got customer: {} arrival time: {} old size: {}",
+        customer->id(), customer->arrival_time(), system_customers_.size());
+
+    if (trace_writer_) {
+        trace_writer_->record(customer->arrival_time(),
+                              TraceKind::SYSTEM_ENTERED,
+                              customer->id(),
+                              no_trace_place(),
+                              0,
+                              customer->priority());
     }
-    ++system_entered_customers_[customer->priority()];
-    system_customers_.insert({customer->id(), customer});
 
-    if (constants::DEBUG_ENABLED) {
-        std::cout << "SimulationSpy::" << __func__
-                  << " exited with new size:" << system_customers_.size() << std::endl;
+    if (regenerative_cycles_enabled_) {
+        if (system_customers_.empty()) {
+            regenerative_cycles_.on_regeneration();
+        }
+        regenerative_cycles_.on_entered();
+    }
+
+    if (importance_sampled_cycles_) {
+        if (system_customers_.empty()) {
+            importance_sampled_cycles_->on_regeneration();
+        }
+        customer->set_likelihood_ratio(importance_sampled_cycles_->on_entered());
     }
 
+    if (time_buckets_.enabled()) {
+        time_buckets_.on_entered(customer->arrival_time(), system_customers_.size());
+    }
+
+    ++priority_stats_[priority_index(customer->priority())].system_entered;
+    system_customers_.insert({customer->id(), customer});
 }
 
 void SimulationSpy::on_customer_exiting(const std::shared_ptr<Customer> & customer)
 {
-    if (constants::DEBUG_ENABLED) {
-        std::cout << "SimulationSpy::" << __func__
-                  << " erasing " << customer->to_string()
-                  << " old size: " << system_customers_.size() << std::endl;
+    probe::ScopedProbe scoped_probe(probe::Probe::SPY_EXITING);
+    allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::SPY);
+    logging::log<logging::Level::DEBUG, logging::Component::SPY>(
+        "SimulationSpy::on_customer_exiting erasing customer: {} serviced: {} departure time: {} old size: {}",
+        customer->id(), customer->serviced(), customer->departure_time(), system_customers_.size());
+
+    if (trace_writer_) {
+        trace_customer_exit(customer);
     }
 
     const auto id = customer->id();
@@ -36,6 +64,27 @@ void SimulationSpy::on_customer_exiting(const std::shared_ptr<Customer> & custom
         throw std::runtime_error("system_customers asked to delete customer it doesn't have");
     }
 
+    // right away, a tilted cycle's first loss switches the rates back before the next draw
+    if (importance_sampled_cycles_ && !customer->serviced()) {
+        importance_sampled_cycles_->on_lost(customer->likelihood_ratio());
+    }
+
+    // every departure, the transient period included, carries the busy period's perturbation on
+    if (perturbation_analysis_ && customer->serviced()) {
+        perturbation_analysis_->on_serviced(customer->arrival_time(),
+                                            customer->total_waiting_time(),
+                                            customer->service_time());
+    }
+
+    if (time_buckets_.enabled()) {
+        const bool serviced = customer->serviced();
+        time_buckets_.on_exited(customer->arrival_time(),
+                                customer->departure_time(),
+                                serviced,
+                                serviced ? customer->total_waiting_time() : 0,
+                                serviced ? customer->system_time() : 0);
+    }
+
     if (id == L_
         || id == L_+1
         || id == L_+10
@@ -43,25 +92,112 @@ void SimulationSpy::on_customer_exiting(const std::shared_ptr<Customer> & custom
         save_additional_stats(customer);
     }
 
+    if (mser_buffering_) {
+        buffer_warm_up_customer(customer);
+        return;
+    }
+
     save_default_stats(customer);
 
     if (id == transient_period_ - 1) {
         on_transient_period_elapsed();
     }
+}
+
+void SimulationSpy::buffer_warm_up_customer(const std::shared_ptr<Customer> & customer)
+{
+    warm_up_buffer_.push_back(customer);
+    if (customer->serviced()) {
+        mser_batch_sum_ += customer->system_time();
+        if (++mser_in_batch_ == kMserBatchSize) {
+            mser_batch_means_.push_back(mser_batch_sum_ / kMserBatchSize);
+            mser_batch_ends_.push_back(warm_up_buffer_.size());
+            mser_batch_sum_ = 0;
+            mser_in_batch_ = 0;
+        }
+    }
 
-    if (constants::DEBUG_ENABLED) {
-        std::cout << "SimulationSpy::" << __func__
-                  << " exited with new size:" << system_customers_.size() << std::endl;
+    if (warm_up_buffer_.size() >= mser_max_customers_) {
+        warm_up_detected_ = false;
+        end_warm_up(statistics::mser_truncation(mser_batch_means_));
+        return;
     }
+
+    if (mser_batch_means_.size() == mser_next_check_) {
+        mser_next_check_ *= 2;
+        // a truncation point in the second half means the run hasn't settled yet
+        auto truncation = statistics::mser_truncation(mser_batch_means_);
+        if (truncation < mser_batch_means_.size() / 2) {
+            end_warm_up(truncation);
+        }
+    }
+}
+
+void SimulationSpy::end_warm_up(std::size_t truncation_batches)
+{
+    mser_buffering_ = false;
+    warm_up_customers_ = truncation_batches ? mser_batch_ends_[truncation_batches - 1] : 0;
+
+    logging::log<logging::Level::INFO, logging::Component::SPY>(
+        "SimulationSpy::end_warm_up MSER-5 dropped the first {} of {} customers",
+        warm_up_customers_, warm_up_buffer_.size());
+
+    clear_stats();
+    for (auto i = warm_up_customers_; i < warm_up_buffer_.size(); ++i) {
+        const auto & customer = warm_up_buffer_[i];
+        ++priority_stats_[priority_index(customer->priority())].system_entered;
+        save_default_stats(customer);
+    }
+    for (const auto & id_and_customer : system_customers_) {
+        ++priority_stats_[priority_index(id_and_customer.second->priority())].system_entered;
+    }
+
+    warm_up_buffer_ = {};
+    mser_batch_ends_ = {};
+    mser_batch_means_ = {};
+}
+
+void SimulationSpy::trace_customer_exit(const std::shared_ptr<Customer> & customer)
+{
+    for (const auto & event : customer->events()) {
+        TraceKind kind = TraceKind::EVENT_ENTERED;
+        switch (event.event_type_) {
+        case CustomerEventType::ENTERED:
+            kind = TraceKind::EVENT_ENTERED;
+            break;
+        case CustomerEventType::EXITED:
+            kind = TraceKind::EVENT_EXITED;
+            break;
+        case CustomerEventType::DROPPED_BY:
+            kind = TraceKind::EVENT_DROPPED_BY;
+            break;
+        case CustomerEventType::PREEMPTED_FROM:
+            kind = TraceKind::EVENT_PREEMPTED_FROM;
+            break;
+        }
+
+        trace_writer_->record(event.time_,
+                              kind,
+                              customer->id(),
+                              trace_writer_->place_id(&event.place_name_),
+                              std::uint8_t(event.place_type_));
+    }
+
+    trace_writer_->record(customer->departure_time(),
+                          TraceKind::SYSTEM_EXITED,
+                          customer->id(),
+                          no_trace_place(),
+                          customer->serviced(),
+                          customer->service_time());
 }
 
 void SimulationSpy::on_transient_period_elapsed()
 {
+    warm_up_customers_ = transient_period_;
+
     // TODO: consider testing this (manually tested once)
-    if (constants::DEBUG_ENABLED) {
-        std::cout << "SimulationSpy::" << __func__
-                  << " erasing stats!" << std::endl;
-    }
+    logging::log<logging::Level::INFO, logging::Component::SPY>(
+        "SimulationSpy::on_transient_period_elapsed erasing stats!");
 
     clear_stats();
 }
@@ -71,36 +207,50 @@ void SimulationSpy::save_default_stats(const std::shared_ptr<Customer> & custome
     // TODO: consider making one big helper function (on customer)
     // that returns waiting times, entrances and losses
     // this will avoid iterating multiple times
-    if (constants::DEBUG_ENABLED) {
-        std::cout << "SimulationSpy::" << __func__ << " entered" << std::endl;
-    }
-
-    auto priority = customer->priority();
+    auto priority = priority_index(customer->priority());
 
     if (customer->serviced()) {
-        ++serviced_customers_[priority];
+        ++priority_stats_[priority].serviced;
+        ++total_serviced_customers_;
 
-        for (const auto & name : queue_names_) {
+        float total_waiting_time = 0;
+        for (std::size_t queue_id = 0; queue_id < queue_names_.size(); ++queue_id) {
+            const auto & name = queue_names_[queue_id];
+            auto & stats = queue_stats(queue_id, priority);
             auto entrances = customer->entrances(name);
-            total_entrances_by_queue_[name][priority] += entrances;
+            auto waiting_time = customer->waiting_time(name);
+            stats.total_entrances += entrances;
             if (entrances > 0) {
-                unique_customers_by_queue_[name][priority] += 1;
+                stats.unique_customers += 1;
+                waiting_time_sketches_[queue_id].record(waiting_time);
+                // another walk over the events, only worth it with the sketches on
+                if (sojourn_time_sketches_[queue_id].enabled()) {
+                    sojourn_time_sketches_[queue_id].record(customer->sojourn_time(name));
+                }
             }
-            waiting_times_by_queue_.at(name)[priority] += customer->waiting_time(name);
+            stats.waiting_time += waiting_time;
+            total_waiting_time += waiting_time;
         }
+        total_waiting_time_sketch_.record(total_waiting_time);
+        system_time_sketch_.record(customer->system_time());
+        batch_means_.waiting_times.add(total_waiting_time);
+        batch_means_.system_times.add(customer->system_time());
+        regenerative_cycles_.on_serviced(total_waiting_time, customer->system_time());
         total_service_time_ += customer->service_time();
         total_system_time_ += customer->system_time();
         if (service_time_percentile_to_value_) {
             save_slowdown(customer->total_waiting_time(), customer->service_time());
         }
     } else {
-        const auto & dropper = customer->dropped_by();
-        losses_by_queue_[dropper][priority] += 1;
-        unique_customers_by_queue_[dropper][priority] += 1;
-        ++system_lost_customers_[customer->priority()];
-    }
-    if (constants::DEBUG_ENABLED) {
-        std::cout << "SimulationSpy::" << __func__ << " exited" << std::endl;
+        auto dropper = queue_ids_.find(customer->dropped_by());
+        if (dropper == queue_ids_.end()) {
+            throw std::runtime_error("SimulationSpy customer dropped by unknown queue: " + customer->dropped_by());
+        }
+        auto & stats = queue_stats(dropper->second, priority);
+        stats.losses += 1;
+        stats.unique_customers += 1;
+        ++priority_stats_[priority].system_lost;
+        regenerative_cycles_.on_lost();
     }
 }
 
@@ -121,26 +271,36 @@ void SimulationSpy::save_additional_stats(const std::shared_ptr<Customer> & cust
     additional_stats_.push_back(ss.str());
 }
 
-void SimulationSpy::save_slowdown(float waiting_time, float service_time)
+// first bucket whose boundary is >= service_time, found with a binary search
+// whose loop has no data dependent branches
+std::size_t SimulationSpy::slowdown_bucket(float service_time) const
 {
-    int percentile = 0;
+    if (slowdown_boundaries_.empty()) {
+        return 0;
+    }
 
-    // consider using binary search or stl algorithm
-    for(; percentile < 99; ++percentile) {
-        if (service_time <= service_time_percentile_to_value_((percentile + 1) * .009999999999999)) {
-            break;
-        }
+    const double * base = slowdown_boundaries_.data();
+    auto length = slowdown_boundaries_.size();
+    while (length > 1) {
+        auto half = length / 2;
+        base = base[half] < service_time ? base + half : base;
+        length -= half;
     }
+    return (base - slowdown_boundaries_.data()) + (*base < service_time);
+}
 
-    auto &[total_slowdown, customer_count] = total_slowdown_and_customer_count_by_service_time_percentile_.at(percentile);
+void SimulationSpy::save_slowdown(float waiting_time, float service_time)
+{
+    auto &[total_slowdown, customer_count] =
+        total_slowdown_and_customer_count_by_service_time_percentile_[slowdown_bucket(service_time)];
 
     total_slowdown += waiting_time / service_time;
     ++customer_count;
 }
 
-std::array<float, 100> SimulationSpy::average_slowdown_percentiles()
+std::vector<float> SimulationSpy::average_slowdown_percentiles()
 {
-    std::array<float, 100> average_slowdown_percentiles;
+    std::vector<float> average_slowdown_percentiles(total_slowdown_and_customer_count_by_service_time_percentile_.size());
     std::transform(total_slowdown_and_customer_count_by_service_time_percentile_.begin(),
                    total_slowdown_and_customer_count_by_service_time_percentile_.end(),
                    average_slowdown_percentiles.begin(),
@@ -161,45 +321,55 @@ float SimulationSpy::average_system_time() const
     return total_system_time_ / total_serviced_customers();
 }
 
+// The rate and waiting time maps only have entries for the (queue, priority)
+// pairs that saw customers, the same keys the old name keyed tables ended up with
 queue_name_to_priority_to_stat
 SimulationSpy::customer_loss_rates()
 {
     queue_name_to_priority_to_stat rates;
 
     // iterate across queues, and collect stats for each queue
-    for (auto & name_and_unique_customers_map : unique_customers_by_queue_) {
-        auto & name = name_and_unique_customers_map.first;
+    for (std::size_t queue_id = 0; queue_id < queue_names_.size(); ++queue_id) {
+        auto & name_rates = rates[queue_names_[queue_id]];
         float name_losses = 0;
         float name_unique_customers = 0;
-        for (auto & priority_and_unique_entrances : name_and_unique_customers_map.second) {
-            auto priority = priority_and_unique_entrances.first;
+        for (std::size_t priority = 0; priority < priority_count_; ++priority) {
+            const auto & stats = queue_stats(queue_id, priority);
+            if (stats.unique_customers == 0) {
+                continue;
+            }
 
-            float losses = losses_by_queue_[name][priority];
-            float unique_customers = priority_and_unique_entrances.second;
+            float losses = stats.losses;
+            float unique_customers = stats.unique_customers;
 
-            rates[name][priority] = losses / unique_customers;
+            name_rates[priority_at(priority)] = losses / unique_customers;
             name_losses += losses;
             name_unique_customers += unique_customers;
         }
 
-        rates[name][SimulationRunStats::all_priorities()] = name_losses / name_unique_customers;
+        name_rates[SimulationRunStats::all_priorities()] = name_losses / name_unique_customers;
     }
 
     // iterate across priorities, and collect stats about all queues
+    auto & all_queue_rates = rates[SimulationRunStats::all_queues()];
     float total_system_losses = 0;
     float total_system_entrances = 0;
-    for (const auto & priority_and_entrances : system_entered_customers_) {
-        auto priority = priority_and_entrances.first;
-        float losses = system_lost_customers_[priority];
-        auto entrances = priority_and_entrances.second;
+    for (std::size_t priority = 0; priority < priority_count_; ++priority) {
+        const auto & stats = priority_stats_[priority];
+        if (stats.system_entered == 0) {
+            continue;
+        }
+
+        float losses = stats.system_lost;
+        auto entrances = stats.system_entered;
 
-        rates[SimulationRunStats::all_queues()][priority] = losses / entrances;
+        all_queue_rates[priority_at(priority)] = losses / entrances;
 
         total_system_entrances += entrances;
         total_system_losses += losses;
     }
 
-    rates[SimulationRunStats::all_queues()][SimulationRunStats::all_priorities()] = total_system_losses / total_system_entrances;
+    all_queue_rates[SimulationRunStats::all_priorities()] = total_system_losses / total_system_entrances;
     return rates;
 }
 
@@ -208,46 +378,63 @@ queue_name_to_priority_to_stat
 SimulationSpy::average_waiting_times()
 {
     queue_name_to_priority_to_stat average_times;
-    for (auto & name_and_total_entrances_map : total_entrances_by_queue_) {
-        auto & name = name_and_total_entrances_map.first;
+    auto & all_queue_times = average_times[SimulationRunStats::all_queues()];
+    for (std::size_t queue_id = 0; queue_id < queue_names_.size(); ++queue_id) {
+        auto & name_times = average_times[queue_names_[queue_id]];
         float name_waiting_time = 0;
         float name_total_entrances = 0;
-        for (auto & priority_and_total_entrances : name_and_total_entrances_map.second) {
-            auto priority = priority_and_total_entrances.first;
-            auto waiting_time = waiting_times_by_queue_[name][priority];
-            auto total_entrances = priority_and_total_entrances.second;
+        for (std::size_t priority = 0; priority < priority_count_; ++priority) {
+            auto serviced_customers = priority_stats_[priority].serviced;
+            if (serviced_customers == 0) {
+                continue;
+            }
+
+            const auto & stats = queue_stats(queue_id, priority);
+            auto waiting_time = stats.waiting_time;
+            auto total_entrances = stats.total_entrances;
             auto average_waiting_time = waiting_time / total_entrances;
-            auto serviced_customers = serviced_customers_[priority];
             auto average_enterances = float(total_entrances) / serviced_customers;
-            average_times[name][priority] = average_waiting_time;
-            average_times[SimulationRunStats::all_queues()][priority] += average_waiting_time * average_enterances;
+            name_times[priority_at(priority)] = average_waiting_time;
+            all_queue_times[priority_at(priority)] += average_waiting_time * average_enterances;
 
             name_waiting_time += waiting_time;
             name_total_entrances += total_entrances;
         }
         // this is the average waiting time any customer expects to wait given they enter a given queue
         auto name_average_waiting_time = name_waiting_time / name_total_entrances;
-        average_times[name][SimulationRunStats::all_priorities()] = name_average_waiting_time;
+        name_times[SimulationRunStats::all_priorities()] = name_average_waiting_time;
         // this is the average total waiting in all queues time from customer perspective
         auto name_average_enterances = name_total_entrances / total_serviced_customers();
 
         // TODO: actually propogate this correctly
         // std::cout << "name " << name << " average_enterances " << name_average_enterances << std::endl;
 
-        average_times[SimulationRunStats::all_queues()][SimulationRunStats::all_priorities()] += name_average_waiting_time * name_average_enterances;
+        all_queue_times[SimulationRunStats::all_priorities()] += name_average_waiting_time * name_average_enterances;
     }
     return average_times;
 }
 
+quantiles::TimeSketches SimulationSpy::time_sketches() const
+{
+    quantiles::TimeSketches sketches;
+    for (std::size_t queue_id = 0; queue_id < queue_names_.size(); ++queue_id) {
+        sketches.waiting_times.emplace(queue_names_[queue_id], waiting_time_sketches_[queue_id]);
+        sketches.sojourn_times.emplace(queue_names_[queue_id], sojourn_time_sketches_[queue_id]);
+    }
+    sketches.waiting_times.emplace(SimulationRunStats::all_queues(), total_waiting_time_sketch_);
+    sketches.system_times = system_time_sketch_;
+    return sketches;
+}
+
 void SimulationSpy::print_proj1_stats()
 {
+    const auto & stats = priority_stats_.at(priority_index(default_customer_priority()));
     std::cout << "CLR = "
-              << system_lost_customers_.at(default_customer_priority())
+              << stats.system_lost
               << "/"
-              << system_entered_customers_.at(default_customer_priority())
+              << stats.system_entered
               << " = "
-              << float(system_lost_customers_.at(default_customer_priority()))
-                 / system_entered_customers_.at(default_customer_priority())
+              << float(stats.system_lost) / stats.system_entered
               << std::endl;
 
     std::cout << "Average Service Time = "
@@ -6,29 +6,77 @@
 #include <vector>
 #include <utility>
 #include <array>
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <stdexcept>
 
 #include "customer.h"
 #include "stats.h"
+#include "quantile_sketch.h"
+#include "regenerative.h"
+#include "importance_sampling.h"
+#include "perturbation_analysis.h"
+#include "time_buckets.h"
+#include "trace.h"
 
+constexpr std::size_t default_slowdown_buckets() {
+    return 100;
+}
+
+// Per customer statistics, kept in dense tables indexed by queue and priority.
+//
+// Queue names and the priority range are fixed at construction, so the hot
+// path (on_customer_exiting) only does array arithmetic. The name keyed maps
+// handed to SimulationRunStats are built when the results are read.
 class SimulationSpy {
 public:
     SimulationSpy(std::size_t L,
                   std::size_t maximum_system_customers,
                   const std::vector<std::string> & queue_names,
                   std::uint32_t transient_period = 0,
-                  const std::function<double(double)> service_time_percentile_to_value = nullptr)
+                  const std::function<double(double)> service_time_percentile_to_value = nullptr,
+                  std::uint32_t minimum_priority = default_customer_priority(),
+                  std::uint32_t maximum_priority = default_customer_priority(),
+                  std::size_t slowdown_buckets = default_slowdown_buckets())
     : L_(L)
     , transient_period_(transient_period)
     , service_time_percentile_to_value_(service_time_percentile_to_value)
     , queue_names_(queue_names)
+    , minimum_priority_(minimum_priority)
+    , priority_count_(maximum_priority - minimum_priority + 1)
     , system_customers_()
-    , system_entered_customers_(0)
-    , system_lost_customers_(0)
-    , serviced_customers_(0)
+    , total_slowdown_and_customer_count_by_service_time_percentile_(slowdown_buckets)
+    , queue_stats_(queue_names.size() * priority_count_)
+    , priority_stats_(priority_count_)
+    , waiting_time_sketches_(queue_names.size())
+    , sojourn_time_sketches_(queue_names.size())
+    , total_serviced_customers_(0)
     , total_service_time_(0)
     , total_system_time_(0)
     , additional_stats_()
     {
+        if (maximum_priority < minimum_priority) {
+            throw std::invalid_argument("SimulationSpy maximum_priority below minimum_priority");
+        }
+
+        if (slowdown_buckets == 0) {
+            throw std::invalid_argument("SimulationSpy needs at least one slowdown bucket");
+        }
+
+        if (service_time_percentile_to_value_) {
+            // bucket i holds service times in (boundary[i-1], boundary[i]], the last one everything above
+            slowdown_boundaries_.reserve(slowdown_buckets - 1);
+            const double bucket_width = .9999999999999 / slowdown_buckets;
+            for (std::size_t i = 1; i < slowdown_buckets; ++i) {
+                slowdown_boundaries_.push_back(service_time_percentile_to_value_(i * bucket_width));
+            }
+        }
+
+        for (std::size_t i = 0; i < queue_names_.size(); ++i) {
+            queue_ids_[queue_names_[i]] = i;
+        }
+
         // because the most customers in the server is known and small
         // (for project 1 it will be 101 I think). I'd rather just reserve the memory
         // upfront and not worry about rehashing
@@ -38,11 +86,18 @@ public:
 
     std::uint32_t total_serviced_customers() const
     {
-        std::uint32_t total = 0;
-        for (const auto & priority_and_serviced_customers : serviced_customers_) {
-            total += priority_and_serviced_customers.second;
-        }
-        return total;
+        return total_serviced_customers_;
+    }
+
+    // every customer passing through the spy is written to the trace (see replay_trace)
+    void register_trace_writer(TraceWriter & trace_writer)
+    {
+        trace_writer_ = &trace_writer;
+        trace_writer_->set_spy_configuration(L_,
+                                             transient_period_,
+                                             queue_names_,
+                                             minimum_priority_,
+                                             minimum_priority_ + priority_count_ - 1);
     }
 
     void on_customer_entering(const std::shared_ptr<Customer> & customer);
@@ -51,61 +106,228 @@ public:
     queue_name_to_priority_to_stat customer_loss_rates();
     queue_name_to_priority_to_stat average_waiting_times();
 
+    // waiting time per queue entered (and in total) plus system time of every serviced customer
+    quantiles::TimeSketches time_sketches() const;
+
+    // also average total waiting and system time over every batch_size customers serviced after the transient period
+    void enable_batch_means(std::size_t batch_size)
+    {
+        batch_means_ = {statistics::BatchMeans(batch_size), statistics::BatchMeans(batch_size)};
+    }
+
+    const statistics::TimeBatchMeans & batch_means() const
+    {
+        return batch_means_;
+    }
+
+    // also sum waiting time, system time and losses per regenerative cycle
+    // (an arrival finding the system empty starts the next one)
+    void enable_regenerative_cycles()
+    {
+        regenerative_cycles_enabled_ = true;
+    }
+
+    // cycles that ended before the run did
+    const std::vector<statistics::RegenerativeCycle> & regenerative_cycles() const
+    {
+        return regenerative_cycles_.cycles();
+    }
+
+    // weight every customer by likelihood_ratio at its arrival and estimate
+    // the CLR from alternating plain and tilted cycles (see importance_sampling.h)
+    void enable_importance_sampling(LikelihoodRatio & likelihood_ratio)
+    {
+        importance_sampled_cycles_.emplace(likelihood_ratio);
+    }
+
+    statistics::ImportanceSamplingEstimate importance_sampling_estimate() const
+    {
+        return importance_sampled_cycles_.value().estimate();
+    }
+
+    // also estimate d(mean waiting and system time) / d(rate) by IPA; only
+    // valid for a single FCFS queue and server
+    void enable_perturbation_analysis(double arrival_rate, double service_rate)
+    {
+        perturbation_analysis_.emplace(arrival_rate, service_rate);
+    }
+
+    // all zero unless enabled
+    statistics::Sensitivities sensitivities() const
+    {
+        return perturbation_analysis_ ? perturbation_analysis_->sensitivities() : statistics::Sensitivities();
+    }
+
+    // also stream waiting and system times into copies of empty_sketch, see
+    // time_sketches(); they are off (quantiles::NoSketch) until then
+    void enable_quantiles(const quantiles::Sketch & empty_sketch)
+    {
+        std::fill(waiting_time_sketches_.begin(), waiting_time_sketches_.end(), empty_sketch);
+        std::fill(sojourn_time_sketches_.begin(), sojourn_time_sketches_.end(), empty_sketch);
+        total_waiting_time_sketch_ = empty_sketch;
+        system_time_sketch_ = empty_sketch;
+    }
+
+    // also group customers by arrival time into buckets this wide, folded onto
+    // period if it isn't 0 (see time_buckets.h)
+    void enable_time_buckets(double width, double period = 0)
+    {
+        time_buckets_ = statistics::TimeBuckets(width, period);
+    }
+
+    const statistics::TimeBuckets & time_buckets() const
+    {
+        return time_buckets_;
+    }
+
+    // Instead of the fixed transient period, hold exiting customers back until
+    // MSER-5 on their system times finds where the warm up ends (or
+    // max_warm_up_customers have exited), then count only the ones after it
+    void enable_mser_warm_up(std::size_t max_warm_up_customers)
+    {
+        mser_max_customers_ = std::max<std::size_t>(max_warm_up_customers, kMserBatchSize * kMserFirstCheckBatches);
+        mser_buffering_ = true;
+    }
+
+    // customers dropped from the front of the run as warm up
+    std::size_t warm_up_customers() const
+    {
+        return warm_up_customers_;
+    }
+
+    // false if MSER-5 was cut off by max_warm_up_customers rather than settling
+    bool warm_up_detected() const
+    {
+        return warm_up_detected_;
+    }
+
     float average_service_time() const;
 
     float average_system_time() const;
-    std::array<float, 100> average_slowdown_percentiles();
+    std::vector<float> average_slowdown_percentiles();
 
     void print_proj1_stats();
 
 private:
+    struct QueueStats {
+        float waiting_time = 0;
+        // This does not count if they are dropped by the queue
+        std::uint32_t total_entrances = 0;
+        // this DOES count if they are dropped by
+        std::uint32_t unique_customers = 0;
+        std::uint32_t losses = 0;
+    };
+
+    struct PriorityStats {
+        std::uint32_t system_entered = 0;
+        std::uint32_t system_lost = 0;
+        std::uint32_t serviced = 0;
+    };
+
+    std::size_t priority_index(std::uint32_t priority) const
+    {
+        auto index = std::size_t(priority) - minimum_priority_;
+        if (priority < minimum_priority_ || index >= priority_count_) {
+            throw std::out_of_range("SimulationSpy got a customer priority outside its range");
+        }
+        return index;
+    }
+
+    QueueStats & queue_stats(std::size_t queue_id, std::size_t priority_index)
+    {
+        return queue_stats_[queue_id * priority_count_ + priority_index];
+    }
+
+    std::uint32_t priority_at(std::size_t priority_index) const
+    {
+        return minimum_priority_ + priority_index;
+    }
+
     void save_default_stats(const std::shared_ptr<Customer> & customer);
     void save_additional_stats(const std::shared_ptr<Customer> & customer);
-    void save_slowdown(float service_time, float waiting_time);
+    void save_slowdown(float waiting_time, float service_time);
+    std::size_t slowdown_bucket(float service_time) const;
+    void trace_customer_exit(const std::shared_ptr<Customer> & customer);
     void on_transient_period_elapsed();
+    void buffer_warm_up_customer(const std::shared_ptr<Customer> & customer);
+    void end_warm_up(std::size_t truncation_batches);
+
+    static constexpr std::size_t kMserBatchSize = 5;
+    static constexpr std::size_t kMserFirstCheckBatches = 40; // then every time the buffer doubles
 
     void clear_stats()
     {
-        system_entered_customers_ = {};
-        system_lost_customers_ = {};
-        serviced_customers_ = {};
+        std::fill(queue_stats_.begin(), queue_stats_.end(), QueueStats{});
+        std::fill(priority_stats_.begin(), priority_stats_.end(), PriorityStats{});
+        total_serviced_customers_ = 0;
+        for (auto & sketch : waiting_time_sketches_) {
+            sketch.clear();
+        }
+        for (auto & sketch : sojourn_time_sketches_) {
+            sketch.clear();
+        }
+        total_waiting_time_sketch_.clear();
+        system_time_sketch_.clear();
+        batch_means_.waiting_times.clear();
+        batch_means_.system_times.clear();
+        regenerative_cycles_.clear();
+        if (importance_sampled_cycles_) {
+            importance_sampled_cycles_->clear();
+        }
+        if (perturbation_analysis_) {
+            perturbation_analysis_->clear();
+        }
 
         total_service_time_ = 0; // TODO: this isn't right for cpu example
         total_system_time_ = 0;
 
-        for (const auto & name : queue_names_) {
-            waiting_times_by_queue_[name] = {};
-            total_entrances_by_queue_[name] = {};
-            unique_customers_by_queue_[name] = {};
-            losses_by_queue_[name] = {};
-            total_slowdown_and_customer_count_by_service_time_percentile_ = {};
-        }
-
+        std::fill(total_slowdown_and_customer_count_by_service_time_percentile_.begin(),
+                  total_slowdown_and_customer_count_by_service_time_percentile_.end(),
+                  std::pair<float, std::uint32_t>{});
     }
 
     std::size_t L_;
     std::uint32_t transient_period_;
     const std::function<double(double)> service_time_percentile_to_value_;
     std::vector<std::string> queue_names_;
+    std::unordered_map<std::string, std::size_t> queue_ids_;
+    std::uint32_t minimum_priority_;
+    std::size_t priority_count_;
+    std::vector<double> slowdown_boundaries_; // ascending service time upper bounds of all but the last bucket
 
     std::unordered_map<std::uint32_t, std::shared_ptr<Customer>> system_customers_;
 
     // stats that must be cleared
-    std::array<std::pair<float, std::uint32_t>, 100> total_slowdown_and_customer_count_by_service_time_percentile_;
-    std::unordered_map<std::string, std::unordered_map<std::uint32_t, float>> waiting_times_by_queue_;
-
-    // This does not count if they are dropped by the queue
-    std::unordered_map<std::string, std::unordered_map<std::uint32_t, std::uint32_t>> total_entrances_by_queue_;
-
-    // this DOES count if they are dropped by
-    std::unordered_map<std::string, std::unordered_map<std::uint32_t, std:: uint32_t>> unique_customers_by_queue_;
-
-    std::unordered_map<std::string, std::unordered_map<std::uint32_t, std::uint32_t>> losses_by_queue_;
-    std::unordered_map<std::uint32_t, std::uint32_t> system_entered_customers_;
-    std::unordered_map<std::uint32_t, std::uint32_t> system_lost_customers_;
-    std::unordered_map<std::uint32_t, std::uint32_t> serviced_customers_;
+    std::vector<std::pair<float, std::uint32_t>> total_slowdown_and_customer_count_by_service_time_percentile_;
+    std::vector<QueueStats> queue_stats_; // [queue id][priority index]
+    std::vector<PriorityStats> priority_stats_; // [priority index]
+    std::vector<quantiles::Sketch> waiting_time_sketches_; // [queue id], customers that entered the queue
+    std::vector<quantiles::Sketch> sojourn_time_sketches_; // [queue id], the same customers
+    quantiles::Sketch total_waiting_time_sketch_;
+    quantiles::Sketch system_time_sketch_;
+    statistics::TimeBatchMeans batch_means_;
+    statistics::RegenerativeCycles regenerative_cycles_;
+    std::optional<statistics::ImportanceSampledCycles> importance_sampled_cycles_;
+    std::optional<statistics::PerturbationAnalysis> perturbation_analysis_;
+    statistics::TimeBuckets time_buckets_; // never cleared, the warm up is part of the picture
+    std::uint32_t total_serviced_customers_;
     float total_service_time_;
     float total_system_time_;
 
     std::vector<std::string> additional_stats_;
+
+    TraceWriter * trace_writer_ = nullptr;
+
+    bool regenerative_cycles_enabled_ = false;
+
+    bool mser_buffering_ = false;
+    std::size_t mser_max_customers_ = 0;
+    std::size_t mser_next_check_ = kMserFirstCheckBatches;
+    std::vector<std::shared_ptr<Customer>> warm_up_buffer_; // every exit, in order, until the warm up ends
+    std::vector<std::size_t> mser_batch_ends_; // warm_up_buffer_ size at the end of each batch
+    std::vector<double> mser_batch_means_; // of serviced customers' system times
+    double mser_batch_sum_ = 0;
+    std::size_t mser_in_batch_ = 0;
+    std::size_t warm_up_customers_ = 0;
+    bool warm_up_detected_ = true;
 };
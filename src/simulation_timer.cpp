@@ -1,26 +1,32 @@
 #include <iostream>
 
 #include "simulation_timer.h"
+#include "probe.h"
+#include "allocation_counter.h"
 
 SimulationTimer::SimulationTimer()
 : time_(0)
 , last_job_id_(0)
 {
-    if (constants::DEBUG_ENABLED) {
-            std::cout << "Simulation Timer Created" << std::endl;
-    }
+    logging::log<logging::Level::DEBUG, logging::Component::TIMER>("Simulation Timer Created");
 }
 
 void SimulationTimer::advance_time()
 {
+    probe::ScopedProbe scoped_probe(probe::Probe::ADVANCE_TIME);
     if (jobs_.empty()) {
        throw(std::runtime_error("jobs empty in advance time"));
     }
 
-    if (constants::DEBUG_ENABLED) {
-        std::cout << std::endl << "SimulationTimer::" << __func__
-                  << " called at time: " << time_
-                  << " with jobs:" << jobs_.size() << std::endl;
+    logging::log<logging::Level::TRACE, logging::Component::TIMER>(
+        "SimulationTimer::advance_time called at time: {} with jobs: {}", time_, jobs_.size());
+
+    if (state_log_) {
+        state_log_->save([this, time = time_, jobs = dispatched_jobs_, arrivals = dispatched_arrivals_] {
+            time_ = time;
+            dispatched_jobs_ = jobs;
+            dispatched_arrivals_ = arrivals;
+        });
     }
 
     auto jobs_iterator = jobs_.begin();
@@ -28,17 +34,36 @@ void SimulationTimer::advance_time()
     time_ = soonest_time;
     for (; jobs_iterator != jobs_.end(); ++jobs_iterator) {
         if (jobs_iterator->first == soonest_time) {
+            const auto & tag = jobs_iterator->second.tag();
+            ++dispatched_jobs_;
+            dispatched_arrivals_ += tag.kind == TraceKind::ARRIVAL;
+            if (trace_writer_) {
+                trace_writer_->record(time_,
+                                      tag.kind,
+                                      tag.customer_id,
+                                      trace_writer_->place_id(tag.place_name));
+            }
             jobs_iterator->second.do_job();
         } else {
             break;
         }
    }
 
-    if (constants::DEBUG_ENABLED) {
-        std::cout << "SimulationTimer::" << __func__
-                  << " ended at time:" << time_
-                  <<  " with jobs:" << jobs_.size() << std::endl;
-    }
+    logging::log<logging::Level::TRACE, logging::Component::TIMER>(
+        "SimulationTimer::advance_time ended at time: {} with jobs: {}", time_, jobs_.size());
 
+   allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::TIMER);
+   if (state_log_) {
+       // every job at the time ran, so putting them back in order restores the order they ran in
+       std::vector<Job> ran;
+       for (auto range = jobs_.equal_range(soonest_time); range.first != range.second; ++range.first) {
+           ran.push_back(range.first->second);
+       }
+       state_log_->save([this, soonest_time, ran = std::move(ran)] {
+           for (const auto & job : ran) {
+               jobs_.insert({soonest_time, job});
+           }
+       });
+   }
    jobs_.erase(soonest_time);
 }
@@ -6,12 +6,17 @@
 #include <iostream>
 
 #include  "constants.h"
+#include "state_log.h"
+#include "trace.h"
+#include "log.h"
+#include "allocation_counter.h"
 
 class Job {
 public:
-    Job(std::uint32_t id, const std::function<void()> & job)
+    Job(std::uint32_t id, const std::function<void()> & job, const JobTag & tag = JobTag())
     : id_(id)
     , job_(job)
+    , tag_(tag)
     {}
 
     void do_job()
@@ -24,9 +29,15 @@ public:
         return id_;
     }
 
+    const JobTag & tag() const
+    {
+        return tag_;
+    }
+
 private:
     std::uint32_t id_;
     std::function<void()> job_;
+    JobTag tag_;
 };
 
 class SimulationTimer {
@@ -37,28 +48,36 @@ public:
         return time_;
     }
 
-    inline std::uint32_t register_job(float start_time, const std::function<void()> & callback) const
+    inline std::uint32_t register_job(float start_time,
+                                      const std::function<void()> & callback,
+                                      const JobTag & tag = JobTag()) const
     {
-        if (constants::DEBUG_ENABLED) {
-            std::cout << "SimulationTimer::" << __func__
-                      << " registered job with start time: " << start_time
-                      << " and id: " << last_job_id_
-                      << " at time: " << time_ << std::endl;
+        allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::TIMER);
+        logging::log<logging::Level::TRACE, logging::Component::TIMER>(
+            "SimulationTimer::register_job registered job with start time: {} and id: {} at time: {}",
+            start_time, last_job_id_, time_);
+        jobs_.insert({start_time, Job(last_job_id_, callback, tag)});
+        if (state_log_) {
+            state_log_->save([this, start_time, id = last_job_id_] {
+                erase_job(start_time, id);
+                last_job_id_ = id;
+            });
         }
-        jobs_.insert({start_time, Job(last_job_id_, callback)});
         return last_job_id_++;
     }
 
     inline float remove_job(std::uint32_t id) const
     {
+        allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::TIMER);
         for (auto jobs_iterator = jobs_.begin(); jobs_iterator != jobs_.end(); ++jobs_iterator) {
             if (jobs_iterator->second.id() == id) {
                 float old_departure_time = jobs_iterator->first;
-                jobs_.erase(jobs_iterator);
-                if (constants::DEBUG_ENABLED) {
-                    std::cout << "SimulationTimer::" << __func__
-                            << " erased job: " << id << std::endl;
+                if (state_log_) {
+                    state_log_->save([this, job = *jobs_iterator] { jobs_.insert(job); });
                 }
+                jobs_.erase(jobs_iterator);
+                logging::log<logging::Level::TRACE, logging::Component::TIMER>(
+                    "SimulationTimer::remove_job erased job: {}", id);
                 return old_departure_time;
             }
         }
@@ -67,8 +86,58 @@ public:
 
     void advance_time();
 
+    // false once nothing is left to run, e.g. a replayed log has run out and every customer has left
+    bool has_jobs() const
+    {
+        return !jobs_.empty();
+    }
+
+    // when advance_time will run next, only while has_jobs()
+    float next_job_time() const
+    {
+        return jobs_.begin()->first;
+    }
+
+    // every change to the time and the jobs is saved while a log is set, so the
+    // Time Warp engine can roll the timer back (null turns saving off)
+    void set_state_log(StateLog * state_log)
+    {
+        state_log_ = state_log;
+    }
+
+    // jobs run by advance_time so far, and how many of them were customer arrivals
+    std::uint64_t dispatched_jobs() const
+    {
+        return dispatched_jobs_;
+    }
+
+    std::uint64_t dispatched_arrivals() const
+    {
+        return dispatched_arrivals_;
+    }
+
+    // every dispatched job is recorded while a writer is set (null turns tracing off)
+    void set_trace_writer(TraceWriter * trace_writer)
+    {
+        trace_writer_ = trace_writer;
+    }
+
 private:
+    void erase_job(float start_time, std::uint32_t id) const
+    {
+        for (auto range = jobs_.equal_range(start_time); range.first != range.second; ++range.first) {
+            if (range.first->second.id() == id) {
+                jobs_.erase(range.first);
+                return;
+            }
+        }
+    }
+
     float time_;
     mutable std::uint32_t last_job_id_;
     mutable std::multimap<float, Job> jobs_;
+    StateLog * state_log_ = nullptr;
+    TraceWriter * trace_writer_ = nullptr;
+    std::uint64_t dispatched_jobs_ = 0;
+    std::uint64_t dispatched_arrivals_ = 0;
 };
@@ -0,0 +1,174 @@
+#include "splitting.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#include "prng.h"
+
+namespace splitting {
+
+namespace {
+
+using State = std::vector<std::uint32_t>; // customers at each station, in service included
+
+class Restart {
+public:
+    Restart(const Network & network, const Settings & settings, long seed)
+    : network_(network)
+    , settings_(settings)
+    , uniform_(seed)
+    {
+        weights_.push_back(1);
+        for (auto splits : settings_.splits) {
+            weights_.push_back(weights_.back() / splits);
+        }
+        estimate_.losses.resize(network_.stations.size());
+    }
+
+    Estimate run()
+    {
+        State state(network_.stations.size(), 0);
+        estimate_.arrivals = trajectory(state, 0, settings_.arrivals);
+        return estimate_;
+    }
+
+private:
+    // how many thresholds the target station's occupancy has reached
+    std::size_t region(const State & state) const
+    {
+        const auto & thresholds = settings_.thresholds;
+        return std::upper_bound(thresholds.begin(), thresholds.end(), state[settings_.target_station])
+               - thresholds.begin();
+    }
+
+    // Copies born at born_region die once they drop below it. Every trajectory
+    // also ends where the main one does, after settings.arrivals arrivals
+    // counted from the start, so copies see what the main trajectory could
+    // have. Returns the arrivals seen.
+    std::uint64_t trajectory(State & state, std::size_t born_region, std::uint64_t remaining_arrivals)
+    {
+        auto current = region(state);
+        std::uint64_t arrivals = 0;
+        while (arrivals < remaining_arrivals) {
+            if (step(state, weights_[current])) {
+                ++arrivals;
+            }
+
+            const auto next = region(state);
+            if (next < born_region) {
+                break;
+            }
+
+            while (current < next) {
+                ++current;
+                for (std::uint32_t copy = 1; copy < settings_.splits[current - 1]; ++copy) {
+                    auto copied_state = state;
+                    trajectory(copied_state, current, remaining_arrivals - arrivals);
+                }
+            }
+            current = next;
+        }
+        return arrivals;
+    }
+
+    // true if the event was an arrival
+    bool step(State & state, double weight)
+    {
+        ++estimate_.events;
+
+        double total_rate = network_.arrival_rate;
+        for (std::size_t i = 0; i < state.size(); ++i) {
+            if (state[i] > 0) {
+                total_rate += network_.stations[i].service_rate;
+            }
+        }
+
+        double event = uniform_.generate() * total_rate;
+        if (event < network_.arrival_rate) {
+            enter(state, 0, weight);
+            return true;
+        }
+        event -= network_.arrival_rate;
+
+        // the last busy station also takes whatever rounding leaves over
+        std::size_t serviced = state.size();
+        for (std::size_t i = 0; i < state.size(); ++i) {
+            if (state[i] == 0) {
+                continue;
+            }
+            serviced = i;
+            if (event < network_.stations[i].service_rate) {
+                break;
+            }
+            event -= network_.stations[i].service_rate;
+        }
+
+        --state[serviced];
+        double route = uniform_.generate();
+        const auto & routing = network_.stations[serviced].routing;
+        for (std::size_t j = 0; j < routing.size(); ++j) {
+            if (route < routing[j]) {
+                enter(state, j, weight);
+                return false;
+            }
+            route -= routing[j];
+        }
+        return false;
+    }
+
+    void enter(State & state, std::size_t station, double weight)
+    {
+        if (state[station] > network_.stations[station].capacity) {
+            estimate_.losses[station] += weight;
+        } else {
+            ++state[station];
+        }
+    }
+
+    const Network & network_;
+    const Settings & settings_;
+    UniformGenerator uniform_;
+    std::vector<double> weights_; // [region] 1 / product of the splits below it
+    Estimate estimate_;
+};
+
+} // anonymous
+
+Settings every_level(const Network & network, std::size_t target_station, std::uint32_t splits, std::uint64_t arrivals)
+{
+    Settings settings;
+    settings.target_station = target_station;
+    settings.arrivals = arrivals;
+    for (std::uint32_t occupancy = 1; occupancy <= network.stations.at(target_station).capacity + 1; ++occupancy) {
+        settings.thresholds.push_back(occupancy);
+        settings.splits.push_back(splits);
+    }
+    return settings;
+}
+
+double Estimate::loss_rate(std::size_t station) const
+{
+    return losses.at(station) / arrivals;
+}
+
+double Estimate::total_loss_rate() const
+{
+    return std::accumulate(losses.begin(), losses.end(), 0.0) / arrivals;
+}
+
+Estimate restart(const Network & network, const Settings & settings, long seed)
+{
+    if (network.stations.empty() || settings.target_station >= network.stations.size()) {
+        throw std::invalid_argument("restart needs a target station in the network");
+    }
+    if (settings.thresholds.size() != settings.splits.size()
+        || !std::is_sorted(settings.thresholds.begin(), settings.thresholds.end())
+        || std::count(settings.splits.begin(), settings.splits.end(), 0u) > 0) {
+        throw std::invalid_argument("restart needs ascending thresholds, each with at least one copy");
+    }
+
+    return Restart(network, settings, seed).run();
+}
+
+} // splitting
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// RESTART splitting for rare customer losses.
+//
+// The event driven models can't be copied mid run (timer jobs and queue
+// callbacks hold references into the run), so splitting works on a compact
+// Markov chain of the same network instead. Every station has exponential
+// service and a single server, so the whole state is one occupancy count per
+// station and a copy costs a few bytes. Only the order of events matters to a
+// loss rate per arriving customer, so the embedded jump chain is stepped and
+// there is no clock.
+//
+// The importance function is the occupancy of one station. Whenever a
+// trajectory climbs to a threshold it is split into R_i copies. Copies born at
+// threshold i die when they fall back below it, while the main trajectory runs
+// for a fixed number of arrivals. A loss seen above i thresholds counts
+// 1 / (R_1 ... R_i), so the weighted count is an unbiased estimate of the main
+// trajectory's losses. Near full the copies produce most of the losses.
+
+namespace splitting {
+
+struct Station {
+    double service_rate;
+    std::uint32_t capacity; // waiting room; the server holds one more
+    std::vector<double> routing; // probability of moving to station j after service, the rest leave
+};
+
+// Poisson arrivals into station 0
+struct Network {
+    double arrival_rate;
+    std::vector<Station> stations;
+};
+
+struct Settings {
+    std::size_t target_station = 0; // the importance function is its occupancy
+    std::vector<std::uint32_t> thresholds; // ascending occupancies
+    std::vector<std::uint32_t> splits; // copies (counting the one that got there) at each threshold
+    std::uint64_t arrivals = 0; // length of the main trajectory
+};
+
+// splits ways at every occupancy of target_station from 1 up to full
+Settings every_level(const Network & network, std::size_t target_station, std::uint32_t splits, std::uint64_t arrivals);
+
+struct Estimate {
+    std::uint64_t arrivals = 0; // into the main trajectory
+    std::vector<double> losses; // weighted, per station
+    std::uint64_t events = 0; // simulated over every trajectory, the cost of the estimate
+
+    double loss_rate(std::size_t station) const;
+    double total_loss_rate() const;
+};
+
+Estimate restart(const Network & network, const Settings & settings, long seed);
+
+} // splitting
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// Incremental state saving for the optimistic Time Warp engine (see
+// time_warp.h). A component with a log saves how to undo each change it makes
+// to its state, and rolling back to a mark undoes every change saved since,
+// newest first, so the undos only ever see the state their change left.
+// Changes no rollback can reach anymore are forgotten to free their memory.
+//
+// An undo puts state back directly, it must not save anything itself.
+class StateLog {
+public:
+    using Mark = std::uint64_t;
+
+    // where the log is now, to roll back to later
+    Mark mark() const
+    {
+        return forgotten_ + undos_.size();
+    }
+
+    void save(std::function<void()> undo)
+    {
+        undos_.push_back(std::move(undo));
+    }
+
+    void undo_to(Mark mark)
+    {
+        while (this->mark() > mark) {
+            undos_.back()();
+            undos_.pop_back();
+        }
+    }
+
+    // drops the undos saved before mark, which must not be rolled back to again
+    void forget_to(Mark mark)
+    {
+        while (forgotten_ < mark && !undos_.empty()) {
+            undos_.pop_front();
+            ++forgotten_;
+        }
+    }
+
+    // undos kept
+    std::size_t size() const
+    {
+        return undos_.size();
+    }
+
+private:
+    std::deque<std::function<void()>> undos_;
+    Mark forgotten_ = 0;
+};
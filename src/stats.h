@@ -3,7 +3,14 @@
 #include <sstream>
 #include <tgmath.h>
 #include <unordered_map>
-#include <array>
+#include <vector>
+
+#include "quantile_sketch.h"
+#include "batch_means.h"
+#include "regenerative.h"
+#include "control_variates.h"
+#include "perturbation_analysis.h"
+#include "time_buckets.h"
 
 using queue_name_to_priority_to_stat = std::unordered_map<std::string, std::unordered_map<std::uint32_t, float>>;
 
@@ -14,13 +21,27 @@ public:
                        float average_system_time,
                        float average_service_time,
                        float simulation_end_time,
-                       const std::array<float, 100> & average_slowdown_percentiles)
+                       const std::vector<float> & average_slowdown_percentiles,
+                       const quantiles::TimeSketches & time_sketches,
+                       const statistics::TimeBatchMeans & batch_means,
+                       std::size_t warm_up_customers,
+                       const std::vector<statistics::RegenerativeCycle> & regenerative_cycles,
+                       const statistics::RunControls & controls,
+                       const statistics::Sensitivities & sensitivities,
+                       const statistics::TimeBuckets & time_buckets)
     : customer_loss_rates_(customer_loss_rates)
     , average_waiting_times_(average_waiting_times)
     , average_system_time_(average_system_time)
     , average_service_time_(average_service_time)
     , simulation_end_time_(simulation_end_time)
     , average_slowdown_percentiles_(average_slowdown_percentiles)
+    , time_sketches_(time_sketches)
+    , batch_means_(batch_means)
+    , warm_up_customers_(warm_up_customers)
+    , regenerative_cycles_(regenerative_cycles)
+    , controls_(controls)
+    , sensitivities_(sensitivities)
+    , time_buckets_(time_buckets)
     {}
 
     queue_name_to_priority_to_stat customer_loss_rates()
@@ -48,11 +69,51 @@ public:
         return simulation_end_time_;
     }
 
-    const std::array<float, 100> & average_slowdown_percentiles()
+    const std::vector<float> & average_slowdown_percentiles()
     {
         return average_slowdown_percentiles_;
     }
 
+    const quantiles::TimeSketches & time_sketches()
+    {
+        return time_sketches_;
+    }
+
+    const statistics::TimeBatchMeans & batch_means()
+    {
+        return batch_means_;
+    }
+
+    // customers dropped from the front of the run as warm up
+    std::size_t warm_up_customers()
+    {
+        return warm_up_customers_;
+    }
+
+    // cycles that ended during the run (empty unless the spy was asked for them)
+    const std::vector<statistics::RegenerativeCycle> & regenerative_cycles()
+    {
+        return regenerative_cycles_;
+    }
+
+    // sample means of the run's random inputs, for control variates
+    const statistics::RunControls & controls()
+    {
+        return controls_;
+    }
+
+    // IPA derivatives of the run's means (all zero unless the spy was asked for them)
+    const statistics::Sensitivities & sensitivities()
+    {
+        return sensitivities_;
+    }
+
+    // customers by arrival time (disabled unless the spy was asked for them)
+    const statistics::TimeBuckets & time_buckets()
+    {
+        return time_buckets_;
+    }
+
     static std::uint32_t all_priorities() {
         return UINT32_MAX;
     }
@@ -67,7 +128,14 @@ private:
     float average_system_time_;
     float average_service_time_;
     float simulation_end_time_;
-    std::array<float, 100> average_slowdown_percentiles_;
+    std::vector<float> average_slowdown_percentiles_;
+    quantiles::TimeSketches time_sketches_;
+    statistics::TimeBatchMeans batch_means_;
+    std::size_t warm_up_customers_;
+    std::vector<statistics::RegenerativeCycle> regenerative_cycles_;
+    statistics::RunControls controls_;
+    statistics::Sensitivities sensitivities_;
+    statistics::TimeBuckets time_buckets_;
 };
 
 namespace statistics {
@@ -97,18 +165,56 @@ T sample_variance(const Container & items, const T & mean)
 }
 
 template <class Container>
-std::string confidence_interval_string(const Container & items)
+double confidence_half_width(const Container & items)
 {
     auto mean = sample_mean(items);
     auto variance = sample_variance(items, mean);
 
     constexpr auto z_for_95_percent_confidence = 1.960;
 
-    auto offset = z_for_95_percent_confidence * sqrt(variance) / sqrt(items.size());
+    return z_for_95_percent_confidence * sqrt(variance) / sqrt(items.size());
+}
+
+template <class Container>
+std::string confidence_interval_string(const Container & items)
+{
+    auto mean = sample_mean(items);
+    auto offset = confidence_half_width(items);
 
     std::stringstream ss;
     ss << mean << " ± " << offset;
     return ss.str();
 }
 
+// Runs 2j and 2j + 1 of an antithetic pair averaged into one independent sample
+template <class Container>
+Container pair_averages(const Container & items)
+{
+    Container averages;
+    for (std::size_t i = 0; i + 1 < items.size(); i += 2) {
+        averages.push_back((items[i] + items[i + 1]) / 2);
+    }
+    return averages;
+}
+
+// Interval for the mean of lhs[i] - rhs[i] when run i of both shared random numbers
+template <class Container>
+std::string paired_difference_string(const Container & lhs, const Container & rhs)
+{
+    Container differences;
+    for (std::size_t i = 0; i < lhs.size() && i < rhs.size(); ++i) {
+        differences.push_back(lhs[i] - rhs[i]);
+    }
+    return confidence_interval_string(differences);
+}
+
+// The half width the same difference would get from independent runs
+template <class Container>
+double unpaired_difference_half_width(const Container & lhs, const Container & rhs)
+{
+    auto lhs_width = confidence_half_width(lhs);
+    auto rhs_width = confidence_half_width(rhs);
+    return sqrt(lhs_width * lhs_width + rhs_width * rhs_width);
+}
+
 } // statistics
@@ -4,6 +4,7 @@
 #include <string>
 #include <iostream>
 #include <unordered_map>
+#include <fstream>
 
 #include "test.h"
 #include "simulation_timer.h"
@@ -15,6 +16,29 @@
 #include "random_load_balancer.h"
 #include "priority_generator.h"
 #include "simulation_spy.h"
+#include "parallel_runs.h"
+#include "proj_2.h"
+#include "proj_3.h"
+#include "state_log.h"
+#include "time_warp.h"
+#include "trace.h"
+#include "log.h"
+#include "microbench.h"
+#include "bench.h"
+#include "allocation_counter.h"
+#include "probe.h"
+#include "quantile_sketch.h"
+#include "batch_means.h"
+#include "regenerative.h"
+#include "control_variates.h"
+#include "splitting.h"
+#include "importance_sampling.h"
+#include "perturbation_analysis.h"
+#include "analytic.h"
+#include "request_log.h"
+#include "logged_customers.h"
+#include "rate_profile.h"
+#include "time_buckets.h"
 
 namespace {
 
@@ -22,6 +46,16 @@ auto make_exp_gen_lambda(float kLambda) {
     return [gen = ExponentialGenerator(kLambda)] { return gen.generate(); };
 }
 
+// an allocation the optimizer can't elide, for the tests that count them
+template <class T>
+std::unique_ptr<T> make_kept()
+{
+    static void * volatile kept = nullptr;
+    auto pointer = std::make_unique<T>();
+    kept = pointer.get();
+    return pointer;
+}
+
 } //anonymous
 
 
@@ -48,7 +82,33 @@ void run_all_tests()
         std::make_pair("Priority Preempt", test_prio_p_queue),
         std::make_pair("Spy", test_spy),
         std::make_pair("Spy Odd", test_spy_odd_entrances),
-        std::make_pair("Bounded Pareto", test_bounded_pareto)
+        std::make_pair("Spy Priority Range", test_spy_priority_range),
+        std::make_pair("Spy Slowdown Buckets", test_spy_slowdown_buckets),
+        std::make_pair("Quantile Sketches", test_quantile_sketches),
+        std::make_pair("Batch Means", test_batch_means),
+        std::make_pair("Precision Runs", test_precision_runs),
+        std::make_pair("MSER Warm Up", test_mser_warm_up),
+        std::make_pair("Regenerative Cycles", test_regenerative_cycles),
+        std::make_pair("Variance Reduction", test_variance_reduction),
+        std::make_pair("Control Variates", test_control_variates),
+        std::make_pair("Restart Splitting", test_restart_splitting),
+        std::make_pair("Importance Sampling", test_importance_sampling),
+        std::make_pair("Perturbation Analysis", test_perturbation_analysis),
+        std::make_pair("Buffer Search", test_buffer_search),
+        std::make_pair("Analytic", test_analytic),
+        std::make_pair("Closed Network", test_closed_network),
+        std::make_pair("Request Log", test_request_log),
+        std::make_pair("Rate Profile", test_rate_profile),
+        std::make_pair("Bounded Pareto", test_bounded_pareto),
+        std::make_pair("Parallel Runs", test_parallel_runs),
+        std::make_pair("Time Warp", test_time_warp),
+        std::make_pair("Time Warp Rounds", test_time_warp_rounds),
+        std::make_pair("Trace", test_trace),
+        std::make_pair("Logging", test_logging),
+        std::make_pair("Microbench", test_microbench),
+        std::make_pair("Bench", test_bench),
+        std::make_pair("Allocation Accounting", test_allocation_accounting),
+        std::make_pair("Probes", test_probes)
     };
 
     auto failure_count = 0;
@@ -936,6 +996,9 @@ void test_customer_events()
 
     ASSERT_EQ(customer->waiting_time(server_name), (kExitedServer - kEnteredServer), "server is 3");
 
+    ASSERT_EQ(customer->sojourn_time(queue_name_1), (kExitedServer - kEnteredQueue), "queue1 until serviced is 4");
+    ASSERT_EQ(customer->sojourn_time("queue3"), float(0), "never visited");
+
     auto customer_string = customer->to_string(true);
 
     // std::cout << customer_string << std::endl;
@@ -1117,10 +1180,15 @@ void test_spy()
     constexpr auto kNoLVal = 0;
     constexpr auto kMaxSize = 100;
     constexpr auto kTransientPeriod = 1000;
+    constexpr auto kMinPriority = 1;
+    constexpr auto kMaxPriority = 2;
     SimulationSpy spy(kNoLVal,
                       kMaxSize,
                       {queue_name_1, queue_name_2},
-                      kTransientPeriod);
+                      kTransientPeriod,
+                      nullptr,
+                      kMinPriority,
+                      kMaxPriority);
 
     spy.on_customer_entering(customer);
     spy.on_customer_exiting(customer);
@@ -1288,10 +1356,15 @@ void test_spy_odd_entrances()
     constexpr auto kNoLVal = 0;
     constexpr auto kMaxSize = 100;
     constexpr auto kTransientPeriod = 1000;
+    constexpr auto kMinPriority = 1;
+    constexpr auto kMaxPriority = 2;
     SimulationSpy spy(kNoLVal,
                       kMaxSize,
                       {queue_name_1, queue_name_2},
-                      kTransientPeriod);
+                      kTransientPeriod,
+                      nullptr,
+                      kMinPriority,
+                      kMaxPriority);
 
     spy.on_customer_entering(customer);
     spy.on_customer_exiting(customer);
@@ -1371,6 +1444,1441 @@ void test_bounded_pareto()
     ASSERT_LT(max, double(1e10));
     ASSERT_GT(mean, double(2800));
     ASSERT_LT(mean, double(3200));
+
+    // a tail light enough for the sample mean to settle, whose top 3% the
+    // inverse CDF once sent past the upper bound and then to NaN
+    BoundedParetoGenerator light_tail(1, 10, 1.5, 4321);
+    constexpr auto kLightTailNumbers = 200'000;
+    double light_tail_min = INFINITY;
+    double light_tail_max = 0;
+    double light_tail_mean = 0;
+    for (auto i = 0; i < kLightTailNumbers; ++i) {
+        auto generated_number = light_tail.generate();
+        light_tail_min = std::min(light_tail_min, generated_number);
+        light_tail_max = std::max(light_tail_max, generated_number);
+        light_tail_mean += generated_number / kLightTailNumbers;
+    }
+
+    ASSERT_GT(light_tail_min, .9999, "draws stay above the lower bound");
+    ASSERT_LT(light_tail_max, 10.0001, "draws stay below the upper bound");
+    ASSERT_LT(std::abs(light_tail_mean - light_tail.mean()), .01 * light_tail.mean(), "sampled mean matches mean()");
+}
+
+void test_parallel_runs()
+{
+    constexpr std::size_t kRuns = 6;
+    constexpr std::size_t kThreads = 3;
+    constexpr float kLambda = .7;
+    constexpr std::size_t kQueueSize = 10;
+    constexpr std::size_t kCustomersToServe = 2000;
+
+    auto do_run = [=] (std::size_t i) {
+        return project2::do_m_m_1_k(kLambda,
+                                    kQueueSize,
+                                    kCustomersToServe,
+                                    project2::Discipline::FCFS,
+                                    long(i)*constants::SEED_OFFSET);
+    };
+
+    ParallelRunReport report;
+    auto sequential_stats = run_in_parallel(kRuns, do_run, 1);
+    auto parallel_stats = run_in_parallel(kRuns, do_run, kThreads, &report);
+
+    ASSERT_EQ(parallel_stats.size(), kRuns, "one result per run");
+    ASSERT_EQ(report.runs, kRuns, "report counts runs");
+    ASSERT_EQ(report.threads, kThreads, "report counts threads");
+    ASSERT_GT(report.efficiency(), double(0), "efficiency is measured");
+
+    for (std::size_t i = 0; i < kRuns; ++i) {
+        ASSERT_EQ(parallel_stats[i].simulation_end_time(),
+                  sequential_stats[i].simulation_end_time(),
+                  "run i matches sequential run i");
+        ASSERT_EQ(parallel_stats[i].average_system_time(),
+                  sequential_stats[i].average_system_time(),
+                  "run i matches sequential run i");
+    }
+    ASSERT_NEQ(parallel_stats[0].simulation_end_time(),
+               parallel_stats[1].simulation_end_time(),
+               "runs use different seeds");
+
+    try {
+        run_in_parallel(kRuns,
+                        [] (std::size_t i) -> SimulationRunStats {
+                            throw std::runtime_error("run failed");
+                        },
+                        kThreads);
+        ASSERT(false, "expected run exception to propagate");
+    } catch (std::runtime_error &) {}
+}
+
+void test_time_warp()
+{
+    // a rolled back timer runs the same jobs again, in the same order
+    StateLog state_log;
+    SimulationTimer timer;
+    timer.set_state_log(&state_log);
+    std::vector<std::uint32_t> call_order;
+    timer.register_job(1, [&call_order, &timer] {
+        call_order.push_back(1);
+        timer.register_job(1, [&call_order] { call_order.push_back(2); });
+    });
+    timer.register_job(2, [&call_order] { call_order.push_back(3); });
+    const auto start = state_log.mark();
+    timer.advance_time();
+    timer.advance_time();
+    ASSERT_EQ(call_order.size(), std::size_t(3), "ran every job");
+    state_log.undo_to(start);
+    ASSERT_EQ(timer.time(), float(0), "rolled back to the start");
+    ASSERT_EQ(timer.dispatched_jobs(), std::uint64_t(0), "rolled back the job count");
+    timer.advance_time();
+    timer.advance_time();
+    ASSERT_EQ(call_order, std::vector<std::uint32_t>({1, 2, 3, 1, 2, 3}), "ran the jobs again in order");
+    state_log.forget_to(state_log.mark());
+    ASSERT_EQ(state_log.size(), std::size_t(0), "forgot what no rollback reaches");
+
+    // the optimistic runs commit what the sequential one does
+    constexpr float kLambda = .3;
+    constexpr std::size_t kCustomersToServe = 2000;
+    const long seed_offset = constants::SEED_OFFSET;
+    auto sequential = project2::do_web_server(kLambda, 40, 5, kCustomersToServe, seed_offset);
+    for (auto threads : {std::size_t(1), std::size_t(3)}) {
+        time_warp::Report report;
+        auto optimistic = project2::do_web_server_time_warp(kLambda, 40, 5, kCustomersToServe, seed_offset, threads, {}, report);
+        ASSERT_EQ(optimistic.simulation_end_time(), sequential.simulation_end_time(), "ends when the sequential run does");
+        ASSERT_EQ(optimistic.average_system_time(), sequential.average_system_time(), "same system time");
+        ASSERT(optimistic.average_waiting_times() == sequential.average_waiting_times(), "same waiting times");
+        ASSERT(optimistic.customer_loss_rates() == sequential.customer_loss_rates(), "same losses");
+        ASSERT(optimistic.controls().observed == sequential.controls().observed, "same draws");
+
+        ASSERT_EQ(report.runs, std::size_t(1), "report counts the run");
+        ASSERT_EQ(report.processes, std::size_t(5), "one process per station and one for the arrivals");
+        ASSERT_EQ(report.threads, threads, "report counts threads");
+        ASSERT_GT(report.committed_events, std::uint64_t(0), "events committed");
+        ASSERT(report.committed_events + report.rolled_back_events <= report.processed_events,
+               "only events that ran are committed or rolled back");
+        ASSERT(report.efficiency() > 0 && report.efficiency() <= 1, "efficiency is a fraction");
+        ASSERT_GT(report.gvt_rounds, std::uint64_t(0), "GVT advanced");
+    }
+}
+
+namespace {
+
+// tokens passed around a ring of processes, each hop after a short delay;
+// returns when the hops-th token arrives
+float run_token_ring(std::size_t processes, std::size_t threads, std::size_t hops, time_warp::Report & report)
+{
+    constexpr float kWindow = .5;
+    time_warp::Engine engine(threads, kWindow);
+    std::vector<time_warp::LogicalProcess *> ring;
+    for (std::size_t i = 0; i < processes; ++i) {
+        ring.push_back(&engine.add_process());
+    }
+    for (std::size_t i = 0; i < processes; ++i) {
+        auto & process = *ring[i];
+        auto & next = *ring[(i + 1) % processes];
+        process.set_inlet([&process, &next, i] (const std::shared_ptr<Customer> & customer) {
+            process.record_entering(customer);
+            const float delay = .25 + float((customer->id()*7 + i) % 5)/10;
+            process.timer().register_job(process.timer().time() + delay, [&process, &next, customer] {
+                process.send(next, customer);
+            });
+        });
+        auto token = std::make_shared<Customer>(std::uint32_t(i), 0, default_customer_priority(), 0, false, 0);
+        process.timer().register_job(0, [&process, &next, token] { process.send(next, token); });
+    }
+
+    std::size_t arrived = 0;
+    const auto stop_time = engine.run([&arrived, hops] (const time_warp::Record &) { return ++arrived == hops; });
+    report.add(engine.report());
+    return stop_time;
+}
+
+} // anonymous
+
+void test_time_warp_rounds()
+{
+    // more workers than cores, so they get preempted in the middle of ending a
+    // round, and thousands of rounds for one to end wrong and hang the run
+    const auto threads = default_thread_count() + 3;
+    constexpr std::size_t kHops = 20000;
+    constexpr std::size_t kRuns = 3;
+
+    time_warp::Report sequential_report;
+    const auto sequential_stop = run_token_ring(threads, 1, kHops, sequential_report);
+    for (std::size_t run = 0; run < kRuns; ++run) {
+        time_warp::Report report;
+        const auto stop = run_token_ring(threads, threads, kHops, report);
+        ASSERT_EQ(stop, sequential_stop, "stops when one thread does");
+        ASSERT_EQ(report.threads, threads, "one worker per process");
+        ASSERT_GT(report.gvt_rounds, std::uint64_t(1000), "ran many rounds");
+    }
+}
+
+void test_trace()
+{
+    const std::string kTracePath = "/tmp/a_plus_q_test_trace.bin";
+    constexpr float kLambda = .9;
+    constexpr std::size_t kQueueSize = 8;
+    constexpr std::size_t kCustomersToServe = 3000;
+    constexpr long kSeedOffset = 42;
+
+    SimulationOptions options;
+    options.trace_path = kTracePath;
+    auto stats = project2::do_m_m_1_k(kLambda,
+                                      kQueueSize,
+                                      kCustomersToServe,
+                                      project2::Discipline::PRIO_NP,
+                                      kSeedOffset,
+                                      options);
+
+    TraceReader reader(kTracePath);
+    ASSERT_GT(reader.record_count(), std::uint64_t(kCustomersToServe), "trace has records");
+    ASSERT_EQ(reader.queue_names().size(), std::size_t(1), "spy configuration saved");
+
+    constexpr auto kMaxSize = 100;
+    SimulationSpy spy(reader.L(),
+                      kMaxSize,
+                      reader.queue_names(),
+                      reader.transient_period(),
+                      nullptr,
+                      reader.minimum_priority(),
+                      reader.maximum_priority());
+    auto dispatches = replay_trace(reader, spy);
+    ASSERT_GT(dispatches, std::uint64_t(2*kCustomersToServe), "arrivals and departures dispatched");
+
+    ASSERT_EQ(spy.average_system_time(), stats.average_system_time(), "replayed system time");
+
+    auto original_clrs = stats.customer_loss_rates();
+    auto replayed_clrs = spy.customer_loss_rates();
+    auto original_waiting_times = stats.average_waiting_times();
+    auto replayed_waiting_times = spy.average_waiting_times();
+    for (const auto & priority_and_clr : original_clrs.at(SimulationRunStats::all_queues())) {
+        auto priority = priority_and_clr.first;
+        ASSERT_EQ(replayed_clrs.at(SimulationRunStats::all_queues()).at(priority),
+                  priority_and_clr.second,
+                  "replayed clr");
+        ASSERT_EQ(replayed_waiting_times.at(SimulationRunStats::all_queues()).at(priority),
+                  original_waiting_times.at(SimulationRunStats::all_queues()).at(priority),
+                  "replayed waiting time");
+    }
+}
+
+void test_logging()
+{
+    using logging::Level;
+    using logging::Component;
+
+    ASSERT(!logging::enabled(Level::OFF, Component::QUEUE), "OFF is never enabled");
+
+    constexpr std::size_t kCapacity = 8;
+    std::vector<std::string> lines;
+    logging::Logger logger(kCapacity, [&lines] (const std::string & line) { lines.push_back(line); });
+
+    const std::string kLongName = "a_name_longer_than_twenty_three_characters";
+    logger.push(Level::DEBUG, Component::QUEUE, "{} got customer: {} at time: {}", std::string("CPU"), 7u, 1.5);
+    logger.push(Level::INFO, Component::SPY, "no placeholders", -3);
+    logger.push(Level::TRACE, Component::TIMER, "{}", kLongName);
+    ASSERT(lines.empty(), "formatting is deferred until drained");
+
+    ASSERT_EQ(logger.drain(), std::size_t(3), "drained all records");
+    ASSERT_EQ(lines[0], std::string("[DEBUG][QUEUE] CPU got customer: 7 at time: 1.5"), "placeholders filled");
+    ASSERT_EQ(lines[1], std::string("[INFO][SPY] no placeholders -3"), "extra arguments appended");
+    ASSERT_EQ(lines[2], "[TRACE][TIMER] " + kLongName.substr(0, logging::LogArgument::kMaxTextSize), "long text truncated");
+
+    for (std::size_t i = 0; i < kCapacity + 2; ++i) {
+        logger.push(Level::DEBUG, Component::SERVER, "record {}", i);
+    }
+    ASSERT_EQ(logger.dropped(), std::uint64_t(2), "full ring drops records");
+    ASSERT_EQ(logger.drain(), kCapacity, "ring keeps capacity records");
+
+    // many producers, one background consumer
+    constexpr std::size_t kProducers = 4;
+    constexpr std::size_t kRecordsPerProducer = 1000;
+    std::atomic<std::size_t> received(0);
+    logging::Logger threaded_logger(1 << 14, [&received] (const std::string &) { ++received; });
+    threaded_logger.start();
+
+    std::vector<std::thread> producers;
+    for (std::size_t p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&threaded_logger, p] {
+            for (std::size_t i = 0; i < kRecordsPerProducer; ++i) {
+                threaded_logger.push(Level::DEBUG, Component::QUEUE, "producer {} record {}", p, i);
+            }
+        });
+    }
+    for (auto & producer : producers) {
+        producer.join();
+    }
+    threaded_logger.stop();
+
+    ASSERT_EQ(received.load() + threaded_logger.dropped(),
+              kProducers * kRecordsPerProducer,
+              "every record was written or counted as dropped");
+}
+
+void test_microbench()
+{
+    microbench::Settings settings;
+    settings.min_seconds = 0.001;
+    settings.repetitions = 3;
+
+    std::uint64_t calls = 0;
+    auto result = microbench::measure("test/count", "test", 7, [&calls] { ++calls; }, settings);
+
+    ASSERT_EQ(result.name, std::string("test/count"), "name kept");
+    ASSERT_EQ(result.size, std::size_t(7), "size kept");
+    ASSERT_GT(result.operations, std::uint64_t(0), "ran at least one operation");
+    ASSERT(result.min_nanoseconds <= result.median_nanoseconds, "min is at most median");
+    // calibration doubles up to the final count, then each repetition runs it again
+    ASSERT_EQ(calls, (2 * result.operations - 1) + settings.repetitions * result.operations, "call count");
+
+    std::stringstream json;
+    microbench::write_json({result, result}, json);
+    auto text = json.str();
+    ASSERT(text.find("\"results\": [") != std::string::npos, "has results array");
+    ASSERT(text.find("{\"name\": \"test/count\", \"component\": \"test\", \"size\": 7") != std::string::npos,
+           "result written");
+    ASSERT(text.find("},\n") != std::string::npos, "results are comma separated");
+}
+
+void test_bench()
+{
+    // run counters and the allocation counter
+    {
+        RunCounters counters;
+        SimulationOptions options;
+        options.counters = &counters;
+
+        auto allocations_before = allocation_counter::thread_allocations();
+        project2::do_m_m_1_k(.5, 10, 1000, project2::Discipline::FCFS, 0, options);
+        auto allocations = allocation_counter::thread_allocations() - allocations_before;
+
+        ASSERT_EQ(counters.runs.load(), std::uint64_t(1), "one run counted");
+        ASSERT_GT(counters.customers.load(), std::uint64_t(1000), "at least every serviced customer arrived");
+        ASSERT_GT(counters.timer_dispatches.load(), counters.customers.load(), "departures are dispatched too");
+
+        auto before = allocation_counter::thread_allocations();
+        auto bytes_before = allocation_counter::thread_allocated_bytes();
+        auto value = make_kept<std::array<char, 100>>();
+        auto value_allocations = allocation_counter::thread_allocations() - before;
+        auto value_bytes = allocation_counter::thread_allocated_bytes() - bytes_before;
+        ASSERT(value != nullptr, "allocated");
+        if constexpr (constants::ALLOCATION_ACCOUNTING) {
+            ASSERT_GT(allocations, counters.customers.load(), "every customer is heap allocated");
+            ASSERT_EQ(value_allocations, std::uint64_t(1), "new counted");
+            ASSERT_EQ(value_bytes, std::uint64_t(100), "bytes counted");
+        } else {
+            ASSERT_EQ(allocations, std::uint64_t(0), "accounting off counts nothing");
+            ASSERT_EQ(value_allocations, std::uint64_t(0), "accounting off counts nothing");
+        }
+    }
+
+    // baselines and regressions
+    {
+        bench::Metrics metrics;
+        metrics.events_per_second = 1000;
+        metrics.customers_per_second = 500;
+        metrics.peak_rss_kb = 4000;
+        metrics.allocations_per_customer = 12;
+        std::vector<bench::Result> results = {{"config/a", metrics}, {"config/b", metrics}};
+
+        const std::string kPath = "/tmp/a_plus_q_test_bench_baseline.txt";
+        bench::write_baseline(results, kPath);
+        auto baseline = bench::read_baseline(kPath);
+        std::remove(kPath.c_str());
+
+        ASSERT_EQ(baseline.size(), std::size_t(2), "both configurations read back");
+        ASSERT_EQ(baseline["config/a"].events_per_second, 1000.0, "events per second read back");
+        ASSERT_EQ(baseline["config/b"].allocations_per_customer, 12.0, "allocations read back");
+        ASSERT(bench::read_baseline("/tmp/a_plus_q_missing_baseline.txt").empty(), "missing baseline is empty");
+        ASSERT(bench::find_regressions(results, baseline, .1).empty(), "same results don't regress");
+
+        results[0].metrics.events_per_second = 850; // 15% slower
+        results[0].metrics.customers_per_second = 600; // faster is never a regression
+        results[1].metrics.allocations_per_customer = 13.5; // 12.5% more
+        results[1].metrics.peak_rss_kb = 3000; // less is never a regression
+
+        ASSERT_EQ(bench::find_regressions(results, baseline, .1).size(), std::size_t(2), "both regressions found");
+        ASSERT_EQ(bench::find_regressions(results, baseline, .2).size(), std::size_t(0), "threshold respected");
+
+        results.push_back({"config/new", metrics});
+        ASSERT_EQ(bench::find_regressions(results, baseline, .2).size(), std::size_t(0), "no baseline no regression");
+    }
+}
+
+void test_allocation_accounting()
+{
+    using allocation_counter::Subsystem;
+
+    auto counts_for = [] (Subsystem subsystem) {
+        return allocation_counter::thread_subsystem_counts()[std::size_t(subsystem)];
+    };
+
+    auto queue_before = counts_for(Subsystem::QUEUE);
+    auto spy_before = counts_for(Subsystem::SPY);
+    {
+        allocation_counter::AllocationScope queue_scope(Subsystem::QUEUE);
+        auto first = make_kept<std::array<char, 64>>();
+        {
+            allocation_counter::AllocationScope spy_scope(Subsystem::SPY);
+            auto second = make_kept<std::array<char, 32>>();
+        }
+        auto third = make_kept<std::array<char, 16>>();
+    }
+    auto queue_after = counts_for(Subsystem::QUEUE);
+
+    // over-aligned types go through the aligned operator new
+    struct alignas(64) CacheLine {
+        char bytes[64];
+    };
+    auto balancer_before = counts_for(Subsystem::BALANCER);
+    {
+        allocation_counter::AllocationScope balancer_scope(Subsystem::BALANCER);
+        auto line = make_kept<CacheLine>();
+        ASSERT_EQ(reinterpret_cast<std::uintptr_t>(line.get()) % alignof(CacheLine), std::uintptr_t(0), "aligned");
+    }
+    auto balancer_after = counts_for(Subsystem::BALANCER);
+    auto spy_after = counts_for(Subsystem::SPY);
+
+    if constexpr (constants::ALLOCATION_ACCOUNTING) {
+        ASSERT_EQ(queue_after.allocations - queue_before.allocations, std::uint64_t(2), "outer scope allocations");
+        ASSERT_EQ(queue_after.bytes - queue_before.bytes, std::uint64_t(80), "outer scope bytes");
+        ASSERT_EQ(spy_after.allocations - spy_before.allocations, std::uint64_t(1), "inner scope allocations");
+        ASSERT_EQ(spy_after.bytes - spy_before.bytes, std::uint64_t(32), "inner scope bytes");
+        ASSERT_EQ(balancer_after.allocations - balancer_before.allocations, std::uint64_t(1), "aligned allocations");
+        ASSERT_EQ(balancer_after.bytes - balancer_before.bytes, std::uint64_t(64), "aligned bytes");
+        ASSERT(allocation_counter::thread_current_subsystem() == Subsystem::OTHER, "scopes restored");
+    } else {
+        ASSERT_EQ(queue_after.allocations, queue_before.allocations, "accounting off charges nothing");
+        ASSERT_EQ(spy_after.allocations, spy_before.allocations, "accounting off charges nothing");
+        ASSERT_EQ(balancer_after.allocations, balancer_before.allocations, "accounting off charges nothing");
+    }
+
+    allocation_counter::AllocationReport report;
+    auto text = report.to_string(10);
+    ASSERT(text.find("(10 customers)") != std::string::npos, "customer count printed");
+    for (std::size_t i = 0; i < allocation_counter::kSubsystemCount; ++i) {
+        ASSERT(text.find(allocation_counter::to_string(Subsystem(i))) != std::string::npos, "every subsystem printed");
+    }
+}
+
+void test_probes()
+{
+    using probe::Probe;
+
+    probe::Histogram histogram;
+    histogram.add(0, 0);
+    histogram.add(3, 10);
+    histogram.add(100, 100);
+    histogram.add(1000, 1000);
+    ASSERT_EQ(histogram.calls, std::uint64_t(4), "calls");
+    ASSERT_EQ(histogram.self_cycles, std::uint64_t(1103), "self cycles");
+    ASSERT_EQ(histogram.inclusive_cycles, std::uint64_t(1110), "inclusive cycles");
+    ASSERT_EQ(histogram.buckets[0], std::uint64_t(1), "zero bucket");
+    ASSERT_EQ(histogram.buckets[2], std::uint64_t(1), "3 is in [2, 4)");
+    ASSERT_EQ(histogram.buckets[7], std::uint64_t(1), "100 is in [64, 128)");
+    ASSERT_EQ(histogram.percentile(.5), std::uint64_t(3), "median bucket bound");
+    ASSERT_EQ(histogram.percentile(1), std::uint64_t(1023), "max bucket bound");
+
+    auto before = probe::thread_histograms();
+    {
+        probe::ScopedProbe outer(Probe::ADVANCE_TIME);
+        for (auto i = 0; i < 3; ++i) {
+            probe::ScopedProbe inner(Probe::GENERATOR);
+        }
+    }
+    auto after = probe::thread_histograms();
+    const auto & outer = after[std::size_t(Probe::ADVANCE_TIME)];
+    const auto & inner = after[std::size_t(Probe::GENERATOR)];
+    const auto & outer_before = before[std::size_t(Probe::ADVANCE_TIME)];
+    const auto & inner_before = before[std::size_t(Probe::GENERATOR)];
+
+    if constexpr (constants::PROBES_ENABLED) {
+        ASSERT_EQ(outer.calls - outer_before.calls, std::uint64_t(1), "outer probe counted");
+        ASSERT_EQ(inner.calls - inner_before.calls, std::uint64_t(3), "inner probes counted");
+        ASSERT_EQ((outer.self_cycles - outer_before.self_cycles) + (inner.self_cycles - inner_before.self_cycles),
+                  outer.inclusive_cycles - outer_before.inclusive_cycles,
+                  "nested self cycles add up to the outer inclusive cycles");
+    } else {
+        ASSERT_EQ(outer.calls, outer_before.calls, "probes off records nothing");
+        ASSERT_EQ(inner.calls, inner_before.calls, "probes off records nothing");
+    }
+
+    probe::ProbeReport report;
+    auto text = report.to_string(5);
+    ASSERT(text.find("(5 customers)") != std::string::npos, "customer count printed");
+    for (std::size_t i = 0; i < probe::kProbeCount; ++i) {
+        ASSERT(text.find(probe::to_string(Probe(i))) != std::string::npos, "every probe printed");
+    }
+}
+
+void test_spy_priority_range()
+{
+    const std::string queue_name = "q";
+    constexpr auto kNoLVal = 0;
+    constexpr auto kMaxSize = 10;
+    constexpr auto kMinPriority = 2;
+    constexpr auto kMaxPriority = 4;
+    SimulationSpy spy(kNoLVal, kMaxSize, {queue_name}, 0, nullptr, kMinPriority, kMaxPriority);
+
+    auto serviced = make_customer(1, 0, 4);
+    serviced->add_event(CustomerEvent(CustomerEventType::ENTERED, PlaceType::QUEUE, queue_name, 0));
+    serviced->add_event(CustomerEvent(CustomerEventType::EXITED, PlaceType::QUEUE, queue_name, 2));
+    serviced->set_serviced(true);
+
+    auto dropped = make_customer(2, 0, 2);
+    dropped->add_event(CustomerEvent(CustomerEventType::DROPPED_BY, PlaceType::QUEUE, queue_name, 0));
+
+    spy.on_customer_entering(serviced);
+    spy.on_customer_exiting(serviced);
+    spy.on_customer_entering(dropped);
+    spy.on_customer_exiting(dropped);
+    ASSERT_EQ(spy.total_serviced_customers(), std::uint32_t(1), "one customer serviced");
+
+    auto clrs = spy.customer_loss_rates();
+    ASSERT_EQ(clrs[queue_name].count(3), std::size_t(0), "no entry for a priority that saw no customers");
+    ASSERT_EQ(clrs[queue_name][2], float(1), "low priority customer lost");
+    ASSERT_EQ(clrs[queue_name][4], float(0), "high priority customer kept");
+    ASSERT_EQ(clrs[SimulationRunStats::all_queues()][SimulationRunStats::all_priorities()], float(.5), "half lost overall");
+
+    auto waiting_times = spy.average_waiting_times();
+    ASSERT_EQ(waiting_times[queue_name].count(2), std::size_t(0), "no waiting time for a priority nobody finished");
+    ASSERT_EQ(waiting_times[queue_name][4], float(2), "waiting time of the serviced customer");
+
+    auto out_of_range = make_customer(3, 0, 5);
+    try {
+        spy.on_customer_entering(out_of_range);
+        ASSERT(false, "expected to throw out of range");
+    } catch (std::out_of_range &) {}
+}
+
+void test_spy_slowdown_buckets()
+{
+    const std::string queue_name = "q";
+    constexpr auto kNoLVal = 0;
+    constexpr auto kMaxSize = 10;
+    constexpr auto kBuckets = 4;
+    // service times are uniform on [0, 100], so the bucket boundaries sit near 25, 50 and 75
+    SimulationSpy spy(kNoLVal,
+                      kMaxSize,
+                      {queue_name},
+                      0,
+                      [] (double percentile) { return percentile * 100; },
+                      default_customer_priority(),
+                      default_customer_priority(),
+                      kBuckets);
+
+    const std::vector<std::pair<float, float>> service_and_waiting_times = {
+        {10, 1}, {30, 3}, {60, 12}, {90, 9}, {1000, 300}
+    };
+    std::uint32_t id = 0;
+    for (const auto & [service_time, waiting_time] : service_and_waiting_times) {
+        auto customer = make_customer(id++, 0);
+        customer->add_event(CustomerEvent(CustomerEventType::ENTERED, PlaceType::QUEUE, queue_name, 0));
+        customer->add_event(CustomerEvent(CustomerEventType::EXITED, PlaceType::QUEUE, queue_name, waiting_time));
+        customer->set_service_time(service_time);
+        customer->set_serviced(true);
+        spy.on_customer_entering(customer);
+        spy.on_customer_exiting(customer);
+    }
+
+    auto slowdowns = spy.average_slowdown_percentiles();
+    ASSERT_EQ(slowdowns.size(), std::size_t(kBuckets), "one slowdown per bucket");
+    ASSERT_EQ(slowdowns[0], float(.1), "first bucket slowdown");
+    ASSERT_EQ(slowdowns[1], float(.1), "second bucket slowdown");
+    ASSERT_EQ(slowdowns[2], float(.2), "third bucket slowdown");
+    ASSERT_EQ(slowdowns[3], float(.2), "values past the last boundary land in the last bucket");
+}
+
+void test_quantile_sketches()
+{
+    using namespace quantiles;
+
+    // 1..10000 split across two sketches of each kind, as two runs would be
+    std::vector<Sketch> histograms = {HdrHistogram(), HdrHistogram()};
+    std::vector<Sketch> digests = {TDigest(), TDigest()};
+    for (int value = 1; value <= 10000; ++value) {
+        histograms[value % 2].record(value);
+        digests[value % 2].record(value);
+    }
+
+    auto check = [] (const Sketch & sketch, double tolerance, const std::string & name) {
+        ASSERT_EQ(sketch.count(), std::uint64_t(10000), name + " counted every value");
+        for (auto fraction : reported_quantiles()) {
+            auto exact = fraction * 10000;
+            ASSERT_LT(std::abs(sketch.quantile(fraction) - exact), exact * tolerance, name + " quantile close to exact");
+        }
+    };
+
+    auto histogram = histograms[0];
+    histogram.merge(histograms[1]);
+    check(histogram, .01, "hdr");
+
+    auto digest = digests[0];
+    digest.merge(digests[1]);
+    check(digest, .01, "t-digest");
+
+    // the end centroids of a big digest hold many values, the extremes must survive a merge
+    TDigest big_digest;
+    for (int value = 1; value <= 100000; ++value) {
+        big_digest.record(value);
+    }
+    TDigest merged_digest;
+    merged_digest.merge(big_digest);
+    ASSERT_EQ(merged_digest.quantile(0), 1.0, "merge keeps the other's minimum");
+    ASSERT_EQ(merged_digest.quantile(1), 100000.0, "merge keeps the other's maximum");
+
+    try {
+        histogram.merge(digest);
+        ASSERT(false, "expected to throw invalid argument");
+    } catch (std::invalid_argument &) {}
+
+    Sketch off;
+    off.record(1);
+    ASSERT(!off.enabled(), "a default sketch is off");
+    ASSERT_EQ(off.count(), std::uint64_t(0), "an off sketch records nothing");
+
+    Sketch zeros = HdrHistogram();
+    zeros.record(0);
+    zeros.record(0);
+    zeros.record(5);
+    ASSERT_EQ(zeros.quantile(.5), double(0), "values below the range read back as zero");
+
+    auto report = quantile_report(histograms);
+    ASSERT(report.find("p99.9: ") != std::string::npos, "report has every quantile");
+    ASSERT(report.find("merged: ") != std::string::npos, "report has merged estimate");
+
+    zeros.clear();
+    ASSERT_EQ(zeros.count(), std::uint64_t(0), "cleared");
+
+    // the spy sketches each queue's sojourn, its waiting plus the service after it
+    SimulationSpy spy(0, 10, {"q"}, 0);
+    spy.enable_quantiles(HdrHistogram());
+    auto customer = make_customer(0, 0);
+    const std::string queue_name = "q";
+    const std::string server_name = "s";
+    customer->add_event(CustomerEvent(CustomerEventType::ENTERED, PlaceType::QUEUE, queue_name, 0));
+    customer->add_event(CustomerEvent(CustomerEventType::EXITED, PlaceType::QUEUE, queue_name, 1));
+    customer->add_event(CustomerEvent(CustomerEventType::EXITED, PlaceType::SERVER, server_name, 3));
+    customer->set_serviced(true);
+    customer->set_departure_time(3);
+    spy.on_customer_entering(customer);
+    spy.on_customer_exiting(customer);
+    const auto sketches = spy.time_sketches();
+    ASSERT_EQ(sketches.sojourn_times.at("q").count(), std::uint64_t(1), "sojourn recorded");
+    ASSERT_LT(std::abs(sketches.sojourn_times.at("q").quantile(.5) - 3), .03, "sojourn is wait plus service");
+    ASSERT_LT(std::abs(sketches.waiting_times.at("q").quantile(.5) - 1), .01, "waiting is the queue alone");
+}
+
+void test_batch_means()
+{
+    using namespace statistics;
+
+    BatchMeans batches(10);
+    for (int value = 1; value <= 105; ++value) {
+        batches.add(value);
+    }
+    ASSERT_EQ(batches.means().size(), std::size_t(10), "partial last batch left out");
+    ASSERT_EQ(batches.means()[0], 5.5, "first batch mean");
+    ASSERT_EQ(batches.means()[9], 95.5, "last batch mean");
+
+    ASSERT_LT(lag1_autocorrelation({1, -1, 1, -1, 1, -1, 1, -1}), -.8, "alternating series negatively correlated");
+    ASSERT_EQ(student_t_975(9), 2.262, "t table");
+    ASSERT_LT(std::abs(student_t_975(1000) - 1.962), .001, "t expansion");
+
+    // independent draws pass the lag-1 test and keep their batches
+    ExponentialGenerator generator(1, 4321);
+    BatchMeans independent(100);
+    for (int i = 0; i < 100 * 40; ++i) {
+        independent.add(generator.generate());
+    }
+    auto estimate = estimate_batch_means(independent);
+    ASSERT(estimate.independent, "independent batches pass");
+    ASSERT_EQ(estimate.batches, std::size_t(40), "no batches merged");
+    ASSERT_LT(std::abs(estimate.mean - 1), 3 * estimate.half_width, "interval near the true mean");
+
+    // a slowly drifting series fails it, so neighbouring batches get merged
+    BatchMeans correlated(1);
+    for (int i = 0; i < 80; ++i) {
+        correlated.add(i < 40 ? i : 80 - i);
+    }
+    estimate = estimate_batch_means(correlated);
+    ASSERT_LT(estimate.batches, std::size_t(80), "correlated batches merged");
+    ASSERT_EQ(estimate.batch_size * estimate.batches, std::size_t(80), "merged batches cover the run");
+
+    estimate = estimate_batch_means(correlated, 80);
+    ASSERT(!estimate.independent, "flagged when there are too few batches to merge");
+}
+
+void test_precision_runs()
+{
+    auto make_stats = [] (float waiting_time) {
+        queue_name_to_priority_to_stat times;
+        times[SimulationRunStats::all_queues()][SimulationRunStats::all_priorities()] = waiting_time;
+        queue_name_to_priority_to_stat loss_rates;
+        loss_rates[SimulationRunStats::all_queues()][SimulationRunStats::all_priorities()] = 0;
+        return SimulationRunStats(loss_rates, times, 1, 1, 1, {}, quantiles::TimeSketches(), statistics::TimeBatchMeans(), 0, {}, {}, {}, statistics::TimeBuckets());
+    };
+
+    SimulationOptions options;
+    options.precision = .01;
+    options.max_runs = 1000;
+
+    std::vector<std::size_t> runs_done;
+    auto steady = [&] (std::size_t i) {
+        return make_stats(1 + ((i % 2) ? .01f : -.01f));
+    };
+    auto stats = run_until_precise(options, steady, 1);
+    ASSERT_EQ(stats.size(), std::size_t(10), "precise after the first wave");
+    ASSERT(meets_relative_precision(stats, options.precision), "target met");
+
+    auto noisy = [&] (std::size_t i) {
+        runs_done.push_back(i);
+        return make_stats(1 + ((i % 2) ? .5f : -.5f));
+    };
+    options.max_runs = 40;
+    ParallelRunReport report;
+    stats = run_until_precise(options, noisy, 1, &report);
+    ASSERT_EQ(stats.size(), std::size_t(40), "stopped at the budget");
+    ASSERT_EQ(report.runs, std::size_t(40), "report covers every wave");
+    for (std::size_t i = 0; i < runs_done.size(); ++i) {
+        ASSERT_EQ(runs_done[i], i, "every run index used once, in order");
+    }
+    ASSERT(!meets_relative_precision(stats, options.precision), "target missed");
+
+    options.precision_metrics = PRECISION_SYSTEM_TIME;
+    ASSERT(meets_relative_precision(stats, options.precision, options.precision_metrics), "only the chosen metrics count");
+}
+
+void test_mser_warm_up()
+{
+    std::vector<double> batch_means(20, 10.0);
+    for (int i = 0; i < 60; ++i) {
+        batch_means.push_back(i % 2 ? 1.1 : .9);
+    }
+    ASSERT_EQ(statistics::mser_truncation(batch_means), std::size_t(20), "biased prefix found");
+    ASSERT_EQ(statistics::mser_truncation(std::vector<double>(10, 1.0)), std::size_t(0), "nothing to drop");
+
+    // the first 100 customers spend 100 in the system, the rest 1
+    constexpr auto kNoLVal = 0;
+    constexpr auto kMaxSize = 10;
+    SimulationSpy spy(kNoLVal, kMaxSize, {"q"});
+    spy.enable_mser_warm_up(1000);
+    for (std::uint32_t id = 0; id < 500; ++id) {
+        auto customer = make_customer(id, 0);
+        customer->add_event(CustomerEvent(CustomerEventType::ENTERED, PlaceType::QUEUE, "q", 0));
+        customer->add_event(CustomerEvent(CustomerEventType::EXITED, PlaceType::QUEUE, "q", 0));
+        customer->set_serviced(true);
+        customer->set_departure_time(id < 100 ? 100 : 1);
+        spy.on_customer_entering(customer);
+        spy.on_customer_exiting(customer);
+        if (id == 198) {
+            ASSERT_EQ(spy.total_serviced_customers(), std::uint32_t(0), "nothing counted while the warm up is undecided");
+        }
+    }
+
+    ASSERT(spy.warm_up_detected(), "settled before the limit");
+    ASSERT_EQ(spy.warm_up_customers(), std::size_t(100), "only the biased prefix dropped");
+    ASSERT_EQ(spy.total_serviced_customers(), std::uint32_t(400), "everything after it counted");
+    ASSERT_EQ(spy.average_system_time(), float(1), "stats only from after the warm up");
+    ASSERT_EQ(spy.customer_loss_rates()[SimulationRunStats::all_queues()][SimulationRunStats::all_priorities()],
+              float(0),
+              "entries recounted from after the warm up");
+
+    // system times that keep growing never settle, the limit cuts the buffering off
+    constexpr std::size_t kMaxWarmUp = 250;
+    SimulationSpy unsettled_spy(kNoLVal, kMaxSize, {"q"});
+    unsettled_spy.enable_mser_warm_up(kMaxWarmUp);
+    for (std::uint32_t id = 0; id < 500; ++id) {
+        auto customer = make_customer(id, 0);
+        customer->add_event(CustomerEvent(CustomerEventType::ENTERED, PlaceType::QUEUE, "q", 0));
+        customer->add_event(CustomerEvent(CustomerEventType::EXITED, PlaceType::QUEUE, "q", 0));
+        customer->set_serviced(true);
+        customer->set_departure_time(float(id));
+        unsettled_spy.on_customer_entering(customer);
+        unsettled_spy.on_customer_exiting(customer);
+        if (id == kMaxWarmUp - 1) {
+            ASSERT(!unsettled_spy.warm_up_detected(), "cut off at the limit");
+            ASSERT_GT(unsettled_spy.total_serviced_customers(), std::uint32_t(0), "counting once cut off");
+        }
+    }
+}
+
+void test_regenerative_cycles()
+{
+    auto exact = statistics::ratio_estimate({2, 4, 6}, {1, 2, 3});
+    ASSERT_EQ(exact.mean, 2.0, "ratio of the sums");
+    ASSERT_EQ(exact.half_width, 0.0, "cycles on one line have no spread");
+    ASSERT_EQ(exact.cycles, std::size_t(3), "one cycle per pair");
+
+    const std::string queue_name = "q";
+    constexpr auto kNoLVal = 0;
+    constexpr auto kMaxSize = 10;
+    SimulationSpy spy(kNoLVal, kMaxSize, {queue_name});
+    spy.enable_regenerative_cycles();
+
+    auto serviced = [&] (std::uint32_t id, float arrival, float waiting_time, float departure) {
+        auto customer = make_customer(id, arrival);
+        customer->add_event(CustomerEvent(CustomerEventType::ENTERED, PlaceType::QUEUE, queue_name, arrival));
+        customer->add_event(CustomerEvent(CustomerEventType::EXITED, PlaceType::QUEUE, queue_name, arrival + waiting_time));
+        customer->set_serviced(true);
+        customer->set_departure_time(departure);
+        return customer;
+    };
+
+    // first cycle: 0 arrives to an empty system, 1 waits behind it, 2 is dropped
+    auto first = serviced(0, 0, 0, 2);
+    auto second = serviced(1, 1, 1, 4);
+    auto dropped = make_customer(2, 1.5);
+    dropped->add_event(CustomerEvent(CustomerEventType::DROPPED_BY, PlaceType::QUEUE, queue_name, 1.5));
+    spy.on_customer_entering(first);
+    spy.on_customer_entering(second);
+    spy.on_customer_entering(dropped);
+    spy.on_customer_exiting(dropped);
+    spy.on_customer_exiting(first);
+    spy.on_customer_exiting(second);
+    ASSERT_EQ(spy.regenerative_cycles().size(), std::size_t(0), "a cycle only ends at the next regeneration point");
+
+    // second cycle: 3 alone, ended by 4 arriving to an empty system
+    auto third = serviced(3, 5, 0, 6);
+    spy.on_customer_entering(third);
+    spy.on_customer_exiting(third);
+    auto open = serviced(4, 7, 0, 8);
+    spy.on_customer_entering(open);
+
+    const auto & cycles = spy.regenerative_cycles();
+    ASSERT_EQ(cycles.size(), std::size_t(2), "the open cycle is left out");
+    ASSERT_EQ(cycles[0].entered, std::uint32_t(3), "first cycle entries");
+    ASSERT_EQ(cycles[0].serviced, std::uint32_t(2), "first cycle serviced");
+    ASSERT_EQ(cycles[0].lost, std::uint32_t(1), "first cycle losses");
+    ASSERT_EQ(cycles[0].waiting_time, 1.0, "first cycle waiting time");
+    ASSERT_EQ(cycles[0].system_time, 5.0, "first cycle system time");
+    ASSERT_EQ(cycles[1].entered, std::uint32_t(1), "second cycle entries");
+    ASSERT_EQ(cycles[1].system_time, 1.0, "second cycle system time");
+
+    auto report = statistics::regenerative_report(cycles);
+    ASSERT(report.find("Cycles: 2") != std::string::npos, "report counts the cycles");
+}
+
+void test_variance_reduction()
+{
+    constexpr long kSeed = 12345;
+    UniformGenerator uniform(kSeed);
+    UniformGenerator antithetic_uniform(kSeed, true);
+    ExponentialGenerator exponential(1, kSeed);
+    ExponentialGenerator antithetic_exponential(1, kSeed, true);
+    for (int i = 0; i < 100; ++i) {
+        ASSERT(std::abs(uniform.generate() + antithetic_uniform.generate() - 1) < 1e-6, "uniforms mirrored");
+        auto u = std::exp(-exponential.generate());
+        auto antithetic_u = std::exp(-antithetic_exponential.generate());
+        ASSERT(std::abs(u + antithetic_u - 1) < 1e-4, "exponentials come from mirrored uniforms");
+    }
+
+    SimulationOptions options;
+    options.antithetic = true;
+    ASSERT_EQ(run_seed_offset(options, 2), run_seed_offset(options, 3), "a pair shares seeds");
+    ASSERT_NEQ(run_seed_offset(options, 1), run_seed_offset(options, 2), "pairs differ");
+    ASSERT(!run_options(options, 2).antithetic_draws, "first run of a pair draws u");
+    ASSERT(run_options(options, 3).antithetic_draws, "second run of a pair draws 1 - u");
+    ASSERT_EQ(statistics::pair_averages(std::vector<float>{1, 3, 5, 7}), std::vector<float>({2, 6}), "pairs averaged");
+    ASSERT_EQ(statistics::paired_difference_string(std::vector<float>{3, 5, 7}, std::vector<float>{1, 3, 5}),
+              statistics::confidence_interval_string(std::vector<float>{2, 2, 2}),
+              "interval of the differences");
+
+    // with common random numbers the service time is drawn before the queue sees the customer
+    std::vector<std::shared_ptr<Customer>> received_customers;
+    auto queue = Queue(10, [] (const std::shared_ptr<Customer> &) {}, nullptr, [] { return 0; });
+    auto customer = make_customer(0, 0);
+    customer->set_service_time(7);
+    queue.accept_customer(customer);
+    queue.request_one_customer([&received_customers] (const std::shared_ptr<Customer> & received) {
+        received_customers.push_back(received);
+    });
+    ASSERT_EQ(received_customers.size(), std::size_t(1), "customer delivered");
+    ASSERT_EQ(received_customers.front()->service_time(), float(7), "preset service time kept");
+}
+
+void test_control_variates()
+{
+    statistics::RunningMean draws;
+    statistics::MeasuredGenerator<ExponentialGenerator> generator(ExponentialGenerator(2, 12345), draws);
+    ExponentialGenerator same_seed(2, 12345);
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQ(generator.generate(), same_seed.generate(), "draws passed through unchanged");
+    }
+    ASSERT_EQ(draws.count(), std::size_t(10), "every draw counted");
+    ASSERT_EQ(ExponentialGenerator(2).mean(), float(.5), "exponential mean");
+    ASSERT(std::abs(BoundedParetoGenerator(332, 1e10, 1.1).mean() - 3000) < 30, "project 3 service mean");
+
+    // outputs exactly 5 + 2 * (control - expected), so the controls explain everything
+    std::vector<float> outputs;
+    std::vector<statistics::RunControls> controls;
+    for (int i = 0; i < 10; ++i) {
+        const double observed = 1 + .1 * (i % 4);
+        outputs.push_back(5 + 2 * (observed - 1));
+        statistics::RunControls run;
+        run.add("service", observed, 1);
+        controls.push_back(run);
+    }
+    auto estimate = statistics::control_variate_estimate(outputs, controls);
+    ASSERT_EQ(estimate.controls, std::size_t(1), "one control fit");
+    ASSERT(std::abs(estimate.mean - 5) < 1e-5, "corrected to the output at the expected control");
+    ASSERT_GT(estimate.plain_mean, 5.1, "plain mean biased by the high draws");
+    ASSERT(estimate.half_width < 1e-3, "nothing left unexplained");
+    ASSERT_GT(estimate.variance_reduction(), .99, "nearly all the variance removed");
+
+    auto too_few = statistics::control_variate_estimate({1, 2}, {controls[0], controls[1]});
+    ASSERT_EQ(too_few.controls, std::size_t(0), "falls back to the plain mean without enough runs");
+    ASSERT_EQ(too_few.mean, 1.5, "plain mean");
+}
+
+void test_restart_splitting()
+{
+    // M/M/1/10 at rho = .5
+    const double rho = .5;
+    const std::uint32_t capacity = 9;
+    const double blocking = analytic::mm1k(rho, 1, capacity + 1).loss_probability;
+    const splitting::Network network{rho, {{1, capacity, {}}}};
+
+    auto average_loss_rate = [&network] (std::uint32_t splits, std::uint64_t * events) {
+        const auto settings = splitting::every_level(network, 0, splits, 20000);
+        ASSERT_EQ(settings.thresholds.size(), std::size_t(capacity + 1), "a threshold at every occupancy");
+        double loss_rate = 0;
+        *events = 0;
+        constexpr int kRuns = 10;
+        for (int run = 0; run < kRuns; ++run) {
+            auto estimate = splitting::restart(network, settings, 1111 + run);
+            ASSERT_EQ(estimate.arrivals, std::uint64_t(20000), "main trajectory sees every arrival");
+            loss_rate += estimate.loss_rate(0) / kRuns;
+            *events += estimate.events;
+        }
+        return loss_rate;
+    };
+
+    std::uint64_t plain_events = 0;
+    std::uint64_t split_events = 0;
+    const auto plain = average_loss_rate(1, &plain_events);
+    const auto split = average_loss_rate(2, &split_events);
+    ASSERT(std::abs(plain - blocking) < .5 * blocking, "plain chain near the blocking probability");
+    ASSERT(std::abs(split - blocking) < .1 * blocking, "split estimate near the blocking probability");
+    ASSERT_GT(split_events, plain_events, "copies cost extra events");
+
+    // a tandem: station 0 always feeds station 1, which is the only one that can lose
+    const splitting::Network tandem{.2, {{1, 50, {0, 1}}, {.25, 0, {}}}};
+    auto estimate = splitting::restart(tandem, splitting::every_level(tandem, 1, 2, 5000), 1111);
+    ASSERT_EQ(estimate.losses[0], 0.0, "station 0 never full");
+    ASSERT_GT(estimate.loss_rate(1), 0.0, "station 1 loses");
+    ASSERT_EQ(estimate.total_loss_rate(), estimate.loss_rate(1), "total over stations");
+
+    splitting::Settings unsorted;
+    unsorted.thresholds = {3, 2};
+    unsorted.splits = {2, 2};
+    try {
+        splitting::restart(network, unsorted, 1);
+        ASSERT(false, "expected to throw invalid argument");
+    } catch (std::invalid_argument &) {}
+
+    splitting::Settings missing_station;
+    missing_station.target_station = 1;
+    try {
+        splitting::restart(network, missing_station, 1);
+        ASSERT(false, "expected to throw invalid argument");
+    } catch (std::invalid_argument &) {}
+}
+
+void test_importance_sampling()
+{
+    LikelihoodRatio likelihood_ratio;
+    auto tilted = ExponentialGenerator(1, 12345);
+    tilted.tilt(1.5, likelihood_ratio);
+    ExponentialGenerator same_seed(1, 12345);
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQ(tilted.generate(), same_seed.generate(), "untouched until tilted");
+    }
+    ASSERT_EQ(likelihood_ratio.value, 1.0, "plain draws leave the ratio alone");
+
+    // E[draw] is 1 / 1.5 under the tilt, E[ratio] and E[ratio * draw] are 1 and 1 / 1 under the real rate
+    constexpr int kDraws = 200000;
+    double draws = 0;
+    double ratios = 0;
+    double weighted_draws = 0;
+    likelihood_ratio.tilted = true;
+    for (int i = 0; i < kDraws; ++i) {
+        likelihood_ratio.value = 1;
+        const double draw = tilted.generate();
+        draws += draw / kDraws;
+        ratios += likelihood_ratio.value / kDraws;
+        weighted_draws += likelihood_ratio.value * draw / kDraws;
+    }
+    ASSERT(std::abs(draws - 1 / 1.5) < .01, "drawn at the tilted rate");
+    ASSERT(std::abs(ratios - 1) < .02, "likelihood ratio averages 1");
+    ASSERT(std::abs(weighted_draws - 1) < .03, "weighted draws average the real mean");
+
+    LikelihoodRatio cycle_ratio;
+    statistics::ImportanceSampledCycles cycles(cycle_ratio);
+    cycles.on_regeneration();
+    ASSERT(!cycle_ratio.tilted, "first cycle plain");
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQ(cycles.on_entered(), 1.0, "plain customers weigh 1");
+    }
+    cycles.on_lost(1); // plain cycles only count arrivals
+
+    cycles.on_regeneration();
+    ASSERT(cycle_ratio.tilted, "then tilted");
+    cycle_ratio.value = .25;
+    const auto weight = cycles.on_entered();
+    ASSERT_EQ(weight, .25, "customer takes the path's ratio");
+    cycles.on_lost(weight);
+    ASSERT(!cycle_ratio.tilted, "first loss ends the tilt");
+    cycles.on_lost(weight);
+
+    cycles.on_regeneration();
+    ASSERT(!cycle_ratio.tilted, "alternates");
+    ASSERT_EQ(cycle_ratio.value, 1.0, "ratio starts over");
+    auto estimate = cycles.estimate();
+    ASSERT_EQ(estimate.tilted_cycles, std::size_t(1), "one tilted cycle ended");
+    ASSERT_EQ(estimate.plain_cycles, std::size_t(1), "one plain cycle ended");
+    ASSERT(std::abs(estimate.loss_probability - .5 / 3) < 1e-12, "weighted losses per cycle over arrivals per cycle");
+    ASSERT_EQ(estimate.overflow_probability, .25, "weight of the first loss");
+
+    cycles.clear();
+    ASSERT_EQ(cycles.estimate().tilted_cycles, std::size_t(0), "cleared");
+}
+
+void test_perturbation_analysis()
+{
+    // arrives at 1 to an idle server for 2, then one arriving at 2 waits 1 and takes 1
+    statistics::PerturbationAnalysis busy_period(1, 1);
+    busy_period.on_serviced(1, 0, 2);
+    busy_period.on_serviced(2, 1, 1);
+    auto sensitivities = busy_period.sensitivities();
+    ASSERT_EQ(sensitivities.customers, std::size_t(2), "both counted");
+    ASSERT_EQ(sensitivities.waiting_time_by_arrival_rate, .5, "second start moves with the first arrival");
+    ASSERT_EQ(sensitivities.waiting_time_by_service_rate, -1.0, "and with the first service");
+    ASSERT_EQ(sensitivities.system_time_by_arrival_rate, .5, "service times don't depend on lambda");
+    ASSERT_EQ(sensitivities.system_time_by_service_rate, -2.5, "own service added");
+
+    busy_period.clear();
+    ASSERT_EQ(busy_period.sensitivities().customers, std::size_t(0), "cleared");
+    busy_period.on_serviced(10, 0, 1);
+    sensitivities = busy_period.sensitivities();
+    ASSERT_EQ(sensitivities.waiting_time_by_arrival_rate, 0.0, "an idle server ends the busy period");
+    ASSERT_EQ(sensitivities.system_time_by_service_rate, -1.0, "only its own service");
+
+    // M/M/1 at rho = .5: W = lambda / (mu (mu - lambda)) and T = 1 / (mu - lambda)
+    constexpr double kLambda = .5;
+    constexpr double kMu = 1;
+    ExponentialGenerator arrivals(kLambda, 4321);
+    ExponentialGenerator services(kMu, 1234);
+    statistics::PerturbationAnalysis mm1(kLambda, kMu);
+    double arrival_time = 0;
+    double departure_time = 0;
+    for (int i = 0; i < 400000; ++i) {
+        arrival_time += arrivals.generate();
+        const double start = std::max(arrival_time, departure_time);
+        const double service = services.generate();
+        departure_time = start + service;
+        mm1.on_serviced(arrival_time, start - arrival_time, service);
+    }
+    sensitivities = mm1.sensitivities();
+    ASSERT(std::abs(sensitivities.waiting_time_by_arrival_rate - 4) < .3, "dW/dlambda = mu / (mu - lambda)^2");
+    ASSERT(std::abs(sensitivities.waiting_time_by_service_rate + 3) < .3,
+           "dW/dmu = -lambda (2 mu - lambda) / (mu (mu - lambda))^2");
+    ASSERT(std::abs(sensitivities.system_time_by_arrival_rate - 4) < .3, "dT/dlambda = 1 / (mu - lambda)^2");
+    ASSERT(std::abs(sensitivities.system_time_by_service_rate + 4) < .3, "dT/dmu = -1 / (mu - lambda)^2");
+}
+
+void test_buffer_search()
+{
+    std::size_t evaluations = 0;
+    auto meets = [&evaluations] (std::size_t kcpu, std::size_t kio) {
+        ++evaluations;
+        return kcpu >= 3 && kcpu + 2 * kio >= 12;
+    };
+
+    auto smallest = project2::search_smallest_buffers(20, 1, 8, meets);
+    ASSERT(smallest.has_value(), "found");
+    ASSERT_EQ(smallest->first, std::size_t(4), "Kcpu");
+    ASSERT_EQ(smallest->second, std::size_t(4), "Kio");
+    ASSERT_LT(evaluations, std::size_t(30), "bisection and pruning instead of all 160 candidates");
+
+    // MM1: a single Kio
+    smallest = project2::search_smallest_buffers(20, 5, 5, meets);
+    ASSERT(smallest.has_value(), "found for one Kio");
+    ASSERT_EQ(smallest->first, std::size_t(3), "smallest Kcpu at Kio 5");
+
+    ASSERT(!project2::search_smallest_buffers(2, 1, 3, meets).has_value(), "nothing small enough meets the targets");
+}
+
+void test_analytic()
+{
+    auto close = [] (double actual, double expected, double tolerance) {
+        return std::abs(actual - expected) <= tolerance * std::abs(expected);
+    };
+
+    // M/M/1/10 at rho = .5 blocks rho^10 (1 - rho) / (1 - rho^11) of arrivals
+    auto mm1k = analytic::mm1k(.5, 1, 10);
+    ASSERT(close(mm1k.loss_probability, std::pow(.5, 10) * .5 / (1 - std::pow(.5, 11)), 1e-12), "M/M/1/K blocking");
+    ASSERT(mm1k.exact, "M/M/1/K is exact");
+
+    auto balanced = analytic::mm1k(1, 1, 4); // every occupancy 0..4 equally likely
+    ASSERT(close(balanced.loss_probability, .2, 1e-12), "rho = 1 blocks 1 / (K + 1)");
+    ASSERT(close(balanced.customers, 2, 1e-12), "rho = 1 averages K / 2");
+
+    auto overloaded = analytic::mm1k(2, 1, 3); // p_n proportional to 1, 2, 4, 8
+    ASSERT(close(overloaded.loss_probability, 8.0 / 15, 1e-12), "rho > 1 blocks most arrivals");
+    ASSERT(close(overloaded.customers, 34.0 / 15, 1e-12), "rho > 1 mostly full");
+    ASSERT(close(overloaded.utilization, 14.0 / 15, 1e-12), "busy unless empty");
+
+    // a buffer that never fills is an M/M/1: W = rho / (mu - lambda), T = 1 / (mu - lambda)
+    auto unlimited = analytic::mm1k(.5, 1, 100000000);
+    ASSERT(unlimited.loss_probability < 1e-300, "never full");
+    ASSERT(close(unlimited.waiting_time, 1, 1e-12), "M/M/1 waiting time");
+    ASSERT(close(unlimited.system_time, 2, 1e-12), "M/M/1 system time");
+
+    // two servers offered one Erlang: the chain's states weigh 1, 1, 1/2, 1/4, ... so 1/3 of arrivals wait
+    ASSERT(close(analytic::erlang_c(1, 2), 1.0 / 3, 1e-12), "Erlang C");
+    auto mm2 = analytic::mmc(1, 1, 2);
+    ASSERT(close(mm2.waiting_time, 1.0 / 3, 1e-12), "M/M/2 waits C / (c mu - lambda)");
+    ASSERT(close(analytic::mmc(.5, 1, 1).waiting_time, 1, 1e-12), "one server is M/M/1");
+
+    // Pollaczek-Khinchine with exponential service (E[S^2] = 2 / mu^2) is M/M/1 again
+    auto exponential = analytic::mg1(.5, 1, 2);
+    ASSERT(close(exponential.waiting_time, 1, 1e-12), "P-K is M/M/1 for exponential service");
+    auto deterministic = analytic::mg1(.5, 1, 1);
+    ASSERT(close(deterministic.waiting_time, .5, 1e-12), "M/D/1 waits half as long");
+    auto one_server = analytic::mgc(.5, 1, 1, 1);
+    ASSERT(one_server.exact, "M/G/c with one server is P-K");
+    ASSERT(close(one_server.waiting_time, deterministic.waiting_time, 1e-12), "matches P-K");
+    auto md2 = analytic::mgc(1, 1, 1, 2);
+    ASSERT(!md2.exact, "M/G/c is approximate");
+    ASSERT(close(md2.waiting_time, mm2.waiting_time / 2, 1e-12), "scaled by (1 + Cs^2) / 2");
+
+    // SJF can't reorder identical jobs, and helps when they differ
+    auto identical = analytic::mg1_sjf(.5, [] (double) { return 1.0; });
+    ASSERT(close(identical.waiting_time, deterministic.waiting_time, 1e-6), "SJF of identical jobs is FCFS");
+    auto shortest_first = analytic::mg1_sjf(.5, [] (double percentile) { return -std::log1p(-percentile); });
+    ASSERT(close(shortest_first.utilization, .5, 1e-6), "service mean integrated from the percentiles");
+    ASSERT_LT(shortest_first.waiting_time, exponential.waiting_time, "SJF waits less than FCFS");
+    ASSERT_GT(shortest_first.waiting_time, .5, "but every job waits out the residual service");
+
+    // project 3's heavy tail: the integrated moments match the closed forms
+    const BoundedParetoGenerator bounded_pareto(332, 1e10, 1.1);
+    auto heavy_tail = analytic::mg1_sjf(.0002, [&bounded_pareto] (double percentile) {
+        return bounded_pareto.percentile_to_value(percentile);
+    });
+    ASSERT(close(heavy_tail.utilization, .0002 * bounded_pareto.mean(), 1e-3), "bounded pareto mean");
+    ASSERT_LT(heavy_tail.waiting_time,
+              analytic::mg1(.0002, bounded_pareto.mean(), bounded_pareto.second_moment()).waiting_time,
+              "SJF beats FCFS on a heavy tail");
+    ASSERT(close(bounded_pareto.percentile_to_value(0), 332, 1e-9), "percentile 0 is the lower bound");
+    ASSERT(close(bounded_pareto.percentile_to_value(1), 1e10, 1e-6), "percentile 1 is the upper bound");
+
+    try {
+        analytic::mmc(3, 1, 3);
+        ASSERT(false, "expected to throw invalid argument");
+    } catch (std::invalid_argument &) {}
+
+    try {
+        analytic::mg1(1, 1, 2);
+        ASSERT(false, "expected to throw invalid argument");
+    } catch (std::invalid_argument &) {}
+
+    // a lone station is exactly M/M/1, its buffer ignored
+    auto lone = analytic::jackson({.5, {{1, 9, {}}}});
+    ASSERT(lone.overall.exact, "lone station exact");
+    ASSERT_EQ(lone.overall.loss_probability, 0.0, "unlimited buffer loses nothing");
+    ASSERT(close(lone.overall.system_time, 2, 1e-12), "lone station system time 1 / (mu - lambda)");
+
+    // the web server is a product form network: the CPU sees lambda / .7 and
+    // each IO queue a tenth of that
+    const splitting::Network web_server{.35,
+                                        {{1, 40, {0, .1, .1, .1}},
+                                         {.5, 40, {1}},
+                                         {.5, 40, {1}},
+                                         {.5, 40, {1}}}};
+    auto network = analytic::jackson(web_server);
+    ASSERT(network.overall.exact, "jackson networks are exact");
+    ASSERT(network.stations[1].exact, "so are their stations");
+    ASSERT(close(network.arrival_rates[0], .5, 1e-9), "CPU traffic");
+    ASSERT(close(network.arrival_rates[1], .05, 1e-9), "IO traffic");
+    ASSERT(network.overall.loss_probability < 1e-9, "nothing lost");
+    ASSERT(close(network.overall.customers, 1 + 3 * (.1 / .9), 1e-9), "sum of M/M/1 occupancies");
+    ASSERT(close(network.overall.system_time, (1 + 3 * (.1 / .9)) / .35, 1e-9), "Little's law over the network");
+
+    // a station sending 90% of its customers back sees ten times the arrivals, for ten visits each
+    auto feedback = analytic::jackson({.05, {{1, 5, {.9}}}});
+    ASSERT(close(feedback.arrival_rates[0], .5, 1e-12), "traffic equations with feedback");
+    ASSERT(close(feedback.overall.system_time, 10 * 2, 1e-12), "ten visits of 1 / (mu - lambda)");
+
+    try {
+        analytic::jackson({.1, {{1, 5, {1}}}});
+        ASSERT(false, "expected to throw invalid argument");
+    } catch (std::invalid_argument &) {}
+
+    try {
+        analytic::jackson({.95, {{1, 5, {.1}}}});
+        ASSERT(false, "expected to throw invalid argument");
+    } catch (std::invalid_argument &) {}
+
+    // and the oracle for the simulation engines: long seeded runs land within a few percent
+    auto all = [] (const queue_name_to_priority_to_stat & stat) {
+        return stat.at(SimulationRunStats::all_queues()).at(SimulationRunStats::all_priorities());
+    };
+
+    auto expected = analytic::mm1k(.8, 1, 5);
+    for (auto discipline : {project2::Discipline::FCFS, project2::Discipline::LCFS_NP}) {
+        auto stats = project2::do_m_m_1_k(.8, 4, 200000, discipline, 0);
+        ASSERT(close(all(stats.customer_loss_rates()), expected.loss_probability, .05), "M/M/1/K engine CLR");
+        ASSERT(close(all(stats.average_waiting_times()), expected.waiting_time, .05), "M/M/1/K engine waiting time");
+    }
+
+    auto web_server_stats = project2::do_web_server(.35, 40, 40, 100000, 0);
+    ASSERT(close(all(web_server_stats.average_waiting_times()), network.overall.waiting_time, .05),
+           "web server engine waiting time");
+    ASSERT(close(web_server_stats.average_system_time(), network.overall.system_time, .05),
+           "web server engine system time");
+
+    auto mm3 = analytic::mmc(.0005, 1.0 / 3000, 3);
+    auto mm3_stats = project3::do_one_run(.0005, 100000, project3::Discipline::FCFS, project3::Mode::MM3, 0);
+    ASSERT(close(all(mm3_stats.average_waiting_times()), mm3.waiting_time, .1), "M/M/3 engine waiting time");
+    ASSERT(close(mm3_stats.average_system_time(), mm3.system_time, .05), "M/M/3 engine system time");
+}
+
+void test_closed_network()
+{
+    auto close = [] (double actual, double expected, double tolerance) {
+        return std::abs(actual - expected) <= tolerance * std::abs(expected);
+    };
+
+    // one station (S = 1) and a think time of 1: alone a request takes 1, so
+    // X(1) = 1/2 and Q(1) = 1/2, then the second customer finds 1/2 ahead: R = 1.5, X = .8
+    const splitting::Network single{1, {{1, 10, {}}}};
+    auto one = analytic::mva(single, 1);
+    ASSERT(close(one.throughput, .5, 1e-12), "one customer alternates think and service");
+    auto two = analytic::mva(single, 2);
+    ASSERT(close(two.overall.system_time, 1.5, 1e-12), "arrival theorem residence time");
+    ASSERT(close(two.throughput, .8, 1e-12), "two customers throughput");
+    ASSERT(close(two.overall.customers, 1.2, 1e-12), "Little's law at the station");
+    ASSERT(two.overall.exact, "buffer holds everyone");
+    ASSERT(!analytic::mva(single, 12).overall.exact, "a smaller buffer would block");
+
+    // the web server: 1 / .7 CPU visits per request and .1 / .7 to each IO queue
+    const splitting::Network web_server{.1,
+                                        {{1, 40, {0, .1, .1, .1}},
+                                         {.5, 40, {1}},
+                                         {.5, 40, {1}},
+                                         {.5, 40, {1}}}};
+    const double cpu_demand = 1 / .7;
+    const double io_demand = .1 / .7 / .5;
+    auto alone = analytic::mva(web_server, 1);
+    ASSERT(close(alone.overall.system_time, cpu_demand + 3 * io_demand, 1e-9), "a lone request takes its demands");
+    ASSERT(std::abs(alone.overall.waiting_time) < 1e-9, "and never waits");
+    ASSERT(close(alone.arrival_rates[1] / alone.arrival_rates[0], .1, 1e-9), "visits from the traffic equations");
+
+    auto crowded = analytic::mva(web_server, 500);
+    ASSERT(close(crowded.throughput, 1 / cpu_demand, 1e-6), "the CPU bottleneck caps throughput");
+    ASSERT(close(crowded.stations[0].utilization, 1, 1e-6), "and saturates");
+
+    // the closed web server engine against MVA, then with a CPU buffer too small to be product form
+    SimulationOptions options;
+    options.population = 10;
+    auto expected = analytic::mva(web_server, 10);
+    auto all = [] (const queue_name_to_priority_to_stat & stat) {
+        return stat.at(SimulationRunStats::all_queues()).at(SimulationRunStats::all_priorities());
+    };
+    auto stats = project2::do_web_server(.1, 40, 40, 50000, 0, options);
+    ASSERT_EQ(all(stats.customer_loss_rates()), 0.0f, "buffers hold the whole population");
+    ASSERT(close(stats.average_system_time(), expected.overall.system_time, .05), "closed engine system time");
+    ASSERT(close(all(stats.average_waiting_times()), expected.overall.waiting_time, .05), "closed engine waiting time");
+
+    auto blocking = project2::do_web_server(.1, 2, 40, 20000, 0, options);
+    ASSERT_GT(all(blocking.customer_loss_rates()), 0.0f, "a small CPU buffer turns requests away");
+    ASSERT_LT(blocking.average_system_time(), stats.average_system_time(), "so the ones accepted wait less");
+}
+
+void test_request_log()
+{
+    const std::string kCsvPath = "/tmp/a_plus_q_test_requests.csv";
+    const std::string kBinaryPath = "/tmp/a_plus_q_test_requests.bin";
+
+    {
+        std::ofstream csv(kCsvPath);
+        csv << "timestamp,priority,service_time\n"
+            << "# comments and blank lines are skipped\n"
+            << "\n"
+            << "1000.5,2,0.25\r\n"
+            << "1001, 3 ,\n"
+            << "1003,1";
+    }
+    {
+        RequestLog log(kCsvPath);
+        ASSERT(!log.binary(), "text is read as CSV");
+        LoggedRequest request;
+        ASSERT(log.next(request), "first request");
+        ASSERT_EQ(request.timestamp, 1000.5, "timestamp");
+        ASSERT_EQ(request.priority, std::uint32_t(2), "priority");
+        ASSERT_EQ(request.service_time, 0.25f, "service time");
+        ASSERT(log.next(request), "second request");
+        ASSERT_EQ(request.priority, std::uint32_t(3), "blanks around a field");
+        ASSERT_EQ(request.service_time, no_logged_service_time(), "empty service time");
+        ASSERT(log.next(request), "last line without a newline");
+        ASSERT_EQ(request.timestamp, 1003.0, "last timestamp");
+        ASSERT_EQ(request.service_time, no_logged_service_time(), "missing service time");
+        ASSERT(!log.next(request), "log used up");
+    }
+
+    {
+        std::ofstream csv(kCsvPath);
+        csv << "1,1\n2;1\n";
+    }
+    try {
+        RequestLog log(kCsvPath);
+        LoggedRequest request;
+        ASSERT(log.next(request), "a good line before the bad one");
+        log.next(request);
+        ASSERT(false, "expected to throw runtime error");
+    } catch (std::runtime_error &) {}
+    std::remove(kCsvPath.c_str());
+
+    // customers arrive from time 0 with the logged service time or a drawn one
+    write_request_log(kBinaryPath, {{50, 4, 2}, {51, 1, no_logged_service_time()}, {53.5, 9, 1}});
+    {
+        RequestLog log(kBinaryPath);
+        ASSERT(log.binary(), "binary log detected");
+
+        SimulationTimer timer;
+        std::vector<std::shared_ptr<Customer>> customers;
+        auto logged_customers = LoggedCustomers(timer, log, [] { return 7.0f; });
+        logged_customers.register_for_customers([&customers] (const std::shared_ptr<Customer> & customer) {
+            customers.push_back(customer);
+        });
+        logged_customers.start();
+        while (timer.has_jobs()) {
+            timer.advance_time();
+        }
+
+        ASSERT_EQ(customers.size(), std::size_t(3), "every request arrived");
+        ASSERT_EQ(customers[0]->arrival_time(), 0.0f, "first request at time 0");
+        ASSERT_EQ(customers[2]->arrival_time(), 3.5f, "later ones keep their spacing");
+        ASSERT_EQ(customers[0]->service_time(), 2.0f, "logged service time");
+        ASSERT_EQ(customers[1]->service_time(), 7.0f, "drawn service time");
+        ASSERT_EQ(customers[2]->priority(), default_customer_priority(), "one priority ignores the logged ones");
+    }
+    {
+        RequestLog log(kBinaryPath);
+        SimulationTimer timer;
+        auto logged_customers = LoggedCustomers(timer, log, [] { return 1.0f; }, 1, 4);
+        logged_customers.start();
+        try {
+            while (timer.has_jobs()) {
+                timer.advance_time();
+            }
+            ASSERT(false, "expected to throw runtime error");
+        } catch (std::runtime_error &) {}
+    }
+
+    // Bursts of 3 every 10 with unit service into one waiting place: the
+    // first is served at once, the second waits 1 and the third is lost.
+    // The run ends when the log does, well short of C. The warm up cuts a
+    // burst in two, which moves the rates by less than 1e-3.
+    std::vector<LoggedRequest> bursts;
+    for (int burst = 0; burst < 2000; ++burst) {
+        for (int i = 0; i < 3; ++i) {
+            bursts.push_back({10.0 * burst, 1, 1});
+        }
+    }
+    write_request_log(kBinaryPath, bursts);
+    SimulationOptions options;
+    options.arrivals_path = kBinaryPath;
+    auto all = [] (const queue_name_to_priority_to_stat & stat) {
+        return stat.at(SimulationRunStats::all_queues()).at(SimulationRunStats::all_priorities());
+    };
+    auto stats = project2::do_m_m_1_k(.5, 1, 1000000, project2::Discipline::FCFS, 0, options);
+    std::remove(kBinaryPath.c_str());
+    ASSERT(std::abs(all(stats.customer_loss_rates()) - 1 / 3.0f) < 1e-3f, "the third of every burst is lost");
+    ASSERT(std::abs(all(stats.average_waiting_times()) - .5f) < 1e-3f, "the served ones wait 0 and 1");
+    ASSERT(std::abs(stats.average_system_time() - 1.5f) < 1e-3f, "plus a unit of service");
+}
+
+void test_rate_profile()
+{
+    auto close = [] (double actual, double expected, double tolerance) {
+        return std::abs(actual - expected) <= tolerance * std::abs(expected);
+    };
+
+    const auto step = parse_rate_profile("step:0=.5,100=2,200");
+    ASSERT_EQ(step.rate(50), .5, "first step");
+    ASSERT_EQ(step.rate(150), 2.0, "second step");
+    ASSERT_EQ(step.rate(250), .5, "repeats every period");
+    ASSERT(close(step.mean_rate(), 1.25, 1e-12), "mean over a period");
+    ASSERT_EQ(step.acceptance(), 1.0, "steps bound themselves");
+
+    // a ramp up and back down, the worst case for the bounds
+    const auto ramp = parse_rate_profile("linear:0=0,100=1,200");
+    ASSERT(close(ramp.rate(25), .25, 1e-12), "interpolated up");
+    ASSERT(close(ramp.rate(175), .25, 1e-12), "and back to the first point at the period");
+    ASSERT(close(ramp.mean_rate(), .5, 1e-12), "mean of the ramp");
+    ASSERT_GT(ramp.acceptance(), .95, "thinning keeps almost every candidate");
+
+    for (const auto & text : {"step:10=1,20", "linear:0=1,5=2,5", "step:0=1", "ramp:0=1,10", "step:0=0,10", "step:0=-1,10"}) {
+        try {
+            parse_rate_profile(text);
+            ASSERT(false, "expected to throw invalid argument");
+        } catch (std::invalid_argument &) {}
+    }
+
+    // arrivals land in each piece in proportion to its rate
+    auto count_arrivals = [] (const RateProfile & profile, double lambda, std::size_t periods) {
+        auto generator = ExponentialGenerator(lambda, 17);
+        generator.modulate(profile);
+        std::vector<double> counts(4);
+        double time = 0;
+        while (true) {
+            time += generator.generate();
+            if (time >= periods * profile.period()) {
+                return counts;
+            }
+            counts[std::size_t(4 * std::fmod(time, profile.period()) / profile.period())] += 1;
+        }
+    };
+    constexpr std::size_t kPeriods = 400;
+    auto step_counts = count_arrivals(step, 2, kPeriods);
+    ASSERT(close(step_counts[0], 2 * .5 * 50 * kPeriods, .03), "arrivals at the low step");
+    ASSERT(close(step_counts[3], 2 * 2 * 50 * kPeriods, .03), "arrivals at the high step");
+    auto ramp_counts = count_arrivals(ramp, 4, kPeriods);
+    ASSERT(close(ramp_counts[0], 4 * .25 * 50 * kPeriods, .03), "arrivals on the bottom of the ramp");
+    ASSERT(close(ramp_counts[1], 4 * .75 * 50 * kPeriods, .03), "arrivals on the top of the ramp");
+    ASSERT(close(ramp_counts[3], ramp_counts[0], .05), "and the way down");
+
+    // buckets of 10 folded onto a period of 30, seen up to time 45
+    statistics::TimeBuckets buckets(10, 30);
+    buckets.on_entered(5, 0);
+    buckets.on_entered(35, 2);
+    buckets.on_entered(25, 1);
+    buckets.on_exited(5, 6, true, 0, 1);
+    buckets.on_exited(35, 45, true, 4, 10);
+    buckets.on_exited(25, 25, false, 0, 0);
+    auto folded = buckets.buckets();
+    ASSERT_EQ(folded.size(), std::size_t(3), "one period of buckets");
+    ASSERT_EQ(folded[0].arrivals, std::uint64_t(2), "the second period folds onto the first");
+    ASSERT_EQ(folded[0].customers_found, std::uint64_t(2), "customers found summed");
+    ASSERT_EQ(folded[0].waiting_time, 4.0, "waiting summed");
+    ASSERT_EQ(folded[2].lost, std::uint64_t(1), "loss in the last bucket");
+    ASSERT_EQ(folded[0].exposure, 20.0, "a whole period and the start of the next");
+    ASSERT_EQ(folded[1].exposure, 15.0, "half of the second bucket in the next period");
+    ASSERT_EQ(folded[2].exposure, 10.0, "only the first period");
+
+    // the MM1 queue waits longest in the peak
+    SimulationOptions options;
+    options.rate_profile = std::make_shared<const RateProfile>(parse_rate_profile("step:0=.5,1000=1.1,2000"));
+    options.time_bucket_width = 1000;
+    auto stats = project2::do_m_m_1_k(.8, 40, 20000, project2::Discipline::FCFS, 0, options);
+    auto peak = stats.time_buckets().buckets();
+    ASSERT_EQ(peak.size(), std::size_t(2), "two buckets a period");
+    ASSERT(close(peak[0].arrivals / peak[0].exposure, .4, .05), "off peak arrival rate");
+    ASSERT(close(peak[1].arrivals / peak[1].exposure, .88, .05), "peak arrival rate");
+    ASSERT_GT(peak[1].waiting_time / peak[1].serviced, 3 * peak[0].waiting_time / peak[0].serviced, "the peak queues");
 }
 
 } // testing
@@ -113,6 +113,32 @@ void test_priority_generator();
 void test_spy();
 void test_prio_p_queue();
 void test_spy_odd_entrances();
+void test_spy_priority_range();
+void test_spy_slowdown_buckets();
+void test_quantile_sketches();
+void test_batch_means();
+void test_precision_runs();
+void test_mser_warm_up();
+void test_regenerative_cycles();
+void test_variance_reduction();
+void test_control_variates();
+void test_restart_splitting();
+void test_importance_sampling();
+void test_perturbation_analysis();
+void test_buffer_search();
+void test_analytic();
+void test_closed_network();
+void test_request_log();
+void test_rate_profile();
 void test_bounded_pareto();
+void test_parallel_runs();
+void test_time_warp();
+void test_time_warp_rounds();
+void test_trace();
+void test_logging();
+void test_microbench();
+void test_bench();
+void test_allocation_accounting();
+void test_probes();
 
 } // testing
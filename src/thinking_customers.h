@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+
+#include "simulation_timer.h"
+#include "customer.h"
+#include "log.h"
+#include "allocation_counter.h"
+
+// The delay node of a closed network, in place of IncomingCustomers: a fixed
+// population, each member thinking for a drawn time before sending a request
+// into the system and thinking again once the request leaves it (served or
+// lost). Every request is a new Customer, so the queues and the spy see them
+// exactly like arrivals.
+template <class ThinkTimeGenerator>
+class ThinkingCustomers {
+public:
+    ThinkingCustomers(const SimulationTimer & simulation_timer,
+                      const ThinkTimeGenerator & think_time_generator,
+                      std::size_t population)
+    : simulation_timer_(simulation_timer)
+    , think_time_generator_(think_time_generator)
+    , population_(population)
+    {}
+
+    void register_for_customers(const CustomerRequest & callback)
+    {
+        customer_destinations_.push_back(callback);
+    }
+
+    // everyone starts out thinking
+    void start()
+    {
+        for (std::size_t i = 0; i < population_; ++i) {
+            think();
+        }
+    }
+
+    void on_customer_left(const std::shared_ptr<Customer> & customer)
+    {
+        logging::log<logging::Level::DEBUG, logging::Component::INCOMING>(
+            "ThinkingCustomers::on_customer_left customer: {} left at time: {}",
+            customer->id(), simulation_timer_.time());
+        think();
+    }
+
+private:
+    void think()
+    {
+        allocation_counter::AllocationScope allocation_scope(allocation_counter::Subsystem::INCOMING);
+        auto arrival_time = simulation_timer_.time() + think_time_generator_.generate();
+        auto customer = make_customer(id_, arrival_time, default_customer_priority());
+        ++id_;
+
+        logging::log<logging::Level::DEBUG, logging::Component::INCOMING>(
+            "ThinkingCustomers::think called at time: {} scheduling request: {} for time: {}",
+            simulation_timer_.time(), customer->id(), arrival_time);
+
+        simulation_timer_.register_job(
+            arrival_time,
+            [this, customer] {
+                for (const auto & callback : customer_destinations_) {
+                    callback(customer);
+                }
+            },
+            JobTag{TraceKind::ARRIVAL, customer->id(), nullptr}
+        );
+    }
+
+    std::vector<CustomerRequest> customer_destinations_;
+    const SimulationTimer & simulation_timer_;
+    ThinkTimeGenerator think_time_generator_;
+    const std::size_t population_;
+    std::uint32_t id_ = 0;
+};
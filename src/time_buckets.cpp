@@ -0,0 +1,103 @@
+#include "time_buckets.h"
+
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+#include "stats.h"
+
+namespace statistics {
+
+TimeBuckets::TimeBuckets(double width, double period)
+: width_(width)
+, period_(period)
+{
+    if (enabled() && period_ > 0) {
+        buckets_.resize(std::size_t(std::ceil(period_ / width_)));
+    }
+}
+
+TimeBucket & TimeBuckets::bucket_at(double arrival_time)
+{
+    auto local = period_ > 0 ? std::fmod(arrival_time, period_) : arrival_time;
+    auto index = std::size_t(local / width_);
+    if (period_ > 0) {
+        index = std::min(index, buckets_.size() - 1);
+    } else if (index >= buckets_.size()) {
+        buckets_.resize(index + 1);
+    }
+    return buckets_[index];
+}
+
+std::vector<TimeBucket> TimeBuckets::buckets() const
+{
+    auto buckets = buckets_;
+    if (period_ == 0) {
+        buckets.resize(std::max<std::size_t>(buckets.size(), std::size_t(std::ceil(observed_until_ / width_))));
+    }
+
+    // whole periods cover every bucket once, the part of the last one only the buckets it reaches
+    const double cycles = period_ > 0 ? std::floor(observed_until_ / period_) : 0;
+    const double remainder = observed_until_ - cycles * period_;
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+        const double start = i * width_;
+        const double end = period_ > 0 ? std::min(start + width_, period_) : start + width_;
+        buckets[i].exposure = cycles * (end - start) + std::max(0.0, std::min(end, remainder) - start);
+    }
+    return buckets;
+}
+
+std::string time_bucket_report(const std::vector<TimeBuckets> & runs)
+{
+    if (runs.empty()) {
+        return "";
+    }
+
+    std::vector<std::vector<TimeBucket>> buckets_by_run;
+    std::size_t bucket_count = 0;
+    for (const auto & run : runs) {
+        buckets_by_run.push_back(run.buckets());
+        bucket_count = std::max(bucket_count, buckets_by_run.back().size());
+    }
+
+    // the per run values of one bucket's metric, leaving out runs without the customers to compute it
+    auto per_run = [&buckets_by_run] (std::size_t i, auto ratio) {
+        std::vector<double> values;
+        for (const auto & buckets : buckets_by_run) {
+            if (i < buckets.size()) {
+                auto value = ratio(buckets[i]);
+                if (!std::isnan(value)) {
+                    values.push_back(value);
+                }
+            }
+        }
+        return values;
+    };
+    auto divide = [] (double numerator, double denominator) {
+        return denominator > 0 ? numerator / denominator : std::numeric_limits<double>::quiet_NaN();
+    };
+
+    const auto width = runs.front().width();
+    const auto period = runs.front().period();
+    std::stringstream ss;
+    ss << "Time Buckets (by arrival time" << (period > 0 ? ", folded onto the rate profile's period" : "") << "):"
+       << std::endl;
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+        const auto end = period > 0 ? std::min((i + 1) * width, period) : (i + 1) * width;
+        ss << "    [" << i * width << ", " << end << "):"
+           << " Arrival Rate: " << confidence_interval_string(per_run(i, [&] (const TimeBucket & bucket) {
+                  return divide(bucket.arrivals, bucket.exposure); }))
+           << " Found: " << confidence_interval_string(per_run(i, [&] (const TimeBucket & bucket) {
+                  return divide(bucket.customers_found, bucket.arrivals); }))
+           << " CLR: " << confidence_interval_string(per_run(i, [&] (const TimeBucket & bucket) {
+                  return divide(bucket.lost, bucket.serviced + bucket.lost); }))
+           << " Waiting Time: " << confidence_interval_string(per_run(i, [&] (const TimeBucket & bucket) {
+                  return divide(bucket.waiting_time, bucket.serviced); }))
+           << " System Time: " << confidence_interval_string(per_run(i, [&] (const TimeBucket & bucket) {
+                  return divide(bucket.system_time, bucket.serviced); }))
+           << std::endl;
+    }
+    return ss.str();
+}
+
+} // statistics
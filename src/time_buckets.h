@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Customers grouped by when they arrived, to watch a run go through a time
+// varying load (see rate_profile.h). Bucket k holds the arrivals in
+// [k width, (k + 1) width). With a period the buckets fold onto it, so every
+// day of a long run adds to the same time of day and the last bucket may be
+// shorter.
+//
+// Unlike the other statistics nothing is dropped as warm up: under a varying
+// load when in the period a customer arrived is the point, and a run starts
+// at time 0 of the period like a real day starts empty.
+
+namespace statistics {
+
+struct TimeBucket {
+    std::uint64_t arrivals = 0;
+    std::uint64_t customers_found = 0; // already in the system, summed over the arrivals
+    std::uint64_t serviced = 0;
+    std::uint64_t lost = 0;
+    double waiting_time = 0; // summed over serviced customers
+    double system_time = 0; // summed over serviced customers
+    double exposure = 0; // time the run spent in the bucket
+};
+
+class TimeBuckets {
+public:
+    // width 0 turns the buckets off, period 0 doesn't fold them
+    explicit TimeBuckets(double width = 0, double period = 0);
+
+    bool enabled() const
+    {
+        return width_ > 0;
+    }
+
+    double width() const
+    {
+        return width_;
+    }
+
+    double period() const
+    {
+        return period_;
+    }
+
+    void on_entered(double arrival_time, std::size_t customers_in_system)
+    {
+        auto & bucket = bucket_at(arrival_time);
+        ++bucket.arrivals;
+        bucket.customers_found += customers_in_system;
+        observed_until_ = std::max(observed_until_, arrival_time);
+    }
+
+    void on_exited(double arrival_time, double departure_time, bool serviced, double waiting_time, double system_time)
+    {
+        auto & bucket = bucket_at(arrival_time);
+        if (serviced) {
+            ++bucket.serviced;
+            bucket.waiting_time += waiting_time;
+            bucket.system_time += system_time;
+        } else {
+            ++bucket.lost;
+        }
+        observed_until_ = std::max(observed_until_, departure_time);
+    }
+
+    // the buckets up to the last arrival or departure seen, with their exposure
+    std::vector<TimeBucket> buckets() const;
+
+private:
+    TimeBucket & bucket_at(double arrival_time);
+
+    double width_;
+    double period_;
+    std::vector<TimeBucket> buckets_;
+    double observed_until_ = 0;
+};
+
+// Per bucket 95% intervals over runs of the arrival rate, customers an
+// arrival finds, CLR and waiting and system time. A run that saw no
+// customers in a bucket is left out of that bucket's intervals.
+std::string time_bucket_report(const std::vector<TimeBuckets> & runs);
+
+} // statistics
@@ -0,0 +1,468 @@
+#include "time_warp.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace time_warp {
+
+namespace {
+
+constexpr float kNever = std::numeric_limits<float>::infinity();
+
+// events a process runs before its worker looks again for the process
+// furthest behind, which may have got messages from it in the meantime
+constexpr std::size_t kSliceEvents = 8;
+
+// Threads that each call work with their index once a round. The thread
+// calling run_round is worker 0, and run_round returns once every worker is
+// done, rethrowing the first exception one of them threw.
+class RoundWorkers {
+public:
+    RoundWorkers(std::size_t threads, const std::function<void(std::size_t)> & work)
+    : work_(work)
+    {
+        for (std::size_t i = 1; i < threads; ++i) {
+            threads_.emplace_back([this, i] { wait_for_rounds(i); });
+        }
+    }
+
+    RoundWorkers(const RoundWorkers &) = delete;
+    RoundWorkers & operator=(const RoundWorkers &) = delete;
+
+    ~RoundWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        round_started_.notify_all();
+        for (auto & thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void run_round()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++round_;
+            finished_ = 0;
+        }
+        round_started_.notify_all();
+
+        do_work(0);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        round_finished_.wait(lock, [this] { return finished_ == threads_.size(); });
+        if (first_exception_) {
+            std::rethrow_exception(first_exception_);
+        }
+    }
+
+private:
+    void wait_for_rounds(std::size_t worker)
+    {
+        std::uint64_t round_done = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                round_started_.wait(lock, [this, round_done] { return stopping_ || round_ != round_done; });
+                if (stopping_) {
+                    return;
+                }
+                round_done = round_;
+            }
+
+            do_work(worker);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                ++finished_;
+            }
+            round_finished_.notify_one();
+        }
+    }
+
+    void do_work(std::size_t worker)
+    {
+        try {
+            work_(worker);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!first_exception_) {
+                first_exception_ = std::current_exception();
+            }
+        }
+    }
+
+    const std::function<void(std::size_t)> work_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable round_started_;
+    std::condition_variable round_finished_;
+    std::uint64_t round_ = 0;
+    std::size_t finished_ = 0;
+    bool stopping_ = false;
+    std::exception_ptr first_exception_ = nullptr;
+};
+
+} // anonymous
+
+void Report::add(const Report & other)
+{
+    runs += other.runs;
+    processes = std::max(processes, other.processes);
+    threads = std::max(threads, other.threads);
+    processed_events += other.processed_events;
+    committed_events += other.committed_events;
+    rolled_back_events += other.rolled_back_events;
+    rollbacks += other.rollbacks;
+    anti_messages += other.anti_messages;
+    gvt_rounds += other.gvt_rounds;
+    wall_seconds += other.wall_seconds;
+    timed_wall_seconds += other.timed_wall_seconds;
+    sequential_seconds += other.sequential_seconds;
+}
+
+std::string Report::to_string() const
+{
+    std::stringstream ss;
+    ss << runs << " runs of " << processes << " processes on " << threads << " threads"
+       << ", " << committed_events << " of " << processed_events << " events committed"
+       << ", efficiency: " << efficiency()
+       << ", rollback rate: " << rollback_rate()
+       << " (" << rollbacks << " rollbacks, " << anti_messages << " anti-messages)"
+       << ", GVT rounds: " << gvt_rounds
+       << ", " << wall_seconds << "s";
+    if (sequential_seconds > 0) {
+        ss << ", timed runs " << timed_wall_seconds << "s against " << sequential_seconds << "s sequential"
+           << ", speedup: " << speedup();
+    }
+    return ss.str();
+}
+
+LogicalProcess::LogicalProcess(std::uint32_t id, std::atomic<std::size_t> & unhandled_messages)
+: id_(id)
+, unhandled_messages_(unhandled_messages)
+{
+    timer_.set_state_log(&state_log_);
+}
+
+void LogicalProcess::send(LogicalProcess & receiver, const std::shared_ptr<Customer> & customer)
+{
+    if (&receiver == this) {
+        throw std::invalid_argument("a logical process can't send to itself, its components share a timer");
+    }
+
+    const EventKey key{timer_.time(), depth_ + 1, id_, next_sequence_++};
+    state_log_.save([this, &receiver, key] {
+        next_sequence_ = key.sequence;
+        ++anti_messages_;
+        receiver.receive({key, nullptr, true});
+    });
+    receiver.receive({key, std::make_shared<Customer>(*customer), false});
+}
+
+void LogicalProcess::record_entering(const std::shared_ptr<Customer> & customer)
+{
+    records_.push_back({timer_.time(), true, customer});
+    state_log_.save([this] { records_.pop_back(); });
+}
+
+void LogicalProcess::record_exiting(const std::shared_ptr<Customer> & customer)
+{
+    records_.push_back({timer_.time(), false, customer});
+    state_log_.save([this] { records_.pop_back(); });
+}
+
+void LogicalProcess::receive(const Message & message)
+{
+    ++unhandled_messages_;
+    std::lock_guard<std::mutex> lock(inbox_mutex_);
+    inbox_.push_back(message);
+}
+
+void LogicalProcess::run(float horizon, std::size_t events)
+{
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        received_.swap(inbox_);
+    }
+    for (const auto & message : received_) {
+        on_message(message);
+    }
+    unhandled_messages_ -= received_.size();
+    received_.clear();
+
+    for (std::size_t ran = 0; ran < events; ++ran) {
+        // a message at the time of the process's own jobs runs after them
+        const auto local_time = timer_.has_jobs() ? timer_.next_job_time() : kNever;
+        const bool message = !pending_.empty() && pending_.begin()->first.time < local_time;
+        const auto key = message ? pending_.begin()->first : EventKey{local_time, 0, 0, 0};
+        if (!(key.time < horizon)) {
+            break;
+        }
+
+        processed_.push_back({key, nullptr, state_log_.mark()});
+        if (message) {
+            auto customer = pending_.begin()->second;
+            pending_.erase(pending_.begin());
+            processed_.back().customer = customer;
+            timer_.register_job(key.time, [this, customer] { inlet_(customer); });
+        }
+        depth_ = key.depth;
+        timer_.advance_time();
+        ++processed_events_;
+    }
+}
+
+void LogicalProcess::on_message(const Message & message)
+{
+    // the events run so far rise in key, the ones after the message's ran too early
+    auto first_after = std::upper_bound(processed_.begin(),
+                                        processed_.end(),
+                                        message.key,
+                                        [] (const EventKey & key, const ProcessedEvent & event) {
+                                            return key < event.key;
+                                        });
+    if (!message.anti) {
+        rollback(first_after - processed_.begin());
+        pending_.emplace(message.key, message.customer);
+        return;
+    }
+
+    if (pending_.erase(message.key)) {
+        return;
+    }
+
+    // the message already ran, so it goes back to pending with everything after it, then goes
+    if (first_after == processed_.begin() || (first_after - 1)->key < message.key) {
+        throw std::runtime_error("anti-message for a message that never arrived");
+    }
+    rollback(first_after - processed_.begin() - 1);
+    pending_.erase(message.key);
+}
+
+void LogicalProcess::rollback(std::size_t first_undone)
+{
+    if (first_undone == processed_.size()) {
+        return;
+    }
+    ++rollbacks_;
+    rolled_back_events_ += processed_.size() - first_undone;
+    undo_from(first_undone);
+}
+
+void LogicalProcess::undo_from(std::size_t first_undone)
+{
+    // undoing a send sends its anti-message
+    state_log_.undo_to(processed_[first_undone].mark);
+    for (auto event = processed_.begin() + first_undone; event != processed_.end(); ++event) {
+        if (event->key.message()) {
+            pending_.emplace(event->key, event->customer);
+        }
+    }
+    processed_.erase(processed_.begin() + first_undone, processed_.end());
+}
+
+float LogicalProcess::next_time()
+{
+    auto time = timer_.has_jobs() ? timer_.next_job_time() : kNever;
+    if (!pending_.empty()) {
+        time = std::min(time, pending_.begin()->first.time);
+    }
+
+    // an anti-message rolls back to its message's time
+    std::lock_guard<std::mutex> lock(inbox_mutex_);
+    for (const auto & message : inbox_) {
+        time = std::min(time, message.key.time);
+    }
+    return time;
+}
+
+void LogicalProcess::records_before(float time, std::vector<Record> & records) const
+{
+    for (const auto & record : records_) {
+        if (!(record.time < time)) {
+            break;
+        }
+        records.push_back(record);
+    }
+}
+
+void LogicalProcess::commit(float time)
+{
+    std::size_t committed = 0;
+    while (committed < processed_.size() && processed_[committed].key.time < time) {
+        ++committed;
+    }
+    state_log_.forget_to(committed < processed_.size() ? processed_[committed].mark : state_log_.mark());
+    processed_.erase(processed_.begin(), processed_.begin() + committed);
+    committed_events_ += committed;
+
+    while (!records_.empty() && records_.front().time < time) {
+        records_.pop_front();
+    }
+}
+
+void LogicalProcess::undo_after(float time)
+{
+    auto first_after = std::find_if(processed_.begin(),
+                                    processed_.end(),
+                                    [time] (const ProcessedEvent & event) { return event.key.time > time; });
+    if (first_after != processed_.end()) {
+        undo_from(first_after - processed_.begin());
+    }
+}
+
+Engine::Engine(std::size_t threads, float window)
+: threads_(std::max<std::size_t>(1, threads))
+, window_(window)
+{
+    if (!(window_ > 0)) {
+        throw std::invalid_argument("a Time Warp window must be above 0");
+    }
+}
+
+LogicalProcess & Engine::add_process()
+{
+    processes_.push_back(std::make_unique<LogicalProcess>(std::uint32_t(processes_.size()), unhandled_messages_));
+    return *processes_.back();
+}
+
+float Engine::run(const std::function<bool(const Record &)> & commit)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    // the soonest event of any process, nothing will ever roll back to before it
+    auto global_virtual_time = [this] {
+        auto time = kNever;
+        for (auto & process : processes_) {
+            time = std::min(time, process->next_time());
+        }
+        return time;
+    };
+
+    // Workers only send while they run, so once every worker is idle the count
+    // of unhandled messages holds still. Becoming idle or busy and checking for
+    // the end both take the mutex, so the last check sees one consistent state.
+    struct RoundEnd {
+        std::mutex mutex;
+        std::size_t idle_workers = 0;
+        bool done = false;
+    };
+
+    const auto threads = std::max<std::size_t>(1, std::min(threads_, processes_.size()));
+    float horizon = 0;
+    RoundEnd round_end;
+    RoundWorkers workers(threads, [this, threads, &horizon, &round_end] (std::size_t worker) {
+        // A worker with nothing left before the horizon waits for the others,
+        // which may still send it some, and the round ends once all of them
+        // are idle and every message sent has been handled.
+        bool idle = false;
+        while (true) {
+            // lowest time first: the process furthest behind runs next, the
+            // others would only have to roll back to what it sends them
+            LogicalProcess * soonest = nullptr;
+            auto soonest_time = horizon;
+            for (auto i = worker; i < processes_.size(); i += threads) {
+                const auto time = processes_[i]->next_time();
+                if (time < soonest_time) {
+                    soonest = processes_[i].get();
+                    soonest_time = time;
+                }
+            }
+
+            if (soonest) {
+                if (idle) {
+                    std::lock_guard<std::mutex> lock(round_end.mutex);
+                    idle = false;
+                    --round_end.idle_workers;
+                }
+                soonest->run(horizon, kSliceEvents);
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(round_end.mutex);
+                if (!idle) {
+                    idle = true;
+                    ++round_end.idle_workers;
+                }
+                if (round_end.idle_workers == threads && unhandled_messages_ == 0) {
+                    round_end.done = true;
+                }
+                if (round_end.done) {
+                    break;
+                }
+            }
+            std::this_thread::yield();
+        }
+    });
+
+    std::vector<Record> records;
+    std::optional<float> stop_time;
+    auto gvt = global_virtual_time();
+    while (!stop_time) {
+        if (gvt == kNever) {
+            throw std::runtime_error("Time Warp ran every event before the run was done");
+        }
+        horizon = std::max(gvt + window_, std::nextafter(gvt, kNever));
+        round_end.idle_workers = 0;
+        round_end.done = false;
+        workers.run_round();
+        gvt = global_virtual_time();
+        ++report_.gvt_rounds;
+
+        // the records before GVT go to commit by time, those at the same time
+        // in process order
+        records.clear();
+        for (auto & process : processes_) {
+            process->records_before(gvt, records);
+        }
+        std::stable_sort(records.begin(), records.end(), [] (const Record & a, const Record & b) {
+            return a.time < b.time;
+        });
+        for (const auto & record : records) {
+            if (stop_time && record.time != *stop_time) {
+                break;
+            }
+            if (commit(record) && !stop_time) {
+                stop_time = record.time;
+            }
+        }
+
+        // fossil collection, keeping what ran past the stop to undo
+        const auto committed_time = stop_time ? std::nextafter(*stop_time, kNever) : gvt;
+        for (auto & process : processes_) {
+            process->commit(committed_time);
+        }
+    }
+
+    report_.runs = 1;
+    report_.processes = processes_.size();
+    report_.threads = threads;
+    for (auto & process : processes_) {
+        report_.processed_events += process->processed_events_;
+        report_.rolled_back_events += process->rolled_back_events_;
+        report_.rollbacks += process->rollbacks_;
+        report_.anti_messages += process->anti_messages_;
+
+        // what ran past the stop didn't count, what's left did
+        process->undo_after(*stop_time);
+        report_.committed_events += process->committed_events_ + process->processed_.size();
+    }
+    report_.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return *stop_time;
+}
+
+} // time_warp
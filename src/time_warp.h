@@ -0,0 +1,271 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "simulation_timer.h"
+#include "customer.h"
+#include "state_log.h"
+
+// Optimistic parallel simulation by Time Warp (Jefferson, 1985).
+//
+// A model is split into logical processes, each with its own SimulationTimer
+// and the queues and servers registered on it. Customers move between
+// processes as timestamped messages, and every process runs its events as soon
+// as it has them, on worker threads, without waiting to learn whether another
+// process will still send it something earlier. When it does (a straggler) the
+// receiver rolls back: the components on its timer save every change they make
+// to a StateLog (incremental state saving), so the changes made since the
+// straggler's time are undone newest first, and every message sent in that
+// time is cancelled with an anti-message, which rolls its receiver back in turn
+// if it had already run it.
+//
+// After every round of processing the threads stop at a barrier and the global
+// virtual time (GVT) is found: the soonest event any process still has to run,
+// its own or in a message waiting for it. Nothing can roll back past GVT, so
+// the state saved before it is freed (fossil collection) and what happened
+// before it is committed. The spy only ever sees committed customers: the
+// processes record customers entering and leaving the system, rolling the
+// records back with the rest of their state, and once GVT passes them the
+// records of every process are handed to the spy in time order.
+//
+// A process runs at most window past GVT in a round, which bounds how much
+// optimism can be wasted and how far the sources can run ahead. Within a round
+// every thread runs the process of its own that is furthest behind, a slice of
+// events at a time, and the round ends once no thread has anything left before
+// the window's end and every message sent has been handled.
+//
+// Events at the same time run in a fixed order, so the committed result doesn't
+// depend on the threads: a process runs its own jobs at a time before the
+// messages for that time, and the messages by their depth, then by sender and
+// sending order. A message is one deeper than the event that sent it, so a
+// message caused by an event, through any chain of sends at the same time
+// (service times can round to 0 at a large time), always runs after it and
+// can't roll it back, which would cancel the message itself and never end.
+// Only customers whose events tie to the float can be ordered unlike in the
+// sequential engine, which runs jobs at the same time in the order they were
+// registered.
+
+namespace time_warp {
+
+// A process's events in the order they are run: its own jobs at a time come
+// first, then messages by depth, who sent them and in what order
+struct EventKey {
+    float time;
+    std::uint32_t depth; // 0 for the process's own jobs, one more than the sending event for a message
+    std::uint32_t sender;
+    std::uint64_t sequence; // of the message among the ones its sender sent
+
+    bool message() const
+    {
+        return depth > 0;
+    }
+
+    bool operator<(const EventKey & other) const
+    {
+        return std::tie(time, depth, sender, sequence)
+               < std::tie(other.time, other.depth, other.sender, other.sequence);
+    }
+};
+
+// A customer entering or leaving the system, for the spy
+struct Record {
+    float time;
+    bool entering;
+    std::shared_ptr<Customer> customer;
+};
+
+// Where the engine's work went, summed over runs
+struct Report {
+    std::size_t runs = 0;
+    std::size_t processes = 0;
+    std::size_t threads = 0;
+    std::uint64_t processed_events = 0; // rolled back ones included
+    std::uint64_t committed_events = 0;
+    std::uint64_t rolled_back_events = 0;
+    std::uint64_t rollbacks = 0;
+    std::uint64_t anti_messages = 0;
+    std::uint64_t gvt_rounds = 0;
+    double wall_seconds = 0;
+    double timed_wall_seconds = 0; // of the runs also timed on the sequential engine
+    double sequential_seconds = 0; // those runs on the sequential engine (0 = not timed)
+
+    // fraction of the events run that counted
+    double efficiency() const
+    {
+        return processed_events ? double(committed_events) / processed_events : 0;
+    }
+
+    // fraction of the events run that were undone
+    double rollback_rate() const
+    {
+        return processed_events ? double(rolled_back_events) / processed_events : 0;
+    }
+
+    // above 1 Time Warp paid off
+    double speedup() const
+    {
+        return timed_wall_seconds > 0 ? sequential_seconds / timed_wall_seconds : 0;
+    }
+
+    void add(const Report & other);
+
+    std::string to_string() const;
+};
+
+class LogicalProcess {
+public:
+    // unhandled_messages counts the messages sent to any process that it hasn't handled yet
+    LogicalProcess(std::uint32_t id, std::atomic<std::size_t> & unhandled_messages);
+
+    LogicalProcess(const LogicalProcess &) = delete;
+    LogicalProcess & operator=(const LogicalProcess &) = delete;
+
+    std::uint32_t id() const
+    {
+        return id_;
+    }
+
+    // for the components of this process, which must save their changes to state_log
+    const SimulationTimer & timer() const
+    {
+        return timer_;
+    }
+
+    StateLog & state_log()
+    {
+        return state_log_;
+    }
+
+    // where the customers sent to this process go
+    void set_inlet(const CustomerRequest & inlet)
+    {
+        inlet_ = inlet;
+    }
+
+    // a copy of customer arrives at receiver now, this process's copy stays
+    // behind for a rollback to put back
+    void send(LogicalProcess & receiver, const std::shared_ptr<Customer> & customer);
+
+    // customer entered or left the system now
+    void record_entering(const std::shared_ptr<Customer> & customer);
+    void record_exiting(const std::shared_ptr<Customer> & customer);
+
+private:
+    friend class Engine;
+
+    struct Message {
+        EventKey key;
+        std::shared_ptr<Customer> customer;
+        bool anti;
+    };
+
+    struct ProcessedEvent {
+        EventKey key;
+        std::shared_ptr<Customer> customer; // the message's, null for the process's own jobs
+        StateLog::Mark mark; // the state log before the event
+    };
+
+    // called from any thread
+    void receive(const Message & message);
+
+    // handles the messages received so far, then runs up to events events before horizon
+    void run(float horizon, std::size_t events);
+    void on_message(const Message & message);
+    void rollback(std::size_t first_undone);
+    void undo_from(std::size_t first_undone);
+
+    // the soonest event this process still has to run, received messages included
+    float next_time();
+
+    // adds the records before time, in the order they were made
+    void records_before(float time, std::vector<Record> & records) const;
+
+    // forgets the events and records before time, which GVT has passed
+    void commit(float time);
+
+    // undoes the events after time, where the run stopped
+    void undo_after(float time);
+
+    const std::uint32_t id_;
+    SimulationTimer timer_;
+    StateLog state_log_;
+    CustomerRequest inlet_;
+
+    std::map<EventKey, std::shared_ptr<Customer>> pending_; // messages not run yet
+    std::deque<ProcessedEvent> processed_; // since the last commit, in EventKey order
+    std::deque<Record> records_; // since the last commit
+    std::uint64_t next_sequence_ = 0;
+    std::uint32_t depth_ = 0; // of the event running
+
+    std::atomic<std::size_t> & unhandled_messages_;
+    std::mutex inbox_mutex_;
+    std::vector<Message> inbox_;
+    std::vector<Message> received_; // swapped with inbox_ to handle it
+
+    std::uint64_t processed_events_ = 0;
+    std::uint64_t committed_events_ = 0;
+    std::uint64_t rolled_back_events_ = 0;
+    std::uint64_t rollbacks_ = 0;
+    std::uint64_t anti_messages_ = 0;
+};
+
+class Engine {
+public:
+    // threads share the processes, window is how far past GVT a process may run
+    Engine(std::size_t threads, float window);
+
+    LogicalProcess & add_process();
+
+    // Runs the processes until commit, called with every committed record in
+    // time order, returns true. Records at the same time as that one are
+    // committed too, like the sequential engine finishes the jobs at a time,
+    // and the processes are left as they were at that time, which is returned.
+    // Throws std::runtime_error if every event ran before commit returned true.
+    float run(const std::function<bool(const Record &)> & commit);
+
+    const Report & report() const
+    {
+        return report_;
+    }
+
+private:
+    std::size_t threads_;
+    float window_;
+    std::vector<std::unique_ptr<LogicalProcess>> processes_;
+    std::atomic<std::size_t> unhandled_messages_{0};
+    Report report_;
+};
+
+// Draws from a generator like it, saving the generator's state to a log
+// first so a rollback redraws the same numbers. Generator needs state() and
+// restore(), and the SavedGenerator must stay where it is once it has drawn.
+template <class Generator>
+class SavedGenerator {
+public:
+    SavedGenerator(const Generator & generator, StateLog & state_log)
+    : generator_(generator)
+    , state_log_(&state_log)
+    {}
+
+    auto generate() const
+    {
+        state_log_->save([&generator = generator_, state = generator_.state()] { generator.restore(state); });
+        return generator_.generate();
+    }
+
+private:
+    Generator generator_;
+    StateLog * state_log_;
+};
+
+} // time_warp
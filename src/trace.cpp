@@ -0,0 +1,341 @@
+#include "trace.h"
+
+#include <iostream>
+#include <map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "simulation_timer.h"
+#include "simulation_spy.h"
+#include "customer.h"
+
+namespace {
+
+constexpr char kTraceMagic[8] = {'A', 'P', 'Q', 'T', 'R', 'A', 'C', 'E'};
+constexpr std::uint32_t kTraceVersion = 1;
+constexpr std::uint64_t kInitialRecordCapacity = 1 << 16;
+
+struct TraceHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t transient_period;
+    std::uint64_t record_count;
+    std::uint64_t footer_offset;
+    std::uint64_t L;
+    std::uint32_t minimum_priority; // zero in traces from before the spy had a priority range,
+    std::uint32_t maximum_priority; // which matches the default range
+    std::uint64_t reserved[2];
+};
+
+static_assert(sizeof(TraceHeader) == 64, "records must stay 16 byte aligned");
+
+void append_string(std::string & buffer, const std::string & value)
+{
+    std::uint32_t size = value.size();
+    buffer.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    buffer.append(value);
+}
+
+void append_strings(std::string & buffer, const std::vector<std::string> & values)
+{
+    std::uint32_t count = values.size();
+    buffer.append(reinterpret_cast<const char *>(&count), sizeof(count));
+    for (const auto & value : values) {
+        append_string(buffer, value);
+    }
+}
+
+std::vector<std::string> read_strings(const char * & position, const char * end)
+{
+    auto read_count = [&position, end] {
+        std::uint32_t count = 0;
+        if (position + sizeof(count) > end) {
+            throw std::runtime_error("trace footer is truncated");
+        }
+        std::memcpy(&count, position, sizeof(count));
+        position += sizeof(count);
+        return count;
+    };
+
+    std::vector<std::string> values(read_count());
+    for (auto & value : values) {
+        auto size = read_count();
+        if (position + size > end) {
+            throw std::runtime_error("trace footer is truncated");
+        }
+        value.assign(position, size);
+        position += size;
+    }
+    return values;
+}
+
+CustomerEventType to_event_type(TraceKind kind)
+{
+    switch (kind) {
+    case TraceKind::EVENT_ENTERED:
+        return CustomerEventType::ENTERED;
+    case TraceKind::EVENT_EXITED:
+        return CustomerEventType::EXITED;
+    case TraceKind::EVENT_DROPPED_BY:
+        return CustomerEventType::DROPPED_BY;
+    case TraceKind::EVENT_PREEMPTED_FROM:
+        return CustomerEventType::PREEMPTED_FROM;
+    default:
+        throw std::runtime_error("trace record is not a customer event");
+    }
+}
+
+} // anonymous
+
+TraceWriter::TraceWriter(const std::string & path)
+{
+    file_descriptor_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor_ < 0) {
+        throw std::runtime_error("could not open trace file: " + path);
+    }
+    map(kInitialRecordCapacity);
+}
+
+TraceWriter::~TraceWriter()
+{
+    // destructors can't throw, a trace left unfinished here is one the reader rejects
+    try {
+        close();
+    } catch (std::runtime_error &) {
+    }
+}
+
+void TraceWriter::map(std::uint64_t record_capacity)
+{
+    auto bytes = sizeof(TraceHeader) + record_capacity * sizeof(TraceRecord);
+    if (ftruncate(file_descriptor_, bytes) != 0) {
+        throw std::runtime_error("could not grow trace file");
+    }
+    if (mapping_) {
+        munmap(mapping_, mapping_bytes_);
+    }
+    mapping_ = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor_, 0);
+    if (mapping_ == MAP_FAILED) {
+        mapping_ = nullptr;
+        throw std::runtime_error("could not map trace file");
+    }
+    mapping_bytes_ = bytes;
+    records_ = reinterpret_cast<TraceRecord *>(static_cast<char *>(mapping_) + sizeof(TraceHeader));
+    record_capacity_ = record_capacity;
+}
+
+void TraceWriter::grow()
+{
+    map(record_capacity_ * 2);
+}
+
+void TraceWriter::close()
+{
+    if (file_descriptor_ < 0) {
+        return;
+    }
+
+    std::string footer;
+    append_strings(footer, place_names_);
+    append_strings(footer, queue_names_);
+
+    TraceHeader header = {};
+    std::memcpy(header.magic, kTraceMagic, sizeof(kTraceMagic));
+    header.version = kTraceVersion;
+    header.transient_period = transient_period_;
+    header.record_count = record_count_;
+    header.footer_offset = sizeof(TraceHeader) + record_count_ * sizeof(TraceRecord);
+    header.L = L_;
+    header.minimum_priority = minimum_priority_;
+    header.maximum_priority = maximum_priority_;
+
+    munmap(mapping_, mapping_bytes_);
+    mapping_ = nullptr;
+    records_ = nullptr;
+
+    const bool finished = ftruncate(file_descriptor_, header.footer_offset + footer.size()) == 0
+        && pwrite(file_descriptor_, footer.data(), footer.size(), header.footer_offset) == ssize_t(footer.size())
+        && pwrite(file_descriptor_, &header, sizeof(header), 0) == ssize_t(sizeof(header));
+
+    ::close(file_descriptor_);
+    file_descriptor_ = -1;
+
+    if (!finished) {
+        throw std::runtime_error("could not finish trace file");
+    }
+}
+
+TraceReader::TraceReader(const std::string & path)
+{
+    auto file_descriptor = open(path.c_str(), O_RDONLY);
+    if (file_descriptor < 0) {
+        throw std::runtime_error("could not open trace file: " + path);
+    }
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) != 0 || std::size_t(file_stat.st_size) < sizeof(TraceHeader)) {
+        ::close(file_descriptor);
+        throw std::runtime_error("trace file is too small: " + path);
+    }
+
+    mapping_bytes_ = file_stat.st_size;
+    mapping_ = mmap(nullptr, mapping_bytes_, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    ::close(file_descriptor);
+    if (mapping_ == MAP_FAILED) {
+        mapping_ = nullptr;
+        throw std::runtime_error("could not map trace file: " + path);
+    }
+
+    const auto * bytes = static_cast<const char *>(mapping_);
+    TraceHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+
+    if (std::memcmp(header.magic, kTraceMagic, sizeof(kTraceMagic)) != 0
+        || header.version != kTraceVersion
+        || header.record_count > (mapping_bytes_ - sizeof(TraceHeader)) / sizeof(TraceRecord)
+        || header.footer_offset != sizeof(TraceHeader) + header.record_count * sizeof(TraceRecord)) {
+        munmap(mapping_, mapping_bytes_);
+        throw std::runtime_error("not a finished trace file: " + path);
+    }
+
+    records_ = reinterpret_cast<const TraceRecord *>(bytes + sizeof(TraceHeader));
+    record_count_ = header.record_count;
+    L_ = header.L;
+    transient_period_ = header.transient_period;
+    minimum_priority_ = header.minimum_priority;
+    maximum_priority_ = header.maximum_priority;
+
+    const char * position = bytes + header.footer_offset;
+    place_names_ = read_strings(position, bytes + mapping_bytes_);
+    queue_names_ = read_strings(position, bytes + mapping_bytes_);
+}
+
+TraceReader::~TraceReader()
+{
+    if (mapping_) {
+        munmap(mapping_, mapping_bytes_);
+    }
+}
+
+std::unique_ptr<TraceWriter> attach_trace_writer(const std::string & path,
+                                                 SimulationTimer & timer,
+                                                 SimulationSpy & spy)
+{
+    if (path.empty()) {
+        return nullptr;
+    }
+
+    auto writer = std::make_unique<TraceWriter>(path);
+    timer.set_trace_writer(writer.get());
+    spy.register_trace_writer(*writer);
+    return writer;
+}
+
+std::uint64_t replay_trace(const TraceReader & reader, SimulationSpy & spy)
+{
+    std::unordered_map<std::uint32_t, std::shared_ptr<Customer>> customers;
+    std::uint64_t dispatches = 0;
+
+    for (const auto & record : reader) {
+        switch (record.kind) {
+        case TraceKind::JOB:
+        case TraceKind::ARRIVAL:
+        case TraceKind::DEPARTURE:
+            ++dispatches;
+            break;
+        case TraceKind::SYSTEM_ENTERED:
+        {
+            auto customer = make_customer(record.customer_id, record.time, std::uint32_t(record.value));
+            customers.insert({record.customer_id, customer});
+            spy.on_customer_entering(customer);
+            break;
+        }
+        case TraceKind::EVENT_ENTERED:
+        case TraceKind::EVENT_EXITED:
+        case TraceKind::EVENT_DROPPED_BY:
+        case TraceKind::EVENT_PREEMPTED_FROM:
+            customers.at(record.customer_id)->add_event(CustomerEvent(to_event_type(record.kind),
+                                                                      PlaceType(record.flags),
+                                                                      reader.place_name(record.place_id),
+                                                                      record.time));
+            break;
+        case TraceKind::SYSTEM_EXITED:
+        {
+            auto & customer = customers.at(record.customer_id);
+            customer->set_service_time(record.value);
+            customer->set_serviced(record.flags);
+            customer->set_departure_time(record.time);
+            spy.on_customer_exiting(customer);
+            customers.erase(record.customer_id);
+            break;
+        }
+        }
+    }
+
+    return dispatches;
+}
+
+void print_trace_replay(const std::string & path)
+{
+    TraceReader reader(path);
+
+    constexpr auto kInitialReserve = 1000; // arbitrary
+    SimulationSpy spy(reader.L(),
+                      kInitialReserve,
+                      reader.queue_names(),
+                      reader.transient_period(),
+                      nullptr,
+                      reader.minimum_priority(),
+                      reader.maximum_priority());
+
+    auto dispatches = replay_trace(reader, spy);
+    float last_time = reader.record_count() ? (reader.end() - 1)->time : 0;
+
+    auto to_string = [] (std::uint32_t priority) {
+        if (priority == SimulationRunStats::all_priorities()) {
+            return std::string("AVERAGE");
+        } else {
+            return std::to_string(priority);
+        }
+    };
+
+    // sort so the output is stable between replays
+    std::map<std::string, std::map<std::uint32_t, float>> customer_loss_rates;
+    for (const auto & name_and_clr_map : spy.customer_loss_rates()) {
+        customer_loss_rates[name_and_clr_map.first].insert(name_and_clr_map.second.begin(),
+                                                           name_and_clr_map.second.end());
+    }
+    std::map<std::string, std::map<std::uint32_t, float>> average_waiting_times;
+    for (const auto & name_and_time_map : spy.average_waiting_times()) {
+        average_waiting_times[name_and_time_map.first].insert(name_and_time_map.second.begin(),
+                                                              name_and_time_map.second.end());
+    }
+
+    std::cout << "Trace: " << path << std::endl;
+    std::cout << "Records: " << reader.record_count() << std::endl;
+    std::cout << "Timer Dispatches: " << dispatches << std::endl;
+    std::cout << "Last Recorded Time: " << last_time << std::endl;
+    std::cout << "Serviced Customers: " << spy.total_serviced_customers() << std::endl;
+
+    std::cout << std::endl << "Customer Loss Rates:" << std::endl;
+    for (const auto & name_and_clr_map : customer_loss_rates) {
+        std::cout << name_and_clr_map.first << ":" << std::endl;
+        for (const auto & priority_and_clr : name_and_clr_map.second) {
+            std::cout << "    Priority_" << to_string(priority_and_clr.first) << ":"
+                      << " CLR: " << priority_and_clr.second << std::endl;
+        }
+    }
+
+    std::cout << std::endl << "Waiting Times: " << std::endl;
+    for (const auto & name_and_time_map : average_waiting_times) {
+        std::cout << name_and_time_map.first << ":" << std::endl;
+        for (const auto & priority_and_time : name_and_time_map.second) {
+            std::cout << "    Priority_" << to_string(priority_and_time.first) << ":"
+                      << " Waiting Time: " << priority_and_time.second << std::endl;
+        }
+    }
+
+    std::cout << std::endl << "System Time " << spy.average_system_time() << std::endl;
+}
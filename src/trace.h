@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#include <memory>
+
+// Compact binary trace of a simulation run.
+//
+// Every timer dispatch is written as one fixed size record, and when a customer
+// leaves the system the spy writes the customer's arrival, event history and
+// departure. That is enough to re-drive a SimulationSpy offline (see replay_trace)
+// and get back the same CLR and waiting times without re-running the model.
+//
+// Records go straight into a memory mapped file that doubles in size when full,
+// so writing one is a bounds check and a 16 byte copy.
+
+enum class TraceKind : std::uint8_t {
+    JOB,                    // untagged timer dispatch
+    ARRIVAL,                // timer dispatch delivering a new customer
+    DEPARTURE,              // timer dispatch finishing service at a server
+    SYSTEM_ENTERED,         // customer entered the system (value = priority)
+    EVENT_ENTERED,          // one record per CustomerEvent, flags = PlaceType
+    EVENT_EXITED,
+    EVENT_DROPPED_BY,
+    EVENT_PREEMPTED_FROM,
+    SYSTEM_EXITED,          // customer left the system (value = service time, flags = serviced)
+};
+
+struct TraceRecord {
+    float time;
+    std::uint32_t customer_id;
+    std::uint16_t place_id;
+    TraceKind kind;
+    std::uint8_t flags;
+    float value;
+};
+
+static_assert(sizeof(TraceRecord) == 16, "trace records are written raw");
+
+constexpr std::uint16_t no_trace_place() {
+    return UINT16_MAX;
+}
+
+// Optional description of what a timer job does, so dispatches can be traced
+struct JobTag {
+    TraceKind kind = TraceKind::JOB;
+    std::uint32_t customer_id = 0;
+    const std::string * place_name = nullptr; // must outlive the timer (component names do)
+};
+
+class TraceWriter {
+public:
+    explicit TraceWriter(const std::string & path);
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter & operator=(const TraceWriter &) = delete;
+
+    inline void record(float time,
+                       TraceKind kind,
+                       std::uint32_t customer_id,
+                       std::uint16_t place_id = no_trace_place(),
+                       std::uint8_t flags = 0,
+                       float value = 0)
+    {
+        if (record_count_ == record_capacity_) {
+            grow();
+        }
+        records_[record_count_++] = TraceRecord{time, customer_id, place_id, kind, flags, value};
+    }
+
+    // Places are identified by the address of the component's name, which only
+    // needs hashing the first time a place is seen.
+    inline std::uint16_t place_id(const std::string * name)
+    {
+        if (name == nullptr) {
+            return no_trace_place();
+        }
+        auto iterator = place_ids_.find(name);
+        if (iterator != place_ids_.end()) {
+            return iterator->second;
+        }
+        if (place_names_.size() >= no_trace_place()) {
+            throw std::runtime_error("too many places to trace");
+        }
+        auto id = std::uint16_t(place_names_.size());
+        place_names_.push_back(*name);
+        place_ids_.insert({name, id});
+        return id;
+    }
+
+    // Written into the trace so the replay can build a matching spy
+    void set_spy_configuration(std::size_t L,
+                               std::uint32_t transient_period,
+                               const std::vector<std::string> & queue_names,
+                               std::uint32_t minimum_priority,
+                               std::uint32_t maximum_priority)
+    {
+        L_ = L;
+        transient_period_ = transient_period;
+        queue_names_ = queue_names;
+        minimum_priority_ = minimum_priority;
+        maximum_priority_ = maximum_priority;
+    }
+
+    std::uint64_t record_count() const
+    {
+        return record_count_;
+    }
+
+    // Finishes the file, throws std::runtime_error if it can't. Called by the
+    // destructor if not called explicitly, which ignores a failure.
+    void close();
+
+private:
+    void grow();
+    void map(std::uint64_t record_capacity);
+
+    int file_descriptor_ = -1;
+    void * mapping_ = nullptr;
+    std::size_t mapping_bytes_ = 0;
+    TraceRecord * records_ = nullptr;
+    std::uint64_t record_count_ = 0;
+    std::uint64_t record_capacity_ = 0;
+
+    std::unordered_map<const std::string *, std::uint16_t> place_ids_;
+    std::vector<std::string> place_names_;
+
+    std::uint64_t L_ = 0;
+    std::uint32_t transient_period_ = 0;
+    std::vector<std::string> queue_names_;
+    std::uint32_t minimum_priority_ = 0;
+    std::uint32_t maximum_priority_ = 0;
+};
+
+class TraceReader {
+public:
+    explicit TraceReader(const std::string & path);
+    ~TraceReader();
+
+    TraceReader(const TraceReader &) = delete;
+    TraceReader & operator=(const TraceReader &) = delete;
+
+    const TraceRecord * begin() const
+    {
+        return records_;
+    }
+
+    const TraceRecord * end() const
+    {
+        return records_ + record_count_;
+    }
+
+    std::uint64_t record_count() const
+    {
+        return record_count_;
+    }
+
+    const std::string & place_name(std::uint16_t place_id) const
+    {
+        return place_names_.at(place_id);
+    }
+
+    std::size_t L() const
+    {
+        return L_;
+    }
+
+    std::uint32_t transient_period() const
+    {
+        return transient_period_;
+    }
+
+    const std::vector<std::string> & queue_names() const
+    {
+        return queue_names_;
+    }
+
+    std::uint32_t minimum_priority() const
+    {
+        return minimum_priority_;
+    }
+
+    std::uint32_t maximum_priority() const
+    {
+        return maximum_priority_;
+    }
+
+private:
+    void * mapping_ = nullptr;
+    std::size_t mapping_bytes_ = 0;
+    const TraceRecord * records_ = nullptr;
+    std::uint64_t record_count_ = 0;
+
+    std::vector<std::string> place_names_;
+    std::size_t L_ = 0;
+    std::uint32_t transient_period_ = 0;
+    std::vector<std::string> queue_names_;
+    std::uint32_t minimum_priority_ = 0;
+    std::uint32_t maximum_priority_ = 0;
+};
+
+class SimulationTimer;
+class SimulationSpy;
+
+// Creates a writer for path (or returns null when path is empty) and hooks it
+// into the timer and spy. Keep it alive until the run is finished.
+std::unique_ptr<TraceWriter> attach_trace_writer(const std::string & path,
+                                                 SimulationTimer & timer,
+                                                 SimulationSpy & spy);
+
+// Feeds every customer in the trace through spy, in the order the original spy
+// saw them. Returns the number of timer dispatches in the trace.
+std::uint64_t replay_trace(const TraceReader & reader, SimulationSpy & spy);
+
+// Replays a trace into a spy configured like the original and prints its stats
+void print_trace_replay(const std::string & path);